@@ -0,0 +1,129 @@
+#include "eventlog.h"
+#include <string.h>
+
+namespace Tracer
+{
+
+const size_t EventLog::DEFAULT_CAPACITY;
+const unsigned EventLog::FLUSH_PERIOD_MS;
+
+EventLog::EventLog():
+    stream_(nullptr),
+    capacity_(0),
+    stop_(false)
+{
+}
+
+EventLog::~EventLog()
+{
+    close();
+}
+
+bool EventLog::open(const char *fname, size_t capacity)
+{
+    if (stream_ != nullptr || capacity == 0)
+        return false;
+
+    stream_ = fopen(fname, "wb");
+    if (stream_ == nullptr)
+        return false;
+
+    LogHeader header;
+    memcpy(header.magic_, LOG_MAGIC, sizeof(header.magic_));
+    header.version_ = LOG_VERSION;
+    header.eventSize_ = sizeof(Event);
+
+    if (fwrite(&header, sizeof(header), 1, stream_) != 1)
+    {
+        fclose(stream_);
+        stream_ = nullptr;
+
+        return false;
+    }
+    fflush(stream_);
+
+    capacity_ = capacity;
+    front_.reserve(capacity_);
+    back_.reserve(capacity_);
+    stop_ = false;
+    start_ = std::chrono::steady_clock::now();
+
+    writer_ = std::thread(&EventLog::writerLoop, this);
+
+    return true;
+}
+
+void EventLog::close()
+{
+    if (stream_ == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    full_.notify_one();
+    writer_.join();
+
+    fclose(stream_);
+    stream_ = nullptr;
+}
+
+bool EventLog::isOpen() const
+{
+    return stream_ != nullptr;
+}
+
+void EventLog::append(EventType type, uint64_t arg0, uint64_t arg1,
+                      uint64_t arg2, uint64_t arg3)
+{
+    if (stream_ == nullptr)
+        return;
+
+    Event event;
+    event.type_ = type;
+    event.reserved_ = 0;
+    event.time_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start_).count();
+    event.args_[0] = arg0;
+    event.args_[1] = arg1;
+    event.args_[2] = arg2;
+    event.args_[3] = arg3;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Both buffers are full, wait for the writer
+    written_.wait(lock, [this] { return front_.size() < capacity_; });
+
+    front_.push_back(event);
+    if (front_.size() == capacity_)
+        full_.notify_one();
+}
+
+void EventLog::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true)
+    {
+        full_.wait_for(lock, std::chrono::milliseconds(FLUSH_PERIOD_MS),
+                       [this] { return stop_ || front_.size() >= capacity_; });
+
+        if (!front_.empty())
+        {
+            front_.swap(back_);
+            written_.notify_all();
+
+            lock.unlock();
+            fwrite(back_.data(), sizeof(Event), back_.size(), stream_);
+            fflush(stream_);
+            back_.clear();
+            lock.lock();
+        }
+
+        if (stop_ && front_.empty())
+            break;
+    }
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef SOURCES_CPP_EVENTLOG
+#define SOURCES_CPP_EVENTLOG
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Tracer
+{
+
+/*
+ * Binary event log format
+ *
+ * The log starts with a LogHeader followed by Event records, in the order of
+ * the events. All the fields are in the byte order of the traced process. The
+ * log is only appended, a log truncated by the end of the process remains
+ * readable up to its last complete record.
+ */
+
+static const char LOG_MAGIC[8] = {'Q', 'B', 'D', 'I', 'M', 'T', 'R', 'C'};
+static const uint32_t LOG_VERSION = 1;
+
+struct LogHeader
+{
+    char magic_[8];
+    uint32_t version_;
+    uint32_t eventSize_;
+};
+
+enum EventType : uint32_t
+{
+    // args_: address, size
+    EVENT_ALLOC = 1,
+    // args_: address
+    EVENT_FREE = 2,
+    // args_: fromObj, toObj, from, to (see Link)
+    EVENT_LINK = 3,
+    // args_: the removed link
+    EVENT_UNLINK = 4,
+};
+
+struct Event
+{
+    uint32_t type_;
+    uint32_t reserved_;
+    // Nanoseconds since the log has been opened
+    uint64_t time_;
+    uint64_t args_[4];
+};
+
+/*
+ * Writer of the event log. The events are appended to a buffer, written to the
+ * file by a background thread when the buffer is full, and at least every
+ * flush period so that the log of a running process stays up to date. The
+ * memory used is bounded by two buffers, the tracer waits for the writer if
+ * both are full.
+ */
+class EventLog
+{
+private:
+    FILE *stream_;
+    std::chrono::steady_clock::time_point start_;
+
+    // Filled by the tracer
+    std::vector<Event> front_;
+    // Written by the writer thread
+    std::vector<Event> back_;
+    size_t capacity_;
+
+    std::mutex mutex_;
+    std::condition_variable full_;
+    std::condition_variable written_;
+    bool stop_;
+    std::thread writer_;
+
+    void writerLoop();
+
+public:
+    static const size_t DEFAULT_CAPACITY = 1 << 16;
+    static const unsigned FLUSH_PERIOD_MS = 100;
+
+    EventLog();
+    ~EventLog();
+
+    EventLog(const EventLog &) = delete;
+    EventLog &operator=(const EventLog &) = delete;
+
+    bool open(const char *fname, size_t capacity = DEFAULT_CAPACITY);
+    void close();
+    bool isOpen() const;
+
+    void append(EventType type, uint64_t arg0, uint64_t arg1 = 0,
+                uint64_t arg2 = 0, uint64_t arg3 = 0);
+};
+
+}; /* Tracer */
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <time.h>
+
+struct node
+{
+    struct node *next;
+    struct node *link;
+    int64_t data;
+};
+
+static uint64_t randNext(uint64_t *state);
+static double timeDiff(const struct timespec *start, const struct timespec *end);
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <objects>\n", argv[0]);
+
+        return 1;
+    }
+
+    size_t count = 0;
+    if (sscanf(argv[1], "%zu", &count) != 1 || count == 0)
+    {
+        fprintf(stderr, "Invalid number of objects: %s\n", argv[1]);
+
+        return 1;
+    }
+
+    struct node **nodes = calloc(count, sizeof(*nodes));
+    assert(nodes);
+
+    uint64_t state = 0x9E3779B97F4A7C15;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Allocate a list of objects, each one also pointing to a random object
+    for (size_t i = 0; i < count; i++)
+    {
+        nodes[i] = malloc(sizeof(*nodes[i]));
+        assert(nodes[i]);
+
+        nodes[i]->data = i;
+        nodes[i]->next = (i > 0) ? nodes[i - 1] : NULL;
+        nodes[i]->link = nodes[randNext(&state) % (i + 1)];
+    }
+
+    // Replace half of the objects, the links to the freed objects become dangling
+    for (size_t i = 0; i < count; i += 2)
+    {
+        free(nodes[i]);
+
+        nodes[i] = malloc(sizeof(*nodes[i]));
+        assert(nodes[i]);
+
+        nodes[i]->data = i;
+        nodes[i]->next = NULL;
+        nodes[i]->link = nodes[randNext(&state) % count];
+    }
+
+    // Rewrite random links
+    for (size_t i = 0; i < count; i++)
+        nodes[randNext(&state) % count]->link = nodes[randNext(&state) % count];
+
+    for (size_t i = 0; i < count; i++)
+        free(nodes[i]);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = timeDiff(&start, &end);
+    size_t operations = 4 * count + count / 2;
+    printf("%zu objects: %.3f s, %.0f operations/s\n", count, elapsed,
+           operations / elapsed);
+
+    free(nodes);
+
+    return 0;
+}
+
+static uint64_t randNext(uint64_t *state)
+{
+    // xorshift64
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+static double timeDiff(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
@@ -31,22 +31,32 @@ int qbdipreload_on_main(int argc, char **argv)
 
 int qbdipreload_on_run(QBDI::VMInstanceRef vm, QBDI::rword start, QBDI::rword stop)
 {
-    Tracer::Graph::initInstance(vm);
+    const char *logName = getenv("MEMTRACER_LOG");
+    if (logName == nullptr)
+        logName = "traced.log";
 
-    vm->addInstrumentedModuleFromAddr(start);
+    if (!Tracer::Graph::initInstance(vm, logName))
+    {
+        fprintf(stderr, "MemTracer: cannot open the event log %s\n", logName);
+
+        return QBDIPRELOAD_ERR_STARTUP_FAILED;
+    }
 
-    vm->addInstrRule(Tracer::callDetectRuleCB, QBDI::ANALYSIS_INSTRUCTION, nullptr);
+    vm->addInstrumentedModuleFromAddr(start);
 
     vm->run(start, stop);
 
-    Tracer::Graph::saveInstanceDot("traced.dot");
+    Tracer::Graph::finiInstance();
 
     return QBDIPRELOAD_NO_ERROR;
 }
 
 int qbdipreload_on_exit(int status)
 { 
-    return QBDIPRELOAD_NOT_HANDLED;
+    // exit may be called before the end of vm->run
+    Tracer::Graph::finiInstance();
+
+    return QBDIPRELOAD_NO_ERROR;
 }
 
 }
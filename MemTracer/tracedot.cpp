@@ -0,0 +1,125 @@
+#include "eventlog.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <unordered_map>
+
+/*
+ * Rebuild the object graph of a MemTracer event log at a point in time and
+ * write it in the DOT format
+ */
+
+struct LinkState
+{
+    uint64_t fromObj_;
+    uint64_t toObj_;
+};
+
+static bool readHeader(FILE *stream);
+
+int main(int argc, char **argv)
+{
+    if (argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "Usage: %s <log> <dot> [time in ns]\n", argv[0]);
+
+        return 1;
+    }
+
+    uint64_t time = UINT64_MAX;
+    if (argc == 4 && sscanf(argv[3], "%" SCNu64, &time) != 1)
+    {
+        fprintf(stderr, "Invalid time: %s\n", argv[3]);
+
+        return 1;
+    }
+
+    FILE *log = fopen(argv[1], "rb");
+    if (!log)
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+
+        return 1;
+    }
+
+    if (!readHeader(log))
+    {
+        fprintf(stderr, "%s isn't a MemTracer event log\n", argv[1]);
+        fclose(log);
+
+        return 1;
+    }
+
+    // Live objects and their size, live links indexed by the address of the pointer
+    std::map<uint64_t, uint64_t> objects;
+    std::unordered_map<uint64_t, LinkState> links;
+    size_t count = 0;
+
+    Tracer::Event event;
+    while (fread(&event, sizeof(event), 1, log) == 1 && event.time_ <= time)
+    {
+        switch (event.type_)
+        {
+            case Tracer::EVENT_ALLOC:
+                objects[event.args_[0]] = event.args_[1];
+                break;
+            case Tracer::EVENT_FREE:
+                objects.erase(event.args_[0]);
+                break;
+            case Tracer::EVENT_LINK:
+                links[event.args_[2]] = {event.args_[0], event.args_[1]};
+                break;
+            case Tracer::EVENT_UNLINK:
+                links.erase(event.args_[2]);
+                break;
+            default:
+                fprintf(stderr, "Unknown event %u at record %zu\n", event.type_, count);
+                fclose(log);
+
+                return 1;
+        }
+        count++;
+    }
+
+    fclose(log);
+
+    FILE *dot = fopen(argv[2], "w");
+    if (!dot)
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[2]);
+
+        return 1;
+    }
+
+    fprintf(dot, "Digraph G{\n");
+
+    for (auto it = objects.begin(), end = objects.end(); it != end; ++it)
+        fprintf(dot, "\tnode0x%016lx[label=\"0x%016lx\"];\n",
+                     it->first, it->first);
+
+    for (auto it = links.begin(), end = links.end(); it != end; ++it)
+        fprintf(dot, "\tnode0x%016lx->node0x%016lx;\n",
+                     it->second.fromObj_, it->second.toObj_);
+
+    fprintf(dot, "}\n");
+
+    fclose(dot);
+
+    fprintf(stderr, "%zu events, %zu objects, %zu links\n", count, objects.size(),
+            links.size());
+
+    return 0;
+}
+
+static bool readHeader(FILE *stream)
+{
+    Tracer::LogHeader header;
+    if (fread(&header, sizeof(header), 1, stream) != 1)
+        return false;
+
+    return memcmp(header.magic_, Tracer::LOG_MAGIC, sizeof(header.magic_)) == 0 &&
+           header.version_ == Tracer::LOG_VERSION &&
+           header.eventSize_ == sizeof(Tracer::Event);
+}
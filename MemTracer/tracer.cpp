@@ -8,44 +8,24 @@
 namespace Tracer
 {
 
-static QBDI::VMAction callDetectCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
-                                   QBDI::FPRState *fprState, void *data);
+static QBDI::VMAction transferCallCB(QBDI::VMInstanceRef vm, const QBDI::VMState *vmState,
+                                     QBDI::GPRState *gprState, QBDI::FPRState *fprState,
+                                     void *data);
 
-static QBDI::VMAction mallocCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
-                               QBDI::FPRState *fprState, void *data);
+static QBDI::VMAction transferReturnCB(QBDI::VMInstanceRef vm, const QBDI::VMState *vmState,
+                                       QBDI::GPRState *gprState, QBDI::FPRState *fprState,
+                                       void *data);
 
-static QBDI::VMAction freeCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
-                             QBDI::FPRState *fprState, void *data);
-
-static QBDI::VMAction objModifyCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState, 
+static QBDI::VMAction objModifyCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
                                   QBDI::FPRState *fprState, void *data);
 
 QBDI::VMInstanceRef Graph::vm_ = nullptr;
 
 Graph graphInstance;
 
-MemInstrumentation::MemInstrumentation(QBDI::VMInstanceRef vm,
-                                       QBDI::Range<QBDI::rword> range,
-                                       void *context) :
-    vm_(vm)
-{
-    id_ = vm_->addMemRangeCB(range.start(), range.end(),
-                             QBDI::MEMORY_WRITE,
-                             objModifyCB,
-                             context);
-    assert(id_ != QBDI::INVALID_EVENTID);
-} 
-
-MemInstrumentation::~MemInstrumentation()
-{
-    vm_->deleteInstrumentation(id_); 
-}
-
-Object::Object(QBDI::VMInstanceRef vm, 
-               QBDI::rword address,
+Object::Object(QBDI::rword address,
                QBDI::rword size):
-    range_(address, address + size),
-    inst_(vm, {address, address + size}, static_cast<void *>(this))
+    range_(address, address + size)
 {
 }
 
@@ -54,73 +34,124 @@ const QBDI::Range<QBDI::rword> &Tracer::Object::range() const
     return range_;
 }
 
-void Graph::initInstance(QBDI::VMInstanceRef vm)
+bool Graph::initInstance(QBDI::VMInstanceRef vm, const char *logName)
 {
     vm_ = vm;
+
+    if (!graphInstance.log_.open(logName))
+        return false;
+
+    // malloc and free aren't instrumented, they are executed by the ExecBroker
+    uint32_t id = vm_->addVMEventCB(QBDI::EXEC_TRANSFER_CALL, transferCallCB, nullptr);
+    assert(id != QBDI::INVALID_EVENTID);
+
+    id = vm_->addVMEventCB(QBDI::EXEC_TRANSFER_RETURN, transferReturnCB, nullptr);
+    assert(id != QBDI::INVALID_EVENTID);
+
+    // A single callback for all the objects, filtered with the object index
+    id = vm_->addMemAccessCB(QBDI::MEMORY_WRITE, objModifyCB, nullptr);
+    assert(id != QBDI::INVALID_EVENTID);
+
+    return true;
 }
 
-void Graph::saveInstanceDot(const char *fname)
+void Graph::finiInstance()
 {
-    graphInstance.saveDot(fname);
+    graphInstance.log_.close();
 }
 
-void Graph::addObject(QBDI::rword address, QBDI::rword size)
+Object *Graph::findObject(QBDI::rword address)
 {
-    obj_[address] = std::make_unique<Object>(vm_, address, size);
+    auto it = obj_.upper_bound(address);
+    if (it == obj_.begin())
+        return nullptr;
+
+    --it;
+    if (!it->second.range().contains(address))
+        return nullptr;
+
+    return &it->second;
 }
 
-void Graph::delObject(QBDI::rword address)
+void Graph::unlinkSlot(Object &obj, QBDI::rword from)
 {
-    for (auto it = link_.begin(), end = link_.end(); it != end; ++it)
-        if (it->fromObj_ == address || it->toObj_ == address)
-            link_.erase(it);
+    auto it = obj.out_.find(from);
+    if (it == obj.out_.end())
+        return;
 
-    obj_.erase(address);
+    const Link &link = it->second;
+    log_.append(EVENT_UNLINK, link.fromObj_, link.toObj_, link.from_, link.to_);
+
+    auto target = obj_.find(link.toObj_);
+    if (target != obj_.end())
+        target->second.in_.erase(from);
+
+    obj.out_.erase(it);
 }
 
-void Graph::createLink(QBDI::rword from, QBDI::rword to)
+void Graph::addObject(QBDI::rword address, QBDI::rword size)
 {
-    QBDI::rword fromObj = 0;
-    QBDI::rword toObj = 0;
+    // A previous object at the same address hasn't been freed through free
+    delObject(address);
 
-    for (auto it = obj_.begin(), end = obj_.end(); it != end; ++it)
-    {
-        const QBDI::Range<QBDI::rword> &range = it->second->range();
-
-        if (fromObj == 0 && range.contains(from))
-            fromObj = it->first;
-        
-        if (toObj == 0 && range.contains(to))
-            toObj = it->first;
-
-        if (fromObj != 0 && toObj != 0)
-        {
-            link_.insert({fromObj, toObj, from, to});
-            break;
-        }
-    }
+    obj_.emplace(address, Object(address, size));
+    log_.append(EVENT_ALLOC, address, size);
 }
 
-void Graph::saveDot(const char *fname)
+void Graph::delObject(QBDI::rword address)
 {
-    assert(fname);
+    auto it = obj_.find(address);
+    if (it == obj_.end())
+        return;
+
+    Object &obj = it->second;
+
+    for (auto link = obj.out_.begin(), end = obj.out_.end(); link != end; ++link)
+    {
+        const Link &l = link->second;
+        log_.append(EVENT_UNLINK, l.fromObj_, l.toObj_, l.from_, l.to_);
+
+        auto target = obj_.find(link->second.toObj_);
+        if (target != obj_.end() && &target->second != &obj)
+            target->second.in_.erase(link->first);
+    }
+
+    for (auto from = obj.in_.begin(), end = obj.in_.end(); from != end; ++from)
+    {
+        Object *source = findObject(*from);
+        if (source == nullptr || source == &obj)
+            continue;
+
+        auto link = source->out_.find(*from);
+        if (link == source->out_.end())
+            continue;
 
-    FILE *stream = fopen(fname, "w");
-    assert(stream);
+        const Link &l = link->second;
+        log_.append(EVENT_UNLINK, l.fromObj_, l.toObj_, l.from_, l.to_);
+        source->out_.erase(link);
+    }
 
-    fprintf(stream, "Digraph G{\n");
+    obj_.erase(it);
+    log_.append(EVENT_FREE, address);
+}
 
-    for (auto it = obj_.begin(), end = obj_.end(); it != end; ++it)
-        fprintf(stream, "\tnode0x%016lx[label=\"0x%016lx\"];\n", 
-                        it->first, it->first);
+void Graph::storePointer(QBDI::rword from, QBDI::rword to)
+{
+    Object *fromObj = findObject(from);
+    if (fromObj == nullptr)
+        return;
 
-    for (auto it = link_.begin(), end = link_.end(); it != end; ++it)
-        fprintf(stream, "\tnode0x%016lx->node0x%016lx;\n", 
-                        it->fromObj_, it->toObj_);
+    // The previous value of the slot is overwritten
+    unlinkSlot(*fromObj, from);
 
-    fprintf(stream, "}\n");
+    Object *toObj = findObject(to);
+    if (toObj == nullptr)
+        return;
 
-    fclose(stream);
+    Link link = {fromObj->range().start(), toObj->range().start(), from, to};
+    fromObj->out_[from] = link;
+    toObj->in_.insert(from);
+    log_.append(EVENT_LINK, link.fromObj_, link.toObj_, link.from_, link.to_);
 }
 
 /*
@@ -130,7 +161,7 @@ void Graph::saveDot(const char *fname)
 QBDI::VMAction showInstructionCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
                                  QBDI::FPRState *fprState, void *data)
 {
-    const QBDI::InstAnalysis *inst = vm->getInstAnalysis(); 
+    const QBDI::InstAnalysis *inst = vm->getInstAnalysis();
 
     std::cout << std::setbase(16) << inst->address << ": "
               << std::setbase(10) << inst->disassembly << std::endl;
@@ -138,106 +169,54 @@ QBDI::VMAction showInstructionCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprStat
     return QBDI::CONTINUE;
 }
 
-std::vector<QBDI::InstrRuleDataCBK> callDetectRuleCB(QBDI::VMInstanceRef vm,
-                                                     const QBDI::InstAnalysis *inst,
-                                                     void *data)
-{
-    if (inst->isBranch)
-        return {{QBDI::POSTINST, callDetectCB, NULL}};
-
-    return {};
-} 
-
-struct FuncCxt
-{
-    std::vector<QBDI::rword> arg;
-    uint32_t instId;
-};
+// Size argument of the malloc being executed by the ExecBroker
+static QBDI::rword mallocSize = 0;
 
-static QBDI::VMAction callDetectCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
-                                   QBDI::FPRState *fprState, void *data)
+static QBDI::VMAction transferCallCB(QBDI::VMInstanceRef vm, const QBDI::VMState *vmState,
+                                     QBDI::GPRState *gprState, QBDI::FPRState *fprState,
+                                     void *data)
 {
+    // The state of a transfer event is the address of the called function
+    if (vmState->sequenceStart == reinterpret_cast<QBDI::rword>(malloc))
+        mallocSize = gprState->rdi;
+    else if (vmState->sequenceStart == reinterpret_cast<QBDI::rword>(free))
+        graphInstance.delObject(gprState->rdi);
 
-    if (gprState->rip == reinterpret_cast<QBDI::rword>(malloc))
-    {
-        FuncCxt *cxt = new FuncCxt;
-
-        cxt->arg.push_back(gprState->rdi);
-        cxt->instId = vm->addCodeAddrCB(*reinterpret_cast<QBDI::rword *>(gprState->rsp),
-                                        QBDI::PREINST,
-                                        mallocCB,
-                                        static_cast<void *>(cxt));
-        assert(cxt->instId != QBDI::INVALID_EVENTID);
-
-        return QBDI::BREAK_TO_VM;
-    }
-
-    if (gprState->rip == reinterpret_cast<QBDI::rword>(free))
-    {
-        FuncCxt *cxt = new FuncCxt;
-    
-
-        cxt->arg.push_back(gprState->rdi);
-        cxt->instId = vm->addCodeAddrCB(*reinterpret_cast<QBDI::rword *>(gprState->rsp),
-                                       QBDI::PREINST,
-                                       freeCB,
-                                       static_cast<void *>(cxt));
-        assert(cxt->instId != QBDI::INVALID_EVENTID);
-
-        return QBDI::BREAK_TO_VM;
-    }
-    
     return QBDI::CONTINUE;
 }
 
-static QBDI::VMAction mallocCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
-                               QBDI::FPRState *fprState, void *data)
-{
-    assert(data != nullptr);
-
-    FuncCxt *cxt = static_cast<FuncCxt *>(data);
-
-    if (gprState->rax != 0)
-        graphInstance.addObject(gprState->rax, cxt->arg[0]);
-     
-    vm->deleteInstrumentation(cxt->instId);
-
-    delete cxt;
-
-    return QBDI::BREAK_TO_VM;
-}
-
-static QBDI::VMAction freeCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
-                             QBDI::FPRState *fprState, void *data)
+static QBDI::VMAction transferReturnCB(QBDI::VMInstanceRef vm, const QBDI::VMState *vmState,
+                                       QBDI::GPRState *gprState, QBDI::FPRState *fprState,
+                                       void *data)
 {
-    assert(data != nullptr);
-
-    FuncCxt *cxt = static_cast<FuncCxt *>(data);
-
-    graphInstance.delObject(cxt->arg[0]);
-     
-    vm->deleteInstrumentation(cxt->instId);
+    if (vmState->sequenceStart == reinterpret_cast<QBDI::rword>(malloc) &&
+        gprState->rax != 0)
+        graphInstance.addObject(gprState->rax, mallocSize);
 
-    delete cxt;
-
-    return QBDI::BREAK_TO_VM;
+    return QBDI::CONTINUE;
 }
 
-static QBDI::VMAction objModifyCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState, 
+static QBDI::VMAction objModifyCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
                                   QBDI::FPRState *fprState, void *data)
 {
-    assert(data != nullptr);
+    const size_t maxAccess = 16;
+    QBDI::MemoryAccess memAccess[maxAccess];
 
-    Tracer::Object *objptr = static_cast<Tracer::Object *>(data);
-    auto memAccess = vm->getInstMemoryAccess(); 
+    size_t count = vm->copyInstMemoryAccess(memAccess, maxAccess);
+    if (count > maxAccess)
+        count = maxAccess;
 
-    for (auto it = memAccess.begin(), end = memAccess.end(); it != end; ++it)
+    for (size_t i = 0; i < count; i++)
     {
-        if ((it->type & QBDI::MEMORY_WRITE) == 0 ||
-            !objptr->range().contains(it->accessAddress))
-            break;
+        const QBDI::MemoryAccess &access = memAccess[i];
+
+        // Only a write of a whole pointer can create a link
+        if ((access.type & QBDI::MEMORY_WRITE) == 0 ||
+            access.size != sizeof(QBDI::rword) ||
+            (access.flags & QBDI::MEMORY_UNKNOWN_VALUE) != 0)
+            continue;
 
-        graphInstance.createLink(it->accessAddress, it->value);
+        graphInstance.storePointer(access.accessAddress, access.value);
     }
 
     return QBDI::CONTINUE;
@@ -2,86 +2,74 @@
 #define SOURCES_CPP_TRACER
 
 #include "QBDI.h"
+#include "eventlog.h"
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace Tracer
 {
 
-struct MemInstrumentation
+/*
+ * A pointer stored at address from_ (in object fromObj_) to the address to_
+ * (in object toObj_).
+ */
+struct Link
 {
-private:
-    QBDI::VMInstanceRef vm_;
-    uint32_t id_;
-
-public:
-    MemInstrumentation(QBDI::VMInstanceRef vm, QBDI::Range<QBDI::rword> range, void *context);
-    MemInstrumentation(const MemInstrumentation &other) = delete;
-    MemInstrumentation(MemInstrumentation &&other) = delete;
-    
-    ~MemInstrumentation();
-
-    MemInstrumentation &operator=(const MemInstrumentation &other) = delete;
-    MemInstrumentation &operator=(MemInstrumentation &&other) = delete;
+    QBDI::rword fromObj_;
+    QBDI::rword toObj_;
+    QBDI::rword from_;
+    QBDI::rword to_;
 };
 
 struct Object
 {
 private:
     QBDI::Range<QBDI::rword> range_;
-    MemInstrumentation inst_;
+    // Outgoing links, indexed by the address of the pointer
+    std::unordered_map<QBDI::rword, Link> out_;
+    // Addresses of the pointers to this object
+    std::unordered_set<QBDI::rword> in_;
+
+    friend struct Graph;
 
 public:
-    Object(QBDI::VMInstanceRef vm, QBDI::rword address, QBDI::rword size);
+    Object(QBDI::rword address, QBDI::rword size);
 
     const QBDI::Range<QBDI::rword> &range() const;
 };
 
-struct Link
-{
-    QBDI::rword fromObj_;
-    QBDI::rword toObj_;
-    QBDI::rword from_;
-    QBDI::rword to_; 
-
-    size_t operator()(const Link& toHash) const
-    {
-        return std::hash<QBDI::rword>{}(fromObj_ + toObj_ + from_ + to_);
-    }
-        
-    bool operator==(const Link& toCompare) const 
-    {
-        return (fromObj_ == toCompare.fromObj_ &&
-                toObj_ == toCompare.toObj_ &&
-                from_ == toCompare.from_ &&
-                to_ == toCompare.to_);
-    }
-};
-
+/*
+ * The objects are indexed by start address. As the live allocations never
+ * overlap, the object containing an address is the last one starting before
+ * it, found in O(log n). Each object keeps its incoming and outgoing links, so
+ * deleting an object only touches its own links.
+ *
+ * Only the live objects are kept in memory, each change of the graph is
+ * streamed to the event log.
+ */
 struct Graph
 {
 private:
     static QBDI::VMInstanceRef vm_;
-    std::unordered_map<QBDI::rword, std::unique_ptr<Object>> obj_;
-    std::unordered_set<Link, Link> link_;
+    std::map<QBDI::rword, Object> obj_;
+    EventLog log_;
+
+    Object *findObject(QBDI::rword address);
+    void unlinkSlot(Object &obj, QBDI::rword from);
 
 public:
-    static void initInstance(QBDI::VMInstanceRef vm);
-    static void saveInstanceDot(const char *fname);
+    static bool initInstance(QBDI::VMInstanceRef vm, const char *logName);
+    static void finiInstance();
 
     void addObject(QBDI::rword address, QBDI::rword size);
     void delObject(QBDI::rword address);
-    void createLink(QBDI::rword from, QBDI::rword to);
-    void saveDot(const char *fname);
+    void storePointer(QBDI::rword from, QBDI::rword to);
 };
 
-QBDI::VMAction showInstructionCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState, 
+QBDI::VMAction showInstructionCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
                                  QBDI::FPRState *fprState, void *data);
 
-std::vector<QBDI::InstrRuleDataCBK> callDetectRuleCB(QBDI::VMInstanceRef vm,
-                                                     const QBDI::InstAnalysis *inst,
-                                                     void *data);
-
 }; /* Tracer */
 
 #endif
@@ -22,6 +22,7 @@
 #include "QBDI/InstAnalysis.h"
 #include "QBDI/Platform.h"
 #include "QBDI/State.h"
+#include <stddef.h>
 #ifdef __cplusplus
 #include <functional>
 #include <vector>
@@ -144,6 +145,34 @@ typedef enum {
                   *   is used in the callback */
 } CallbackPriority;
 
+/*! Flags of an instruction callback
+ */
+typedef enum {
+  _QBDI_EI(CALLBACK_DEFAULT) = 0, /*!< The callback is called by the VM after
+                                   *   the instrumented code has switched back
+                                   *   to the host.
+                                   */
+  _QBDI_EI(CALLBACK_INLINE) = 1,  /*!< The callback is called directly by the
+                                   *   instrumented code, on the host stack.
+                                   *   It avoids the return to the VM and
+                                   *   suits small callbacks like counters.
+                                   *
+                                   *   The result of the callback is ignored:
+                                   *   it must return CONTINUE. The GPRState
+                                   *   and the FPRState can be read and
+                                   *   modified, except the Program Counter.
+                                   *
+                                   *   The callback must not change the
+                                   *   instrumentation nor the cache of the
+                                   *   VM, and must not use
+                                   *   VM::getInstAnalysis() and
+                                   *   VM::getInstMemoryAccess(). The analysis
+                                   *   of the instruction is available with
+                                   *   VM::getCachedInstAnalysis() and the
+                                   *   Program Counter.
+                                   */
+} CallbackFlags;
+
 typedef enum {
   _QBDI_EI(NO_EVENT) = 0,
   _QBDI_EI(SEQUENCE_ENTRY) = 1,            /*!< Triggered when the execution
@@ -200,6 +229,60 @@ typedef struct {
   rword lastSignal;      /*!< Not implemented.*/
 } VMState;
 
+/*!
+ * Statistics of the translation cache of a VM
+ */
+typedef struct {
+  size_t memoryUsage;         /*!< Memory used by the translated code, its
+                               * metadata and the decoded basic blocks (in
+                               * bytes).
+                               */
+  size_t memoryBudget;        /*!< Memory budget of the cache (in bytes), 0 if
+                               * the cache is unbounded.
+                               */
+  size_t regions;             /*!< Number of regions in the cache. */
+  size_t execBlocks;          /*!< Number of ExecBlocks in the cache. */
+  size_t dualMapped;          /*!< ExecBlocks of the cache whose code is
+                               * written through a second mapping.
+                               */
+  uint64_t hits;              /*!< Sequences found in the cache. */
+  uint64_t misses;            /*!< Sequences missing from the cache. */
+  uint64_t evictions;         /*!< Number of times the budget was exceeded. */
+  uint64_t evictedRegions;    /*!< Number of regions evicted. */
+  uint64_t evictedExecBlocks; /*!< Number of ExecBlocks evicted. */
+  uint64_t evictedBytes;      /*!< Memory released by the evictions (in
+                               * bytes).
+                               */
+  uint64_t traces;            /*!< Number of hot traces written. */
+  uint64_t pretranslated;     /*!< Basic blocks decoded ahead by the
+                               * translator thread and used.
+                               */
+  uint64_t persistentHits;    /*!< Instructions read from the files of the
+                               * persistent cache.
+                               */
+} CacheStats;
+
+/*!
+ * Report of the pre-translation of a range or a module
+ */
+typedef struct {
+  size_t entryPoints;     /*!< Addresses where the discovery started. */
+  size_t basicBlocks;     /*!< Basic blocks found by the discovery. */
+  size_t newBasicBlocks;  /*!< Basic blocks written in the cache (the others
+                           * were already cached).
+                           */
+  rword coveredBytes;     /*!< Bytes of the range in the basic blocks found.
+                           */
+  rword rangeBytes;       /*!< Bytes of the instrumented part of the range. */
+  unsigned threads;       /*!< Threads used by the discovery. */
+  uint64_t discoveryTime; /*!< Time of the discovery, the decoding and the
+                           * patching (in microseconds).
+                           */
+  uint64_t writeTime;     /*!< Time of the instrumentation and the writing in
+                           * the cache (in microseconds).
+                           */
+} PrecacheReport;
+
 /*! VM callback function type.
  *
  * @param[in] vm            VM instance of the callback.
@@ -281,6 +364,24 @@ typedef struct {
   MemoryAccessFlags flags; /*!< Memory access flags */
 } MemoryAccess;
 
+/*! Memory trace callback function type. Called when the memory trace buffer
+ * reaches its high-water mark, and when the buffer is drained at the end of the
+ * execution.
+ *
+ * @param[in] vm        VM instance of the callback.
+ * @param[in] accesses  The memory accesses recorded since the last call, in
+ *                      execution order.
+ * @param[in] size      The number of accesses.
+ * @param[in] data      User defined data which can be defined when
+ *                      registering the buffer.
+ *
+ * @return              CONTINUE to resume the execution, STOP to stop it.
+ *                      Any other value is handled like CONTINUE.
+ */
+typedef VMAction (*MemTraceCallback)(VMInstanceRef vm,
+                                     const MemoryAccess *accesses, size_t size,
+                                     void *data);
+
 #ifdef __cplusplus
 struct InstrRuleDataCBK {
   InstPosition position; /*!< Relative position of the event callback (PREINST /
@@ -18,6 +18,7 @@
 #ifndef QBDI_RANGE_H_
 #define QBDI_RANGE_H_
 
+#include <algorithm>
 #include <ostream>
 #include <vector>
 
@@ -142,85 +143,69 @@ public:
   }
 
   bool contains(const T t) const {
-    for (const Range<T> &r : ranges) {
-      if (r.contains(t)) {
-        return true;
-      }
-      if (r.start() > t) {
-        return false;
-      }
-    }
-    return false;
+    // first range ending after t
+    auto it = std::upper_bound(
+        ranges.begin(), ranges.end(), t,
+        [](const T v, const Range<T> &r) { return v < r.end(); });
+    return it != ranges.end() && it->start() <= t;
   }
 
   bool contains(const Range<T> &t) const {
-    for (const Range<T> &r : ranges) {
-      if (r.contains(t)) {
-        return true;
-      }
-      if (r.start() > t.end()) {
-        return false;
-      }
-    }
-    return false;
+    // as the ranges are merged, only the first range ending at or after t can
+    // contain it
+    auto it = std::lower_bound(
+        ranges.begin(), ranges.end(), t.end(),
+        [](const Range<T> &r, const T v) { return r.end() < v; });
+    return it != ranges.end() && it->contains(t);
   }
 
   bool overlaps(const Range<T> &t) const {
-    for (const Range<T> &r : ranges) {
-      if (r.overlaps(t)) {
-        return true;
-      }
-      if (r.end() < t.start()) {
-        return false;
-      }
+    // first range ending after the start of t
+    auto it = std::upper_bound(
+        ranges.begin(), ranges.end(), t.start(),
+        [](const T v, const Range<T> &r) { return v < r.end(); });
+    return it != ranges.end() && it->overlaps(t);
+  }
+
+  /*! Return the ranges of the set overlapping a range.
+   *
+   * @param[in] t  Range to check.
+   *
+   * @return  The overlapping ranges, sorted by start value.
+   */
+  std::vector<Range<T>> getOverlappingRanges(const Range<T> &t) const {
+    std::vector<Range<T>> result;
+    auto it = std::upper_bound(
+        ranges.begin(), ranges.end(), t.start(),
+        [](const T v, const Range<T> &r) { return v < r.end(); });
+    for (; it != ranges.end() && it->overlaps(t); ++it) {
+      result.push_back(*it);
     }
-    return false;
+    return result;
   }
 
   void add(const Range<T> &t) {
-    size_t i = 0;
-    size_t r = 0;
-
     // Exception for empty ranges
     if (t.end() <= t.start()) {
       return;
     }
 
-    // Find start in sorted range list
-    for (i = 0; i < ranges.size(); i++) {
-      if (ranges[i].end() >= t.start()) {
-        // Add a new range before ranges[i]
-        if (ranges[i].start() > t.start()) {
-          ranges.insert(ranges.begin() + i, t);
-        }
-        // else extend ranges[i]
-        r = i;
-        break;
-      }
-    }
-    // If no range to extend or insert before was found
-    if (i == ranges.size()) {
-      ranges.push_back(t);
+    // Ranges [first, last) touch or overlap t and are merged with it
+    auto first = std::lower_bound(
+        ranges.begin(), ranges.end(), t.start(),
+        [](const Range<T> &r, const T v) { return r.end() < v; });
+    auto last = std::upper_bound(
+        first, ranges.end(), t.end(),
+        [](const T v, const Range<T> &r) { return v < r.start(); });
+
+    if (first == last) {
+      ranges.insert(first, t);
       return;
     }
-    // Determine range [r+1,i] of blocks that are covered by t
-    // and will be deleted
-    for (i = r; i < ranges.size() && t.end() >= ranges[i].end(); i++)
-      ;
-    // If t.end() is inside another range, merge it
-    if (i < ranges.size() && t.end() >= ranges[i].start()) {
-      ranges[r].setEnd(ranges[i].end());
-      if (i > r) {
-        ranges.erase(ranges.begin() + r + 1, ranges.begin() + i + 1);
-      }
-    }
-    // Else finish normally
-    else {
-      ranges[r].setEnd(t.end());
-      if (i > r + 1) {
-        ranges.erase(ranges.begin() + r + 1, ranges.begin() + i);
-      }
-    }
+    T start = first->start() < t.start() ? first->start() : t.start();
+    T end = (last - 1)->end() > t.end() ? (last - 1)->end() : t.end();
+    *first = Range<T>(start, end);
+    ranges.erase(first + 1, last);
   }
 
   void add(const RangeSet<T> &t) {
@@ -230,52 +215,37 @@ public:
   }
 
   void remove(const Range<T> &t) {
-    size_t i = 0;
-    size_t r = 0;
-
     // Exception for empty ranges
     if (t.end() <= t.start()) {
       return;
     }
 
-    // Find deletion start
-    for (i = 0; i < ranges.size(); i++) {
-      if (ranges[i].end() >= t.start()) {
-        // start inside a range
-        if (ranges[i].start() < t.start()) {
-          // Split a range
-          if (t.end() < ranges[i].end()) {
-            ranges.insert(ranges.begin() + i,
-                          Range<T>(ranges[i].start(), t.start()));
-            ranges[i + 1].setStart(t.end());
-            return;
-          }
-          // Truncate a range
-          else {
-            ranges[i].setEnd(t.start());
-            r = i + 1;
-            break;
-          }
-        }
-        // start before a range
-        r = i;
-        break;
-      }
-    }
+    // Ranges [first, last) overlap t
+    auto first = std::upper_bound(
+        ranges.begin(), ranges.end(), t.start(),
+        [](const T v, const Range<T> &r) { return v < r.end(); });
+    auto last = std::lower_bound(
+        first, ranges.end(), t.end(),
+        [](const Range<T> &r, const T v) { return r.start() < v; });
+
     // If no range to delete was found
-    if (i == ranges.size()) {
+    if (first == last) {
       return;
     }
-    // Determine set of ranges contained inside t which will be deleted
-    for (i = r; i < ranges.size() && t.end() >= ranges[i].end(); i++)
-      ;
-    // Truncate a range
-    if (i < ranges.size() && t.end() >= ranges[i].start()) {
-      ranges[i].setStart(t.end());
+    // Keep the parts of the first and last ranges outside of t
+    Range<T> head = *first;
+    Range<T> tail = *(last - 1);
+    bool keepHead = head.start() < t.start();
+    bool keepTail = t.end() < tail.end();
+    head.setEnd(t.start());
+    tail.setStart(t.end());
+
+    auto it = ranges.erase(first, last);
+    if (keepTail) {
+      it = ranges.insert(it, tail);
     }
-    // Delete covered range
-    if (i > r) {
-      ranges.erase(ranges.begin() + r, ranges.begin() + i);
+    if (keepHead) {
+      ranges.insert(it, head);
     }
   }
 
@@ -288,14 +258,8 @@ public:
   void intersect(const RangeSet<T> &t) {
     RangeSet<T> intersected;
     for (size_t i = 0; i < ranges.size(); i++) {
-      if (t.contains(ranges[i])) {
-        intersected.add(ranges[i]);
-      } else {
-        for (const Range<T> &r : t.getRanges()) {
-          if (r.overlaps(ranges[i])) {
-            intersected.add(r.intersect(ranges[i]));
-          }
-        }
+      for (const Range<T> &r : t.getOverlappingRanges(ranges[i])) {
+        intersected.add(r.intersect(ranges[i]));
       }
     }
     ranges = intersected.getRanges();
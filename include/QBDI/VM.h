@@ -39,8 +39,8 @@ namespace QBDI {
 
 // Forward declaration of engine class
 class Engine;
-// Forward declaration of private memCBInfo
-struct MemCBInfo;
+// Forward declaration of private MemCBInfos
+struct MemCBInfos;
 // Forward declaration of private InstrCBInfo
 struct InstrCBInfo;
 
@@ -49,7 +49,7 @@ private:
   // Private internal engine
   std::unique_ptr<Engine> engine;
   uint8_t memoryLoggingLevel;
-  std::unique_ptr<std::vector<std::pair<uint32_t, MemCBInfo>>> memCBInfos;
+  std::unique_ptr<MemCBInfos> memCBInfos;
   uint32_t memCBID;
   uint32_t memReadGateCBID;
   uint32_t memWriteGateCBID;
@@ -59,6 +59,8 @@ private:
   std::forward_list<std::pair<uint32_t, VMCbLambda>> vmCBData;
   std::forward_list<std::pair<uint32_t, InstCbLambda>> instCBData;
   std::forward_list<std::pair<uint32_t, InstrRuleCbLambda>> instrRuleCBData;
+  // Reusable buffer of copyInstMemoryAccess and copyBBMemoryAccess
+  mutable std::vector<MemoryAccess> memAccessBuffer;
 
 public:
   /*! Construct a new VM for a given CPU with specific attributes
@@ -148,6 +150,22 @@ public:
    */
   void setOptions(Options options);
 
+  /*! Set the size of the code and data blocks of the ExecBlocks
+   *  This method mustn't be called when the VM runs.
+   *
+   * @param[in] codeSize  Size in bytes of the code block of an ExecBlock.
+   * @param[in] dataSize  Size in bytes of the data block of an ExecBlock.
+   *
+   * The sizes must be multiples of the page size, up to 16MB, or 0 for the
+   * default: one page for the code, and the smallest number of pages leaving
+   * half a page after the context for the data. A code block made of 2MB
+   * pages is backed by huge pages when the system supports it. If the new sizes are different than the
+   * current ones, the cache will be clear.
+   *
+   * @return True if the sizes are valid and have been applied.
+   */
+  bool setExecBlockSize(size_t codeSize, size_t dataSize);
+
   /*! Add an address range to the set of instrumented address ranges.
    *
    * @param[in] start  Start address of the range (included).
@@ -398,12 +416,15 @@ public:
    * @param[in] cbk        A function pointer to the callback.
    * @param[in] data       User defined data passed to the callback.
    * @param[in] priority   The priority of the callback.
+   * @param[in] flags      The flags of the callback (CALLBACK_INLINE to call
+   *                       it from the instrumented code).
    *
    * @return The id of the registered instrumentation
    * (or VMError::INVALID_EVENTID in case of failure).
    */
   uint32_t addCodeCB(InstPosition pos, InstCallback cbk, void *data,
-                     int priority = PRIORITY_DEFAULT);
+                     int priority = PRIORITY_DEFAULT,
+                     CallbackFlags flags = CALLBACK_DEFAULT);
 
   /*! Register a callback event for every instruction executed.
    *
@@ -411,14 +432,18 @@ public:
    *                       (PREINST / POSTINST).
    * @param[in] cbk        A lambda function to the callback
    * @param[in] priority   The priority of the callback.
+   * @param[in] flags      The flags of the callback (CALLBACK_INLINE to call
+   *                       it from the instrumented code).
    *
    * @return The id of the registered instrumentation
    * (or VMError::INVALID_EVENTID in case of failure).
    */
   uint32_t addCodeCB(InstPosition pos, const InstCbLambda &cbk,
-                     int priority = PRIORITY_DEFAULT);
+                     int priority = PRIORITY_DEFAULT,
+                     CallbackFlags flags = CALLBACK_DEFAULT);
   uint32_t addCodeCB(InstPosition pos, InstCbLambda &&cbk,
-                     int priority = PRIORITY_DEFAULT);
+                     int priority = PRIORITY_DEFAULT,
+                     CallbackFlags flags = CALLBACK_DEFAULT);
 
   /*! Register a callback for when a specific address is executed.
    *
@@ -687,6 +712,120 @@ public:
    */
   std::vector<MemoryAccess> getBBMemoryAccess() const;
 
+  /*! Copy the memory accesses made by the last executed instruction in a
+   *  buffer. Unlike getInstMemoryAccess, this method doesn't allocate memory
+   *  once the VM has analysed a few instructions.
+   *  The method should be called in an InstCallback.
+   *
+   * @param[out] buffer  The buffer to fill with the memory accesses.
+   * @param[in]  size    The number of elements of the buffer.
+   *
+   * @return The number of memory accesses made by the instruction. If it's
+   *         greater than size, only the first size accesses are copied.
+   */
+  size_t copyInstMemoryAccess(MemoryAccess *buffer, size_t size) const;
+
+  /*! Copy the memory accesses made by the last executed basic block in a
+   *  buffer. Unlike getBBMemoryAccess, this method doesn't allocate memory
+   *  once the VM has analysed a few basic blocks.
+   *  The method should be called in a VMCallback with VMEvent::SEQUENCE_EXIT.
+   *
+   * @param[out] buffer  The buffer to fill with the memory accesses.
+   * @param[in]  size    The number of elements of the buffer.
+   *
+   * @return The number of memory accesses made by the basic block. If it's
+   *         greater than size, only the first size accesses are copied.
+   */
+  size_t copyBBMemoryAccess(MemoryAccess *buffer, size_t size) const;
+
+  /*! Record the memory accesses in a buffer directly from the instrumented
+   *  code, without calling a callback for each access. The callback is called
+   *  with the recorded accesses between two sequences once the buffer reaches
+   *  the high-water mark, and at the end of each execution. Any previous trace
+   *  buffer is removed.
+   *
+   *  The reads are recorded before the instruction and the writes after it.
+   *  For the instructions with a REP prefix, only the start address of the
+   *  access is recorded (QBDI::MEMORY_UNKNOWN_SIZE).
+   *
+   *  The buffer must be large enough for the accesses of a sequence.
+   *  This method mustn't be called if the VM already runs.
+   *
+   * @param[in] type           Memory mode bitfield to trace:
+   *                           either QBDI::MEMORY_READ, QBDI::MEMORY_WRITE or
+   *                           both (QBDI::MEMORY_READ_WRITE).
+   * @param[in] buffer         The buffer where the accesses are written.
+   * @param[in] size           The number of elements of the buffer.
+   * @param[in] highWaterMark  The number of recorded accesses that triggers
+   *                           the callback, in the range [1, size].
+   * @param[in] cbk            The callback called to drain the buffer.
+   * @param[in] data           User defined data passed to the callback.
+   *
+   * @return True if the trace buffer has been set, False if not supported or
+   *         in case of error.
+   */
+  bool setMemoryTraceBuffer(MemoryAccessType type, MemoryAccess *buffer,
+                            size_t size, size_t highWaterMark,
+                            MemTraceCallback cbk, void *data);
+
+  /*! Remove the memory trace buffer set by setMemoryTraceBuffer.
+   *  This method mustn't be called if the VM already runs.
+   *
+   * @return True if a trace buffer has been removed.
+   */
+  bool removeMemoryTraceBuffer();
+
+  /*! Count the executions of the basic blocks ending in a range. The counter
+   *  of a basic block is incremented by the instrumented code, before the
+   *  last instruction of the basic block, without calling a callback. The
+   *  counters are kept when the cache is cleared. The instrumented code
+   *  increments a rword, on X86 the counter of a basic block wraps after
+   *  2^32 executions between two flushes of its code.
+   *
+   * @param[in] start  Start of the address range (included).
+   * @param[in] end    End of the address range (excluded).
+   *
+   * @return The id of the registered instrumentation (or
+   * VMError::INVALID_EVENTID in case of failure).
+   */
+  uint32_t addBBCounterRange(rword start, rword end);
+
+  /*! Mark the basic blocks ending in a range in a coverage map. The map has
+   *  a byte for each address of the range, the instrumented code sets to 1
+   *  the byte matching the last byte of a basic block before its last
+   *  instruction, without calling a callback.
+   *
+   * @param[in] start  Start of the address range (included).
+   * @param[in] end    End of the address range (excluded).
+   * @param[in] map    The coverage map of (end - start) bytes. It must stay
+   *                   valid until the instrumentation is removed.
+   *
+   * @return The id of the registered instrumentation (or
+   * VMError::INVALID_EVENTID in case of failure).
+   */
+  uint32_t addCoverageMapRange(rword start, rword end, uint8_t *map);
+
+  /*! Get the execution counter of a basic block (see addBBCounterRange).
+   *
+   * @param[in] bbEnd  The end address of the basic block (the basicBlockEnd
+   *                   of the VMState).
+   *
+   * @return The number of executions of the basic block.
+   */
+  uint64_t getBBCounter(rword bbEnd) const;
+
+  /*! Get the execution counters of all the basic blocks (see
+   *  addBBCounterRange).
+   *
+   * @return The end address and the counter of each basic block, sorted by
+   *         address.
+   */
+  std::vector<std::pair<rword, uint64_t>> getBBCounters() const;
+
+  /*! Reset the execution counters of all the basic blocks to zero.
+   */
+  void resetBBCounters();
+
   /*! Pre-cache a known basic block
    *  This method mustn't be called if the VM already runs.
    *
@@ -696,6 +835,40 @@ public:
    */
   bool precacheBasicBlock(rword pc);
 
+  /*! Pre-cache the basic blocks of a range, found by recursive descent from
+   *  the start of the range and the entry points of its module. The basic
+   *  blocks are decoded by a pool of threads, then instrumented and written in
+   *  the cache by the calling thread. Only the instrumented part of the range
+   *  is translated.
+   *  This method mustn't be called if the VM already runs.
+   *
+   * @param[in]  start    Start of the range.
+   * @param[in]  end      End of the range (not included).
+   * @param[out] report   The coverage and the time of the translation, or
+   *                      nullptr.
+   * @param[in]  threads  The number of threads decoding the basic blocks, 0
+   *                      for the number of CPUs (64 at most).
+   *
+   * @return True if at least one basic block was found.
+   */
+  bool precacheRange(rword start, rword end, PrecacheReport *report = nullptr,
+                     unsigned threads = 0);
+
+  /*! Pre-cache the basic blocks of the executable ranges of a module (see
+   *  precacheRange).
+   *  This method mustn't be called if the VM already runs.
+   *
+   * @param[in]  name     The name of the module.
+   * @param[out] report   The coverage and the time of the translation, or
+   *                      nullptr.
+   * @param[in]  threads  The number of threads decoding the basic blocks, 0
+   *                      for the number of CPUs (64 at most).
+   *
+   * @return True if at least one basic block was found.
+   */
+  bool precacheModule(const std::string &name,
+                      PrecacheReport *report = nullptr, unsigned threads = 0);
+
   /*! Clear a specific address range from the translation cache.
    *
    * @param[in] start Start of the address range to clear from the cache.
@@ -707,6 +880,46 @@ public:
   /*! Clear the entire translation cache.
    */
   void clearAllCache();
+
+  /*! Set the memory budget of the translation cache. When the translated code
+   * and its metadata exceed the budget, the regions of the cache not used
+   * recently are evicted. The evicted code is only released between two
+   * sequences, never while it runs.
+   * A quarter of the budget is kept for the decoded basic
+   * blocks reused when the instrumentation changes.
+   *
+   * @param[in] budget  The budget in bytes, 0 for an unbounded cache (the
+   *                    default).
+   */
+  void setCacheBudget(size_t budget);
+
+  /*! Get the statistics of the translation cache.
+   *
+   * @return The memory usage, the budget and the eviction counters of the
+   * cache.
+   */
+  CacheStats getCacheStats() const;
+
+  /*! Keep the decoded instructions of the modules in a persistent cache. The
+   * instructions are stored per module build-id, and are loaded by the next
+   * VM using the same directory and CPU instead of being decoded again. The
+   * new instructions are written when the VM is destroyed or with
+   * savePersistentCache.
+   *
+   * Only the modules with a build-id (Linux and Android) are cached.
+   *
+   * @param[in] directory  The directory of the cache, or an empty string to
+   *                       disable the persistent cache (the default).
+   *
+   * @return False if the persistent cache isn't supported on this platform.
+   */
+  bool setPersistentCache(const std::string &directory);
+
+  /*! Write the new decoded instructions in the persistent cache.
+   *
+   * @return False if the persistent cache is disabled or couldn't be written.
+   */
+  bool savePersistentCache();
 };
 
 } // namespace QBDI
@@ -245,6 +245,22 @@ QBDI_EXPORT Options qbdi_getOptions(VMInstanceRef instance);
  */
 QBDI_EXPORT void qbdi_setOptions(VMInstanceRef instance, Options options);
 
+/*! Set the size of the code and data blocks of the ExecBlocks
+ *  This method mustn't be called when the VM runs.
+ *
+ * @param[in] instance  VM instance.
+ * @param[in] codeSize  Size in bytes of the code block of an ExecBlock.
+ * @param[in] dataSize  Size in bytes of the data block of an ExecBlock.
+ *
+ * The sizes must be multiples of the page size, up to 16MB, or 0 for one
+ * page (the default). A code block made of 2MB pages is backed by huge pages
+ * when the system supports it.
+ *
+ * @return True if the sizes are valid and have been applied.
+ */
+QBDI_EXPORT bool qbdi_setExecBlockSize(VMInstanceRef instance, size_t codeSize,
+                                       size_t dataSize);
+
 /*! Add a custom instrumentation rule to the VM.
  *
  * @param[in] instance   VM instance.
@@ -381,6 +397,24 @@ QBDI_EXPORT uint32_t qbdi_addMnemonicCB(VMInstanceRef instance,
 QBDI_EXPORT uint32_t qbdi_addCodeCB(VMInstanceRef instance, InstPosition pos,
                                     InstCallback cbk, void *data, int priority);
 
+/*! Register an inline callback event for every instruction executed. The
+ * callback is called directly by the instrumented code (see
+ * QBDI_CALLBACK_INLINE) and must return QBDI_CONTINUE.
+ *
+ * @param[in] instance  VM instance.
+ * @param[in] pos       Relative position of the event callback
+ *                      (QBDI_PREINST / QBDI_POSTINST).
+ * @param[in] cbk       A function pointer to the callback.
+ * @param[in] data      User defined data passed to the callback.
+ * @param[in] priority  The priority of the callback.
+ *
+ * @return The id of the registered instrumentation (or QBDI_INVALID_EVENTID
+ * in case of failure).
+ */
+QBDI_EXPORT uint32_t qbdi_addInlineCodeCB(VMInstanceRef instance,
+                                          InstPosition pos, InstCallback cbk,
+                                          void *data, int priority);
+
 /*! Register a callback for when a specific address is executed.
  *
  * @param[in] instance  VM instance.
@@ -515,6 +549,118 @@ QBDI_EXPORT MemoryAccess *qbdi_getInstMemoryAccess(VMInstanceRef instance,
 QBDI_EXPORT MemoryAccess *qbdi_getBBMemoryAccess(VMInstanceRef instance,
                                                  size_t *size);
 
+/*! Copy the memory accesses made by the last executed instruction in a
+ *  buffer, without allocating memory.
+ *  The method should be called in an InstCallback.
+ *
+ *  @param[in]  instance     VM instance.
+ *  @param[out] buffer       The buffer to fill with the memory accesses.
+ *  @param[in]  size         The number of elements of the buffer.
+ *
+ * @return The number of memory accesses made by the instruction. If it's
+ *         greater than size, only the first size accesses are copied.
+ */
+QBDI_EXPORT size_t qbdi_copyInstMemoryAccess(VMInstanceRef instance,
+                                             MemoryAccess *buffer, size_t size);
+
+/*! Copy the memory accesses made by the last executed basic block in a
+ *  buffer, without allocating memory.
+ *  The method should be called in a VMCallback with QBDI_SEQUENCE_EXIT.
+ *
+ *  @param[in]  instance     VM instance.
+ *  @param[out] buffer       The buffer to fill with the memory accesses.
+ *  @param[in]  size         The number of elements of the buffer.
+ *
+ * @return The number of memory accesses made by the basic block. If it's
+ *         greater than size, only the first size accesses are copied.
+ */
+QBDI_EXPORT size_t qbdi_copyBBMemoryAccess(VMInstanceRef instance,
+                                           MemoryAccess *buffer, size_t size);
+
+/*! Record the memory accesses in a buffer directly from the instrumented code,
+ *  without calling a callback for each access. The callback is called with the
+ *  recorded accesses between two sequences once the buffer reaches the
+ *  high-water mark, and at the end of each execution.
+ *
+ *  @param[in] instance       VM instance.
+ *  @param[in] type           Memory mode bitfield to trace:
+ *                            either QBDI_MEMORY_READ, QBDI_MEMORY_WRITE
+ *                            or both (QBDI_MEMORY_READ_WRITE).
+ *  @param[in] buffer         The buffer where the accesses are written.
+ *  @param[in] size           The number of elements of the buffer.
+ *  @param[in] highWaterMark  The number of recorded accesses that triggers
+ *                            the callback, in the range [1, size].
+ *  @param[in] cbk            The callback called to drain the buffer.
+ *  @param[in] data           User defined data passed to the callback.
+ *
+ * @return True if the trace buffer has been set, False if not supported or in
+ *         case of error.
+ */
+QBDI_EXPORT bool qbdi_setMemoryTraceBuffer(VMInstanceRef instance,
+                                           MemoryAccessType type,
+                                           MemoryAccess *buffer, size_t size,
+                                           size_t highWaterMark,
+                                           MemTraceCallback cbk, void *data);
+
+/*! Remove the memory trace buffer set by qbdi_setMemoryTraceBuffer.
+ *
+ *  @param[in] instance  VM instance.
+ *
+ * @return True if a trace buffer has been removed.
+ */
+QBDI_EXPORT bool qbdi_removeMemoryTraceBuffer(VMInstanceRef instance);
+
+/*! Count the executions of the basic blocks ending in a range. The counter
+ *  of a basic block is incremented by the instrumented code, before the last
+ *  instruction of the basic block, without calling a callback. The counters
+ *  are kept when the cache is cleared. The instrumented code increments a
+ *  rword, on X86 the counter of a basic block wraps after 2^32 executions
+ *  between two flushes of its code.
+ *
+ * @param[in] instance  VM instance.
+ * @param[in] start     Start of the address range (included).
+ * @param[in] end       End of the address range (excluded).
+ *
+ * @return The id of the registered instrumentation (or VMError::INVALID_EVENTID
+ * in case of failure).
+ */
+QBDI_EXPORT uint32_t qbdi_addBBCounterRange(VMInstanceRef instance,
+                                            rword start, rword end);
+
+/*! Mark the basic blocks ending in a range in a coverage map. The map has a
+ *  byte for each address of the range, the instrumented code sets to 1 the
+ *  byte matching the last byte of a basic block before its last instruction,
+ *  without calling a callback.
+ *
+ * @param[in] instance  VM instance.
+ * @param[in] start     Start of the address range (included).
+ * @param[in] end       End of the address range (excluded).
+ * @param[in] map       The coverage map of (end - start) bytes. It must stay
+ *                      valid until the instrumentation is removed.
+ *
+ * @return The id of the registered instrumentation (or VMError::INVALID_EVENTID
+ * in case of failure).
+ */
+QBDI_EXPORT uint32_t qbdi_addCoverageMapRange(VMInstanceRef instance,
+                                              rword start, rword end,
+                                              uint8_t *map);
+
+/*! Get the execution counter of a basic block (see qbdi_addBBCounterRange).
+ *
+ * @param[in] instance  VM instance.
+ * @param[in] bbEnd     The end address of the basic block (the basicBlockEnd
+ *                      of the VMState).
+ *
+ * @return The number of executions of the basic block.
+ */
+QBDI_EXPORT uint64_t qbdi_getBBCounter(VMInstanceRef instance, rword bbEnd);
+
+/*! Reset the execution counters of all the basic blocks to zero.
+ *
+ * @param[in] instance  VM instance.
+ */
+QBDI_EXPORT void qbdi_resetBBCounters(VMInstanceRef instance);
+
 /*! Pre-cache a known basic block
  *  This method mustn't be called when the VM runs.
  *
@@ -525,6 +671,42 @@ QBDI_EXPORT MemoryAccess *qbdi_getBBMemoryAccess(VMInstanceRef instance,
  */
 QBDI_EXPORT bool qbdi_precacheBasicBlock(VMInstanceRef instance, rword pc);
 
+/*! Pre-cache the basic blocks of a range, found by recursive descent from the
+ *  start of the range and the entry points of its module. The basic blocks
+ *  are decoded by a pool of threads, then instrumented and written in the
+ *  cache by the calling thread.
+ *  This method mustn't be called when the VM runs.
+ *
+ * @param[in]  instance   VM instance.
+ * @param[in]  start      Start of the range.
+ * @param[in]  end        End of the range (not included).
+ * @param[out] report     The coverage and the time of the translation, or
+ *                        NULL.
+ * @param[in]  threads    The number of threads decoding the basic blocks, 0
+ *                        for the number of CPUs (64 at most).
+ *
+ * @return True if at least one basic block was found.
+ */
+QBDI_EXPORT bool qbdi_precacheRange(VMInstanceRef instance, rword start,
+                                    rword end, PrecacheReport *report,
+                                    unsigned threads);
+
+/*! Pre-cache the basic blocks of the executable ranges of a module (see
+ *  qbdi_precacheRange).
+ *  This method mustn't be called when the VM runs.
+ *
+ * @param[in]  instance   VM instance.
+ * @param[in]  name       The name of the module.
+ * @param[out] report     The coverage and the time of the translation, or
+ *                        NULL.
+ * @param[in]  threads    The number of threads decoding the basic blocks, 0
+ *                        for the number of CPUs (64 at most).
+ *
+ * @return True if at least one basic block was found.
+ */
+QBDI_EXPORT bool qbdi_precacheModule(VMInstanceRef instance, const char *name,
+                                     PrecacheReport *report, unsigned threads);
+
 /*! Clear a specific address range from the translation cache.
  *
  * @param[in] instance     VM instance.
@@ -541,6 +723,50 @@ QBDI_EXPORT void qbdi_clearCache(VMInstanceRef instance, rword start,
  */
 QBDI_EXPORT void qbdi_clearAllCache(VMInstanceRef instance);
 
+/*! Set the memory budget of the translation cache. When the translated code
+ * and its metadata exceed the budget, the regions of the cache not used
+ * recently are evicted. The evicted code is only released between two
+ * sequences, never while it runs.
+ * A quarter of the budget is kept for the decoded basic
+ * blocks reused when the instrumentation changes.
+ *
+ * @param[in] instance     VM instance.
+ * @param[in] budget       The budget in bytes, 0 for an unbounded cache (the
+ *                         default).
+ */
+QBDI_EXPORT void qbdi_setCacheBudget(VMInstanceRef instance, size_t budget);
+
+/*! Get the statistics of the translation cache.
+ *
+ * @param[in]  instance    VM instance.
+ * @param[out] stats       The memory usage, the budget and the eviction
+ *                         counters of the cache.
+ *
+ * @return True if the statistics have been written.
+ */
+QBDI_EXPORT bool qbdi_getCacheStats(VMInstanceRef instance, CacheStats *stats);
+
+/*! Keep the decoded instructions of the modules in a persistent cache. The
+ * new instructions are written when the VM is destroyed or with
+ * qbdi_savePersistentCache.
+ *
+ * @param[in] instance    VM instance.
+ * @param[in] directory   The directory of the cache, or NULL to disable the
+ *                        persistent cache (the default).
+ *
+ * @return False if the persistent cache isn't supported on this platform.
+ */
+QBDI_EXPORT bool qbdi_setPersistentCache(VMInstanceRef instance,
+                                         const char *directory);
+
+/*! Write the new decoded instructions in the persistent cache.
+ *
+ * @param[in] instance    VM instance.
+ *
+ * @return False if the persistent cache is disabled or couldn't be written.
+ */
+QBDI_EXPORT bool qbdi_savePersistentCache(VMInstanceRef instance);
+
 #ifdef __cplusplus
 } // "C"
 } // QBDI::
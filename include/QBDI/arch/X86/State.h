@@ -75,9 +75,11 @@ typedef struct {
 
 typedef uint32_t rword;
 
-/*! X86 Floating Point Register context.
+/*! X86 Floating Point Register context. The structure follows the standard
+ * format of the XSAVE area: the FXSAVE region, the XSAVE header, the AVX upper
+ * halves, the AVX-512 opmask and the upper halves of the ZMM.
  */ // SPHINX_X86_FPRSTATE_BEGIN
-typedef struct QBDI_ALIGNED(16) {
+typedef struct QBDI_ALIGNED(64) {
   union {
     FPControl fcw; /* x87 FPU control word */
     uint16_t rfcw;
@@ -114,6 +116,9 @@ typedef struct QBDI_ALIGNED(16) {
   char xmm6[16];      /* XMM 6  */
   char xmm7[16];      /* XMM 7  */
   char reserved[14 * 16];
+  uint64_t xstate_bv; /* XSAVE header: state components in the area */
+  uint64_t xcomp_bv;  /* XSAVE header: must be 0 */
+  char rsrv4[48];     /* reserved */
   char ymm0[16]; /* YMM0[255:128] */
   char ymm1[16]; /* YMM1[255:128] */
   char ymm2[16]; /* YMM2[255:128] */
@@ -122,9 +127,27 @@ typedef struct QBDI_ALIGNED(16) {
   char ymm5[16]; /* YMM5[255:128] */
   char ymm6[16]; /* YMM6[255:128] */
   char ymm7[16]; /* YMM7[255:128] */
+  char rsrv5[384]; /* reserved */
+  char k0[8];    /* K0 */
+  char k1[8];    /* K1 */
+  char k2[8];    /* K2 */
+  char k3[8];    /* K3 */
+  char k4[8];    /* K4 */
+  char k5[8];    /* K5 */
+  char k6[8];    /* K6 */
+  char k7[8];    /* K7 */
+  char zmm0[32]; /* ZMM0[511:256] */
+  char zmm1[32]; /* ZMM1[511:256] */
+  char zmm2[32]; /* ZMM2[511:256] */
+  char zmm3[32]; /* ZMM3[511:256] */
+  char zmm4[32]; /* ZMM4[511:256] */
+  char zmm5[32]; /* ZMM5[511:256] */
+  char zmm6[32]; /* ZMM6[511:256] */
+  char zmm7[32]; /* ZMM7[511:256] */
+  char rsrv6[256]; /* reserved */
 } FPRState;
 // SPHINX_X86_FPRSTATE_END
-typedef char __compile_check_01__[sizeof(FPRState) == 640 ? 1 : -1];
+typedef char __compile_check_01__[sizeof(FPRState) == 1664 ? 1 : -1];
 
 /*! X86 General Purpose Register context.
  */ // SPHINX_X86_GPRSTATE_BEGIN
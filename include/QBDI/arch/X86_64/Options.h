@@ -30,15 +30,46 @@ namespace QBDI {
 typedef enum {
   _QBDI_EI(NO_OPT) = 0, /*!< Default value */
   // general options between 0 and 23
-  _QBDI_EI(OPT_DISABLE_FPR) = 1 << 0,          /*!< Disable all operation on FPU
-                                                * (SSE, AVX, SIMD). May break
-                                                * the execution if the target
-                                                * use the FPU
-                                                */
-  _QBDI_EI(OPT_DISABLE_OPTIONAL_FPR) = 1 << 1, /*!< Disable context switch
-                                                * optimisation when the target
-                                                * execblock doesn't used FPR
-                                                */
+  _QBDI_EI(OPT_DISABLE_FPR) = 1 << 0,           /*!< Disable all operation on
+                                                 * FPU (SSE, AVX, SIMD). May
+                                                 * break the execution if the
+                                                 * target use the FPU
+                                                 */
+  _QBDI_EI(OPT_DISABLE_OPTIONAL_FPR) = 1 << 1,  /*!< Disable context switch
+                                                 * optimisation when the target
+                                                 * execblock doesn't used FPR
+                                                 */
+  _QBDI_EI(OPT_ENABLE_BLOCK_CHAINING) = 1 << 2, /*!< Allow the sequences ending
+                                                 * with a direct jump to jump to
+                                                 * their successor in the same
+                                                 * ExecBlock without going back
+                                                 * to the VM. Only effective
+                                                 * while no SEQUENCE_* or
+                                                 * BASIC_BLOCK_ENTRY/EXIT
+                                                 * VMEvent callback is
+                                                 * registered
+                                                 */
+  _QBDI_EI(OPT_ENABLE_DUAL_MAPPING) = 1 << 3,   /*!< Map the code of the
+                                                 * ExecBlocks twice, RX for the
+                                                 * execution and RW for the
+                                                 * JIT, so that the page
+                                                 * permissions never change.
+                                                 * Only available on Linux
+                                                 */
+  _QBDI_EI(OPT_ENABLE_HOT_TRACES) = 1 << 4,     /*!< Translate the hot loops
+                                                 * as traces of basic blocks
+                                                 * in one sequence. Only
+                                                 * effective on X86_64 while
+                                                 * no SEQUENCE_* or
+                                                 * BASIC_BLOCK_ENTRY/EXIT
+                                                 * VMEvent callback is
+                                                 * registered
+                                                 */
+  _QBDI_EI(OPT_ENABLE_PRETRANSLATION) = 1 << 5, /*!< Decode and patch the
+                                                 * successors of the new basic
+                                                 * blocks ahead on a
+                                                 * translator thread
+                                                 */
   // architecture specific option between 24 and 31
   _QBDI_EI(OPT_ATT_SYNTAX) = 1 << 24,   /*!< Used the AT&T syntax for
                                          * instruction disassembly
@@ -48,6 +79,13 @@ typedef enum {
                                          * instructions (RD|WR)(FS|GS)BASE that
                                          * must be supported by the operating
                                          * system */
+  _QBDI_EI(OPT_ENABLE_XSAVE) = 1 << 26, /*!< Use XSAVE and XRSTOR for the
+                                         * FPU context switches, with only
+                                         * the state components needed by
+                                         * the sequence. Saves and restores
+                                         * the AVX-512 registers when the
+                                         * CPU supports them
+                                         */
 } Options;
 
 _QBDI_ENABLE_BITMASK_OPERATORS(Options)
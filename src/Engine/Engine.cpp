@@ -16,15 +16,20 @@
  * limitations under the License.
  */
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <iterator>
+#include <map>
 #include <string.h>
+#include <thread>
+#include <utility>
 
-#include "llvm/ADT/ArrayRef.h"
-#include "llvm/MC/MCDisassembler/MCDisassembler.h"
 #include "llvm/MC/MCInst.h"
 
 #include "Engine/Engine.h"
 #include "Engine/LLVMCPU.h"
+#include "Engine/PersistentCache.h"
+#include "Engine/Translator.h"
 
 #include "ExecBlock/Context.h"
 #include "ExecBlock/ExecBlock.h"
@@ -32,10 +37,15 @@
 #include "ExecBroker/ExecBroker.h"
 #include "Patch/InstMetadata.h"
 #include "Patch/InstrRule.h"
+#include "Patch/InstrRuleIndex.h"
+#include "Patch/InstrRules.h"
+#include "Patch/MemoryAccess.h"
 #include "Patch/Patch.h"
-#include "Patch/PatchRule.h"
+#include "Patch/PatchCondition.h"
 #include "Patch/PatchRules.h"
+#include "Patch/PatchUtils.h"
 #include "Utility/LogSys.h"
+#include "Utility/System.h"
 
 #include "QBDI/Bitmask.h"
 #include "QBDI/Config.h"
@@ -50,18 +60,27 @@
 
 namespace QBDI {
 
+static VMAction stopCallback(VMInstanceRef vm, GPRState *gprState,
+                             FPRState *fprState, void *data) {
+  return VMAction::STOP;
+}
+
 Engine::Engine(const std::string &_cpu, const std::vector<std::string> &_mattrs,
                Options opts, VMInstanceRef vminstance)
     : vminstance(vminstance), instrRulesCounter(0), vmCallbacksCounter(0),
       curCPUMode(CPUMode::DEFAULT), options(opts), eventMask(VMEvent::NO_EVENT),
-      running(false) {
+      running(false), execBlockCodeSize(0), execBlockDataSize(0),
+      cacheBudget(0), persistentHits(0), pretranslated(0), patchCacheUsage(0),
+      stopAddress(0) {
 
   llvmCPUs = std::make_unique<LLVMCPUs>(_cpu, _mattrs, opts);
   blockManager = std::make_unique<ExecBlockManager>(*llvmCPUs, vminstance);
   execBroker = blockManager->getExecBroker();
+  instrRuleIndex = std::make_unique<InstrRuleIndex>();
 
   // Get default Patch rules for this architecture
-  patchRules = getDefaultPatchRules(options);
+  patcher = std::make_unique<Patcher>(*llvmCPUs, options);
+  updateTranslator();
 
   gprState = std::make_unique<GPRState>();
   fprState = std::make_unique<FPRState>();
@@ -72,6 +91,7 @@ Engine::Engine(const std::string &_cpu, const std::vector<std::string> &_mattrs,
   initFPRState();
 
   curExecBlock = nullptr;
+  updateChaining();
 }
 
 Engine::~Engine() = default;
@@ -82,21 +102,32 @@ Engine::Engine(const Engine &other)
       vmCallbacks(other.vmCallbacks),
       vmCallbacksCounter(other.vmCallbacksCounter),
       curCPUMode(CPUMode::DEFAULT), options(other.options),
-      eventMask(other.eventMask), running(false) {
+      eventMask(other.eventMask), running(false),
+      execBlockCodeSize(other.execBlockCodeSize),
+      execBlockDataSize(other.execBlockDataSize),
+      cacheBudget(other.cacheBudget), persistentHits(0), pretranslated(0),
+      patchCacheUsage(0), stopAddress(0) {
 
   llvmCPUs = std::make_unique<LLVMCPUs>(
       other.llvmCPUs->getCPU(), other.llvmCPUs->getMattrs(), other.options);
-  blockManager = std::make_unique<ExecBlockManager>(*llvmCPUs, nullptr);
+  blockManager = std::make_unique<ExecBlockManager>(
+      *llvmCPUs, nullptr, execBlockCodeSize, execBlockDataSize);
+  blockManager->setMemoryBudget(execBlockBudget());
   execBroker = blockManager->getExecBroker();
   // copy instrumentation range
   execBroker->setInstrumentedRange(other.execBroker->getInstrumentedRange());
+  instrRuleIndex = std::make_unique<InstrRuleIndex>();
 
   // Get default Patch rules for this architecture
-  patchRules = getDefaultPatchRules(options);
+  patcher = std::make_unique<Patcher>(*llvmCPUs, options);
+  updateTranslator();
 
-  // Copy unique_ptr of instrRules
+  // Copy unique_ptr of instrRules. The memory trace buffer isn't shared.
   for (const auto &r : other.instrRules) {
-    instrRules.emplace_back(r.first, r.second->clone());
+    if (std::find(other.memTraceRules.begin(), other.memTraceRules.end(),
+                  r.first) == other.memTraceRules.end()) {
+      instrRules.emplace_back(r.first, r.second->clone());
+    }
   }
 
   gprState = std::make_unique<GPRState>();
@@ -106,11 +137,17 @@ Engine::Engine(const Engine &other)
   setGPRState(other.getGPRState());
   setFPRState(other.getFPRState());
 
+  if (other.persistentCache) {
+    setPersistentCache(other.persistentCache->getDirectory());
+  }
+
   curExecBlock = nullptr;
+  updateChaining();
 }
 
 Engine &Engine::operator=(const Engine &other) {
   QBDI_REQUIRE_ACTION(not running && "Cannot assign a running Engine", abort());
+  this->removeMemoryTrace();
   this->clearAllCache();
 
   if (not llvmCPUs->isSameCPU(*other.llvmCPUs)) {
@@ -119,21 +156,39 @@ Engine &Engine::operator=(const Engine &other) {
     llvmCPUs = std::make_unique<LLVMCPUs>(
         other.llvmCPUs->getCPU(), other.llvmCPUs->getMattrs(), other.options);
 
-    blockManager = std::make_unique<ExecBlockManager>(*llvmCPUs, nullptr);
+    blockManager = std::make_unique<ExecBlockManager>(
+        *llvmCPUs, nullptr, execBlockCodeSize, execBlockDataSize);
+    blockManager->setMemoryBudget(execBlockBudget());
     execBroker = blockManager->getExecBroker();
+    patcher = std::make_unique<Patcher>(*llvmCPUs, options);
+    // the translator thread decodes for the previous CPU
+    translator.reset();
+    updateTranslator();
   }
 
   this->setOptions(other.options);
-
-  // copy the configuration
+  this->setExecBlockSize(other.execBlockCodeSize, other.execBlockDataSize);
+  this->setCacheBudget(other.cacheBudget);
+  // the cache files depend on the CPU
+  persistentCache.reset();
+  this->setPersistentCache(other.persistentCache
+                               ? other.persistentCache->getDirectory()
+                               : "");
+
+  // copy the configuration. The memory trace buffer isn't shared.
+  instrRuleIndex->invalidate();
   instrRules.clear();
   for (const auto &r : other.instrRules) {
-    instrRules.emplace_back(r.first, r.second->clone());
+    if (std::find(other.memTraceRules.begin(), other.memTraceRules.end(),
+                  r.first) == other.memTraceRules.end()) {
+      instrRules.emplace_back(r.first, r.second->clone());
+    }
   }
   vmCallbacks = other.vmCallbacks;
   instrRulesCounter = other.instrRulesCounter;
   vmCallbacksCounter = other.vmCallbacksCounter;
   eventMask = other.eventMask;
+  updateChaining();
 
   // copy instrumentation range
   execBroker->setInstrumentedRange(other.execBroker->getInstrumentedRange());
@@ -152,26 +207,74 @@ void Engine::setOptions(Options options) {
     QBDI_DEBUG("Change Options from {:x} to {:x}", this->options, options);
     clearAllCache();
     llvmCPUs->setOptions(options);
+    // the translator thread decodes with the previous options
+    translator.reset();
 
-    Options needRecreate =
-        Options::OPT_DISABLE_FPR | Options::OPT_DISABLE_OPTIONAL_FPR;
+    Options needRecreate = Options::OPT_DISABLE_FPR |
+                           Options::OPT_DISABLE_OPTIONAL_FPR |
+                           Options::OPT_ENABLE_DUAL_MAPPING;
 #if defined(QBDI_ARCH_X86_64)
-    needRecreate |= Options::OPT_ENABLE_FS_GS;
+    // the epilogue probes the indirect branch target cache with the chaining
+    needRecreate |= Options::OPT_ENABLE_FS_GS |
+                    Options::OPT_ENABLE_BLOCK_CHAINING;
 #endif // QBDI_ARCH_X86_64
+#if defined(QBDI_ARCH_X86_64) || defined(QBDI_ARCH_X86)
+    needRecreate |= Options::OPT_ENABLE_XSAVE;
+#endif
 
     // need to recreate all ExecBlock
     if (((this->options ^ options) & needRecreate) != 0) {
       const RangeSet<rword> instrumentationRange =
           execBroker->getInstrumentedRange();
 
-      patchRules = getDefaultPatchRules(options);
-      blockManager = std::make_unique<ExecBlockManager>(*llvmCPUs, vminstance);
+      std::map<rword, uint64_t> bbCounters = blockManager->getBBCounters();
+
+      patcher = std::make_unique<Patcher>(*llvmCPUs, options);
+      blockManager = std::make_unique<ExecBlockManager>(
+          *llvmCPUs, vminstance, execBlockCodeSize, execBlockDataSize);
+      blockManager->setMemoryBudget(execBlockBudget());
+      blockManager->setBBCounters(std::move(bbCounters));
       execBroker = blockManager->getExecBroker();
 
       execBroker->setInstrumentedRange(instrumentationRange);
     }
     this->options = options;
+    updateChaining();
+    updateTranslator();
+  }
+}
+
+bool Engine::setExecBlockSize(size_t codeSize, size_t dataSize) {
+  QBDI_REQUIRE_ACTION(
+      not running && "Cannot setExecBlockSize on a running Engine", abort());
+  if (not ExecBlock::isValidBlockSize(codeSize) or
+      not ExecBlock::isValidBlockSize(dataSize)) {
+    QBDI_ERROR("Invalid ExecBlock size: code 0x{:x}, data 0x{:x}", codeSize,
+               dataSize);
+    return false;
   }
+  if (codeSize != execBlockCodeSize or dataSize != execBlockDataSize) {
+    QBDI_DEBUG("Change ExecBlock size to code 0x{:x}, data 0x{:x}", codeSize,
+               dataSize);
+    clearAllCache();
+    execBlockCodeSize = codeSize;
+    execBlockDataSize = dataSize;
+
+    // need to recreate all ExecBlock
+    const RangeSet<rword> instrumentationRange =
+        execBroker->getInstrumentedRange();
+    std::map<rword, uint64_t> bbCounters = blockManager->getBBCounters();
+
+    blockManager = std::make_unique<ExecBlockManager>(
+        *llvmCPUs, vminstance, execBlockCodeSize, execBlockDataSize);
+    blockManager->setMemoryBudget(execBlockBudget());
+    blockManager->setBBCounters(std::move(bbCounters));
+    execBroker = blockManager->getExecBroker();
+
+    execBroker->setInstrumentedRange(instrumentationRange);
+    updateChaining();
+  }
+  return true;
 }
 
 void Engine::changeVMInstanceRef(VMInstanceRef vminstance) {
@@ -242,101 +345,72 @@ bool Engine::instrumentAllExecutableMaps() {
 }
 
 void Engine::removeInstrumentedRange(rword start, rword end) {
+  // Linked sequences are executed without checking the instrumented range
+  blockManager->unlinkChains();
   execBroker->removeInstrumentedRange(Range<rword>(start, end));
 }
 
 bool Engine::removeInstrumentedModule(const std::string &name) {
+  blockManager->unlinkChains();
   return execBroker->removeInstrumentedModule(name);
 }
 
 bool Engine::removeInstrumentedModuleFromAddr(rword addr) {
+  blockManager->unlinkChains();
   return execBroker->removeInstrumentedModuleFromAddr(addr);
 }
 
 void Engine::removeAllInstrumentedRanges() {
+  blockManager->unlinkChains();
   execBroker->removeAllInstrumentedRanges();
 }
 
 std::vector<Patch> Engine::patch(rword start) {
   std::vector<Patch> basicBlock;
-  const LLVMCPU &llvmcpu = llvmCPUs->getCPU(curCPUMode);
-  const llvm::ArrayRef<uint8_t> code((uint8_t *)start, (size_t)-1);
-  bool basicBlockEnd = false;
-  rword i = 0;
-  QBDI_DEBUG("Patching basic block at address 0x{:x}", start);
-
-  // Get Basic block
-  while (not basicBlockEnd) {
-    llvm::MCInst inst;
-    llvm::MCDisassembler::DecodeStatus dstatus;
-    rword address = start;
-    Patch *patch = nullptr;
-    uint64_t instSize = 0;
-
-    // Aggregate a complete patch
-    do {
-      // Disassemble
-      rword prev_address = address;
-      address = start + i;
-      dstatus = llvmcpu.getInstruction(inst, instSize, code.slice(i), address);
-      if (llvm::MCDisassembler::Success != dstatus) {
-        QBDI_DEBUG("Bump into invalid instruction at address {:x}", address);
-        // Current instruction is invalid, stop the basic block right here
-        if (prev_address == address) {
-          QBDI_CRITICAL(
-              "Disassembly error : fail to parse address 0x{:x} ({:n})",
-              address,
-              spdlog::to_hex(reinterpret_cast<uint8_t *>(address),
-                             reinterpret_cast<uint8_t *>(address + 16)));
-          abort();
-        } else {
-          address = prev_address;
-          basicBlockEnd = true;
-          break;
-        }
-      }
-      QBDI_REQUIRE_ACTION(llvm::MCDisassembler::Success == dstatus, abort());
-      QBDI_DEBUG_BLOCK({
-        std::string disass = llvmcpu.showInst(inst, address);
-        QBDI_DEBUG("Patching 0x{:x} {}", address, disass.c_str());
-      });
-      // Patch & merge
-      for (uint32_t j = 0; j < patchRules.size(); j++) {
-        if (patchRules[j].canBeApplied(inst, address, instSize, llvmcpu)) {
-          QBDI_DEBUG("Patch rule {} applied", j);
-          if (patch == nullptr) {
-            basicBlock.push_back(
-                patchRules[j].generate(inst, address, instSize, llvmcpu));
-            patch = &basicBlock.back();
-          } else {
-            QBDI_DEBUG("Previous instruction merged");
-            *patch =
-                patchRules[j].generate(inst, address, instSize, llvmcpu, patch);
-          }
-          break;
-        }
-      }
-      QBDI_REQUIRE_ACTION(patch != nullptr, abort());
-      i += instSize;
-    } while (patch->metadata.merge);
+  if (not patcher->patch(basicBlock, start, curCPUMode,
+                         persistentCache.get())) {
+    QBDI_CRITICAL("Disassembly error : fail to parse address 0x{:x} ({:n})",
+                  start,
+                  spdlog::to_hex(reinterpret_cast<uint8_t *>(start),
+                                 reinterpret_cast<uint8_t *>(start + 16)));
+    abort();
+  }
+  return basicBlock;
+}
 
-    if (patch) {
-      QBDI_DEBUG("Patch of size {:x} generated", patch->metadata.patchSize);
+void Engine::requestSuccessors(const Patch &last) {
+  std::vector<rword> successors;
+  getStaticSuccessors(last.metadata, successors);
+  for (rword target : successors) {
+    if (patchCache.count(target) != 0 or
+        blockManager->getExecBlock(target) != nullptr) {
+      continue;
     }
-
-    if (basicBlockEnd || patch->metadata.modifyPC) {
-      QBDI_DEBUG(
-          "Basic block starting at address 0x{:x} ended at address 0x{:x}",
-          start, address);
-      basicBlockEnd = true;
+    // The thread doesn't read the code past the instrumented range, which
+    // may be followed by unmapped memory
+    std::vector<Range<rword>> instrumented =
+        execBroker->getInstrumentedRange().getOverlappingRanges(
+            Range<rword>(target, target + 1));
+    if (not instrumented.empty()) {
+      translator->request(target, instrumented.front().end(), curCPUMode);
     }
   }
+}
 
-  return basicBlock;
+void Engine::updateTranslator() {
+  if ((options & Options::OPT_ENABLE_PRETRANSLATION) == 0) {
+    translator.reset();
+  } else if (not translator) {
+    QBDI_DEBUG("Start the translator thread");
+    translator = std::make_unique<Translator>(*llvmCPUs);
+  }
 }
 
 void Engine::instrument(std::vector<Patch> &basicBlock, size_t patchEnd) {
   const LLVMCPU &llvmcpu = llvmCPUs->getCPU(curCPUMode);
+  if (not instrRuleIndex->isValid()) {
+    instrRuleIndex->build(instrRules);
+  }
   QBDI_DEBUG(
       "Instrumenting sequence [0x{:x}, 0x{:x}] in basic block [0x{:x}, 0x{:x}]",
       basicBlock.front().metadata.address,
@@ -352,25 +426,123 @@ void Engine::instrument(std::vector<Patch> &basicBlock, size_t patchEnd) {
                  disass.c_str());
     });
     // Instrument
-    for (const auto &item : instrRules) {
+    for (uint32_t pos : instrRuleIndex->getCandidates(patch, llvmcpu)) {
+      const auto &item = instrRules[pos];
       const InstrRule *rule = item.second.get();
       if (rule->tryInstrument(patch, llvmcpu)) {
         QBDI_DEBUG("Instrumentation rule {:x} applied", item.first);
       }
     }
+    if (stopRule and patch.metadata.address == stopAddress) {
+      stopRule->tryInstrument(patch, llvmcpu);
+    }
     patch.finalizeInstsPatch();
   }
 }
 
 void Engine::handleNewBasicBlock(rword pc) {
-  // disassemble and patch new basic block
-  Patch::Vec basicBlock = patch(pc);
+  Patch::Vec basicBlock;
+  // Reuse the patched basic block if only the instrumentation changed
+  auto it = patchCache.find(pc);
+  if (it != patchCache.end() and
+      it->second.front().metadata.cpuMode == curCPUMode) {
+    basicBlock.reserve(it->second.size());
+    for (const Patch &p : it->second) {
+      basicBlock.push_back(p.clone());
+    }
+  } else {
+    // Commit the basic block decoded ahead by the translator thread, or
+    // disassemble and patch new basic block
+    if (translator and translator->take(basicBlock, pc, curCPUMode,
+                                        llvmCPUs->getCPU(curCPUMode))) {
+      pretranslated++;
+    } else {
+      basicBlock = patch(pc);
+    }
+    cachePatches(pc, basicBlock);
+  }
+  // Decode the successors before they are reached
+  if (translator) {
+    requestSuccessors(basicBlock.back());
+  }
+  writeNewBasicBlock(std::move(basicBlock));
+}
+
+void Engine::writeNewBasicBlock(Patch::Vec &&basicBlock) {
+  // Remember the PLT stubs to jump over them
+  execBroker->registerStub(basicBlock);
   // Reserve cache and get uncached instruction
   size_t patchEnd = blockManager->preWriteBasicBlock(basicBlock);
   // instrument uncached instruction
   instrument(basicBlock, patchEnd);
   // Write in the cache
   blockManager->writeBasicBlock(std::move(basicBlock), patchEnd);
+  // The patched basic blocks of the evicted regions are dropped too
+  dropPatches(blockManager->takeEvictedRange());
+}
+
+static size_t patchesMemoryUsage(const Patch::Vec &basicBlock) {
+  size_t usage = basicBlock.capacity() * sizeof(Patch);
+  for (const Patch &p : basicBlock) {
+    usage += p.insts.capacity() * sizeof(std::unique_ptr<RelocatableInst>) +
+             p.insts.size() * sizeof(llvm::MCInst);
+  }
+  return usage;
+}
+
+void Engine::cachePatches(rword address, const Patch::Vec &basicBlock) {
+  auto it = patchCache.find(address);
+  if (it != patchCache.end()) {
+    patchCacheUsage -= patchesMemoryUsage(it->second);
+    patchCache.erase(it);
+  }
+  size_t usage = patchesMemoryUsage(basicBlock);
+  size_t limit = patchCacheLimit();
+  if (usage > limit) {
+    return;
+  }
+  shrinkPatchCache(limit - usage);
+  Patch::Vec &cached = patchCache[address];
+  cached.reserve(basicBlock.size());
+  for (const Patch &p : basicBlock) {
+    cached.push_back(p.clone());
+  }
+  patchCacheUsage += patchesMemoryUsage(cached);
+}
+
+void Engine::shrinkPatchCache(size_t limit) {
+  // The patchCache only avoids decoding again, any entry can be dropped
+  for (auto it = patchCache.begin();
+       it != patchCache.end() and patchCacheUsage > limit;) {
+    patchCacheUsage -= patchesMemoryUsage(it->second);
+    it = patchCache.erase(it);
+  }
+}
+
+void Engine::dropPatches(const RangeSet<rword> &ranges) {
+  if (ranges.size() == 0) {
+    return;
+  }
+  for (auto it = patchCache.begin(); it != patchCache.end();) {
+    if (ranges.overlaps(Range<rword>(
+            it->first, it->second.back().metadata.endAddress()))) {
+      patchCacheUsage -= patchesMemoryUsage(it->second);
+      it = patchCache.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+size_t Engine::patchCacheLimit() const {
+  if (cacheBudget == 0) {
+    return PATCH_CACHE_MAX_USAGE;
+  }
+  return cacheBudget / 4;
+}
+
+size_t Engine::execBlockBudget() const {
+  return cacheBudget - cacheBudget / 4;
 }
 
 bool Engine::precacheBasicBlock(rword pc) {
@@ -390,6 +562,79 @@ bool Engine::precacheBasicBlock(rword pc) {
   return true;
 }
 
+bool Engine::precacheRanges(const RangeSet<rword> &ranges,
+                            PrecacheReport *report, unsigned threads) {
+  QBDI_REQUIRE_ACTION(
+      not running && "Cannot precacheRanges on a running Engine", abort());
+  auto startTime = std::chrono::steady_clock::now();
+  if (blockManager->isFlushPending()) {
+    // Commit the flush
+    blockManager->flushCommit();
+  }
+
+  RangeSet<rword> targets = ranges;
+  targets.intersect(execBroker->getInstrumentedRange());
+  std::vector<rword> entries;
+  for (const Range<rword> &r : targets.getRanges()) {
+    entries.push_back(r.start());
+    getModuleEntryPoints(r.start(), entries);
+  }
+  if (threads == 0) {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  if (threads > PRECACHE_MAX_THREADS) {
+    threads = PRECACHE_MAX_THREADS;
+  }
+  std::map<rword, Patch::Vec> basicBlocks;
+  size_t nbEntries = discoverBasicBlocks(basicBlocks, *llvmCPUs, targets,
+                                         entries, curCPUMode, threads);
+  auto discoveryTime = std::chrono::steady_clock::now();
+
+  // Write the basic blocks in a single pass, in the order of their addresses
+  RangeSet<rword> covered;
+  size_t newBasicBlocks = 0;
+  running = true;
+  for (auto &it : basicBlocks) {
+    covered.add(
+        Range<rword>(it.first, it.second.back().metadata.endAddress()));
+    if (blockManager->isFlushPending()) {
+      // The memory budget evicted some regions
+      blockManager->flushCommit();
+    }
+    if (blockManager->getExecBlock(it.first) != nullptr) {
+      // already in cache
+      continue;
+    }
+    cachePatches(it.first, it.second);
+    writeNewBasicBlock(std::move(it.second));
+    newBasicBlocks++;
+  }
+  running = false;
+  covered.intersect(targets);
+  auto writeTime = std::chrono::steady_clock::now();
+
+  QBDI_DEBUG("Precache {} basic blocks ({} new) covering 0x{:x} of 0x{:x} "
+             "bytes from {} entry points",
+             basicBlocks.size(), newBasicBlocks, covered.size(),
+             targets.size(), nbEntries);
+  if (report != nullptr) {
+    report->entryPoints = nbEntries;
+    report->basicBlocks = basicBlocks.size();
+    report->newBasicBlocks = newBasicBlocks;
+    report->coveredBytes = covered.size();
+    report->rangeBytes = targets.size();
+    report->threads = threads;
+    report->discoveryTime =
+        std::chrono::duration_cast<std::chrono::microseconds>(discoveryTime -
+                                                              startTime)
+            .count();
+    report->writeTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                            writeTime - discoveryTime)
+                            .count();
+  }
+  return not basicBlocks.empty();
+}
+
 bool Engine::run(rword start, rword stop) {
   QBDI_REQUIRE_ACTION(not running && "Cannot run an already running Engine",
                       abort());
@@ -401,34 +646,71 @@ bool Engine::run(rword start, rword stop) {
 
   rword basicBlockBeginAddr = 0;
   rword basicBlockEndAddr = 0;
+  // end of the last sequence, to find the backward branches
+  rword lastSeqEnd = 0;
 
   // Start address is out of range
   if (!execBroker->isInstrumented(start)) {
     return false;
   }
 
+  setStopAddress(stop);
   running = true;
 
   // Execute basic block per basic block
   do {
     VMAction action = CONTINUE;
 
-    // If this PC is not instrumented try to transfer execution
-    if (execBroker->isInstrumented(currentPC) == false &&
-        execBroker->canTransferExecution(curGPRState)) {
+    // Jump over a stub bound to a non-instrumented function if nothing
+    // observes it: the transfer starts from the target.
+    rword stubTarget = execBroker->getStubTarget(currentPC);
+    if (stubTarget != 0 and stubTarget != stop and
+        not execBroker->isInstrumented(stubTarget) and
+        canSkipStub(currentPC)) {
+      QBDI_DEBUG("Skip the stub at 0x{:x} to 0x{:x}", currentPC, stubTarget);
+      QBDI_GPR_SET(curGPRState, REG_PC, stubTarget);
+      currentPC = stubTarget;
+    }
 
+    // If this PC is not instrumented try to transfer execution
+    rword *returnPoint = nullptr;
+    if (execBroker->isInstrumented(currentPC) == false) {
+      returnPoint = execBroker->getReturnPoint(curGPRState);
+    }
+    if (returnPoint != nullptr) {
+
+      // Run the transfer on the context of the last ExecBlock if it holds
+      // the current state, to avoid copying the state in and out.
+      ExecBlock *liveBlock = nullptr;
+      if (curExecBlock != nullptr and
+          &(curExecBlock->getContext()->gprState) == curGPRState and
+          &(curExecBlock->getContext()->fprState) == curFPRState) {
+        liveBlock = curExecBlock;
+      }
       curExecBlock = nullptr;
       basicBlockBeginAddr = 0;
       basicBlockEndAddr = 0;
+      lastSeqEnd = 0;
+      // A trace doesn't follow the non-instrumented code
+      if (not tracePath.empty()) {
+        finishTrace(false);
+      }
 
       QBDI_DEBUG("Executing 0x{:x} through execBroker", currentPC);
-      action = signalEvent(EXEC_TRANSFER_CALL, currentPC, nullptr, 0,
-                           curGPRState, curFPRState);
+      if ((eventMask & EXEC_TRANSFER_CALL) != 0) {
+        action = signalEvent(EXEC_TRANSFER_CALL, currentPC, nullptr, 0,
+                             curGPRState, curFPRState);
+      }
       // transfer execution
       if (action == CONTINUE) {
-        execBroker->transferExecution(currentPC, curGPRState, curFPRState);
-        action = signalEvent(EXEC_TRANSFER_RETURN, currentPC, nullptr, 0,
-                             curGPRState, curFPRState);
+        Context *context = execBroker->transferExecution(
+            currentPC, curGPRState, curFPRState, returnPoint, liveBlock);
+        curGPRState = &(context->gprState);
+        curFPRState = &(context->fprState);
+        if ((eventMask & EXEC_TRANSFER_RETURN) != 0) {
+          action = signalEvent(EXEC_TRANSFER_RETURN, currentPC, nullptr, 0,
+                               curGPRState, curFPRState);
+        }
       }
     }
     // Else execute through DBI
@@ -464,6 +746,14 @@ bool Engine::run(rword start, rword stop) {
         QBDI_REQUIRE_ACTION(curExecBlock != nullptr, abort());
       }
 
+      // Count the dispatches to find the hot traces
+      if (blockManager->isTracing() and
+          recordTrace(currentPC, currentPC < lastSeqEnd)) {
+        curExecBlock =
+            blockManager->getProgrammedExecBlock(currentPC, &currentSequence);
+        QBDI_REQUIRE_ACTION(curExecBlock != nullptr, abort());
+      }
+
       if (basicBlockEndAddr == 0) {
         event |= BASIC_BLOCK_ENTRY;
         basicBlockEndAddr = currentSequence.bbEnd;
@@ -482,11 +772,23 @@ bool Engine::run(rword start, rword stop) {
       action = signalEvent(event, currentPC, &currentSequence,
                            basicBlockBeginAddr, curGPRState, curFPRState);
 
+      if (action == CONTINUE and not memTraceRules.empty()) {
+        action = reserveMemoryTrace(curExecBlock, currentSequence.seqID);
+      }
+
       if (action == CONTINUE) {
         hasRan = true;
+        // A trace also runs over several basic blocks
+        bool chained = blockManager->isChaining() or blockManager->isTracing();
         action = curExecBlock->execute();
+        lastSeqEnd = currentSequence.seqEnd;
         // Signal events if normal exit
-        if (action == CONTINUE) {
+        if (chained) {
+          // The sequence may have jumped to other ones, the current basic
+          // block is unknown.
+          basicBlockBeginAddr = 0;
+          basicBlockEndAddr = 0;
+        } else if (action == CONTINUE) {
           if (basicBlockEndAddr == currentSequence.seqEnd) {
             action = signalEvent(SEQUENCE_EXIT | BASIC_BLOCK_EXIT, currentPC,
                                  &currentSequence, basicBlockBeginAddr,
@@ -513,6 +815,15 @@ bool Engine::run(rword start, rword stop) {
     QBDI_DEBUG("Next address to execute is 0x{:x}", currentPC);
   } while (currentPC != stop);
 
+  if (not tracePath.empty()) {
+    finishTrace(false);
+  }
+
+  // Drain the memory trace buffer
+  if (not memTraceRules.empty()) {
+    flushMemoryTrace();
+  }
+
   // Copy final context
   *gprState = *curGPRState;
   *fprState = *curFPRState;
@@ -540,6 +851,7 @@ uint32_t Engine::addInstrRule(std::unique_ptr<InstrRule> &&rule) {
                                       b.second->getPriority();
                              });
   instrRules.insert(it, std::move(v));
+  instrRuleIndex->invalidate();
 
   return id;
 }
@@ -562,6 +874,7 @@ uint32_t Engine::addVMEventCB(VMEvent mask, VMCallback cbk, void *data) {
   QBDI_REQUIRE_ACTION(id < EVENTID_VM_MASK, return VMError::INVALID_EVENTID);
   vmCallbacks.emplace_back(id, CallbackRegistration{mask, cbk, data});
   eventMask |= mask;
+  updateChaining();
   return id | EVENTID_VM_MASK;
 }
 
@@ -627,6 +940,11 @@ bool Engine::deleteInstrumentation(uint32_t id) {
     for (size_t i = 0; i < vmCallbacks.size(); i++) {
       if (vmCallbacks[i].first == id) {
         vmCallbacks.erase(vmCallbacks.begin() + i);
+        eventMask = VMEvent::NO_EVENT;
+        for (const auto &cb : vmCallbacks) {
+          eventMask |= cb.second.mask;
+        }
+        updateChaining();
         return true;
       }
     }
@@ -635,6 +953,7 @@ bool Engine::deleteInstrumentation(uint32_t id) {
       if (instrRules[i].first == id) {
         this->clearCache(instrRules[i].second->affectedRange());
         instrRules.erase(instrRules.begin() + i);
+        instrRuleIndex->invalidate();
         return true;
       }
     }
@@ -643,26 +962,306 @@ bool Engine::deleteInstrumentation(uint32_t id) {
 }
 
 void Engine::deleteAllInstrumentations() {
+  if (not memTraceRules.empty()) {
+    flushMemoryTrace();
+    memTraceRules.clear();
+  }
   // clear cache
   for (const auto &r : instrRules) {
     this->clearCache(r.second->affectedRange());
   }
   instrRules.clear();
+  instrRuleIndex->invalidate();
   vmCallbacks.clear();
   instrRulesCounter = 0;
   vmCallbacksCounter = 0;
   eventMask = VMEvent::NO_EVENT;
+  updateChaining();
+}
+
+bool Engine::canSkipStub(rword address) {
+  const VMEvent seqEvents = SEQUENCE_ENTRY | SEQUENCE_EXIT | BASIC_BLOCK_ENTRY |
+                            BASIC_BLOCK_EXIT | BASIC_BLOCK_NEW;
+  if ((eventMask & seqEvents) != 0) {
+    return false;
+  }
+  if (not instrRuleIndex->isValid()) {
+    instrRuleIndex->build(instrRules);
+  }
+  return not instrRuleIndex->mayInstrument(address);
+}
+
+void Engine::setStopAddress(rword stop) {
+  if (stopRule and stop == stopAddress) {
+    return;
+  }
+  // A stop address outside of the instrumented ranges is never translated:
+  // the ExecBlocks always return to the dispatcher before jumping to it.
+  RangeSet<rword> affected;
+  affected.add(Range<rword>(stopAddress, stopAddress + 1));
+  affected.add(Range<rword>(stop, stop + 1));
+  stopAddress = stop;
+  stopRule = InstrRuleBasicCBK::unique(AddressIs::unique(stop), stopCallback,
+                                       nullptr, PREINST, true, PRIORITY_DEFAULT,
+                                       RelocTagPreInstStdCBK);
+  clearCache(affected);
 }
 
-void Engine::clearAllCache() { blockManager->clearCache(not running); }
+void Engine::updateChaining() {
+  // BASIC_BLOCK_NEW is still signaled as a link never targets an unknown
+  // sequence
+  const VMEvent seqEvents = SEQUENCE_ENTRY | SEQUENCE_EXIT |
+                            BASIC_BLOCK_ENTRY | BASIC_BLOCK_EXIT;
+  // The memory trace buffer is reserved before each sequence
+  // The dispatches are counted while a trace is recorded
+  blockManager->setChaining(
+      (options & Options::OPT_ENABLE_BLOCK_CHAINING) != 0 and
+      (eventMask & seqEvents) == 0 and memTraceRules.empty() and
+      tracePath.empty());
+#if defined(QBDI_ARCH_X86_64)
+  blockManager->setTracing((options & Options::OPT_ENABLE_HOT_TRACES) != 0 and
+                           (eventMask & seqEvents) == 0 and
+                           memTraceRules.empty());
+#endif
+  if (not blockManager->isTracing()) {
+    tracePath.clear();
+  }
+}
+
+bool Engine::recordTrace(rword address, bool backward) {
+  if (tracePath.empty()) {
+    if (blockManager->countTraceHead(address, backward) and
+        patchCache.count(address) != 0) {
+      QBDI_DEBUG("Record a trace from the hot head 0x{:x}", address);
+      tracePath.push_back(address);
+      updateChaining();
+    }
+    return false;
+  }
+  if (address == tracePath.front()) {
+    return finishTrace(true);
+  }
+  auto last = patchCache.find(tracePath.back());
+  if (last != patchCache.end() and last->first < address and
+      address < last->second.back().metadata.endAddress()) {
+    // Next sequence of the same basic block
+    return false;
+  }
+  if (tracePath.size() < TRACE_MAX_BLOCKS and patchCache.count(address) != 0) {
+    tracePath.push_back(address);
+    return false;
+  }
+  return finishTrace(false);
+}
+
+bool Engine::finishTrace(bool loop) {
+  std::vector<rword> path;
+  std::swap(path, tracePath);
+  updateChaining();
+
+  Patch::Vec trace;
+  size_t nbBlocks = 0;
+  for (rword address : path) {
+    auto it = patchCache.find(address);
+    if (it == patchCache.end() or
+        it->second.front().metadata.cpuMode != curCPUMode) {
+      break;
+    }
+    // The basic blocks are only joined by the branches of the trace
+    if (not trace.empty() and not trace.back().metadata.modifyPC and
+        trace.back().metadata.endAddress() != address) {
+      break;
+    }
+    Patch::Vec basicBlock;
+    basicBlock.reserve(it->second.size());
+    for (const Patch &p : it->second) {
+      basicBlock.push_back(p.clone());
+    }
+    instrument(basicBlock, basicBlock.size());
+    std::move(basicBlock.begin(), basicBlock.end(), std::back_inserter(trace));
+    nbBlocks++;
+  }
+  loop = loop and nbBlocks == path.size();
+  if (nbBlocks < (loop ? 1 : 2)) {
+    return false;
+  }
+  QBDI_DEBUG("Write a trace of {} basic blocks from 0x{:x}", nbBlocks,
+             path.front());
+  return blockManager->writeTrace(std::move(trace), loop);
+}
+
+bool Engine::setMemoryTrace(MemoryAccessType type, MemoryAccess *buffer,
+                            size_t size, size_t highWaterMark,
+                            MemTraceCallback cbk, void *data) {
+  QBDI_REQUIRE_ACTION(
+      not running && "Cannot set a memory trace buffer on a running Engine",
+      return false);
+  if (buffer == nullptr or cbk == nullptr or highWaterMark == 0 or
+      highWaterMark > size or (type & MEMORY_READ_WRITE) == 0) {
+    QBDI_ERROR("Invalid memory trace buffer");
+    return false;
+  }
+  removeMemoryTrace();
+
+  // The state is kept until the Engine is destroyed, as the instrumented code
+  // of the current sequence may still use it.
+  if (memTrace == nullptr) {
+    memTrace = std::make_unique<MemTraceState>();
+  }
+  *memTrace = MemTraceState{buffer, buffer, size, highWaterMark, cbk, data};
+
+  std::vector<std::unique_ptr<InstrRule>> rules;
+  if (type & MEMORY_READ) {
+    append(rules, getInstrRuleMemTraceRead());
+  }
+  if (type & MEMORY_WRITE) {
+    append(rules, getInstrRuleMemTraceWrite());
+  }
+  for (auto &r : rules) {
+    uint32_t id = addInstrRule(std::move(r));
+    if (id != VMError::INVALID_EVENTID) {
+      memTraceRules.push_back(id);
+    }
+  }
+  updateChaining();
+  return not memTraceRules.empty();
+}
+
+bool Engine::removeMemoryTrace() {
+  QBDI_REQUIRE_ACTION(
+      not running && "Cannot remove a memory trace buffer on a running Engine",
+      return false);
+  if (memTraceRules.empty()) {
+    return false;
+  }
+  flushMemoryTrace();
+  for (uint32_t id : memTraceRules) {
+    deleteInstrumentation(id);
+  }
+  memTraceRules.clear();
+  updateChaining();
+  return true;
+}
+
+VMAction Engine::reserveMemoryTrace(ExecBlock *block, uint16_t seqID) {
+  size_t records = block->getSeqMemTraceRecords(seqID);
+  block->getContext()->hostState.memTrace =
+      reinterpret_cast<rword>(memTrace.get());
+
+  if (records == 0) {
+    return CONTINUE;
+  }
+  if (records > memTrace->size) {
+    QBDI_ERROR("The memory trace buffer is too small: {} entries for {} "
+               "records in a sequence",
+               memTrace->size, records);
+    return STOP;
+  }
+  size_t used = memTrace->cursor - memTrace->buffer;
+  if (used >= memTrace->highWaterMark or memTrace->size - used < records) {
+    return flushMemoryTrace();
+  }
+  return CONTINUE;
+}
+
+VMAction Engine::flushMemoryTrace() {
+  size_t used = memTrace->cursor - memTrace->buffer;
+  if (used == 0) {
+    return CONTINUE;
+  }
+  memTrace->cursor = memTrace->buffer;
+  if (memTrace->cbk(vminstance, memTrace->buffer, used, memTrace->data) ==
+      STOP) {
+    return STOP;
+  }
+  return CONTINUE;
+}
+
+void Engine::clearAllCache() {
+  patchCache.clear();
+  patchCacheUsage = 0;
+  if (translator) {
+    translator->discardAll();
+  }
+  blockManager->clearCache(not running);
+}
 
 void Engine::clearCache(rword start, rword end) {
-  blockManager->clearCache(Range<rword>(start, end));
+  // The code may have changed, the patched basic blocks are dropped too
+  Range<rword> range(start, end);
+  RangeSet<rword> dropped;
+  dropped.add(range);
+  dropPatches(dropped);
+  if (translator) {
+    translator->discard(start, end);
+  }
+  blockManager->clearCache(range);
+  if (not running && blockManager->isFlushPending()) {
+    blockManager->flushCommit();
+  }
+}
+
+void Engine::setCacheBudget(size_t budget) {
+  cacheBudget = budget;
+  blockManager->setMemoryBudget(execBlockBudget());
+  // a running VM flushes the evicted regions before the next sequence
   if (not running && blockManager->isFlushPending()) {
     blockManager->flushCommit();
   }
 }
 
+bool Engine::setPersistentCache(const std::string &directory) {
+  QBDI_REQUIRE_ACTION(
+      not running && "Cannot setPersistentCache on a running Engine", abort());
+  if (persistentCache and persistentCache->getDirectory() == directory) {
+    return true;
+  }
+  // the previous cache is saved when destroyed
+  if (persistentCache) {
+    persistentHits += persistentCache->getHits();
+  }
+  persistentCache.reset();
+  if (directory.empty()) {
+    return true;
+  }
+  if constexpr (not(is_linux or is_android)) {
+    QBDI_WARN("The persistent cache isn't supported on this platform");
+    return false;
+  }
+  persistentCache = std::make_unique<PersistentCache>(directory, *llvmCPUs);
+  return true;
+}
+
+bool Engine::savePersistentCache() {
+  if (not persistentCache) {
+    return false;
+  }
+  return persistentCache->save();
+}
+
+CacheStats Engine::getCacheStats() const {
+  CacheStats stats = blockManager->getCacheStats();
+  // the budget covers the ExecBlocks and the patched basic blocks
+  stats.memoryBudget = cacheBudget;
+  stats.memoryUsage += patchCacheUsage;
+  stats.pretranslated = pretranslated;
+  stats.persistentHits = persistentHits;
+  if (persistentCache) {
+    stats.persistentHits += persistentCache->getHits();
+  }
+  return stats;
+}
+
+uint64_t Engine::getBBCounter(rword bbEnd) const {
+  return blockManager->getBBCounter(bbEnd);
+}
+
+std::map<rword, uint64_t> Engine::getBBCounters() const {
+  return blockManager->getBBCounters();
+}
+
+void Engine::resetBBCounters() { blockManager->resetBBCounters(); }
+
 void Engine::clearCache(RangeSet<rword> rangeSet) {
   blockManager->clearCache(rangeSet);
   if (not running && blockManager->isFlushPending()) {
@@ -19,7 +19,9 @@
 #define ENGINE_H
 
 #include <cstdlib>
+#include <map>
 #include <memory>
+#include <stddef.h>
 #include <stdint.h>
 #include <string>
 #include <utility>
@@ -33,13 +35,18 @@
 
 namespace QBDI {
 
+class LLVMCPU;
 class LLVMCPUs;
 class ExecBlock;
 class ExecBlockManager;
 class ExecBroker;
-class PatchRule;
 class InstrRule;
+class InstrRuleIndex;
 class Patch;
+class Patcher;
+class PersistentCache;
+class Translator;
+struct MemTraceState;
 struct SeqLoc;
 
 struct CallbackRegistration {
@@ -55,8 +62,9 @@ private:
   std::unique_ptr<LLVMCPUs> llvmCPUs;
   std::unique_ptr<ExecBlockManager> blockManager;
   ExecBroker *execBroker;
-  std::vector<PatchRule> patchRules;
+  std::unique_ptr<Patcher> patcher;
   std::vector<std::pair<uint32_t, std::unique_ptr<InstrRule>>> instrRules;
+  std::unique_ptr<InstrRuleIndex> instrRuleIndex;
   uint32_t instrRulesCounter;
   std::vector<std::pair<uint32_t, CallbackRegistration>> vmCallbacks;
   uint32_t vmCallbacksCounter;
@@ -69,19 +77,153 @@ private:
   Options options;
   VMEvent eventMask;
   bool running;
+  // size of the code and data blocks of the ExecBlocks (0 for one page)
+  size_t execBlockCodeSize;
+  size_t execBlockDataSize;
+  // memory budget of the translation cache (0 for unbounded)
+  size_t cacheBudget;
+  std::unique_ptr<MemTraceState> memTrace;
+  std::vector<uint32_t> memTraceRules;
+  std::unique_ptr<PersistentCache> persistentCache;
+  // instructions read from the previous persistent caches
+  uint64_t persistentHits;
+  // thread decoding the successors of the new basic blocks
+  std::unique_ptr<Translator> translator;
+  // basic blocks taken from the translator thread
+  uint64_t pretranslated;
+  // patched basic blocks before the instrumentation, by start address
+  std::map<rword, std::vector<Patch>> patchCache;
+  // estimated memory used by the patchCache
+  size_t patchCacheUsage;
+  // stop address of the translated code, kept between the runs
+  rword stopAddress;
+  std::unique_ptr<InstrRule> stopRule;
+  // basic blocks of the hot trace being recorded
+  std::vector<rword> tracePath;
+
+  // maximal number of basic blocks in a hot trace
+  static const size_t TRACE_MAX_BLOCKS = 16;
+  // maximal number of threads decoding the precached basic blocks
+  static const unsigned PRECACHE_MAX_THREADS = 64;
+  // maximal memory of the patchCache when the cache has no budget
+  static const size_t PATCH_CACHE_MAX_USAGE = 64 * 1024 * 1024;
 
   std::vector<Patch> patch(rword start);
 
+  /*! Request the translation of the static successors of a basic block that
+   * aren't translated yet.
+   *
+   * @param[in] last  The last patch of the basic block.
+   */
+  void requestSuccessors(const Patch &last);
+
+  /*! Start or stop the translator thread, following the options.
+   */
+  void updateTranslator();
+
   void initGPRState();
   void initFPRState();
 
   void instrument(std::vector<Patch> &basicBlock, size_t patchEnd);
   void handleNewBasicBlock(rword pc);
 
+  /*! Keep a copy of a patched basic block to instrument it again without
+   * decoding it. The oldest copies are dropped above the limit of the
+   * patchCache.
+   *
+   * @param[in] address     The start address of the basic block.
+   * @param[in] basicBlock  The patched basic block.
+   */
+  void cachePatches(rword address, const std::vector<Patch> &basicBlock);
+
+  /*! Drop patched basic blocks until the patchCache fits in a limit.
+   *
+   * @param[in] limit  The memory limit in bytes.
+   */
+  void shrinkPatchCache(size_t limit);
+
+  /*! Drop the patched basic blocks overlapping some ranges.
+   *
+   * @param[in] ranges  The ranges to drop.
+   */
+  void dropPatches(const RangeSet<rword> &ranges);
+
+  /*! Get the memory limit of the patchCache. A quarter of the memory budget
+   * is kept for the patchCache, the rest for the ExecBlocks.
+   */
+  size_t patchCacheLimit() const;
+
+  /*! Get the memory budget of the ExecBlocks.
+   */
+  size_t execBlockBudget() const;
+
+  /*! Instrument a patched basic block and write it in the cache.
+   *
+   * @param[in] basicBlock  The patched basic block.
+   */
+  void writeNewBasicBlock(std::vector<Patch> &&basicBlock);
+
   VMAction signalEvent(VMEvent kind, rword currentPC, const SeqLoc *seqLoc,
                        rword basicBlockBegin, GPRState *gprState,
                        FPRState *fprState);
 
+  /*! Test if a stub can be skipped without hiding an instruction or an event
+   * from a callback.
+   *
+   * @param[in] address  The address of the stub.
+   *
+   * @return True if no callback can observe the stub.
+   */
+  bool canSkipStub(rword address);
+
+  /*! Set the stop address of the translated code. The basic blocks of the
+   * previous and the new stop address are translated again if it changes.
+   *
+   * @param[in] stop  The address where the execution stops.
+   */
+  void setStopAddress(rword stop);
+
+  /*! Enable the sequence chaining if OPT_ENABLE_BLOCK_CHAINING is set and no
+   * VMEvent callback needs to be signaled between two sequences.
+   */
+  void updateChaining();
+
+  /*! Record the hot traces. A trace starts at a hot head and follows the
+   * basic blocks executed next, until it branches back to its head.
+   *
+   * @param[in] address   The address of the next sequence to execute.
+   * @param[in] backward  The sequence is reached by a backward branch.
+   *
+   * @return True if a trace was written in the cache.
+   */
+  bool recordTrace(rword address, bool backward);
+
+  /*! Write the trace being recorded in the cache.
+   *
+   * @param[in] loop  The last basic block of the trace branches to the first.
+   *
+   * @return True if the trace was written.
+   */
+  bool finishTrace(bool loop);
+
+  /*! Ensure the memory trace buffer has enough space for the records of a
+   * sequence, calling the trace callback if the buffer must be drained.
+   *
+   * @param[in] block  The ExecBlock of the sequence.
+   * @param[in] seqID  The ID of the sequence.
+   *
+   * @return The action of the trace callback, or CONTINUE if it wasn't called.
+   */
+  VMAction reserveMemoryTrace(ExecBlock *block, uint16_t seqID);
+
+  /*! Give the content of the memory trace buffer to the trace callback and
+   * reset the cursor.
+   *
+   * @return The action of the trace callback, or CONTINUE if the buffer was
+   * empty.
+   */
+  VMAction flushMemoryTrace();
+
 public:
   /*! Construct a new Engine for a given CPU with specific attributes
    *
@@ -145,6 +287,17 @@ public:
    */
   void setOptions(Options options);
 
+  /*! Set the size of the code and data blocks of the ExecBlocks
+   *
+   * If the new sizes mismatch the current ones, clearAllCache will be called.
+   *
+   * @param[in] codeSize  Size of the code block, 0 for one page.
+   * @param[in] dataSize  Size of the data block, 0 for one page.
+   *
+   * @return True if the sizes are valid.
+   */
+  bool setExecBlockSize(size_t codeSize, size_t dataSize);
+
   /*! Add an address range to the set of instrumented address ranges.
    *
    * @param[in] start  Start address of the range (included).
@@ -258,6 +411,30 @@ public:
    */
   void deleteAllInstrumentations();
 
+  /*! Record the memory accesses in a buffer from the instrumented code. The
+   * callback is called between two sequences when the buffer reaches the
+   * high-water mark, and at the end of the execution. Any previous trace
+   * buffer is removed.
+   *
+   * @param[in] type           The type of access to record.
+   * @param[in] buffer         The buffer where the accesses are written.
+   * @param[in] size           The number of entries of the buffer.
+   * @param[in] highWaterMark  The number of entries that triggers the
+   *                           callback, in the range [1, size].
+   * @param[in] cbk            The callback called to drain the buffer.
+   * @param[in] data           User defined data passed to the callback.
+   *
+   * @return True if the buffer has been set.
+   */
+  bool setMemoryTrace(MemoryAccessType type, MemoryAccess *buffer, size_t size,
+                      size_t highWaterMark, MemTraceCallback cbk, void *data);
+
+  /*! Drain and remove the memory trace buffer.
+   *
+   * @return True if a memory trace buffer was set.
+   */
+  bool removeMemoryTrace();
+
   /*! Expose current ExecBlock
    *
    * @return A pointer to current ExecBlock
@@ -278,6 +455,21 @@ public:
    */
   bool precacheBasicBlock(rword pc);
 
+  /*! Pre-cache the basic blocks of some ranges, found by recursive descent
+   * from the start of the ranges and the entry points of their modules.
+   *
+   * @param[in]  ranges   The ranges to translate. Only their instrumented
+   *                      parts are translated.
+   * @param[out] report   The coverage and the time of the translation, or
+   *                      nullptr.
+   * @param[in]  threads  The number of threads decoding the basic blocks, 0
+   *                      for the number of CPUs (64 at most).
+   *
+   * @return True if at least one basic block was found.
+   */
+  bool precacheRanges(const RangeSet<rword> &ranges, PrecacheReport *report,
+                      unsigned threads);
+
   /*! Return an InstAnalysis for a cached instruction.
    * The pointer may be invalid by any noconst method call.
    *
@@ -297,7 +489,9 @@ public:
    */
   void clearCache(rword start, rword end);
 
-  /*! Clear a specific address rangeSet from the translation cache.
+  /*! Clear a specific address rangeSet from the translation cache after a
+   * change of the instrumentation. The patched basic blocks are kept, only
+   * the instrumentation is applied again.
    *
    * @param[in] rangeSet    The range set to clear from the cache.
    */
@@ -306,6 +500,51 @@ public:
   /*! Clear the entire translation cache.
    */
   void clearAllCache();
+
+  /*! Set the memory budget of the translation cache.
+   *
+   * @param[in] budget  The budget in bytes, 0 for an unbounded cache.
+   */
+  void setCacheBudget(size_t budget);
+
+  /*! Get the statistics of the translation cache.
+   *
+   * @return The statistics.
+   */
+  CacheStats getCacheStats() const;
+
+  /*! Use a persistent cache of the decoded instructions.
+   *
+   * @param[in] directory  The directory of the cache, or an empty string to
+   *                       disable the persistent cache.
+   *
+   * @return False if the persistent cache isn't supported on this platform.
+   */
+  bool setPersistentCache(const std::string &directory);
+
+  /*! Write the persistent cache on the disk.
+   *
+   * @return False if the cache is disabled or couldn't be written.
+   */
+  bool savePersistentCache();
+
+  /*! Get the execution counter of a basic block.
+   *
+   * @param[in] bbEnd  The end address of the basic block.
+   *
+   * @return The number of executions of the basic block.
+   */
+  uint64_t getBBCounter(rword bbEnd) const;
+
+  /*! Get the execution counters of all the basic blocks.
+   *
+   * @return The counters by basic block end address.
+   */
+  std::map<rword, uint64_t> getBBCounters() const;
+
+  /*! Reset the execution counters of all the basic blocks to zero.
+   */
+  void resetBBCounters();
 };
 
 } // namespace QBDI
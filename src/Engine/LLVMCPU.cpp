@@ -15,6 +15,9 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <map>
+#include <mutex>
+#include <tuple>
 #include <utility>
 
 #include "llvm/ADT/SmallVector.h"
@@ -78,30 +81,44 @@ void LLVMCPUs::setOptions(Options opts) {
   }
 }
 
-LLVMCPU::LLVMCPU(const std::string &_cpu, const std::string &_arch,
-                 const std::vector<std::string> &_mattrs, Options opts,
-                 CPUMode cpumode)
-    : cpu(_cpu), arch(_arch), mattrs(_mattrs), options(opts), cpumode(cpumode) {
+namespace {
 
-  std::string error;
-  std::string featuresStr;
+struct HostInfo {
+  std::string cpu;
+  std::vector<std::string> mattrs;
+};
 
-  llvm::InitializeAllTargetInfos();
-  llvm::InitializeAllTargetMCs();
-  llvm::InitializeAllAsmParsers();
-  llvm::InitializeAllDisassemblers();
+const HostInfo &initLLVM() {
+  static HostInfo host;
+  static std::once_flag initFlag;
 
-  // Build features string
-  if (cpu.empty()) {
-    cpu = QBDI::getHostCPUName();
+  std::call_once(initFlag, []() {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+    llvm::InitializeAllDisassemblers();
+
+    host.cpu = QBDI::getHostCPUName();
     // If API is broken on ARM, we are facing big problems...
     if constexpr (is_arm) {
-      QBDI_REQUIRE(!cpu.empty() && cpu != "generic");
+      QBDI_REQUIRE(!host.cpu.empty() && host.cpu != "generic");
     }
-  }
-  if (mattrs.empty()) {
-    mattrs = getHostCPUFeatures();
-  }
+    host.mattrs = getHostCPUFeatures();
+  });
+  return host;
+}
+
+} // anonymous namespace
+
+LLVMTargetInfo::LLVMTargetInfo(const std::string &_cpu,
+                               const std::string &arch,
+                               const std::vector<std::string> &_mattrs)
+    : cpu(_cpu), mattrs(_mattrs) {
+
+  std::string error;
+  std::string featuresStr;
+
+  // Build features string
   if (!mattrs.empty()) {
     llvm::SubtargetFeatures features;
     for (unsigned i = 0; i != mattrs.size(); ++i) {
@@ -116,7 +133,7 @@ LLVMCPU::LLVMCPU(const std::string &_cpu, const std::string &_arch,
   target = llvm::TargetRegistry::lookupTarget(arch, processTriple, error);
   QBDI_DEBUG("Initialized LLVM for target {}", tripleName.c_str());
 
-  // Allocate all LLVM classes
+  // Allocate the read-only LLVM classes
   llvm::MCTargetOptions MCOptions;
   MRI = std::unique_ptr<llvm::MCRegisterInfo>(
       target->createMCRegInfo(tripleName));
@@ -125,27 +142,70 @@ LLVMCPU::LLVMCPU(const std::string &_cpu, const std::string &_arch,
   MCII = std::unique_ptr<llvm::MCInstrInfo>(target->createMCInstrInfo());
   MSTI = std::unique_ptr<llvm::MCSubtargetInfo>(
       target->createMCSubtargetInfo(tripleName, cpu, featuresStr));
-  MCTX = std::make_unique<llvm::MCContext>(processTriple, MAI.get(), MRI.get(),
-                                           MSTI.get());
+  QBDI_DEBUG("Initialized LLVM subtarget with cpu {} and features {}",
+             cpu.c_str(), featuresStr.c_str());
+}
+
+LLVMTargetInfo::~LLVMTargetInfo() = default;
+
+std::shared_ptr<const LLVMTargetInfo>
+LLVMTargetInfo::get(const std::string &cpu, const std::string &arch,
+                    const std::vector<std::string> &mattrs) {
+  using Key = std::tuple<std::string, std::string, std::vector<std::string>>;
+
+  // The entries are kept until the end of the process: the number of
+  // configurations is small and a short-lived VM must not rebuild them.
+  static std::mutex cacheLock;
+  static std::map<Key, std::shared_ptr<const LLVMTargetInfo>> cache;
+
+  const HostInfo &host = initLLVM();
+  Key key{cpu.empty() ? host.cpu : cpu, arch,
+          mattrs.empty() ? host.mattrs : mattrs};
+
+  std::lock_guard<std::mutex> guard(cacheLock);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  auto info = std::make_shared<const LLVMTargetInfo>(
+      std::get<0>(key), std::get<1>(key), std::get<2>(key));
+  cache.emplace(std::move(key), info);
+  return info;
+}
+
+LLVMCPU::LLVMCPU(const std::string &_cpu, const std::string &_arch,
+                 const std::vector<std::string> &_mattrs, Options opts,
+                 CPUMode cpumode)
+    : targetInfo(LLVMTargetInfo::get(_cpu, _arch, _mattrs)), options(opts),
+      cpumode(cpumode) {
+
+  const llvm::Target *target = targetInfo->target;
+  const llvm::MCAsmInfo &MAI = *targetInfo->MAI;
+  const llvm::MCInstrInfo &MCII = *targetInfo->MCII;
+  const llvm::MCRegisterInfo &MRI = *targetInfo->MRI;
+  const llvm::MCSubtargetInfo &MSTI = *targetInfo->MSTI;
+
+  // Allocate the LLVM classes owned by this CPU
+  llvm::MCTargetOptions MCOptions;
+  MCTX = std::make_unique<llvm::MCContext>(
+      llvm::Triple(targetInfo->tripleName), &MAI, &MRI, &MSTI);
   MOFI = std::unique_ptr<llvm::MCObjectFileInfo>(
       target->createMCObjectFileInfo(*MCTX, false));
   MCTX->setObjectFileInfo(MOFI.get());
-  QBDI_DEBUG("Initialized LLVM subtarget with cpu {} and features {}",
-             cpu.c_str(), featuresStr.c_str());
 
   auto MAB = std::unique_ptr<llvm::MCAsmBackend>(
-      target->createMCAsmBackend(*MSTI, *MRI, MCOptions));
+      target->createMCAsmBackend(MSTI, MRI, MCOptions));
   MCE = std::unique_ptr<llvm::MCCodeEmitter>(
-      target->createMCCodeEmitter(*MCII, *MRI, *MCTX));
+      target->createMCCodeEmitter(MCII, MRI, *MCTX));
 
   // assembler, disassembler and printer
   null_ostream = std::make_unique<llvm::raw_null_ostream>();
 
   disassembler = std::unique_ptr<llvm::MCDisassembler>(
-      target->createMCDisassembler(*MSTI, *MCTX));
+      target->createMCDisassembler(MSTI, *MCTX));
 
   auto codeEmitter = std::unique_ptr<llvm::MCCodeEmitter>(
-      target->createMCCodeEmitter(*MCII, *MRI, *MCTX));
+      target->createMCCodeEmitter(MCII, MRI, *MCTX));
 
   auto objectWriter = std::unique_ptr<llvm::MCObjectWriter>(
       MAB->createObjectWriter(*null_ostream));
@@ -157,11 +217,11 @@ LLVMCPU::LLVMCPU(const std::string &_cpu, const std::string &_arch,
 #if defined(QBDI_ARCH_X86_64) || defined(QBDI_ARCH_X86)
   variant = ((options & Options::OPT_ATT_SYNTAX) == 0) ? 1 : 0;
 #else
-  variant = MAI->getAssemblerDialect();
+  variant = MAI.getAssemblerDialect();
 #endif
 
   asmPrinter = std::unique_ptr<llvm::MCInstPrinter>(target->createMCInstPrinter(
-      MSTI->getTargetTriple(), variant, *MAI, *MCII, *MRI));
+      MSTI.getTargetTriple(), variant, MAI, MCII, MRI));
   asmPrinter->setPrintImmHex(true);
   asmPrinter->setPrintImmHex(llvm::HexStyle::C);
 }
@@ -186,7 +246,8 @@ void LLVMCPU::writeInstruction(const llvm::MCInst inst,
     std::string disass = showInst(inst, address);
     QBDI_DEBUG("Assembling {} at 0x{:x}", disass.c_str(), address);
   });
-  assembler->getEmitter().encodeInstruction(inst, *stream, fixups, *MSTI);
+  assembler->getEmitter().encodeInstruction(inst, *stream, fixups,
+                                         *targetInfo->MSTI);
   uint64_t size = stream->current_pos() - pos;
 
   if (fixups.size() > 0) {
@@ -197,7 +258,7 @@ void LLVMCPU::writeInstruction(const llvm::MCInst inst,
       assembler->getBackend().applyFixup(
           *assembler, fixup, target,
           llvm::MutableArrayRef<char>((char *)stream->get_ptr() + pos, size),
-          (uint64_t)value, true, MSTI.get());
+          (uint64_t)value, true, targetInfo->MSTI.get());
     } else {
       QBDI_WARN("Could not evalutate fixup, might crash!");
     }
@@ -217,24 +278,26 @@ std::string LLVMCPU::showInst(const llvm::MCInst &inst,
   llvm::raw_string_ostream rso(out);
 
   llvm::StringRef unusedAnnotations;
-  asmPrinter->printInst(&inst, address, unusedAnnotations, *MSTI, rso);
+  asmPrinter->printInst(&inst, address, unusedAnnotations,
+                        *targetInfo->MSTI, rso);
 
   rso.flush();
   return out;
 }
 
 const char *LLVMCPU::getRegisterName(unsigned int id) const {
-  return MRI->getName(id);
+  return targetInfo->MRI->getName(id);
 }
 
 void LLVMCPU::setOptions(Options opts) {
 #if defined(QBDI_ARCH_X86_64) || defined(QBDI_ARCH_X86)
   if (((opts ^ options) & Options::OPT_ATT_SYNTAX) != 0) {
-    asmPrinter =
-        std::unique_ptr<llvm::MCInstPrinter>(target->createMCInstPrinter(
-            MSTI->getTargetTriple(),
-            ((opts & Options::OPT_ATT_SYNTAX) == 0) ? 1 : 0, *MAI, *MCII,
-            *MRI));
+    const LLVMTargetInfo &info = *targetInfo;
+    asmPrinter = std::unique_ptr<llvm::MCInstPrinter>(
+        info.target->createMCInstPrinter(
+            info.MSTI->getTargetTriple(),
+            ((opts & Options::OPT_ATT_SYNTAX) == 0) ? 1 : 0, *info.MAI,
+            *info.MCII, *info.MRI));
     asmPrinter->setPrintImmHex(true);
     asmPrinter->setPrintImmHex(llvm::HexStyle::C);
   }
@@ -48,24 +48,54 @@ class raw_pwrite_stream;
 namespace QBDI {
 class memory_ostream;
 
-class LLVMCPU {
-
-private:
+/*! Read-only part of the LLVM MC layer of a CPU. The instances are cached for
+ * the whole process and shared by all the LLVMCPU with the same cpu, arch and
+ * mattrs. They are never modified after their creation.
+ */
+class LLVMTargetInfo {
+public:
   std::string tripleName;
   std::string cpu;
-  std::string arch;
   std::vector<std::string> mattrs;
   const llvm::Target *target;
+
+  std::unique_ptr<llvm::MCAsmInfo> MAI;
+  std::unique_ptr<llvm::MCInstrInfo> MCII;
+  std::unique_ptr<llvm::MCRegisterInfo> MRI;
+  std::unique_ptr<llvm::MCSubtargetInfo> MSTI;
+
+  LLVMTargetInfo(const std::string &cpu, const std::string &arch,
+                 const std::vector<std::string> &mattrs);
+
+  ~LLVMTargetInfo();
+
+  LLVMTargetInfo(const LLVMTargetInfo &) = delete;
+  LLVMTargetInfo &operator=(const LLVMTargetInfo &) = delete;
+
+  /*! Get the shared instance for a CPU, create it on the first use. This
+   * function is thread-safe.
+   *
+   * @param[in] cpu     The CPU name, empty for the host CPU.
+   * @param[in] arch    The LLVM architecture name, empty for the host one.
+   * @param[in] mattrs  The CPU features, empty for the host ones.
+   *
+   * @return The shared instance.
+   */
+  static std::shared_ptr<const LLVMTargetInfo>
+  get(const std::string &cpu, const std::string &arch,
+      const std::vector<std::string> &mattrs);
+};
+
+class LLVMCPU {
+
+private:
+  std::shared_ptr<const LLVMTargetInfo> targetInfo;
   Options options;
   CPUMode cpumode;
 
-  std::unique_ptr<llvm::MCAsmInfo> MAI;
   std::unique_ptr<llvm::MCCodeEmitter> MCE;
   std::unique_ptr<llvm::MCContext> MCTX;
-  std::unique_ptr<llvm::MCInstrInfo> MCII;
   std::unique_ptr<llvm::MCObjectFileInfo> MOFI;
-  std::unique_ptr<llvm::MCRegisterInfo> MRI;
-  std::unique_ptr<llvm::MCSubtargetInfo> MSTI;
 
   std::unique_ptr<llvm::MCAssembler> assembler;
   std::unique_ptr<llvm::MCDisassembler> disassembler;
@@ -95,15 +125,21 @@ public:
 
   const char *getRegisterName(unsigned int id) const;
 
-  inline const std::string &getCPU() const { return cpu; }
+  inline const std::string &getCPU() const { return targetInfo->cpu; }
 
-  inline const std::vector<std::string> &getMattrs() const { return mattrs; }
+  inline const std::vector<std::string> &getMattrs() const {
+    return targetInfo->mattrs;
+  }
 
   inline const CPUMode getCPUMode() const { return cpumode; }
 
-  inline const llvm::MCInstrInfo &getMCII() const { return *MCII; }
+  inline const llvm::MCInstrInfo &getMCII() const {
+    return *targetInfo->MCII;
+  }
 
-  inline const llvm::MCRegisterInfo &getMRI() const { return *MRI; }
+  inline const llvm::MCRegisterInfo &getMRI() const {
+    return *targetInfo->MRI;
+  }
 
   Options getOptions() const { return options; }
   void setOptions(Options opts);
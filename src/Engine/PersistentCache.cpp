@@ -0,0 +1,416 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+#include <string>
+#include <system_error>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include "QBDI/Version.h"
+#include "Engine/LLVMCPU.h"
+#include "Engine/PersistentCache.h"
+#include "Utility/LogSys.h"
+#include "Utility/System.h"
+
+namespace QBDI {
+
+namespace {
+
+constexpr char CACHE_MAGIC[8] = {'Q', 'B', 'D', 'I', 'D', 'E', 'C', '1'};
+
+struct FileHeader {
+  char magic[8];
+  uint64_t key;
+  uint32_t nbRecords;
+  uint32_t reserved;
+};
+
+struct RecordHeader {
+  uint64_t offset;
+  uint32_t opcode;
+  uint32_t flags;
+  uint8_t size;
+  uint8_t cpuMode;
+  uint8_t nbOperands;
+  uint8_t reserved;
+  uint8_t bytes[20];
+};
+
+struct RecordOperand {
+  uint32_t kind;
+  uint32_t reserved;
+  uint64_t value;
+};
+
+enum OperandKind : uint32_t {
+  OPERAND_REG = 1,
+  OPERAND_IMM = 2,
+  OPERAND_SFPIMM = 3,
+  OPERAND_DFPIMM = 4,
+};
+
+static_assert(sizeof(RecordHeader) % 8 == 0, "Records must be aligned");
+static_assert(sizeof(FileHeader) % 8 == 0, "Records must be aligned");
+
+inline uint64_t indexKey(uint64_t offset, CPUMode cpuMode) {
+  return (offset << 2) | static_cast<uint64_t>(cpuMode);
+}
+
+} // anonymous namespace
+
+PersistentCache::PersistentCache(const std::string &directory,
+                                 const LLVMCPUs &llvmCPUs)
+    : directory(directory), lastModule(0), hits(0) {
+  const LLVMCPU &llvmcpu = llvmCPUs.getCPU(CPUMode::DEFAULT);
+  nbOpcodes = llvmcpu.getMCII().getNumOpcodes();
+  nbRegs = llvmcpu.getMRI().getNumRegs();
+  // The decoded instructions depend on the version of LLVM and on the CPU
+  std::string keyStr = LLVM_VERSION_STRING ";" QBDI_VERSION_STRING
+                       ";" QBDI_ARCHITECTURE_STRING ";" +
+                       llvmCPUs.getCPU();
+  for (const std::string &mattr : llvmCPUs.getMattrs()) {
+    keyStr += ";" + mattr;
+  }
+  key = llvm::xxHash64(keyStr);
+}
+
+PersistentCache::~PersistentCache() { save(); }
+
+PersistentCache::CachedModule *PersistentCache::getModule(rword address) {
+  if (lastModule < modules.size() and
+      modules[lastModule].range.contains(address)) {
+    return &modules[lastModule];
+  }
+  for (size_t i = 0; i < modules.size(); i++) {
+    if (modules[i].range.contains(address)) {
+      lastModule = i;
+      return &modules[i];
+    }
+  }
+  if (unknown.contains(address)) {
+    return nullptr;
+  }
+
+  Range<rword> range(0, 0);
+  rword bias = 0;
+  std::string buildID = getModuleBuildID(address, range, bias);
+  if (buildID.empty()) {
+    // don't search this page again
+    rword pageSize = llvm::sys::Process::getPageSizeEstimate();
+    rword page = address & ~(pageSize - 1);
+    unknown.add(Range<rword>(page, page + pageSize));
+    return nullptr;
+  }
+
+  llvm::SmallString<256> path(directory);
+  llvm::sys::path::append(path,
+                          buildID + "-" + llvm::utohexstr(key) + ".qbdicache");
+
+  modules.emplace_back();
+  CachedModule &module = modules.back();
+  module.range = range;
+  module.bias = bias;
+  module.path = std::string(path.str());
+  loadModule(module);
+
+  lastModule = modules.size() - 1;
+  return &module;
+}
+
+void PersistentCache::loadModule(CachedModule &module) {
+  auto buffer = llvm::MemoryBuffer::getFile(module.path, /* IsText */ false,
+                                            /* RequiresNullTerminator */ false);
+  if (not buffer) {
+    QBDI_DEBUG("No persistent cache file {}", module.path);
+    return;
+  }
+  const char *data = (*buffer)->getBufferStart();
+  size_t size = (*buffer)->getBufferSize();
+
+  FileHeader header;
+  if (size < sizeof(FileHeader)) {
+    QBDI_WARN("Invalid persistent cache file {}", module.path);
+    return;
+  }
+  memcpy(&header, data, sizeof(FileHeader));
+  if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 or
+      header.key != key) {
+    QBDI_WARN("Invalid persistent cache file {}", module.path);
+    return;
+  }
+
+  // index the records
+  size_t pos = sizeof(FileHeader);
+  for (uint32_t i = 0; i < header.nbRecords; i++) {
+    RecordHeader record;
+    if (pos + sizeof(RecordHeader) > size) {
+      break;
+    }
+    memcpy(&record, data + pos, sizeof(RecordHeader));
+    size_t recordSize =
+        sizeof(RecordHeader) + record.nbOperands * sizeof(RecordOperand);
+    if (pos + recordSize > size or pos >= ADDED_RECORD) {
+      break;
+    }
+    if (not isValidRecord(data + pos)) {
+      QBDI_WARN("Invalid record in persistent cache file {}", module.path);
+      module.index.clear();
+      module.nbRecords = 0;
+      return;
+    }
+    module.index[indexKey(record.offset,
+                          static_cast<CPUMode>(record.cpuMode))] = pos;
+    module.nbRecords++;
+    pos += recordSize;
+  }
+  if (module.nbRecords != header.nbRecords) {
+    QBDI_WARN("Truncated persistent cache file {}", module.path);
+    module.index.clear();
+    module.nbRecords = 0;
+    return;
+  }
+  QBDI_DEBUG("Load {} instructions from persistent cache file {}",
+             module.nbRecords, module.path);
+  module.buffer = std::move(*buffer);
+}
+
+bool PersistentCache::isValidRecord(const char *data) const {
+  RecordHeader record;
+  memcpy(&record, data, sizeof(RecordHeader));
+  // A record of size 0 would match any code and never move the decoder
+  if (record.size == 0 or record.size > sizeof(RecordHeader::bytes) or
+      record.opcode >= nbOpcodes or record.cpuMode >= CPUMode::COUNT) {
+    return false;
+  }
+  for (unsigned i = 0; i < record.nbOperands; i++) {
+    RecordOperand operand;
+    memcpy(&operand,
+           data + sizeof(RecordHeader) + i * sizeof(RecordOperand),
+           sizeof(RecordOperand));
+    switch (operand.kind) {
+      case OPERAND_REG:
+        if (operand.value >= nbRegs) {
+          return false;
+        }
+        break;
+      case OPERAND_IMM:
+      case OPERAND_SFPIMM:
+      case OPERAND_DFPIMM:
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool PersistentCache::getInstruction(llvm::MCInst &inst, uint64_t &size,
+                                     rword address, CPUMode cpuMode) {
+  CachedModule *module = getModule(address);
+  if (module == nullptr or module->index.empty()) {
+    return false;
+  }
+  auto it = module->index.find(indexKey(address - module->bias, cpuMode));
+  if (it == module->index.end()) {
+    return false;
+  }
+  const uint8_t *data;
+  if ((it->second & ADDED_RECORD) != 0) {
+    data = module->added.data() + (it->second & ~ADDED_RECORD);
+  } else {
+    data = reinterpret_cast<const uint8_t *>(module->buffer->getBufferStart()) +
+           it->second;
+  }
+  RecordHeader record;
+  memcpy(&record, data, sizeof(RecordHeader));
+
+  // The code may have been modified since the record was written
+  if (memcmp(record.bytes, reinterpret_cast<const void *>(address),
+             record.size) != 0) {
+    return false;
+  }
+
+  if ((it->second & ADDED_RECORD) == 0) {
+    hits++;
+  }
+  inst.clear();
+  inst.setOpcode(record.opcode);
+  inst.setFlags(record.flags);
+  for (unsigned i = 0; i < record.nbOperands; i++) {
+    RecordOperand operand;
+    memcpy(&operand,
+           data + sizeof(RecordHeader) + i * sizeof(RecordOperand),
+           sizeof(RecordOperand));
+    switch (operand.kind) {
+      case OPERAND_REG:
+        inst.addOperand(
+            llvm::MCOperand::createReg(static_cast<unsigned>(operand.value)));
+        break;
+      case OPERAND_IMM:
+        inst.addOperand(
+            llvm::MCOperand::createImm(static_cast<int64_t>(operand.value)));
+        break;
+      case OPERAND_SFPIMM:
+        inst.addOperand(llvm::MCOperand::createSFPImm(
+            static_cast<uint32_t>(operand.value)));
+        break;
+      case OPERAND_DFPIMM:
+        inst.addOperand(llvm::MCOperand::createDFPImm(operand.value));
+        break;
+      default:
+        QBDI_WARN("Invalid record in persistent cache file {}", module->path);
+        return false;
+    }
+  }
+  size = record.size;
+  return true;
+}
+
+void PersistentCache::addInstruction(const llvm::MCInst &inst, uint64_t size,
+                                     rword address, CPUMode cpuMode) {
+  CachedModule *module = getModule(address);
+  if (module == nullptr or size > sizeof(RecordHeader::bytes) or
+      module->added.size() >= ADDED_RECORD) {
+    return;
+  }
+
+  RecordHeader record;
+  memset(&record, 0, sizeof(RecordHeader));
+  record.offset = address - module->bias;
+  record.opcode = inst.getOpcode();
+  record.flags = inst.getFlags();
+  record.size = static_cast<uint8_t>(size);
+  record.cpuMode = static_cast<uint8_t>(cpuMode);
+  record.nbOperands = static_cast<uint8_t>(inst.getNumOperands());
+  memcpy(record.bytes, reinterpret_cast<const void *>(address), size);
+
+  std::vector<RecordOperand> operands;
+  for (const llvm::MCOperand &op : inst) {
+    RecordOperand operand{0, 0, 0};
+    if (op.isReg()) {
+      operand.kind = OPERAND_REG;
+      operand.value = op.getReg();
+    } else if (op.isImm()) {
+      operand.kind = OPERAND_IMM;
+      operand.value = static_cast<uint64_t>(op.getImm());
+    } else if (op.isSFPImm()) {
+      operand.kind = OPERAND_SFPIMM;
+      operand.value = op.getSFPImm();
+    } else if (op.isDFPImm()) {
+      operand.kind = OPERAND_DFPIMM;
+      operand.value = op.getDFPImm();
+    } else {
+      // expressions and sub-instructions aren't cached
+      return;
+    }
+    operands.push_back(operand);
+  }
+
+  uint32_t pos = static_cast<uint32_t>(module->added.size());
+  const uint8_t *recordData = reinterpret_cast<const uint8_t *>(&record);
+  module->added.insert(module->added.end(), recordData,
+                       recordData + sizeof(RecordHeader));
+  const uint8_t *operandsData =
+      reinterpret_cast<const uint8_t *>(operands.data());
+  module->added.insert(module->added.end(), operandsData,
+                       operandsData + operands.size() * sizeof(RecordOperand));
+  module->index[indexKey(record.offset, cpuMode)] = pos | ADDED_RECORD;
+  module->nbAdded++;
+}
+
+bool PersistentCache::saveModule(CachedModule &module) {
+  if (module.nbAdded == 0) {
+    return true;
+  }
+  // Write a new file and replace the previous one: a process may still map
+  // the previous file.
+  std::error_code ec = llvm::sys::fs::create_directories(directory);
+  if (ec) {
+    QBDI_WARN("Cannot create the persistent cache directory {}: {}",
+              directory, ec.message());
+    return false;
+  }
+  llvm::SmallString<256> tmpPath;
+  int fd;
+  ec = llvm::sys::fs::createUniqueFile(module.path + "-%%%%%%%%.tmp", fd,
+                                       tmpPath);
+  if (ec) {
+    QBDI_WARN("Cannot create the persistent cache file {}: {}", module.path,
+              ec.message());
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream os(fd, /* shouldClose */ true);
+    FileHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.key = key;
+    header.nbRecords = module.nbRecords + module.nbAdded;
+    header.reserved = 0;
+    os.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+    if (module.buffer) {
+      os.write(module.buffer->getBufferStart() + sizeof(FileHeader),
+               module.buffer->getBufferSize() - sizeof(FileHeader));
+    }
+    os.write(reinterpret_cast<const char *>(module.added.data()),
+             module.added.size());
+    os.close();
+    if (os.has_error()) {
+      QBDI_WARN("Cannot write the persistent cache file {}: {}", module.path,
+                os.error().message());
+      os.clear_error();
+      llvm::sys::fs::remove(tmpPath);
+      return false;
+    }
+  }
+  ec = llvm::sys::fs::rename(tmpPath, module.path);
+  if (ec) {
+    QBDI_WARN("Cannot write the persistent cache file {}: {}", module.path,
+              ec.message());
+    llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  QBDI_DEBUG("Save {} new instructions in persistent cache file {}",
+             module.nbAdded, module.path);
+
+  // The records are now in the file. Keep them in memory as the records of
+  // the buffer were already indexed.
+  module.nbRecords += module.nbAdded;
+  module.nbAdded = 0;
+  return true;
+}
+
+bool PersistentCache::save() {
+  bool success = true;
+  for (CachedModule &module : modules) {
+    success = saveModule(module) and success;
+  }
+  return success;
+}
+
+} // namespace QBDI
@@ -0,0 +1,143 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PERSISTENTCACHE_H
+#define PERSISTENTCACHE_H
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "QBDI/Range.h"
+#include "QBDI/State.h"
+
+namespace llvm {
+class MCInst;
+class MemoryBuffer;
+} // namespace llvm
+
+namespace QBDI {
+
+class LLVMCPUs;
+
+/*! Cache of the decoded instructions of the modules, saved on the disk.
+ *
+ * The instructions are stored per module, in a file named after the build-id
+ * of the module and the CPU of the decoder. A file is mapped the first time
+ * an instruction of its module is decoded. The bytes of a cached instruction
+ * are compared with the memory before it is used.
+ */
+class PersistentCache {
+private:
+  struct CachedModule {
+    Range<rword> range{0, 0};
+    rword bias = 0;
+    std::string path;
+    // content of the file
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    // records decoded since the file was loaded
+    std::vector<uint8_t> added;
+    // offset of an instruction to the position of its record. The records in
+    // added have the ADDED_RECORD bit set.
+    std::unordered_map<uint64_t, uint32_t> index;
+    uint32_t nbRecords = 0;
+    uint32_t nbAdded = 0;
+  };
+
+  static constexpr uint32_t ADDED_RECORD = 1u << 31;
+
+  std::string directory;
+  uint64_t key;
+  // bounds of the opcodes and the registers of the records
+  unsigned nbOpcodes;
+  unsigned nbRegs;
+  std::vector<CachedModule> modules;
+  // addresses without build-id
+  RangeSet<rword> unknown;
+  // index of the last module used
+  size_t lastModule;
+  // instructions read from the files
+  uint64_t hits;
+
+  CachedModule *getModule(rword address);
+  void loadModule(CachedModule &module);
+
+  /*! Check a record of a cache file before it is indexed.
+   *
+   * @param[in] data  The record and its operands.
+   *
+   * @return False if the record can't be used to rebuild an instruction.
+   */
+  bool isValidRecord(const char *data) const;
+  bool saveModule(CachedModule &module);
+
+public:
+  /*! Create a cache in a directory.
+   *
+   * @param[in] directory  The directory of the cache files.
+   * @param[in] llvmCPUs   The decoder of the instructions. The files of
+   *                       another CPU or version aren't used.
+   */
+  PersistentCache(const std::string &directory, const LLVMCPUs &llvmCPUs);
+
+  ~PersistentCache();
+
+  PersistentCache(const PersistentCache &) = delete;
+  PersistentCache &operator=(const PersistentCache &) = delete;
+
+  const std::string &getDirectory() const { return directory; }
+
+  /*! Get the number of instructions read from the files. The instructions
+   * added since the files were loaded aren't counted.
+   */
+  uint64_t getHits() const { return hits; }
+
+  /*! Get a cached instruction.
+   *
+   * @param[out] inst     The decoded instruction.
+   * @param[out] size     The size of the instruction.
+   * @param[in]  address  The address of the instruction.
+   * @param[in]  cpuMode  The CPU mode of the decoder.
+   *
+   * @return True if the instruction was found.
+   */
+  bool getInstruction(llvm::MCInst &inst, uint64_t &size, rword address,
+                      CPUMode cpuMode);
+
+  /*! Add a decoded instruction in the cache. The instructions outside of a
+   * module with a build-id are ignored.
+   *
+   * @param[in] inst     The decoded instruction.
+   * @param[in] size     The size of the instruction.
+   * @param[in] address  The address of the instruction.
+   * @param[in] cpuMode  The CPU mode of the decoder.
+   */
+  void addInstruction(const llvm::MCInst &inst, uint64_t size, rword address,
+                      CPUMode cpuMode);
+
+  /*! Write the new instructions in the cache files.
+   *
+   * @return False if a file couldn't be written.
+   */
+  bool save();
+};
+
+} // namespace QBDI
+
+#endif // PERSISTENTCACHE_H
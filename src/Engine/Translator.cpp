@@ -0,0 +1,348 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+
+#include "Engine/LLVMCPU.h"
+#include "Engine/PersistentCache.h"
+#include "Engine/Translator.h"
+#include "Patch/InstMetadata.h"
+#include "Patch/Patch.h"
+#include "Patch/PatchRule.h"
+#include "Patch/PatchRules.h"
+#include "Utility/LogSys.h"
+
+namespace QBDI {
+
+// The patches decoded by a thread use the LLVMCPU of the VM once they are
+// handed back, the LLVMCPU of the thread may be destroyed or used to decode.
+static void attachPatches(std::vector<Patch> &basicBlock,
+                          const LLVMCPU &llvmcpu) {
+  for (Patch &patch : basicBlock) {
+    patch.llvmcpu = &llvmcpu;
+  }
+}
+
+Patcher::Patcher(const LLVMCPUs &llvmCPUs, Options options)
+    : llvmCPUs(llvmCPUs), patchRules(getDefaultPatchRules(options)) {}
+
+Patcher::~Patcher() = default;
+
+const std::vector<uint32_t> &Patcher::getPatchRules(unsigned opcode,
+                                                    const LLVMCPU &llvmcpu) {
+  auto it = patchRulesByOpcode.find(opcode);
+  if (it == patchRulesByOpcode.end()) {
+    std::vector<uint32_t> matching;
+    for (uint32_t j = 0; j < patchRules.size(); j++) {
+      if (patchRules[j].canMatchOpcode(opcode, llvmcpu)) {
+        matching.push_back(j);
+      }
+    }
+    it = patchRulesByOpcode.emplace(opcode, std::move(matching)).first;
+  }
+  return it->second;
+}
+
+bool Patcher::patch(std::vector<Patch> &basicBlock, rword start,
+                    CPUMode cpuMode, PersistentCache *persistentCache,
+                    rword limit) {
+  const LLVMCPU &llvmcpu = llvmCPUs.getCPU(cpuMode);
+  const llvm::ArrayRef<uint8_t> code((uint8_t *)start,
+                                     (size_t)(limit - start));
+  bool basicBlockEnd = false;
+  rword i = 0;
+  QBDI_DEBUG("Patching basic block at address 0x{:x}", start);
+
+  basicBlock.clear();
+  // Get Basic block
+  while (not basicBlockEnd) {
+    llvm::MCInst inst;
+    llvm::MCDisassembler::DecodeStatus dstatus;
+    rword address = start;
+    Patch *patch = nullptr;
+    uint64_t instSize = 0;
+
+    // Aggregate a complete patch
+    do {
+      // Disassemble
+      rword prev_address = address;
+      address = start + i;
+      if (persistentCache and persistentCache->getInstruction(
+                                  inst, instSize, address, cpuMode)) {
+        dstatus = llvm::MCDisassembler::Success;
+      } else {
+        dstatus =
+            llvmcpu.getInstruction(inst, instSize, code.slice(i), address);
+        if (persistentCache and llvm::MCDisassembler::Success == dstatus) {
+          persistentCache->addInstruction(inst, instSize, address, cpuMode);
+        }
+      }
+      if (llvm::MCDisassembler::Success != dstatus) {
+        QBDI_DEBUG("Bump into invalid instruction at address {:x}", address);
+        // Current instruction is invalid, stop the basic block right here
+        if (prev_address == address) {
+          basicBlock.clear();
+          return false;
+        } else {
+          address = prev_address;
+          basicBlockEnd = true;
+          break;
+        }
+      }
+      QBDI_DEBUG_BLOCK({
+        std::string disass = llvmcpu.showInst(inst, address);
+        QBDI_DEBUG("Patching 0x{:x} {}", address, disass.c_str());
+      });
+      // Patch & merge
+      for (uint32_t j : getPatchRules(inst.getOpcode(), llvmcpu)) {
+        if (patchRules[j].canBeApplied(inst, address, instSize, llvmcpu)) {
+          QBDI_DEBUG("Patch rule {} applied", j);
+          if (patch == nullptr) {
+            basicBlock.push_back(
+                patchRules[j].generate(inst, address, instSize, llvmcpu));
+            patch = &basicBlock.back();
+          } else {
+            QBDI_DEBUG("Previous instruction merged");
+            *patch =
+                patchRules[j].generate(inst, address, instSize, llvmcpu, patch);
+          }
+          break;
+        }
+      }
+      QBDI_REQUIRE_ACTION(patch != nullptr, abort());
+      i += instSize;
+    } while (patch->metadata.merge);
+
+    if (patch) {
+      QBDI_DEBUG("Patch of size {:x} generated", patch->metadata.patchSize);
+    }
+
+    if (basicBlockEnd || patch->metadata.modifyPC) {
+      QBDI_DEBUG(
+          "Basic block starting at address 0x{:x} ended at address 0x{:x}",
+          start, address);
+      basicBlockEnd = true;
+    }
+  }
+
+  return true;
+}
+
+Translator::Translator(const LLVMCPUs &vmCPUs)
+    : generation(0), stopping(false) {
+  llvmCPUs = std::make_unique<LLVMCPUs>(vmCPUs.getCPU(), vmCPUs.getMattrs(),
+                                        vmCPUs.getOptions());
+  patcher = std::make_unique<Patcher>(*llvmCPUs, vmCPUs.getOptions());
+  worker = std::thread(&Translator::run, this);
+}
+
+Translator::~Translator() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wakeUp.notify_one();
+  worker.join();
+}
+
+void Translator::run() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    wakeUp.wait(guard, [this] { return stopping or not requests.empty(); });
+    if (stopping) {
+      return;
+    }
+    Request req = requests.front();
+    requests.pop_front();
+    uint64_t reqGeneration = generation;
+
+    // Decode without holding the lock
+    guard.unlock();
+    std::vector<Patch> basicBlock;
+    bool success = patcher->patch(basicBlock, req.address, req.cpuMode,
+                                  nullptr, req.limit);
+    std::vector<uint8_t> bytes;
+    if (success) {
+      const uint8_t *code = reinterpret_cast<const uint8_t *>(req.address);
+      bytes.assign(code, code + (basicBlock.back().metadata.endAddress() -
+                                 req.address));
+    }
+    guard.lock();
+
+    if (success and reqGeneration == generation and
+        staged.size() < MAX_STAGED) {
+      QBDI_DEBUG("Basic block 0x{:x} staged", req.address);
+      rword end = basicBlock.back().metadata.endAddress();
+      staged[req.address] =
+          Staged{req.cpuMode, end, std::move(basicBlock), std::move(bytes)};
+    } else if (reqGeneration == generation) {
+      known.erase(req.address);
+    }
+  }
+}
+
+void Translator::request(rword address, rword limit, CPUMode cpuMode) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (address >= limit or requests.size() >= MAX_REQUESTS or
+        not known.insert(address).second) {
+      return;
+    }
+    requests.push_back(Request{address, limit, cpuMode});
+  }
+  wakeUp.notify_one();
+}
+
+bool Translator::take(std::vector<Patch> &basicBlock, rword address,
+                      CPUMode cpuMode, const LLVMCPU &llvmcpu) {
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = staged.find(address);
+  if (it == staged.end()) {
+    return false;
+  }
+  // The code may have been written since the request
+  const std::vector<uint8_t> &bytes = it->second.bytes;
+  bool found = (it->second.cpuMode == cpuMode) and
+               memcmp(reinterpret_cast<const void *>(address), bytes.data(),
+                      bytes.size()) == 0;
+  if (found) {
+    basicBlock = std::move(it->second.basicBlock);
+    attachPatches(basicBlock, llvmcpu);
+  } else {
+    QBDI_DEBUG("Staged basic block 0x{:x} discarded", address);
+  }
+  staged.erase(it);
+  known.erase(address);
+  return found;
+}
+
+void Translator::discard(rword start, rword end) {
+  std::lock_guard<std::mutex> guard(lock);
+  generation++;
+  requests.clear();
+  known.clear();
+  for (auto it = staged.begin(); it != staged.end();) {
+    if (it->first < end and start < it->second.end) {
+      it = staged.erase(it);
+    } else {
+      known.insert(it->first);
+      ++it;
+    }
+  }
+}
+
+void Translator::discardAll() {
+  std::lock_guard<std::mutex> guard(lock);
+  generation++;
+  requests.clear();
+  known.clear();
+  staged.clear();
+}
+
+size_t discoverBasicBlocks(std::map<rword, std::vector<Patch>> &basicBlocks,
+                           const LLVMCPUs &llvmCPUs,
+                           const RangeSet<rword> &ranges,
+                           const std::vector<rword> &entries, CPUMode cpuMode,
+                           unsigned threads) {
+  std::mutex lock;
+  std::condition_variable wakeUp;
+  std::vector<rword> pending;
+  std::unordered_set<rword> visited;
+  // threads decoding a basic block
+  unsigned active = 0;
+
+  for (rword entry : entries) {
+    if (ranges.contains(entry) and visited.insert(entry).second) {
+      pending.push_back(entry);
+    }
+  }
+  size_t nbEntries = pending.size();
+
+  auto work = [&](Patcher &patcher) {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+      wakeUp.wait(guard, [&] { return not pending.empty() or active == 0; });
+      if (pending.empty()) {
+        return;
+      }
+      rword address = pending.back();
+      pending.pop_back();
+      active++;
+
+      // Decode without holding the lock, up to the end of the range
+      guard.unlock();
+      rword limit =
+          ranges.getOverlappingRanges(Range<rword>(address, address + 1))
+              .front()
+              .end();
+      std::vector<Patch> basicBlock;
+      std::vector<rword> successors;
+      bool success =
+          patcher.patch(basicBlock, address, cpuMode, nullptr, limit);
+      if (success) {
+        getStaticSuccessors(basicBlock.back().metadata, successors);
+        attachPatches(basicBlock, llvmCPUs.getCPU(cpuMode));
+      }
+      guard.lock();
+
+      active--;
+      if (success) {
+        for (rword successor : successors) {
+          if (ranges.contains(successor) and
+              visited.insert(successor).second) {
+            pending.push_back(successor);
+          }
+        }
+        basicBlocks.emplace(address, std::move(basicBlock));
+      }
+      wakeUp.notify_all();
+    }
+  };
+
+  // Each thread has its own decoder, created before the threads start
+  threads = std::max(threads, 1u);
+  std::vector<std::unique_ptr<LLVMCPUs>> workerCPUs;
+  std::vector<std::unique_ptr<Patcher>> patchers;
+  for (unsigned i = 0; i < threads; i++) {
+    workerCPUs.push_back(std::make_unique<LLVMCPUs>(
+        llvmCPUs.getCPU(), llvmCPUs.getMattrs(), llvmCPUs.getOptions()));
+    patchers.push_back(
+        std::make_unique<Patcher>(*workerCPUs.back(), llvmCPUs.getOptions()));
+  }
+  // The calling thread is one of the workers
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < threads; i++) {
+    workers.emplace_back(work, std::ref(*patchers[i]));
+  }
+  work(*patchers[0]);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  return nbEntries;
+}
+
+} // namespace QBDI
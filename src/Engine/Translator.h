@@ -0,0 +1,236 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TRANSLATOR_H
+#define TRANSLATOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "QBDI/Options.h"
+#include "QBDI/Range.h"
+#include "QBDI/State.h"
+
+namespace QBDI {
+
+class LLVMCPU;
+class LLVMCPUs;
+class Patch;
+class PatchRule;
+class PersistentCache;
+
+/*! Decode the basic blocks and apply the patch rules of the architecture.
+ *
+ * A Patcher and its LLVMCPUs are only used by one thread at a time. The patch
+ * rules don't depend on the instrumentation: a basic block can be patched on
+ * any thread, and instrumented later by the thread running the VM.
+ */
+class Patcher {
+private:
+  const LLVMCPUs &llvmCPUs;
+  std::vector<PatchRule> patchRules;
+  // position of the patch rules that may match an opcode
+  std::unordered_map<unsigned, std::vector<uint32_t>> patchRulesByOpcode;
+
+  /*! Get the patch rules that may apply to an instruction with this opcode.
+   *
+   * @param[in] opcode   The opcode of the instruction.
+   * @param[in] llvmcpu  LLVMCPU object
+   *
+   * @return The position of the rules in patchRules, in increasing order.
+   */
+  const std::vector<uint32_t> &getPatchRules(unsigned opcode,
+                                             const LLVMCPU &llvmcpu);
+
+public:
+  /*! Create a Patcher with the default patch rules.
+   *
+   * @param[in] llvmCPUs  The decoder of the instructions.
+   * @param[in] options   The options of the VM.
+   */
+  Patcher(const LLVMCPUs &llvmCPUs, Options options);
+
+  ~Patcher();
+
+  Patcher(const Patcher &) = delete;
+  Patcher &operator=(const Patcher &) = delete;
+
+  /*! Decode and patch a basic block. The basic block ends with the first
+   * instruction that changes the PC, or before the first invalid instruction.
+   *
+   * @param[out] basicBlock       The patches of the basic block.
+   * @param[in]  start            The address of the basic block.
+   * @param[in]  cpuMode          The CPU mode of the basic block.
+   * @param[in]  persistentCache  The cache of the decoded instructions, or
+   *                              nullptr.
+   * @param[in]  limit            The instructions aren't read at or after
+   *                              this address.
+   *
+   * @return False if the first instruction cannot be decoded.
+   */
+  bool patch(std::vector<Patch> &basicBlock, rword start, CPUMode cpuMode,
+             PersistentCache *persistentCache = nullptr,
+             rword limit = static_cast<rword>(-1));
+};
+
+/*! Discover the basic blocks of some ranges by recursive descent: from the
+ * entry points, the static successors of each basic block are followed while
+ * they are in the ranges. The basic blocks are decoded and patched by a pool
+ * of threads, each with its own LLVMCPUs and Patcher. The InstrRules aren't
+ * applied.
+ *
+ * @param[out] basicBlocks  The patched basic blocks, by start address.
+ * @param[in]  llvmCPUs     The decoder of the VM. The threads use new
+ *                          LLVMCPUs with the same CPU, attributes and options.
+ *                          The returned patches use its LLVMCPU.
+ * @param[in]  ranges       The ranges of the discovery.
+ * @param[in]  entries      The entry points. The ones outside of the ranges
+ *                          are ignored.
+ * @param[in]  cpuMode      The CPU mode of the basic blocks.
+ * @param[in]  threads      The number of threads of the pool.
+ *
+ * @return The number of entry points in the ranges.
+ */
+size_t discoverBasicBlocks(std::map<rword, std::vector<Patch>> &basicBlocks,
+                           const LLVMCPUs &llvmCPUs,
+                           const RangeSet<rword> &ranges,
+                           const std::vector<rword> &entries, CPUMode cpuMode,
+                           unsigned threads);
+
+/*! Translator thread decoding and patching the basic blocks ahead of the
+ * execution.
+ *
+ * The thread-safety rules are:
+ *
+ * - The thread has its own LLVMCPUs and its own Patcher. An LLVMCPU is never
+ *   used by two threads, only the LLVMTargetInfo are shared. The taken
+ *   patches are attached to the LLVMCPU of the VM.
+ * - The thread only reads the code and applies the patch rules. The
+ *   InstrRules, and thus the InstrRule callbacks of the user, are only applied
+ *   by the thread running the VM when a basic block is taken.
+ * - The ExecBlockManager, the ExecBroker and the PersistentCache are never
+ *   used by the thread.
+ * - The requests and the staged basic blocks are protected by a mutex. The
+ *   thread doesn't hold it while decoding.
+ * - The staged basic blocks overlapping a cleared range are discarded, as
+ *   well as the basic blocks being decoded when the range is cleared.
+ * - The code isn't read past the end of the instrumented range of a request.
+ *   A staged basic block is only taken if its code didn't change since it was
+ *   decoded.
+ */
+class Translator {
+private:
+  struct Request {
+    rword address;
+    // the instructions aren't read at or after this address
+    rword limit;
+    CPUMode cpuMode;
+  };
+
+  struct Staged {
+    CPUMode cpuMode;
+    rword end;
+    std::vector<Patch> basicBlock;
+    // the code of the basic block when it was decoded
+    std::vector<uint8_t> bytes;
+  };
+
+  std::unique_ptr<LLVMCPUs> llvmCPUs;
+  std::unique_ptr<Patcher> patcher;
+
+  std::mutex lock;
+  std::condition_variable wakeUp;
+  std::deque<Request> requests;
+  // basic blocks decoded and not taken yet, by start address
+  std::map<rword, Staged> staged;
+  // addresses requested, being decoded or staged
+  std::unordered_set<rword> known;
+  // incremented when the staged basic blocks are discarded
+  uint64_t generation;
+  bool stopping;
+  std::thread worker;
+
+  void run();
+
+public:
+  // maximal number of pending requests
+  static const size_t MAX_REQUESTS = 256;
+  // maximal number of staged basic blocks
+  static const size_t MAX_STAGED = 4096;
+
+  /*! Create a Translator and start its thread.
+   *
+   * @param[in] llvmCPUs  The decoder of the VM. The thread uses a new LLVMCPUs
+   *                      with the same CPU, attributes and options.
+   */
+  Translator(const LLVMCPUs &llvmCPUs);
+
+  /*! Stop the thread. The basic block being decoded is completed first.
+   */
+  ~Translator();
+
+  Translator(const Translator &) = delete;
+  Translator &operator=(const Translator &) = delete;
+
+  /*! Request the translation of a basic block. The request is ignored if the
+   * basic block is already requested or staged, or if there are too many
+   * pending requests.
+   *
+   * @param[in] address  The address of the basic block.
+   * @param[in] limit    The end of the instrumented range of the basic block.
+   *                     The code isn't read at or after this address.
+   * @param[in] cpuMode  The CPU mode of the basic block.
+   */
+  void request(rword address, rword limit, CPUMode cpuMode);
+
+  /*! Take a staged basic block. The basic block is discarded if its code
+   * changed since it was decoded.
+   *
+   * @param[out] basicBlock  The patches of the basic block.
+   * @param[in]  address     The address of the basic block.
+   * @param[in]  cpuMode     The CPU mode of the basic block.
+   * @param[in]  llvmcpu     The LLVMCPU of the VM, used by the patches once
+   *                         taken.
+   *
+   * @return True if the basic block was staged and its code is unchanged.
+   */
+  bool take(std::vector<Patch> &basicBlock, rword address, CPUMode cpuMode,
+            const LLVMCPU &llvmcpu);
+
+  /*! Discard the requests and the staged basic blocks overlapping a range.
+   *
+   * @param[in] start  The start of the range.
+   * @param[in] end    The end of the range (not included).
+   */
+  void discard(rword start, rword end);
+
+  /*! Discard all the requests and the staged basic blocks.
+   */
+  void discardAll();
+};
+
+} // namespace QBDI
+
+#endif // TRANSLATOR_H
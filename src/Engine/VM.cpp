@@ -17,6 +17,7 @@
  */
 #include <algorithm>
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -50,74 +51,126 @@
 
 namespace QBDI {
 
-VMAction memReadGate(VMInstanceRef vm, GPRState *gprState, FPRState *fprState,
-                     void *data) {
-  std::vector<std::pair<uint32_t, MemCBInfo>> &memCBInfos =
-      *static_cast<std::vector<std::pair<uint32_t, MemCBInfo>> *>(data);
-  std::vector<MemoryAccess> memAccesses = vm->getInstMemoryAccess();
-  RangeSet<rword> readRange;
-  for (const MemoryAccess &memAccess : memAccesses) {
-    if (memAccess.type & MEMORY_READ) {
-      Range<rword> accessRange(memAccess.accessAddress,
-                               memAccess.accessAddress + memAccess.size);
-      readRange.add(accessRange);
-    }
+static void loadInstMemoryAccess(const Engine &engine,
+                                 std::vector<MemoryAccess> &memAccess) {
+  memAccess.clear();
+  if constexpr (is_arm)
+    return;
+
+  const ExecBlock *curExecBlock = engine.getCurExecBlock();
+  if (curExecBlock == nullptr) {
+    return;
   }
+  uint16_t instID = curExecBlock->getCurrentInstID();
+  analyseMemoryAccess(*curExecBlock, instID, !engine.isPreInst(), memAccess);
+}
 
-  VMAction action = VMAction::CONTINUE;
-  for (const auto &p : memCBInfos) {
-    // Check access type and range
-    if (p.second.type == MEMORY_READ and readRange.overlaps(p.second.range)) {
-      // Forward to virtual callback
-      VMAction ret = p.second.cbk(vm, gprState, fprState, p.second.data);
-      // Always keep the most extreme action as the return
-      if (ret > action) {
-        action = ret;
-      }
-    }
+static void loadBBMemoryAccess(const Engine &engine,
+                               std::vector<MemoryAccess> &memAccess) {
+  memAccess.clear();
+  if constexpr (is_arm)
+    return;
+
+  const ExecBlock *curExecBlock = engine.getCurExecBlock();
+  if (curExecBlock == nullptr) {
+    return;
+  }
+  uint16_t bbID = curExecBlock->getCurrentSeqID();
+  uint16_t instID = curExecBlock->getCurrentInstID();
+  QBDI_DEBUG(
+      "Search MemoryAccess for Basic Block {:x} stopping at Instruction {:x}",
+      bbID, instID);
+
+  uint16_t endInstID = curExecBlock->getSeqEnd(bbID);
+  for (uint16_t itInstID = curExecBlock->getSeqStart(bbID);
+       itInstID <= std::min(endInstID, instID); itInstID++) {
+
+    analyseMemoryAccess(*curExecBlock, itInstID,
+                        itInstID != instID || !engine.isPreInst(), memAccess);
   }
-  return action;
 }
 
-VMAction memWriteGate(VMInstanceRef vm, GPRState *gprState, FPRState *fprState,
-                      void *data) {
-  std::vector<std::pair<uint32_t, MemCBInfo>> &memCBInfos =
-      *static_cast<std::vector<std::pair<uint32_t, MemCBInfo>> *>(data);
-  std::vector<MemoryAccess> memAccesses = vm->getInstMemoryAccess();
-  RangeSet<rword> readRange;
-  RangeSet<rword> writeRange;
-  for (const MemoryAccess &memAccess : memAccesses) {
-    Range<rword> accessRange(memAccess.accessAddress,
-                             memAccess.accessAddress + memAccess.size);
-    if (memAccess.type & MEMORY_READ) {
-      readRange.add(accessRange);
-    }
-    if (memAccess.type & MEMORY_WRITE) {
-      writeRange.add(accessRange);
-    }
+static size_t copyMemoryAccess(const std::vector<MemoryAccess> &memAccess,
+                               MemoryAccess *buffer, size_t size) {
+  if (buffer != nullptr) {
+    std::copy_n(memAccess.begin(), std::min(size, memAccess.size()), buffer);
+  }
+  return memAccess.size();
+}
+
+// Collect the callbacks triggered by an access of the current instruction.
+// Each callback is collected once, even if several accesses overlap its range,
+// and they are called in the order of their registration.
+template <typename Trigger>
+static void collectMemCBInfos(MemCBInfos &infos, Trigger trigger) {
+  const std::vector<MemoryAccess> &accesses = infos.accesses;
+  infos.matches.clear();
+  for (size_t i = 0; i < accesses.size(); i++) {
+    Range<rword> accessRange(accesses[i].accessAddress,
+                             accesses[i].accessAddress + accesses[i].size);
+    infos.ranges.forEachOverlap(accessRange, [&](const MemCBInfo &info) {
+      if (not trigger(info, accesses[i].type)) {
+        return;
+      }
+      // already collected with a previous access
+      for (size_t j = 0; j < i; j++) {
+        if (trigger(info, accesses[j].type) and
+            info.range.overlaps(Range<rword>(accesses[j].accessAddress,
+                                             accesses[j].accessAddress +
+                                                 accesses[j].size))) {
+          return;
+        }
+      }
+      infos.matches.push_back(info);
+    });
   }
+  // The index returns the callbacks by address, call them by registration
+  std::sort(infos.matches.begin(), infos.matches.end(),
+            [](const MemCBInfo &a, const MemCBInfo &b) { return a.id < b.id; });
+}
 
+static VMAction callMemCBInfos(const MemCBInfos &infos, VMInstanceRef vm,
+                               GPRState *gprState, FPRState *fprState) {
   VMAction action = VMAction::CONTINUE;
-  for (const auto &p : memCBInfos) {
-    // Check accessCB
-    // 1. has MEMORY_WRITE and write range overlaps
-    // 2. is MEMORY_READ_WRITE and read range overlaps
-    // note: the case with MEMORY_READ only is managed by memReadGate
-    if (((p.second.type & MEMORY_WRITE) and
-         writeRange.overlaps(p.second.range)) or
-        (p.second.type == MEMORY_READ_WRITE and
-         readRange.overlaps(p.second.range))) {
-      // Forward to virtual callback
-      VMAction ret = p.second.cbk(vm, gprState, fprState, p.second.data);
-      // Always keep the most extreme action as the return
-      if (ret > action) {
-        action = ret;
-      }
+  for (const MemCBInfo &info : infos.matches) {
+    // Forward to virtual callback
+    VMAction ret = info.cbk(vm, gprState, fprState, info.data);
+    // Always keep the most extreme action as the return
+    if (ret > action) {
+      action = ret;
     }
   }
   return action;
 }
 
+VMAction memReadGate(VMInstanceRef vm, GPRState *gprState, FPRState *fprState,
+                     void *data) {
+  MemCBInfos &infos = *static_cast<MemCBInfos *>(data);
+  loadInstMemoryAccess(*infos.engine, infos.accesses);
+
+  // Check access type and range
+  collectMemCBInfos(infos, [](const MemCBInfo &info, MemoryAccessType type) {
+    return info.type == MEMORY_READ and (type & MEMORY_READ);
+  });
+  return callMemCBInfos(infos, vm, gprState, fprState);
+}
+
+VMAction memWriteGate(VMInstanceRef vm, GPRState *gprState, FPRState *fprState,
+                      void *data) {
+  MemCBInfos &infos = *static_cast<MemCBInfos *>(data);
+  loadInstMemoryAccess(*infos.engine, infos.accesses);
+
+  // Check accessCB
+  // 1. has MEMORY_WRITE and write range overlaps
+  // 2. is MEMORY_READ_WRITE and read range overlaps
+  // note: the case with MEMORY_READ only is managed by memReadGate
+  collectMemCBInfos(infos, [](const MemCBInfo &info, MemoryAccessType type) {
+    return ((info.type & MEMORY_WRITE) and (type & MEMORY_WRITE)) or
+           (info.type == MEMORY_READ_WRITE and (type & MEMORY_READ));
+  });
+  return callMemCBInfos(infos, vm, gprState, fprState);
+}
+
 std::vector<InstrRuleDataCBK>
 InstrCBGateC(VMInstanceRef vm, const InstAnalysis *inst, void *_data) {
   InstrCBInfo *data = static_cast<InstrCBInfo *>(_data);
@@ -144,11 +197,6 @@ InstrRuleCBLambdaProxy(VMInstanceRef vm, const InstAnalysis *ana, void *_data) {
   return data(vm, ana);
 }
 
-VMAction stopCallback(VMInstanceRef vm, GPRState *gprState, FPRState *fprState,
-                      void *data) {
-  return VMAction::STOP;
-}
-
 // constructor
 
 VM::VM(const std::string &cpu, const std::vector<std::string> &mattrs,
@@ -160,7 +208,8 @@ VM::VM(const std::string &cpu, const std::vector<std::string> &mattrs,
   opts |= Options::OPT_DISABLE_FPR;
 #endif
   engine = std::make_unique<Engine>(cpu, mattrs, opts, this);
-  memCBInfos = std::make_unique<std::vector<std::pair<uint32_t, MemCBInfo>>>();
+  memCBInfos = std::make_unique<MemCBInfos>();
+  memCBInfos->engine = engine.get();
   instrCBInfos = std::make_unique<
       std::vector<std::pair<uint32_t, std::unique_ptr<InstrCBInfo>>>>();
 }
@@ -207,13 +256,13 @@ VM &VM::operator=(VM &&vm) {
 VM::VM(const VM &vm)
     : engine(std::make_unique<Engine>(*vm.engine)),
       memoryLoggingLevel(vm.memoryLoggingLevel),
-      memCBInfos(std::make_unique<std::vector<std::pair<uint32_t, MemCBInfo>>>(
-          *vm.memCBInfos)),
+      memCBInfos(std::make_unique<MemCBInfos>(*vm.memCBInfos)),
       memCBID(vm.memCBID), memReadGateCBID(vm.memReadGateCBID),
       memWriteGateCBID(vm.memWriteGateCBID), vmCBData(vm.vmCBData),
       instCBData(vm.instCBData), instrRuleCBData(vm.instrRuleCBData) {
 
   engine->changeVMInstanceRef(this);
+  memCBInfos->engine = engine.get();
   instrCBInfos = std::make_unique<
       std::vector<std::pair<uint32_t, std::unique_ptr<InstrCBInfo>>>>();
   for (const auto &p : *vm.instrCBInfos) {
@@ -240,13 +289,9 @@ VM::VM(const VM &vm)
 
   for (std::pair<uint32_t, InstCbLambda> &p : instCBData) {
     if (p.first & EVENTID_VIRTCB_MASK) {
-      uint32_t id = p.first;
-      auto it = std::find_if(memCBInfos->begin(), memCBInfos->end(),
-                             [id](const std::pair<uint32_t, MemCBInfo> &el) {
-                               return id == el.first;
-                             });
-      QBDI_REQUIRE_ACTION(it != memCBInfos->end(), abort());
-      it->second.data = &p.second;
+      MemCBInfo *info = memCBInfos->ranges.find(p.first);
+      QBDI_REQUIRE_ACTION(info != nullptr, abort());
+      info->data = &p.second;
     } else {
       InstrRule *rule = engine->getInstrRule(p.first);
       QBDI_REQUIRE_ACTION(rule != nullptr, abort());
@@ -266,6 +311,7 @@ VM::VM(const VM &vm)
 VM &VM::operator=(const VM &vm) {
   *engine = *vm.engine;
   *memCBInfos = *vm.memCBInfos;
+  memCBInfos->engine = engine.get();
 
   memoryLoggingLevel = vm.memoryLoggingLevel;
   memCBID = vm.memCBID;
@@ -300,13 +346,9 @@ VM &VM::operator=(const VM &vm) {
   instCBData = vm.instCBData;
   for (std::pair<uint32_t, InstCbLambda> &p : instCBData) {
     if (p.first & EVENTID_VIRTCB_MASK) {
-      uint32_t id = p.first;
-      auto it = std::find_if(memCBInfos->begin(), memCBInfos->end(),
-                             [id](const std::pair<uint32_t, MemCBInfo> &el) {
-                               return id == el.first;
-                             });
-      QBDI_REQUIRE_ACTION(it != memCBInfos->end(), abort());
-      it->second.data = &p.second;
+      MemCBInfo *info = memCBInfos->ranges.find(p.first);
+      QBDI_REQUIRE_ACTION(info != nullptr, abort());
+      info->data = &p.second;
     } else {
       InstrRule *rule = engine->getInstrRule(p.first);
       QBDI_REQUIRE_ACTION(rule != nullptr, abort());
@@ -361,6 +403,12 @@ void VM::setOptions(Options options) {
   engine->setOptions(options);
 }
 
+// setExecBlockSize
+
+bool VM::setExecBlockSize(size_t codeSize, size_t dataSize) {
+  return engine->setExecBlockSize(codeSize, dataSize);
+}
+
 // addInstrumentedRange
 
 void VM::addInstrumentedRange(rword start, rword end) {
@@ -413,13 +461,7 @@ bool VM::removeInstrumentedModuleFromAddr(rword addr) {
 
 // run
 
-bool VM::run(rword start, rword stop) {
-  uint32_t stopCB =
-      addCodeAddrCB(stop, InstPosition::PREINST, stopCallback, nullptr);
-  bool ret = engine->run(start, stop);
-  deleteInstrumentation(stopCB);
-  return ret;
-}
+bool VM::run(rword start, rword stop) { return engine->run(start, stop); }
 
 // callA
 
@@ -595,24 +637,26 @@ uint32_t VM::addMnemonicCB(const char *mnemonic, InstPosition pos,
 // addCodeCB
 
 uint32_t VM::addCodeCB(InstPosition pos, InstCallback cbk, void *data,
-                       int priority) {
+                       int priority, CallbackFlags flags) {
   QBDI_REQUIRE_ACTION(cbk != nullptr, return VMError::INVALID_EVENTID);
   return engine->addInstrRule(InstrRuleBasicCBK::unique(
       True::unique(), cbk, data, pos, true, priority,
-      (pos == PREINST) ? RelocTagPreInstStdCBK : RelocTagPostInstStdCBK));
+      (pos == PREINST) ? RelocTagPreInstStdCBK : RelocTagPostInstStdCBK,
+      (flags & CALLBACK_INLINE) != 0));
 }
 
-uint32_t VM::addCodeCB(InstPosition pos, const InstCbLambda &cbk,
-                       int priority) {
+uint32_t VM::addCodeCB(InstPosition pos, const InstCbLambda &cbk, int priority,
+                       CallbackFlags flags) {
   auto &el = instCBData.emplace_front(0xffffffff, cbk);
-  uint32_t id = addCodeCB(pos, InstCBLambdaProxy, &el.second, priority);
+  uint32_t id = addCodeCB(pos, InstCBLambdaProxy, &el.second, priority, flags);
   el.first = id;
   return id;
 }
 
-uint32_t VM::addCodeCB(InstPosition pos, InstCbLambda &&cbk, int priority) {
+uint32_t VM::addCodeCB(InstPosition pos, InstCbLambda &&cbk, int priority,
+                       CallbackFlags flags) {
   auto &el = instCBData.emplace_front(0xffffffff, std::move(cbk));
-  uint32_t id = addCodeCB(pos, InstCBLambdaProxy, &el.second, priority);
+  uint32_t id = addCodeCB(pos, InstCBLambdaProxy, &el.second, priority, flags);
   el.first = id;
   return id;
 }
@@ -759,8 +803,8 @@ uint32_t VM::addMemRangeCB(rword start, rword end, MemoryAccessType type,
   uint32_t id = memCBID++;
   QBDI_REQUIRE_ACTION(id < EVENTID_VIRTCB_MASK,
                       return VMError::INVALID_EVENTID);
-  memCBInfos->emplace_back(id | EVENTID_VIRTCB_MASK,
-                           MemCBInfo{type, {start, end}, cbk, data});
+  memCBInfos->ranges.insert(id | EVENTID_VIRTCB_MASK, {start, end},
+                            MemCBInfo{type, {start, end}, cbk, data, id});
   return id | EVENTID_VIRTCB_MASK;
 }
 
@@ -806,15 +850,9 @@ uint32_t VM::addVMEventCB(VMEvent mask, VMCbLambda &&cbk) {
 
 bool VM::deleteInstrumentation(uint32_t id) {
   if (id & EVENTID_VIRTCB_MASK) {
-    auto found = std::remove_if(memCBInfos->begin(), memCBInfos->end(),
-                                [id](const std::pair<uint32_t, MemCBInfo> &el) {
-                                  return id == el.first;
-                                });
-    if (found == memCBInfos->end()) {
+    if (not memCBInfos->ranges.erase(id)) {
       return false;
     }
-
-    memCBInfos->erase(found, memCBInfos->end());
     instCBData.remove_if([id](const std::pair<uint32_t, InstCbLambda> &x) {
       return x.first == id;
     });
@@ -847,7 +885,7 @@ void VM::deleteAllInstrumentations() {
   engine->deleteAllInstrumentations();
   memReadGateCBID = VMError::INVALID_EVENTID;
   memWriteGateCBID = VMError::INVALID_EVENTID;
-  memCBInfos->clear();
+  memCBInfos->ranges.clear();
   instrCBInfos->clear();
   vmCBData.clear();
   instCBData.clear();
@@ -895,50 +933,117 @@ bool VM::recordMemoryAccess(MemoryAccessType type) {
 // getInstMemoryAccess
 
 std::vector<MemoryAccess> VM::getInstMemoryAccess() const {
-  if constexpr (is_arm)
-    return {};
-
-  const ExecBlock *curExecBlock = engine->getCurExecBlock();
-  if (curExecBlock == nullptr) {
-    return {};
-  }
-  uint16_t instID = curExecBlock->getCurrentInstID();
   std::vector<MemoryAccess> memAccess;
-  analyseMemoryAccess(*curExecBlock, instID, !engine->isPreInst(), memAccess);
+  loadInstMemoryAccess(*engine, memAccess);
   return memAccess;
 }
 
 // getBBMemoryAccess
 
 std::vector<MemoryAccess> VM::getBBMemoryAccess() const {
+  std::vector<MemoryAccess> memAccess;
+  loadBBMemoryAccess(*engine, memAccess);
+  return memAccess;
+}
+
+// copyInstMemoryAccess
+
+size_t VM::copyInstMemoryAccess(MemoryAccess *buffer, size_t size) const {
+  loadInstMemoryAccess(*engine, memAccessBuffer);
+  return copyMemoryAccess(memAccessBuffer, buffer, size);
+}
+
+// copyBBMemoryAccess
+
+size_t VM::copyBBMemoryAccess(MemoryAccess *buffer, size_t size) const {
+  loadBBMemoryAccess(*engine, memAccessBuffer);
+  return copyMemoryAccess(memAccessBuffer, buffer, size);
+}
+
+// setMemoryTraceBuffer
+
+bool VM::setMemoryTraceBuffer(MemoryAccessType type, MemoryAccess *buffer,
+                              size_t size, size_t highWaterMark,
+                              MemTraceCallback cbk, void *data) {
   if constexpr (is_arm)
-    return {};
+    return false;
 
-  const ExecBlock *curExecBlock = engine->getCurExecBlock();
-  if (curExecBlock == nullptr) {
-    return {};
-  }
-  uint16_t bbID = curExecBlock->getCurrentSeqID();
-  uint16_t instID = curExecBlock->getCurrentInstID();
-  std::vector<MemoryAccess> memAccess;
-  QBDI_DEBUG(
-      "Search MemoryAccess for Basic Block {:x} stopping at Instruction {:x}",
-      bbID, instID);
+  return engine->setMemoryTrace(type, buffer, size, highWaterMark, cbk, data);
+}
 
-  uint16_t endInstID = curExecBlock->getSeqEnd(bbID);
-  for (uint16_t itInstID = curExecBlock->getSeqStart(bbID);
-       itInstID <= std::min(endInstID, instID); itInstID++) {
+// removeMemoryTraceBuffer
 
-    analyseMemoryAccess(*curExecBlock, itInstID,
-                        itInstID != instID || !engine->isPreInst(), memAccess);
-  }
-  return memAccess;
+bool VM::removeMemoryTraceBuffer() { return engine->removeMemoryTrace(); }
+
+// addBBCounterRange
+
+uint32_t VM::addBBCounterRange(rword start, rword end) {
+  QBDI_REQUIRE_ACTION(start < end, return VMError::INVALID_EVENTID);
+  return engine->addInstrRule(InstrRuleBBEnd::unique(Range<rword>(start, end),
+                                                     getBBCounterGenerator()));
+}
+
+// addCoverageMapRange
+
+uint32_t VM::addCoverageMapRange(rword start, rword end, uint8_t *map) {
+  QBDI_REQUIRE_ACTION(start < end, return VMError::INVALID_EVENTID);
+  QBDI_REQUIRE_ACTION(map != nullptr, return VMError::INVALID_EVENTID);
+  return engine->addInstrRule(InstrRuleBBEnd::unique(
+      Range<rword>(start, end), getCoverageMapGenerator(map, start)));
+}
+
+// getBBCounter
+
+uint64_t VM::getBBCounter(rword bbEnd) const {
+  return engine->getBBCounter(bbEnd);
 }
 
+// getBBCounters
+
+std::vector<std::pair<rword, uint64_t>> VM::getBBCounters() const {
+  std::map<rword, uint64_t> counters = engine->getBBCounters();
+  return {counters.begin(), counters.end()};
+}
+
+// resetBBCounters
+
+void VM::resetBBCounters() { engine->resetBBCounters(); }
+
 // precacheBasicBlock
 
 bool VM::precacheBasicBlock(rword pc) { return engine->precacheBasicBlock(pc); }
 
+// precacheRange
+
+bool VM::precacheRange(rword start, rword end, PrecacheReport *report,
+                       unsigned threads) {
+  if (start >= end) {
+    return false;
+  }
+  RangeSet<rword> ranges;
+  ranges.add(Range<rword>(start, end));
+  return engine->precacheRanges(ranges, report, threads);
+}
+
+// precacheModule
+
+bool VM::precacheModule(const std::string &name, PrecacheReport *report,
+                        unsigned threads) {
+  if (name.empty()) {
+    return false;
+  }
+  RangeSet<rword> ranges;
+  for (const MemoryMap &m : getCurrentProcessMaps()) {
+    if ((m.name == name) && (m.permission & QBDI::PF_EXEC)) {
+      ranges.add(m.range);
+    }
+  }
+  if (ranges.size() == 0) {
+    return false;
+  }
+  return engine->precacheRanges(ranges, report, threads);
+}
+
 // clearAllCache
 
 void VM::clearAllCache() { engine->clearAllCache(); }
@@ -947,4 +1052,22 @@ void VM::clearAllCache() { engine->clearAllCache(); }
 
 void VM::clearCache(rword start, rword end) { engine->clearCache(start, end); }
 
+// setCacheBudget
+
+void VM::setCacheBudget(size_t budget) { engine->setCacheBudget(budget); }
+
+// getCacheStats
+
+CacheStats VM::getCacheStats() const { return engine->getCacheStats(); }
+
+// setPersistentCache
+
+bool VM::setPersistentCache(const std::string &directory) {
+  return engine->setPersistentCache(directory);
+}
+
+// savePersistentCache
+
+bool VM::savePersistentCache() { return engine->savePersistentCache(); }
+
 } // namespace QBDI
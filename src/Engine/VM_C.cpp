@@ -157,6 +157,12 @@ void qbdi_setOptions(VMInstanceRef instance, Options options) {
   static_cast<VM *>(instance)->setOptions(options);
 }
 
+bool qbdi_setExecBlockSize(VMInstanceRef instance, size_t codeSize,
+                           size_t dataSize) {
+  QBDI_REQUIRE_ACTION(instance, return false);
+  return static_cast<VM *>(instance)->setExecBlockSize(codeSize, dataSize);
+}
+
 uint32_t qbdi_addMnemonicCB(VMInstanceRef instance, const char *mnemonic,
                             InstPosition pos, InstCallback cbk, void *data,
                             int priority) {
@@ -171,6 +177,13 @@ uint32_t qbdi_addCodeCB(VMInstanceRef instance, InstPosition pos,
   return static_cast<VM *>(instance)->addCodeCB(pos, cbk, data, priority);
 }
 
+uint32_t qbdi_addInlineCodeCB(VMInstanceRef instance, InstPosition pos,
+                              InstCallback cbk, void *data, int priority) {
+  QBDI_REQUIRE_ACTION(instance, return VMError::INVALID_EVENTID);
+  return static_cast<VM *>(instance)->addCodeCB(pos, cbk, data, priority,
+                                                CALLBACK_INLINE);
+}
+
 uint32_t qbdi_addCodeAddrCB(VMInstanceRef instance, rword address,
                             InstPosition pos, InstCallback cbk, void *data,
                             int priority) {
@@ -283,11 +296,73 @@ MemoryAccess *qbdi_getBBMemoryAccess(VMInstanceRef instance, size_t *size) {
   return ma_arr;
 }
 
+size_t qbdi_copyInstMemoryAccess(VMInstanceRef instance, MemoryAccess *buffer,
+                                 size_t size) {
+  QBDI_REQUIRE_ACTION(instance, return 0);
+  return static_cast<VM *>(instance)->copyInstMemoryAccess(buffer, size);
+}
+
+size_t qbdi_copyBBMemoryAccess(VMInstanceRef instance, MemoryAccess *buffer,
+                               size_t size) {
+  QBDI_REQUIRE_ACTION(instance, return 0);
+  return static_cast<VM *>(instance)->copyBBMemoryAccess(buffer, size);
+}
+
+bool qbdi_setMemoryTraceBuffer(VMInstanceRef instance, MemoryAccessType type,
+                               MemoryAccess *buffer, size_t size,
+                               size_t highWaterMark, MemTraceCallback cbk,
+                               void *data) {
+  QBDI_REQUIRE_ACTION(instance, return false);
+  return static_cast<VM *>(instance)->setMemoryTraceBuffer(
+      type, buffer, size, highWaterMark, cbk, data);
+}
+
+bool qbdi_removeMemoryTraceBuffer(VMInstanceRef instance) {
+  QBDI_REQUIRE_ACTION(instance, return false);
+  return static_cast<VM *>(instance)->removeMemoryTraceBuffer();
+}
+
+uint32_t qbdi_addBBCounterRange(VMInstanceRef instance, rword start,
+                                rword end) {
+  QBDI_REQUIRE_ACTION(instance, return VMError::INVALID_EVENTID);
+  return static_cast<VM *>(instance)->addBBCounterRange(start, end);
+}
+
+uint32_t qbdi_addCoverageMapRange(VMInstanceRef instance, rword start,
+                                  rword end, uint8_t *map) {
+  QBDI_REQUIRE_ACTION(instance, return VMError::INVALID_EVENTID);
+  return static_cast<VM *>(instance)->addCoverageMapRange(start, end, map);
+}
+
+uint64_t qbdi_getBBCounter(VMInstanceRef instance, rword bbEnd) {
+  QBDI_REQUIRE_ACTION(instance, return 0);
+  return static_cast<VM *>(instance)->getBBCounter(bbEnd);
+}
+
+void qbdi_resetBBCounters(VMInstanceRef instance) {
+  QBDI_REQUIRE_ACTION(instance, return );
+  static_cast<VM *>(instance)->resetBBCounters();
+}
+
 bool qbdi_precacheBasicBlock(VMInstanceRef instance, rword pc) {
   QBDI_REQUIRE_ACTION(instance, return false);
   return static_cast<VM *>(instance)->precacheBasicBlock(pc);
 }
 
+bool qbdi_precacheRange(VMInstanceRef instance, rword start, rword end,
+                        PrecacheReport *report, unsigned threads) {
+  QBDI_REQUIRE_ACTION(instance, return false);
+  return static_cast<VM *>(instance)->precacheRange(start, end, report,
+                                                    threads);
+}
+
+bool qbdi_precacheModule(VMInstanceRef instance, const char *name,
+                         PrecacheReport *report, unsigned threads) {
+  QBDI_REQUIRE_ACTION(instance, return false);
+  QBDI_REQUIRE_ACTION(name, return false);
+  return static_cast<VM *>(instance)->precacheModule(name, report, threads);
+}
+
 void qbdi_clearAllCache(VMInstanceRef instance) {
   static_cast<VM *>(instance)->clearAllCache();
 }
@@ -296,6 +371,29 @@ void qbdi_clearCache(VMInstanceRef instance, rword start, rword end) {
   static_cast<VM *>(instance)->clearCache(start, end);
 }
 
+void qbdi_setCacheBudget(VMInstanceRef instance, size_t budget) {
+  QBDI_REQUIRE_ACTION(instance, return );
+  static_cast<VM *>(instance)->setCacheBudget(budget);
+}
+
+bool qbdi_getCacheStats(VMInstanceRef instance, CacheStats *stats) {
+  QBDI_REQUIRE_ACTION(instance, return false);
+  QBDI_REQUIRE_ACTION(stats, return false);
+  *stats = static_cast<VM *>(instance)->getCacheStats();
+  return true;
+}
+
+bool qbdi_setPersistentCache(VMInstanceRef instance, const char *directory) {
+  QBDI_REQUIRE_ACTION(instance, return false);
+  return static_cast<VM *>(instance)->setPersistentCache(
+      directory != nullptr ? directory : "");
+}
+
+bool qbdi_savePersistentCache(VMInstanceRef instance) {
+  QBDI_REQUIRE_ACTION(instance, return false);
+  return static_cast<VM *>(instance)->savePersistentCache();
+}
+
 uint32_t qbdi_addInstrRule(VMInstanceRef instance, InstrRuleCallbackC cbk,
                            AnalysisType type, void *data) {
   QBDI_REQUIRE_ACTION(instance, return VMError::INVALID_EVENTID);
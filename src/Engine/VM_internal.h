@@ -18,15 +18,32 @@
 #ifndef QBDI_VM_INTERNAL_H_
 #define QBDI_VM_INTERNAL_H_
 
+#include <vector>
+
 #include "QBDI/VM.h"
+#include "Utility/IntervalIndex.h"
 
 namespace QBDI {
 
+class Engine;
+
 struct MemCBInfo {
   MemoryAccessType type;
   Range<rword> range;
   InstCallback cbk;
   void *data;
+  // registration ID, the callbacks are called in this order
+  uint32_t id;
+};
+
+struct MemCBInfos {
+  // Callbacks indexed by their range and their ID
+  IntervalIndex<MemCBInfo> ranges;
+  // Engine of the VM, used by the gates to analyse the memory accesses
+  const Engine *engine = nullptr;
+  // Buffers reused by the gates to avoid an allocation on each access
+  std::vector<MemoryAccess> accesses;
+  std::vector<MemCBInfo> matches;
 };
 
 struct InstrCBInfo {
@@ -53,9 +70,6 @@ VMAction InstCBLambdaProxy(VMInstanceRef vm, GPRState *gprState,
 std::vector<InstrRuleDataCBK>
 InstrRuleCBLambdaProxy(VMInstanceRef vm, const InstAnalysis *ana, void *_data);
 
-VMAction stopCallback(VMInstanceRef vm, GPRState *gprState, FPRState *fprState,
-                      void *data);
-
 } // namespace QBDI
 
 #endif // QBDI_VM_INTERNAL_H_
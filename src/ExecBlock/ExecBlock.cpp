@@ -48,54 +48,122 @@
 
 namespace QBDI {
 
+// iOS now use 16k superpages, but as JIT mecanisms are totally differents
+// on this platform, we can enforce a 4k "virtual" page size
+static uint64_t getExecBlockPageSize() {
+  return is_ios ? 4096
+                : llvm::expectedToOptional(llvm::sys::Process::getPageSize())
+                      .getValueOr(4096);
+}
+
+bool ExecBlock::isValidBlockSize(size_t size) {
+  return size <= EXEC_BLOCK_MAX_SIZE and size % getExecBlockPageSize() == 0;
+}
+
 ExecBlock::ExecBlock(
     const LLVMCPUs &llvmCPUs, VMInstanceRef vminstance,
     const std::vector<std::unique_ptr<RelocatableInst>> *execBlockPrologue,
     const std::vector<std::unique_ptr<RelocatableInst>> *execBlockEpilogue,
-    uint32_t epilogueSize_)
-    : vminstance(vminstance), llvmCPUs(llvmCPUs), epilogueSize(epilogueSize_),
-      isFull(false) {
+    const std::vector<std::unique_ptr<RelocatableInst>> *execBlockInlineCall,
+    uint32_t epilogueSize_, size_t codeSize, size_t dataSize)
+    : vminstance(vminstance), llvmCPUs(llvmCPUs), chainPending(false),
+      referenced(false), epilogueSize(epilogueSize_), inlineCallStart(0),
+      reentryStart(0), isFull(false) {
 
   // Allocate memory blocks
   std::error_code ec;
-  // iOS now use 16k superpages, but as JIT mecanisms are totally differents
-  // on this platform, we can enforce a 4k "virtual" page size
-  uint64_t pageSize =
-      is_ios ? 4096
-             : llvm::expectedToOptional(llvm::sys::Process::getPageSize())
-                   .getValueOr(4096);
+  uint64_t pageSize = getExecBlockPageSize();
   unsigned mflags = PF::MF_READ | PF::MF_WRITE;
 
   if constexpr (is_ios)
     mflags |= PF::MF_EXEC;
 
-  // Allocate 2 pages block
-  codeBlock = QBDI::allocateMappedMemory(2 * pageSize, nullptr, mflags, ec);
+  if (codeSize == 0) {
+    codeSize = pageSize;
+  }
+  if (dataSize == 0) {
+    // keep at least half a page for the shadows after the context
+    dataSize = pageSize;
+    while (dataSize - sizeof(Context) < pageSize / 2) {
+      dataSize += pageSize;
+    }
+  }
+  QBDI_REQUIRE_ACTION(isValidBlockSize(codeSize) and isValidBlockSize(dataSize),
+                      abort());
+  QBDI_REQUIRE_ACTION(sizeof(Context) < dataSize, abort());
+
+  const LLVMCPU &llvmcpu = llvmCPUs.getCPU(CPUMode::DEFAULT);
+
+#if defined(QBDI_PLATFORM_LINUX)
+  // Map the code block twice, RX for the execution and RW for the codeStream
+  if (llvmcpu.getOptions() & Options::OPT_ENABLE_DUAL_MAPPING) {
+    codeBlock = QBDI::allocateDualMappedMemory(codeSize + dataSize, codeSize,
+                                               codeWriteBlock, ec);
+    if (codeBlock.base() == nullptr) {
+      QBDI_WARN("Fail to allocate a dual mapped ExecBlock ({}), fallback to "
+                "the default memory",
+                ec.message());
+    }
+  }
+#endif
+
+  // A code block made of whole huge pages keeps them when it is switched to
+  // RX, the data block uses the following pages.
+  if constexpr (not is_ios) {
+    if (codeBlock.base() == nullptr and codeSize % HUGE_PAGE_SIZE == 0) {
+      codeBlock = QBDI::allocateHugeMappedMemory(codeSize + dataSize, ec);
+      if (codeBlock.base() == nullptr) {
+        QBDI_DEBUG("Fail to allocate an ExecBlock on huge pages ({})",
+                   ec.message());
+      }
+    }
+  }
+
+  // Allocate the code and data blocks
+  if (codeBlock.base() == nullptr) {
+    codeBlock = QBDI::allocateMappedMemory(codeSize + dataSize, nullptr,
+                                           mflags, ec);
+  }
   QBDI_REQUIRE_ACTION(codeBlock.base() != nullptr, abort());
   // Split it in two blocks
   dataBlock = llvm::sys::MemoryBlock(
       reinterpret_cast<void *>(reinterpret_cast<uint64_t>(codeBlock.base()) +
-                               pageSize),
-      pageSize);
-  codeBlock = llvm::sys::MemoryBlock(codeBlock.base(), pageSize);
-  QBDI_DEBUG("codeBlock @ 0x{:x} | dataBlock @ 0x{:x} | pageSize {} bytes",
+                               codeSize),
+      dataSize);
+  codeBlock = llvm::sys::MemoryBlock(codeBlock.base(), codeSize);
+  QBDI_DEBUG("codeBlock @ 0x{:x} | dataBlock @ 0x{:x} | codeSize {} bytes | "
+             "dataSize {} bytes",
              reinterpret_cast<rword>(codeBlock.base()),
-             reinterpret_cast<rword>(dataBlock.base()), pageSize);
+             reinterpret_cast<rword>(dataBlock.base()),
+             codeBlock.allocatedSize(), dataBlock.allocatedSize());
 
   // Other initializations
   context = static_cast<Context *>(dataBlock.base());
+  for (IBTCEntry &entry : context->ibtc) {
+    entry.target = IBTC_EMPTY;
+  }
+  context->hostState.vm = reinterpret_cast<rword>(vminstance);
   shadows = reinterpret_cast<rword *>(
       reinterpret_cast<rword>(dataBlock.base()) + sizeof(Context));
   shadowIdx = 0;
+  // The shadow IDs are 16 bits
+  shadowCapacity = static_cast<uint32_t>(std::min<size_t>(
+      (dataBlock.allocatedSize() - sizeof(Context)) / sizeof(rword), 0xFFFF));
   currentSeq = 0;
   currentInst = 0;
-  codeStream = std::make_unique<memory_ostream>(codeBlock);
-  pageState = RW;
+  if (isDualMapped()) {
+    // The code is written through the RW view and the RX view is always
+    // executable
+    codeStream = std::make_unique<memory_ostream>(codeWriteBlock);
+    pageState = RX;
+  } else {
+    codeStream = std::make_unique<memory_ostream>(codeBlock);
+    pageState = RW;
+  }
 
   std::vector<std::unique_ptr<RelocatableInst>> execBlockPrologue_;
   std::vector<std::unique_ptr<RelocatableInst>> execBlockEpilogue_;
-
-  const LLVMCPU &llvmcpu = llvmCPUs.getCPU(CPUMode::DEFAULT);
+  std::vector<std::unique_ptr<RelocatableInst>> execBlockInlineCall_;
 
   if (execBlockPrologue == nullptr) {
     execBlockPrologue_ = getExecBlockPrologue(llvmcpu.getOptions());
@@ -105,6 +173,10 @@ ExecBlock::ExecBlock(
     execBlockEpilogue_ = getExecBlockEpilogue(llvmcpu.getOptions());
     execBlockEpilogue = &execBlockEpilogue_;
   }
+  if (execBlockInlineCall == nullptr) {
+    execBlockInlineCall_ = getExecBlockInlineCall(llvmcpu.getOptions());
+    execBlockInlineCall = &execBlockInlineCall_;
+  }
 
   if (epilogueSize == 0) {
     // Only way to know the epilogue size is to JIT is somewhere
@@ -118,36 +190,56 @@ ExecBlock::ExecBlock(
     codeStream->seek(0);
     QBDI_DEBUG("Detect Epilogue size: {}", epilogueSize);
   }
-  // JIT prologue and epilogue
-  codeStream->seek(codeBlock.allocatedSize() - epilogueSize);
-  for (const auto &inst : *execBlockEpilogue) {
+  // JIT the prologue, the epilogue may jump to its reentry point
+  codeStream->seek(0);
+  for (const auto &inst : *execBlockPrologue) {
+    if (inst->getTag() == RelocatableInstTag::RelocTagReentry) {
+      reentryStart = static_cast<uint32_t>(codeStream->current_pos());
+      continue;
+    }
     if (inst->getTag() != RelocatableInstTag::RelocInst) {
       continue;
     }
     llvmcpu.writeInstruction(inst->reloc(this), codeStream.get());
   }
-  QBDI_REQUIRE_ACTION(codeStream->current_pos() == codeBlock.allocatedSize() &&
-                          "Wrong Epilogue Size",
-                      abort());
-
-  codeStream->seek(0);
-  for (const auto &inst : *execBlockPrologue) {
+  // JIT the inline callback routine after the prologue
+  inlineCallStart = static_cast<uint32_t>(codeStream->current_pos());
+  for (const auto &inst : *execBlockInlineCall) {
+    if (inst->getTag() != RelocatableInstTag::RelocInst) {
+      continue;
+    }
+    llvmcpu.writeInstruction(inst->reloc(this), codeStream.get());
+  }
+  uint64_t codeStart = codeStream->current_pos();
+  // JIT the epilogue at the end of the code block
+  codeStream->seek(codeBlock.allocatedSize() - epilogueSize);
+  for (const auto &inst : *execBlockEpilogue) {
     if (inst->getTag() != RelocatableInstTag::RelocInst) {
       continue;
     }
     llvmcpu.writeInstruction(inst->reloc(this), codeStream.get());
   }
+  QBDI_REQUIRE_ACTION(codeStream->current_pos() == codeBlock.allocatedSize() &&
+                          "Wrong Epilogue Size",
+                      abort());
+  // The sequences are written after the inline callback routine
+  codeStream->seek(codeStart);
 }
 
 ExecBlock::~ExecBlock() {
   // Reunite the 2 blocks before freeing them
   codeBlock = llvm::sys::MemoryBlock(
       codeBlock.base(), codeBlock.allocatedSize() + dataBlock.allocatedSize());
-  QBDI::releaseMappedMemory(codeBlock);
+  if (isDualMapped()) {
+    QBDI::releaseDualMappedMemory(codeBlock, codeWriteBlock);
+  } else {
+    QBDI::releaseMappedMemory(codeBlock);
+  }
 }
 
 void ExecBlock::changeVMInstanceRef(VMInstanceRef vminstance) {
   this->vminstance = vminstance;
+  context->hostState.vm = reinterpret_cast<rword>(vminstance);
 }
 
 void ExecBlock::show() const {
@@ -194,6 +286,7 @@ void ExecBlock::show() const {
 VMAction ExecBlock::execute() {
   QBDI_DEBUG("Executing ExecBlock 0x{:x} programmed with selector at 0x{:x}",
              reinterpret_cast<uintptr_t>(this), context->hostState.selector);
+  referenced = true;
 
   do {
     context->hostState.callback = static_cast<rword>(0);
@@ -205,6 +298,11 @@ VMAction ExecBlock::execute() {
 
     if (context->hostState.callback != 0) {
       currentInst = context->hostState.origin;
+      // The callback may come from a sequence reached through a link
+      if (currentInst < seqRegistry[currentSeq].startInstID or
+          currentInst > seqRegistry[currentSeq].endInstID) {
+        currentSeq = instRegistry[currentInst].seqID;
+      }
       rword currentPC = QBDI_GPR_GET(&context->gprState, REG_PC);
 
       QBDI_DEBUG("Callback request by ExecBlock 0x{:x} for callback 0x{:x}",
@@ -287,7 +385,8 @@ VMAction ExecBlock::execute() {
 
 SeqWriteResult
 ExecBlock::writeSequence(std::vector<Patch>::const_iterator seqIt,
-                         std::vector<Patch>::const_iterator seqEnd) {
+                         std::vector<Patch>::const_iterator seqEnd, bool trace,
+                         bool loop) {
   rword startOffset = (rword)codeStream->current_pos();
   uint16_t startInstID = getNextInstID();
   uint16_t seqID = getNextSeqID();
@@ -338,7 +437,18 @@ ExecBlock::writeSequence(std::vector<Patch>::const_iterator seqIt,
 
     // Attempt to write a complete patch. If not, rollback to the last complete
     // patch written
-    if (not writePatch(*seqIt, llvmcpu)) {
+    if (not hasRoomForPatch(*seqIt)) {
+      isFull = true;
+    }
+    // In a trace, the jumps to the next basic block are checked
+    rword successor = 0;
+    bool needGuard = trace and std::next(seqIt) != seqEnd and
+                     seqIt->metadata.modifyPC and
+                     not(getDirectSuccessor(seqIt->metadata, successor) and
+                         successor == std::next(seqIt)->metadata.address);
+    if (isFull or not writePatch(*seqIt, llvmcpu) or
+        (needGuard and
+         not writeTraceGuard(std::next(seqIt)->metadata.address, llvmcpu))) {
 
       QBDI_DEBUG("Rolling back to offset 0x{:x}", rollbackOffset);
 
@@ -355,7 +465,8 @@ ExecBlock::writeSequence(std::vector<Patch>::const_iterator seqIt,
                    reinterpret_cast<uintptr_t>(this));
         return {EXEC_BLOCK_FULL, 0, 0};
       }
-      needTerminator = true;
+      // A trace may stop after a jump
+      needTerminator = not instMetadata.back().modifyPC;
       break;
     } else {
       // Complete instruction was written, we add the metadata
@@ -364,10 +475,10 @@ ExecBlock::writeSequence(std::vector<Patch>::const_iterator seqIt,
       instMetadata.back().analysis.reset(seqIt->metadata.analysis.release());
       // Register instruction
       instRegistry.push_back(InstInfo{
-          seqID, static_cast<uint16_t>(rollbackOffset), 0,
+          seqID, static_cast<uint32_t>(rollbackOffset), 0,
           static_cast<uint16_t>(rollbackShadowRegistry),
           static_cast<uint16_t>(shadowRegistry.size() - rollbackShadowRegistry),
-          static_cast<uint16_t>(rollbackTagRegistry),
+          static_cast<uint32_t>(rollbackTagRegistry),
           static_cast<uint16_t>(tagRegistry.size() - rollbackTagRegistry)});
       // compute offsetSkip of the new instruction
       std::vector<TagInfo> endPatchTag =
@@ -381,6 +492,39 @@ ExecBlock::writeSequence(std::vector<Patch>::const_iterator seqIt,
       patchWritten += 1;
     }
   }
+  // A trace written up to its end jumps back to its start when its last basic
+  // block branches to the first one.
+  bool looped = false;
+  if (trace and loop and seqIt == seqEnd) {
+    rword head = instMetadata[startInstID].address;
+    const InstMetadata &last = instMetadata.back();
+    rword successor = 0;
+    if (not last.modifyPC) {
+      looped = (last.endAddress() == head);
+    } else if (getDirectSuccessor(last, successor) and successor == head) {
+      looped = true;
+    } else {
+      looped = writeTraceGuard(head, llvmcpu);
+    }
+    if (looped) {
+      // The loop is a chain to the start of the sequence: it is unlinked with
+      // the other chains when the trace must not run anymore.
+      uint16_t shadowID = newShadow();
+      setShadow(shadowID,
+                reinterpret_cast<rword>(codeBlock.base()) +
+                    static_cast<rword>(instRegistry[startInstID].offset));
+      chainRegistry.push_back(ChainInfo{seqID, shadowID, head, true, true});
+      RelocatableInst::UniquePtrVec jmpStart =
+          JmpChain(Offset(getShadowOffset(shadowID)));
+      for (const RelocatableInst::UniquePtr &inst : jmpStart) {
+        if (inst->getTag() != RelocatableInstTag::RelocInst) {
+          continue;
+        }
+        llvmcpu.writeInstruction(inst->reloc(this), codeStream.get());
+      }
+      needTerminator = false;
+    }
+  }
   // The last instruction of the sequence doesn't end with a change of RIP/PC,
   // add a Terminator
   if (needTerminator) {
@@ -396,8 +540,25 @@ ExecBlock::writeSequence(std::vector<Patch>::const_iterator seqIt,
       llvmcpu.writeInstruction(inst->reloc(this), codeStream.get());
     }
   }
-  // JIT the jump to epilogue
-  RelocatableInst::UniquePtrVec jmpEpilogue = JmpEpilogue();
+  // JIT the jump to epilogue. When the successor of the sequence is known,
+  // jump through a shadow that can later be set to the successor sequence.
+  rword successor = 0;
+  RelocatableInst::UniquePtrVec jmpEpilogue;
+  if (not looped and
+      (llvmcpu.getOptions() & Options::OPT_ENABLE_BLOCK_CHAINING) and
+      (needTerminator or getDirectSuccessor(instMetadata.back(), successor))) {
+    if (needTerminator) {
+      successor = instMetadata.back().endAddress();
+    }
+    uint16_t shadowID = newShadow();
+    setShadow(shadowID, reinterpret_cast<rword>(codeBlock.base()) +
+                            codeBlock.allocatedSize() - epilogueSize);
+    chainRegistry.push_back(
+        ChainInfo{seqID, shadowID, successor, false, false});
+    jmpEpilogue = JmpChain(Offset(getShadowOffset(shadowID)));
+  } else if (not looped) {
+    jmpEpilogue = JmpEpilogue();
+  }
   for (const RelocatableInst::UniquePtr &inst : jmpEpilogue) {
     if (inst->getTag() != RelocatableInstTag::RelocInst) {
       continue;
@@ -413,7 +574,10 @@ ExecBlock::writeSequence(std::vector<Patch>::const_iterator seqIt,
   // Register sequence
   uint16_t endInstID = getNextInstID() - 1;
   seqRegistry.push_back(SeqInfo{startInstID, endInstID, executeFlags, cpuMode});
+  seqRegistry.back().memTraceRecords =
+      countTag(startInstID, endInstID, RelocTagMemTraceRecord);
   finalizeScratchRegisterForPatch();
+  chainPending = true;
   // Return write results
   unsigned bytesWritten =
       static_cast<unsigned>(codeStream->current_pos() - startOffset);
@@ -427,10 +591,64 @@ uint16_t ExecBlock::splitSequence(uint16_t instID) {
   uint16_t seqID = instRegistry[instID].seqID;
   seqRegistry.push_back(SeqInfo{
       instID, seqRegistry[seqID].endInstID, seqRegistry[seqID].executeFlags,
-      seqRegistry[seqID].cpuMode, seqRegistry[seqID].sr});
+      seqRegistry[seqID].cpuMode, seqRegistry[seqID].sr,
+      countTag(instID, seqRegistry[seqID].endInstID, RelocTagMemTraceRecord)});
+  chainPending = true;
   return getNextSeqID() - 1;
 }
 
+void ExecBlock::linkChains(llvm::function_ref<uint16_t(rword)> resolve,
+                           bool loopsOnly) {
+  for (ChainInfo &chain : chainRegistry) {
+    if (chain.linked or (loopsOnly and not chain.loop)) {
+      continue;
+    }
+    uint16_t targetSeq = resolve(chain.target);
+    if (targetSeq == NOT_FOUND) {
+      continue;
+    }
+    QBDI_REQUIRE(targetSeq < seqRegistry.size());
+    const SeqInfo &source = seqRegistry[chain.seqID];
+    const SeqInfo &target = seqRegistry[targetSeq];
+    // The context restored by the prologue must be enough for the target
+    if (source.cpuMode != target.cpuMode or
+        (target.executeFlags & ~source.executeFlags) != 0) {
+      continue;
+    }
+    QBDI_DEBUG("Link seqID {:x} to seqID {:x} in ExecBlock 0x{:x}",
+               chain.seqID, targetSeq, reinterpret_cast<uintptr_t>(this));
+    setShadow(chain.shadowID,
+              reinterpret_cast<rword>(codeBlock.base()) +
+                  static_cast<rword>(instRegistry[target.startInstID].offset));
+    chain.linked = true;
+  }
+  chainPending = false;
+}
+
+void ExecBlock::cacheIndirectTarget(rword address, uint16_t seqID) {
+  QBDI_REQUIRE(seqID < seqRegistry.size());
+  IBTCEntry &entry = context->ibtc[ibtcIndex(address)];
+  entry.target = address;
+  entry.selector =
+      reinterpret_cast<rword>(codeBlock.base()) +
+      static_cast<rword>(instRegistry[seqRegistry[seqID].startInstID].offset);
+  entry.executeFlags = seqRegistry[seqID].executeFlags;
+}
+
+void ExecBlock::unlinkChains() {
+  for (ChainInfo &chain : chainRegistry) {
+    if (chain.linked) {
+      setShadow(chain.shadowID, reinterpret_cast<rword>(codeBlock.base()) +
+                                    codeBlock.allocatedSize() - epilogueSize);
+      chain.linked = false;
+    }
+  }
+  for (IBTCEntry &entry : context->ibtc) {
+    entry.target = IBTC_EMPTY;
+  }
+  chainPending = true;
+}
+
 void ExecBlock::makeRX() {
   if (not isRX()) {
     QBDI_DEBUG("Making ExecBlock 0x{:x} RX", reinterpret_cast<uintptr_t>(this));
@@ -442,7 +660,8 @@ void ExecBlock::makeRX() {
 }
 
 void ExecBlock::makeRW() {
-  if (not isRW()) {
+  // The dual mapped code is written through its RW view
+  if (not isRW() and not isDualMapped()) {
     QBDI_DEBUG("Making ExecBlock 0x{:x} RW", reinterpret_cast<uintptr_t>(this));
     QBDI_REQUIRE_ACTION(!llvm::sys::Memory::protectMappedMemory(
                             codeBlock, PF::MF_READ | PF::MF_WRITE),
@@ -451,11 +670,18 @@ void ExecBlock::makeRW() {
   }
 }
 
+bool ExecBlock::hasRoomForPatch(const Patch &p) const {
+  // Each RelocatableInst allocates at most one shadow. Keep some shadows for
+  // the terminator and the jump to the epilogue of the sequence.
+  static const size_t SEQ_END_SHADOWS = 4;
+
+  return instRegistry.size() < EXEC_BLOCK_MAX_INST and
+         shadowIdx + p.insts.size() + SEQ_END_SHADOWS <= shadowCapacity;
+}
+
 uint16_t ExecBlock::newShadow(uint16_t tag) {
   uint16_t id = shadowIdx++;
-  QBDI_REQUIRE_ACTION(id * sizeof(rword) <
-                          dataBlock.allocatedSize() - sizeof(Context),
-                      abort());
+  QBDI_REQUIRE_ACTION(id < shadowCapacity, abort());
   if (tag != ShadowReservedTag::Untagged) {
     QBDI_DEBUG("Registering new tagged shadow {} for instID {} wih tag {:x}",
                id, getNextInstID(), tag);
@@ -477,17 +703,13 @@ uint16_t ExecBlock::getLastShadow(uint16_t tag) {
 }
 
 void ExecBlock::setShadow(uint16_t id, rword v) {
-  QBDI_REQUIRE_ACTION(id * sizeof(rword) <
-                          dataBlock.allocatedSize() - sizeof(Context),
-                      abort());
+  QBDI_REQUIRE_ACTION(id < shadowCapacity, abort());
   QBDI_DEBUG("Set shadow {} to 0x{:x}", id, v);
   shadows[id] = v;
 }
 
 rword ExecBlock::getShadow(uint16_t id) const {
-  QBDI_REQUIRE_ACTION(id * sizeof(rword) <
-                          dataBlock.allocatedSize() - sizeof(Context),
-                      abort());
+  QBDI_REQUIRE_ACTION(id < shadowCapacity, abort());
   return shadows[id];
 }
 
@@ -558,6 +780,22 @@ uint16_t ExecBlock::getSeqEnd(uint16_t seqID) const {
   return seqRegistry[seqID].endInstID;
 }
 
+uint16_t ExecBlock::getSeqMemTraceRecords(uint16_t seqID) const {
+  QBDI_REQUIRE(seqID < seqRegistry.size());
+  return seqRegistry[seqID].memTraceRecords;
+}
+
+uint16_t ExecBlock::countTag(uint16_t startInstID, uint16_t endInstID,
+                             uint16_t tag) const {
+  QBDI_REQUIRE(startInstID <= endInstID and endInstID < instRegistry.size());
+  size_t begin = instRegistry[startInstID].tagOffset;
+  size_t end =
+      instRegistry[endInstID].tagOffset + instRegistry[endInstID].tagSize;
+  return static_cast<uint16_t>(
+      std::count_if(tagRegistry.begin() + begin, tagRegistry.begin() + end,
+                    [tag](const TagInfo &t) { return t.tag == tag; }));
+}
+
 const llvm::ArrayRef<ShadowInfo>
 ExecBlock::getShadowByInst(uint16_t instID) const {
   QBDI_REQUIRE(instID < instRegistry.size());
@@ -645,4 +883,15 @@ float ExecBlock::occupationRatio() const {
          static_cast<float>(codeBlock.allocatedSize());
 }
 
+size_t ExecBlock::getMemoryUsage() const {
+  return sizeof(ExecBlock) + codeBlock.allocatedSize() +
+         dataBlock.allocatedSize() +
+         instMetadata.capacity() * sizeof(InstMetadata) +
+         instRegistry.capacity() * sizeof(InstInfo) +
+         seqRegistry.capacity() * sizeof(SeqInfo) +
+         shadowRegistry.capacity() * sizeof(ShadowInfo) +
+         tagRegistry.capacity() * sizeof(TagInfo) +
+         chainRegistry.capacity() * sizeof(ChainInfo);
+}
+
 } // namespace QBDI
@@ -19,10 +19,12 @@
 #define EXECBLOCK_H
 
 #include <memory>
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/Memory.h"
 
 #include "Patch/InstMetadata.h"
@@ -59,11 +61,11 @@ struct Context;
 
 struct InstInfo {
   uint16_t seqID;
-  uint16_t offset;
-  uint16_t offsetSkip;
+  uint32_t offset;
+  uint32_t offsetSkip;
   uint16_t shadowOffset;
   uint16_t shadowSize;
-  uint16_t tagOffset;
+  uint32_t tagOffset;
   uint16_t tagSize;
 };
 
@@ -73,6 +75,7 @@ struct SeqInfo {
   uint8_t executeFlags;
   CPUMode cpuMode;
   ScratchRegisterSeqInfo sr;
+  uint16_t memTraceRecords;
 };
 
 struct SeqWriteResult {
@@ -89,11 +92,28 @@ struct ShadowInfo {
 
 struct TagInfo {
   uint16_t tag;
-  uint16_t offset;
+  uint32_t offset;
+};
+
+struct ChainInfo {
+  uint16_t seqID;
+  uint16_t shadowID;
+  rword target;
+  bool linked;
+  // the trace jumps back to its own start
+  bool loop;
 };
 
 static const uint16_t EXEC_BLOCK_FULL = 0xFFFF;
 
+// Maximal number of instructions of an ExecBlock. A sequence starts at one of
+// its instructions, this keeps the sequence IDs under EXEC_BLOCK_FULL even when
+// all the sequences are split.
+static const uint16_t EXEC_BLOCK_MAX_INST = 0x7FF0;
+
+// Maximal size of the code or data block of an ExecBlock
+static const size_t EXEC_BLOCK_MAX_SIZE = 16 * 1024 * 1024;
+
 /*! Manages the concept of an exec block made of two contiguous memory blocks
  * (one for the code, the other for the data) used to store and execute
  * instrumented basic blocks.
@@ -107,6 +127,8 @@ private:
   VMInstanceRef vminstance;
   llvm::sys::MemoryBlock codeBlock;
   llvm::sys::MemoryBlock dataBlock;
+  // RW view of the code block when it is dual mapped, empty otherwise
+  llvm::sys::MemoryBlock codeWriteBlock;
   std::unique_ptr<memory_ostream> codeStream;
   const LLVMCPUs &llvmCPUs;
   Context *context;
@@ -114,13 +136,20 @@ private:
   std::vector<ShadowInfo> shadowRegistry;
   std::vector<TagInfo> tagRegistry;
   uint16_t shadowIdx;
+  uint32_t shadowCapacity;
   std::vector<InstMetadata> instMetadata;
   std::vector<InstInfo> instRegistry;
   std::vector<SeqInfo> seqRegistry;
+  std::vector<ChainInfo> chainRegistry;
+  bool chainPending;
+  // executed since the last call to clearReferenced
+  bool referenced;
   PageState pageState;
   uint16_t currentSeq;
   uint16_t currentInst;
   uint32_t epilogueSize;
+  uint32_t inlineCallStart;
+  uint32_t reentryStart;
   bool isFull;
   ScratchRegisterInfo srInfo;
 
@@ -147,10 +176,41 @@ private:
   void initScratchRegisterForPatch(std::vector<Patch>::const_iterator seqStart,
                                    std::vector<Patch>::const_iterator seqEnd);
 
+  /*! Verify if the instruction and shadow registries have enough free
+   * entries to write a patch and the end of its sequence.
+   *
+   * @param[in] p  The patch to write.
+   *
+   * @return True if the patch can be written.
+   */
+  bool hasRoomForPatch(const Patch &p) const;
+
   bool writePatch(const Patch &p, const LLVMCPU &llvmcpu);
 
+  /*! Write the guard of a trace after a basic block: the execution continues
+   * in the trace if the PC is the start of the next basic block, else it
+   * leaves the ExecBlock.
+   *
+   * @param[in] successor  The start of the next basic block of the trace.
+   * @param[in] llvmcpu    The LLVMCPU of the sequence.
+   *
+   * @return False if the guard can't be written, nothing is written then.
+   */
+  bool writeTraceGuard(rword successor, const LLVMCPU &llvmcpu);
+
   void finalizeScratchRegisterForPatch();
 
+  /*! Count the tags of a range of instructions.
+   *
+   * @param startInstID  The first instruction ID.
+   * @param endInstID    The last instruction ID (included).
+   * @param tag          The tag to count.
+   *
+   * @return The number of tags.
+   */
+  uint16_t countTag(uint16_t startInstID, uint16_t endInstID,
+                    uint16_t tag) const;
+
 public:
   /*! Construct a new ExecBlock
    *
@@ -159,7 +219,13 @@ public:
    * @param[in] vminstance         Pointer to public engine interface
    * @param[in] execBlockPrologue  cached prologue of ExecManager
    * @param[in] execBlockEpilogue  cached epilogue of ExecManager
+   * @param[in] execBlockInlineCall  cached inline callback routine of
+   *                                 ExecManager
    * @param[in] epilogueSize       size in bytes of the epilogue (0 is not know)
+   * @param[in] codeSize           size in bytes of the code block (0 for one
+   *                               page)
+   * @param[in] dataSize           size in bytes of the data block (0 for one
+   *                               page)
    */
   ExecBlock(
       const LLVMCPUs &llvmCPUs, VMInstanceRef vminstance = nullptr,
@@ -167,17 +233,36 @@ public:
           nullptr,
       const std::vector<std::unique_ptr<RelocatableInst>> *execBlockEpilogue =
           nullptr,
-      uint32_t epilogueSize = 0);
+      const std::vector<std::unique_ptr<RelocatableInst>>
+          *execBlockInlineCall = nullptr,
+      uint32_t epilogueSize = 0, size_t codeSize = 0, size_t dataSize = 0);
 
   ~ExecBlock();
 
   ExecBlock(const ExecBlock &) = delete;
   ExecBlock &operator=(const ExecBlock &) = delete;
 
+  /*! Verify if a size can be used for the code or data block of an
+   * ExecBlock: 0 (one page) or a multiple of the page size up to
+   * EXEC_BLOCK_MAX_SIZE.
+   *
+   * @param[in] size  The size in bytes.
+   *
+   * @return True if the size is valid.
+   */
+  static bool isValidBlockSize(size_t size);
+
   /*! Change vminstance when VM object is moved
    */
   void changeVMInstanceRef(VMInstanceRef vminstance);
 
+  /*! Verify if the code block is mapped twice, RX and RW. Its permissions
+   * never change.
+   *
+   * @return Return true if the code block is dual mapped.
+   */
+  inline bool isDualMapped() const { return codeWriteBlock.base() != nullptr; }
+
   /*! Display the content of an exec block to stderr.
    */
   void show() const;
@@ -196,13 +281,22 @@ public:
    * end using an architecture specific terminator. Return 0 if the exec block
    * was full and no instruction was written.
    *
+   * A trace is a sequence made of several basic blocks. A guard after each
+   * basic block leaves the ExecBlock when the PC isn't the start of the next
+   * one.
+   *
    * @param seqStart [in] Iterator to the start of a list of patches.
    * @param seqEnd   [in] Iterator to the end of a list of patches.
+   * @param trace    [in] The patches are a trace of basic blocks.
+   * @param loop     [in] The trace loops: its last basic block jumps back to
+   *                      the start of the sequence when it branches to the
+   *                      first one.
    *
    * @return A structure detailling the write operation result.
    */
   SeqWriteResult writeSequence(std::vector<Patch>::const_iterator seqStart,
-                               std::vector<Patch>::const_iterator seqEnd);
+                               std::vector<Patch>::const_iterator seqEnd,
+                               bool trace = false, bool loop = false);
 
   /*! Split an existing sequence at instruction instID to create a new sequence.
    *
@@ -212,6 +306,54 @@ public:
    */
   uint16_t splitSequence(uint16_t instID);
 
+  /*! Link the sequences ending with a direct jump or a fallthrough to the
+   * sequence of this ExecBlock starting at their successor. The link is only
+   * made when the successor needs no more context than the linked sequence.
+   *
+   * @param[in] resolve    Return the ID of the sequence of this ExecBlock that
+   *                       starts at an address, or NOT_FOUND.
+   * @param[in] loopsOnly  Only link the traces jumping back to their start.
+   */
+  void linkChains(llvm::function_ref<uint16_t(rword)> resolve,
+                  bool loopsOnly = false);
+
+  /*! Register a sequence in the indirect branch target cache probed by the
+   * epilogue. The entry replaces any other target sharing the same slot.
+   *
+   * @param[in] address  The guest address of the start of the sequence.
+   * @param[in] seqID    The ID of the sequence starting at this address.
+   */
+  void cacheIndirectTarget(rword address, uint16_t seqID);
+
+  /*! Restore the jump to the epilogue at the end of all linked sequences and
+   * looped traces, and empty the indirect branch target cache.
+   */
+  void unlinkChains();
+
+  /*! Verify if new sequences may have been linked since the last call to
+   * linkChains.
+   *
+   * @return True if linkChains may link new sequences.
+   */
+  bool isChainPending() const { return chainPending; }
+
+  /*! Link the sequences again at the next call to linkChains, after a
+   * sequence became a valid target.
+   */
+  void setChainPending() { chainPending = true; }
+
+  /*! Verify if the ExecBlock was executed since the last call to
+   * clearReferenced. The sequences reached through the links, the indirect
+   * branch target cache and the looped traces run in the same ExecBlock.
+   *
+   * @return True if the ExecBlock was executed.
+   */
+  bool isReferenced() const { return referenced; }
+
+  /*! Reset the referenced bit used by the eviction clock.
+   */
+  void clearReferenced() { referenced = false; }
+
   /*! Get the address of the DataBlock
    *
    * @return The DataBlock offset.
@@ -239,6 +381,27 @@ public:
     return codeBlock.allocatedSize() - epilogueSize - codeStream->current_pos();
   }
 
+  /*! Compute the offset between the current code stream position and the
+   * reentry point of the exec block prologue, after the FPR restore. Used for
+   * reentering the exec block from its epilogue.
+   *
+   * @return The computed offset.
+   */
+  rword getReentryOffset() const {
+    return static_cast<rword>(reentryStart) -
+           static_cast<rword>(codeStream->current_pos());
+  }
+
+  /*! Compute the offset between the current code stream position and the start
+   * of the routine calling the inline callbacks.
+   *
+   * @return The computed offset.
+   */
+  rword getInlineCallOffset() const {
+    return static_cast<rword>(inlineCallStart) -
+           static_cast<rword>(codeStream->current_pos());
+  }
+
   /*! Get the size of the epilogue
    *
    * @return The size of the epilogue.
@@ -370,6 +533,15 @@ public:
    */
   uint16_t getSeqEnd(uint16_t seqID) const;
 
+  /*! Obtain the number of memory trace records written by one execution of a
+   * sequence.
+   *
+   * @param seqID The sequence ID.
+   *
+   * @return The maximum number of records written in the memory trace buffer.
+   */
+  uint16_t getSeqMemTraceRecords(uint16_t seqID) const;
+
   /*! Set the selector of the exec block to a specific sequence offset. Used to
    * program the execution of a specific sequence within the exec block.
    *
@@ -483,6 +655,13 @@ public:
    */
   float occupationRatio() const;
 
+  /* Compute the memory used by the ExecBlock: its code and data blocks and
+   * the metadata of its instructions and sequences.
+   *
+   * @return the memory usage in bytes.
+   */
+  size_t getMemoryUsage() const;
+
   const ScratchRegisterInfo &getScratchRegisterInfo() const { return srInfo; }
 };
 
@@ -32,15 +32,32 @@
 
 namespace QBDI {
 
+// Add the counters of the basic blocks of a region, by basic block end
+static void collectBBCounters(const ExecRegion &region,
+                              std::map<rword, uint64_t> &counters) {
+  for (const auto &block : region.blocks) {
+    for (const ShadowInfo &info :
+         block->queryShadowByInst(ANY, BB_COUNTER_TAG)) {
+      counters[block->getInstMetadata(info.instID).endAddress()] +=
+          block->getShadow(info.shadowID);
+    }
+  }
+}
+
 ExecBlockManager::ExecBlockManager(const LLVMCPUs &llvmCPUs,
-                                   VMInstanceRef vminstance)
-    : total_translated_size(1), total_translation_size(1),
+                                   VMInstanceRef vminstance, size_t codeSize,
+                                   size_t dataSize)
+    : total_translated_size(1), total_translation_size(1), needFlush(false),
+      chaining(false), tracing(false), stats(), clockHand(0),
       vminstance(vminstance), llvmCPUs(llvmCPUs),
+      execBlockCodeSize(codeSize), execBlockDataSize(dataSize),
       execBlockPrologue(getExecBlockPrologue(llvmCPUs.getOptions())),
-      execBlockEpilogue(getExecBlockEpilogue(llvmCPUs.getOptions())) {
+      execBlockEpilogue(getExecBlockEpilogue(llvmCPUs.getOptions())),
+      execBlockInlineCall(getExecBlockInlineCall(llvmCPUs.getOptions())) {
 
-  auto execBrokerBlock = std::make_unique<ExecBlock>(
-      llvmCPUs, vminstance, &execBlockPrologue, &execBlockEpilogue, 0);
+  auto execBrokerBlock =
+      std::make_unique<ExecBlock>(llvmCPUs, vminstance, &execBlockPrologue,
+                                  &execBlockEpilogue, &execBlockInlineCall, 0);
   epilogueSize = execBrokerBlock->getEpilogueSize();
   execBroker = std::make_unique<ExecBroker>(std::move(execBrokerBlock),
                                             llvmCPUs, vminstance);
@@ -104,56 +121,74 @@ ExecBlock *ExecBlockManager::getProgrammedExecBlock(rword address,
     ExecRegion &region = regions[r];
 
     // Attempting sequenceCache resolution
-    const std::map<rword, SeqLoc>::const_iterator seqLoc =
-        region.sequenceCache.find(address);
-    if (seqLoc != region.sequenceCache.end()) {
+    const SeqLoc *seqLoc = region.sequenceCache.find(address);
+    if (seqLoc != nullptr) {
       QBDI_DEBUG("Found sequence 0x{:x} in ExecBlock 0x{:x} as seqID {:x}",
                  address,
                  reinterpret_cast<uintptr_t>(
-                     region.blocks[seqLoc->second.blockIdx].get()),
-                 seqLoc->second.seqID);
+                     region.blocks[seqLoc->blockIdx].get()),
+                 seqLoc->seqID);
+      region.hits++;
+      stats.hits++;
       // copy current sequence info
       if (programmedSeqLock != nullptr) {
-        *programmedSeqLock = seqLoc->second;
+        *programmedSeqLock = *seqLoc;
       }
       // Select sequence and return execBlock
-      region.blocks[seqLoc->second.blockIdx]->selectSeq(seqLoc->second.seqID);
-      return region.blocks[seqLoc->second.blockIdx].get();
+      ExecBlock *block = region.blocks[seqLoc->blockIdx].get();
+      if (block->isChainPending() and (chaining or tracing)) {
+        linkChains(region, seqLoc->blockIdx);
+      }
+      if (chaining and not isTracePending(region, address)) {
+        block->cacheIndirectTarget(address, seqLoc->seqID);
+      }
+      block->selectSeq(seqLoc->seqID);
+      return block;
     }
 
     // Attempting instCache resolution
-    const std::map<rword, InstLoc>::const_iterator instLoc =
-        region.instCache.find(address);
-    if (instLoc != region.instCache.end()) {
+    const InstLoc *instLoc = region.instCache.find(address);
+    if (instLoc != nullptr) {
       // Retrieving corresponding block and seqLoc
-      ExecBlock *block = region.blocks[instLoc->second.blockIdx].get();
-      uint16_t existingSeqId = block->getSeqID(instLoc->second.instID);
-      const SeqLoc &existingSeqLoc =
-          region.sequenceCache[block
-                                   ->getInstMetadata(
-                                       block->getSeqStart(existingSeqId))
-                                   .address];
+      const InstLoc loc = *instLoc;
+      ExecBlock *block = region.blocks[loc.blockIdx].get();
+      uint16_t existingSeqId = block->getSeqID(loc.instID);
+      // copy the existing SeqLoc, the insertion may move it
+      const SeqLoc existingSeqLoc = *region.sequenceCache.find(
+          block->getInstMetadata(block->getSeqStart(existingSeqId)).address);
       // Creating a new sequence at that instruction and
       // saving it in the sequenceCache
-      uint16_t newSeqID = block->splitSequence(instLoc->second.instID);
-      regions[r].sequenceCache[address] = SeqLoc{
-          instLoc->second.blockIdx, newSeqID, existingSeqLoc.bbEnd, address,
+      uint16_t newSeqID = block->splitSequence(loc.instID);
+      const SeqLoc newSeqLoc = SeqLoc{
+          loc.blockIdx, newSeqID, existingSeqLoc.bbEnd, address,
           existingSeqLoc.seqEnd,
       };
+      region.sequenceCache[address] = newSeqLoc;
+      region.hits++;
+      stats.hits++;
+      // The new sequence and its entry in the cache use more memory
+      updateRegionMemory(region);
       QBDI_DEBUG(
           "Splitted seqID {:x} at instID {:x} in ExecBlock 0x{:x} as new "
           "sequence with seqID {:x}",
-          existingSeqId, instLoc->second.instID,
-          reinterpret_cast<uintptr_t>(block), newSeqID);
+          existingSeqId, loc.instID, reinterpret_cast<uintptr_t>(block),
+          newSeqID);
       // copy current sequence info
       if (programmedSeqLock != nullptr) {
-        *programmedSeqLock = regions[r].sequenceCache[address];
+        *programmedSeqLock = newSeqLoc;
+      }
+      if (chaining or tracing) {
+        linkChains(region, loc.blockIdx);
+      }
+      if (chaining and not isTracePending(region, address)) {
+        block->cacheIndirectTarget(address, newSeqID);
       }
       block->selectSeq(newSeqID);
       return block;
     }
   }
   QBDI_DEBUG("Cache miss for sequence 0x{:x}", address);
+  stats.misses++;
   return nullptr;
 }
 
@@ -166,13 +201,12 @@ const ExecBlock *ExecBlockManager::getExecBlock(rword address) const {
     const ExecRegion &region = regions[r];
 
     // Attempting instCache resolution
-    const std::map<rword, InstLoc>::const_iterator instLoc =
-        region.instCache.find(address);
-    if (instLoc != region.instCache.end()) {
-      QBDI_DEBUG("Found address 0x{:x} in ExecBlock 0x{:x}", address,
-                 reinterpret_cast<uintptr_t>(
-                     region.blocks[instLoc->second.blockIdx].get()));
-      return region.blocks[instLoc->second.blockIdx].get();
+    const InstLoc *instLoc = region.instCache.find(address);
+    if (instLoc != nullptr) {
+      QBDI_DEBUG(
+          "Found address 0x{:x} in ExecBlock 0x{:x}", address,
+          reinterpret_cast<uintptr_t>(region.blocks[instLoc->blockIdx].get()));
+      return region.blocks[instLoc->blockIdx].get();
     }
   }
   QBDI_DEBUG("Cache miss for address 0x{:x}", address);
@@ -182,11 +216,7 @@ const ExecBlock *ExecBlockManager::getExecBlock(rword address) const {
 const SeqLoc *ExecBlockManager::getSeqLoc(rword address) const {
   size_t r = searchRegion(address);
   if (r < regions.size() && regions[r].covered.contains(address)) {
-    const std::map<rword, SeqLoc>::const_iterator seqLoc =
-        regions[r].sequenceCache.find(address);
-    if (seqLoc != regions[r].sequenceCache.end()) {
-      return &(seqLoc->second);
-    }
+    return regions[r].sequenceCache.find(address);
   }
   return nullptr;
 }
@@ -262,7 +292,8 @@ void ExecBlockManager::writeBasicBlock(std::vector<Patch> &&basicBlock,
         QBDI_REQUIRE_ACTION(i < (1 << 16), abort());
         region.blocks.emplace_back(std::make_unique<ExecBlock>(
             llvmCPUs, vminstance, &execBlockPrologue, &execBlockEpilogue,
-            epilogueSize));
+            &execBlockInlineCall, epilogueSize, execBlockCodeSize,
+            execBlockDataSize));
       }
       // Write sequence
       SeqWriteResult res = region.blocks[i]->writeSequence(
@@ -307,6 +338,86 @@ void ExecBlockManager::writeBasicBlock(std::vector<Patch> &&basicBlock,
   total_translation_size += translation;
   total_translated_size += translated;
   updateRegionStat(r, translated);
+  updateRegionMemory(region);
+
+  // The region of the new basic block is about to be executed
+  if (stats.memoryBudget != 0 and stats.memoryUsage > stats.memoryBudget) {
+    evictRegions(r);
+  }
+}
+
+bool ExecBlockManager::writeTrace(std::vector<Patch> &&trace, bool loop) {
+  QBDI_REQUIRE_ACTION(not trace.empty(), return false);
+  rword head = trace.front().metadata.address;
+  size_t r = searchRegion(head);
+  if (r >= regions.size() or not regions[r].covered.contains(head)) {
+    return false;
+  }
+  ExecRegion &region = regions[r];
+
+  // The basic block counters of the trace are read in the region of the head
+  size_t patchEnd = 0;
+  while (patchEnd < trace.size() and
+         region.covered.contains(trace[patchEnd].metadata.address) and
+         region.covered.contains(trace[patchEnd].metadata.endAddress() - 1)) {
+    patchEnd++;
+  }
+  if (patchEnd < trace.size()) {
+    loop = false;
+  }
+  if (patchEnd == 0) {
+    return false;
+  }
+  rword bbEnd = head;
+  for (size_t j = 0; j < patchEnd; j++) {
+    if (trace[j].metadata.modifyPC) {
+      bbEnd = trace[j].metadata.endAddress();
+      break;
+    }
+  }
+
+  for (size_t i = 0; true; i++) {
+    if (i >= region.blocks.size()) {
+      QBDI_REQUIRE_ACTION(i < (1 << 16), abort());
+      region.blocks.emplace_back(std::make_unique<ExecBlock>(
+          llvmCPUs, vminstance, &execBlockPrologue, &execBlockEpilogue,
+          &execBlockInlineCall, epilogueSize, execBlockCodeSize,
+          execBlockDataSize));
+    }
+    SeqWriteResult res = region.blocks[i]->writeSequence(
+        trace.begin(), trace.begin() + patchEnd, true, loop);
+    if (res.seqID == EXEC_BLOCK_FULL) {
+      continue;
+    }
+    rword seqEnd = trace[res.patchWritten - 1].metadata.endAddress();
+    region.sequenceCache[head] = SeqLoc{
+        static_cast<uint16_t>(i), res.seqID, std::min(bbEnd, seqEnd),
+        head, seqEnd,
+    };
+    for (size_t j = 0; j < res.patchWritten; j++) {
+      std::move(trace[j].userInstCB.begin(), trace[j].userInstCB.end(),
+                std::back_inserter(region.userInstCB));
+      trace[j].userInstCB.clear();
+    }
+    QBDI_DEBUG("Trace 0x{:x}-0x{:x} of {} instructions written in ExecBlock "
+               "0x{:x} as seqID {:x}",
+               head, seqEnd, res.patchWritten,
+               reinterpret_cast<uintptr_t>(region.blocks[i].get()), res.seqID);
+    // The links to the head now reach the trace
+    for (auto &block : region.blocks) {
+      block->setChainPending();
+    }
+    total_translation_size += res.bytesWritten;
+    region.traces++;
+    stats.traces++;
+    updateRegionMemory(region);
+    break;
+  }
+
+  if (stats.memoryBudget != 0 and stats.memoryUsage > stats.memoryBudget) {
+    evictRegions(r);
+  }
+  return true;
 }
 
 size_t ExecBlockManager::searchRegion(rword address) const {
@@ -345,12 +456,20 @@ void ExecBlockManager::mergeRegion(size_t i) {
              i, regions[i].covered.start(), regions[i].covered.end(), i + 1,
              regions[i + 1].covered.start(), regions[i + 1].covered.end());
   // SeqLoc
+  regions[i].sequenceCache.reserve(regions[i].sequenceCache.size() +
+                                   regions[i + 1].sequenceCache.size());
   for (const auto &it : regions[i + 1].sequenceCache) {
     regions[i].sequenceCache[it.first] = SeqLoc{
         static_cast<uint16_t>(it.second.blockIdx + regions[i].blocks.size()),
         it.second.seqID, it.second.bbEnd, it.second.seqStart, it.second.seqEnd};
   }
+  // TraceCounter
+  for (const auto &it : regions[i + 1].traceCounters) {
+    regions[i].traceCounters[it.first] = it.second;
+  }
   // InstLoc
+  regions[i].instCache.reserve(regions[i].instCache.size() +
+                               regions[i + 1].instCache.size());
   for (const auto &it : regions[i + 1].instCache) {
     regions[i].instCache[it.first] = InstLoc{
         static_cast<uint16_t>(it.second.blockIdx + regions[i].blocks.size()),
@@ -365,7 +484,15 @@ void ExecBlockManager::mergeRegion(size_t i) {
   std::move(regions[i + 1].blocks.begin(), regions[i + 1].blocks.end(),
             std::back_inserter(regions[i].blocks));
   // flush
+  if (regions[i].toFlush != regions[i + 1].toFlush) {
+    // the memory of the flushed region isn't counted anymore
+    stats.memoryUsage -= regions[i].toFlush ? regions[i + 1].memoryUsage
+                                            : regions[i].memoryUsage;
+  }
   regions[i].toFlush |= regions[i + 1].toFlush;
+  regions[i].memoryUsage += regions[i + 1].memoryUsage;
+  regions[i].hits += regions[i + 1].hits;
+  regions[i].traces += regions[i + 1].traces;
 
   regions.erase(regions.begin() + i + 1);
 }
@@ -506,6 +633,245 @@ void ExecBlockManager::updateRegionStat(size_t r, rword translated) {
   }
 }
 
+void ExecBlockManager::linkChains(ExecRegion &region, uint16_t blockIdx) {
+  // Without chaining, only the looped traces are linked
+  region.blocks[blockIdx]->linkChains(
+      [&](rword address) -> uint16_t {
+        // Only link to a sequence of the same ExecBlock that would be executed
+        // by the DBI
+        const SeqLoc *seqLoc = region.sequenceCache.find(address);
+        if (seqLoc == nullptr or seqLoc->blockIdx != blockIdx or
+            not execBroker->isInstrumented(address) or
+            isTracePending(region, address)) {
+          return NOT_FOUND;
+        }
+        return seqLoc->seqID;
+      },
+      not chaining);
+}
+
+bool ExecBlockManager::isTracePending(const ExecRegion &region,
+                                      rword address) const {
+  if (not tracing) {
+    return false;
+  }
+  const TraceCounter *counter = region.traceCounters.find(address);
+  return counter == nullptr or not counter->decided;
+}
+
+bool ExecBlockManager::countTraceHead(rword address, bool backward) {
+  size_t r = searchRegion(address);
+  if (r >= regions.size() or not regions[r].covered.contains(address)) {
+    return false;
+  }
+  ExecRegion &region = regions[r];
+  TraceCounter &counter = region.traceCounters[address];
+  if (counter.decided) {
+    return false;
+  }
+  counter.dispatches++;
+  if (backward) {
+    counter.backward++;
+  }
+  // A sequence not reached backward by its first dispatches is no loop head
+  bool hot = (counter.backward >= TRACE_HOT_THRESHOLD);
+  if (hot or (counter.backward == 0 and counter.dispatches >= 2) or
+      counter.dispatches >= TRACE_MAX_DISPATCHES) {
+    counter.decided = true;
+    // The sequence can now be linked
+    for (auto &block : region.blocks) {
+      block->setChainPending();
+    }
+  }
+  return hot;
+}
+
+void ExecBlockManager::setTracing(bool enable) {
+  if (tracing == enable) {
+    return;
+  }
+  QBDI_DEBUG("{} hot traces", enable ? "Enable" : "Disable");
+  tracing = enable;
+  // The links and the indirect branch target caches follow the new rules
+  unlinkChains();
+  if (not tracing) {
+    // The sequences of the basic blocks of the traces must be dispatched by
+    // the VM again. The flush is delayed if a trace is running, but its loop
+    // is already unlinked.
+    for (auto &region : regions) {
+      if (region.traces != 0) {
+        flushRegion(region);
+      }
+    }
+  }
+}
+
+void ExecBlockManager::updateRegionMemory(ExecRegion &region) {
+  size_t usage =
+      region.sequenceCache.memoryUsage() + region.instCache.memoryUsage() +
+      region.traceCounters.memoryUsage();
+  for (const auto &block : region.blocks) {
+    usage += block->getMemoryUsage();
+  }
+  if (not region.toFlush) {
+    stats.memoryUsage = stats.memoryUsage - region.memoryUsage + usage;
+  }
+  region.memoryUsage = usage;
+}
+
+void ExecBlockManager::flushRegion(ExecRegion &region) {
+  if (region.toFlush) {
+    return;
+  }
+  // The flush may be delayed: the links must not reach the region anymore
+  for (auto &block : region.blocks) {
+    block->unlinkChains();
+  }
+  region.toFlush = true;
+  needFlush = true;
+  stats.memoryUsage -= region.memoryUsage;
+}
+
+void ExecBlockManager::evictRegions(size_t keep) {
+  // Evict down to 3/4 of the budget, the next translations don't need to
+  // evict again
+  size_t target = stats.memoryBudget - stats.memoryBudget / 4;
+  stats.evictions++;
+
+  // Two turns of the clock reset all the hit counters
+  for (size_t n = 0; n < 2 * regions.size() and stats.memoryUsage > target;
+       n++) {
+    if (clockHand >= regions.size()) {
+      clockHand = 0;
+    }
+    ExecRegion &region = regions[clockHand];
+    if (clockHand != keep and not region.toFlush) {
+      // A region is used if one of its ExecBlocks ran, even if it was only
+      // reached through the links, the IBTC or a looped trace
+      bool referenced = (region.hits != 0);
+      for (auto &block : region.blocks) {
+        referenced |= block->isReferenced();
+        block->clearReferenced();
+      }
+      if (referenced) {
+        region.hits = 0;
+      } else {
+        QBDI_DEBUG("Evict region [0x{:x}, 0x{:x}] ({} bytes)",
+                   region.covered.start(), region.covered.end(),
+                   region.memoryUsage);
+        stats.evictedRegions++;
+        stats.evictedExecBlocks += region.blocks.size();
+        stats.evictedBytes += region.memoryUsage;
+        evictedRange.add(region.covered);
+        flushRegion(region);
+      }
+    }
+    clockHand++;
+  }
+}
+
+void ExecBlockManager::setMemoryBudget(size_t budget) {
+  stats.memoryBudget = budget;
+  if (stats.memoryBudget != 0 and stats.memoryUsage > stats.memoryBudget) {
+    evictRegions(regions.size());
+  }
+}
+
+RangeSet<rword> ExecBlockManager::takeEvictedRange() {
+  RangeSet<rword> evicted;
+  std::swap(evicted, evictedRange);
+  return evicted;
+}
+
+CacheStats ExecBlockManager::getCacheStats() const {
+  CacheStats s = stats;
+  s.regions = 0;
+  s.execBlocks = 0;
+  s.dualMapped = 0;
+  for (const auto &region : regions) {
+    if (not region.toFlush) {
+      s.regions++;
+      s.execBlocks += region.blocks.size();
+      for (const auto &block : region.blocks) {
+        if (block->isDualMapped()) {
+          s.dualMapped++;
+        }
+      }
+    }
+  }
+  return s;
+}
+
+void ExecBlockManager::setChaining(bool enable) {
+  if (chaining == enable) {
+    return;
+  }
+  QBDI_DEBUG("{} sequence chaining", enable ? "Enable" : "Disable");
+  chaining = enable;
+  if (not chaining) {
+    unlinkChains();
+  } else {
+    // Only the looped traces may have been linked without chaining
+    for (auto &region : regions) {
+      for (auto &block : region.blocks) {
+        block->setChainPending();
+      }
+    }
+  }
+}
+
+void ExecBlockManager::unlinkChains() {
+  for (auto &region : regions) {
+    for (auto &block : region.blocks) {
+      block->unlinkChains();
+    }
+  }
+}
+
+uint64_t ExecBlockManager::getBBCounter(rword bbEnd) const {
+  uint64_t counter = 0;
+  auto it = bbCounters.find(bbEnd);
+  if (it != bbCounters.end()) {
+    counter = it->second;
+  }
+  // A flushed region may not be removed yet, the code may be translated again
+  // in another region.
+  for (const auto &region : regions) {
+    if (not region.covered.contains(bbEnd - 1)) {
+      continue;
+    }
+    for (const auto &block : region.blocks) {
+      for (const ShadowInfo &info :
+           block->queryShadowByInst(ANY, BB_COUNTER_TAG)) {
+        if (block->getInstMetadata(info.instID).endAddress() == bbEnd) {
+          counter += block->getShadow(info.shadowID);
+        }
+      }
+    }
+  }
+  return counter;
+}
+
+std::map<rword, uint64_t> ExecBlockManager::getBBCounters() const {
+  std::map<rword, uint64_t> counters = bbCounters;
+  for (const auto &region : regions) {
+    collectBBCounters(region, counters);
+  }
+  return counters;
+}
+
+void ExecBlockManager::resetBBCounters() {
+  bbCounters.clear();
+  for (auto &region : regions) {
+    for (auto &block : region.blocks) {
+      for (const ShadowInfo &info :
+           block->queryShadowByInst(ANY, BB_COUNTER_TAG)) {
+        block->setShadow(info.shadowID, 0);
+      }
+    }
+  }
+}
+
 void ExecBlockManager::clearCache(RangeSet<rword> rangeSet) {
   const std::vector<Range<rword>> &ranges = rangeSet.getRanges();
   for (Range<rword> r : ranges) {
@@ -520,6 +886,11 @@ void ExecBlockManager::flushCommit() {
   // It needs to be erased from last to first to preserve index validity
   if (needFlush) {
     QBDI_DEBUG("Flushing analysis caches");
+    for (const auto &region : regions) {
+      if (region.toFlush) {
+        collectBBCounters(region, bbCounters);
+      }
+    }
     regions.erase(std::remove_if(regions.begin(), regions.end(),
                                  [](const ExecRegion &r) -> bool {
                                    if (r.toFlush)
@@ -538,8 +909,7 @@ void ExecBlockManager::clearCache(Range<rword> range) {
   QBDI_DEBUG("Erasing range [0x{:x}, 0x{:x}]", range.start(), range.end());
   for (i = 0; i < regions.size(); i++) {
     if (regions[i].covered.overlaps(range)) {
-      regions[i].toFlush = true;
-      needFlush = true;
+      flushRegion(regions[i]);
     }
   }
 }
@@ -547,14 +917,17 @@ void ExecBlockManager::clearCache(Range<rword> range) {
 void ExecBlockManager::clearCache(bool flushNow) {
   QBDI_DEBUG("Erasing all cache");
   if (flushNow) {
+    for (const auto &region : regions) {
+      collectBBCounters(region, bbCounters);
+    }
     regions.clear();
     total_translated_size = 1;
     total_translation_size = 1;
     needFlush = false;
+    stats.memoryUsage = 0;
   } else {
     for (auto &r : regions) {
-      r.toFlush = true;
-      needFlush = true;
+      flushRegion(r);
     }
   }
 }
@@ -23,11 +23,13 @@
 #include <memory>
 #include <stddef.h>
 #include <stdint.h>
+#include <utility>
 #include <vector>
 
 #include "QBDI/Callback.h"
 #include "QBDI/Range.h"
 #include "QBDI/State.h"
+#include "Utility/AddressMap.h"
 
 namespace QBDI {
 
@@ -50,14 +52,33 @@ struct SeqLoc {
   rword seqEnd;
 };
 
+// Backward dispatches making a sequence the head of a hot trace
+static const uint16_t TRACE_HOT_THRESHOLD = 16;
+// Dispatches after which a sequence that isn't hot is no longer a trace head
+static const uint16_t TRACE_MAX_DISPATCHES = 64;
+
+struct TraceCounter {
+  uint16_t dispatches;
+  uint16_t backward;
+  bool decided;
+};
+
 struct ExecRegion {
   Range<rword> covered;
   unsigned translated;
   unsigned available;
   std::vector<std::unique_ptr<ExecBlock>> blocks;
-  std::map<rword, SeqLoc> sequenceCache;
-  std::map<rword, InstLoc> instCache;
+  AddressMap<SeqLoc> sequenceCache;
+  AddressMap<InstLoc> instCache;
+  // dispatches of the sequences, to find the heads of the hot traces
+  AddressMap<TraceCounter> traceCounters;
+  // number of traces written in the region
+  unsigned traces = 0;
   bool toFlush = false;
+  // memory used by the ExecBlocks and the caches of the region
+  size_t memoryUsage = 0;
+  // lookups since the last pass of the eviction clock
+  uint32_t hits = 0;
 
   // lambda ptr for user callback set with addInstrRule
   // These pointers should be remove at the same time as the region
@@ -74,14 +95,28 @@ private:
   rword total_translated_size;
   rword total_translation_size;
   bool needFlush;
+  bool chaining;
+  bool tracing;
+  // memory budget, usage of the regions not flushed and eviction counters
+  CacheStats stats;
+  size_t clockHand;
+  // ranges of the regions evicted since the last takeEvictedRange()
+  RangeSet<rword> evictedRange;
+  // counters of the basic blocks of the flushed regions, by basic block end
+  std::map<rword, uint64_t> bbCounters;
 
   VMInstanceRef vminstance;
   const LLVMCPUs &llvmCPUs;
 
+  // size of the code and data blocks of the new ExecBlock (0 for one page)
+  size_t execBlockCodeSize;
+  size_t execBlockDataSize;
+
   // cache ExecBlock prologue and epilogue
   uint32_t epilogueSize;
   const std::vector<std::unique_ptr<RelocatableInst>> execBlockPrologue;
   const std::vector<std::unique_ptr<RelocatableInst>> execBlockEpilogue;
+  const std::vector<std::unique_ptr<RelocatableInst>> execBlockInlineCall;
 
   size_t searchRegion(rword start) const;
 
@@ -93,9 +128,37 @@ private:
 
   float getExpansionRatio() const;
 
+  void linkChains(ExecRegion &region, uint16_t blockIdx);
+
+  /*! Test if a sequence may still become the head of a trace. The links and
+   * the indirect branch target cache must not reach it: its dispatches are
+   * counted by the VM.
+   *
+   * @param[in] region   The region of the sequence.
+   * @param[in] address  The address of the sequence.
+   */
+  bool isTracePending(const ExecRegion &region, rword address) const;
+
+  void updateRegionMemory(ExecRegion &region);
+
+  /*! Mark a region to be removed at the next flushCommit.
+   *
+   * @param[in] region  The region to flush.
+   */
+  void flushRegion(ExecRegion &region);
+
+  /*! Flush the regions not used recently until the memory usage is back under
+   * the budget. The regions are scanned with a clock: a region with hits or an
+   * executed ExecBlock since the last scan gets a second chance.
+   *
+   * @param[in] keep  Index of a region that must not be evicted.
+   */
+  void evictRegions(size_t keep);
+
 public:
   ExecBlockManager(const LLVMCPUs &llvmCPUs,
-                   VMInstanceRef vminstance = nullptr);
+                   VMInstanceRef vminstance = nullptr, size_t codeSize = 0,
+                   size_t dataSize = 0);
 
   ~ExecBlockManager();
 
@@ -118,8 +181,27 @@ public:
 
   void writeBasicBlock(std::vector<Patch> &&basicBlock, size_t patchEnd);
 
+  /*! Write a trace of instrumented basic blocks. The trace replaces the
+   * sequence of its first basic block in the sequence cache. The basic blocks
+   * outside of the region of the first one are left out.
+   *
+   * @param[in] trace  The patches of the basic blocks of the trace.
+   * @param[in] loop   The trace jumps back to its start when its last basic
+   *                   block branches to the first one.
+   *
+   * @return True if the trace was written.
+   */
+  bool writeTrace(std::vector<Patch> &&trace, bool loop);
+
   bool isFlushPending() { return needFlush; }
 
+  /*! Get the ranges of the regions evicted by the memory budget since the
+   * previous call.
+   *
+   * @return The ranges covered by the evicted regions.
+   */
+  RangeSet<rword> takeEvictedRange();
+
   void flushCommit();
 
   void clearCache(bool flushNow = true);
@@ -127,6 +209,82 @@ public:
   void clearCache(Range<rword> range);
 
   void clearCache(RangeSet<rword> rangeSet);
+
+  /*! Enable or disable the links between the sequences of the ExecBlocks.
+   * The sequences are linked lazily when their ExecBlock is programmed.
+   *
+   * @param[in] enable  True to link the sequences, false to unlink them.
+   */
+  void setChaining(bool enable);
+
+  inline bool isChaining() const { return chaining; }
+
+  /*! Enable or disable the counters of the dispatches used to find the heads
+   * of the hot traces. When they are disabled, the regions with traces are
+   * flushed: a trace hides the sequences it runs over from the VM.
+   *
+   * @param[in] enable  True to count the dispatches.
+   */
+  void setTracing(bool enable);
+
+  inline bool isTracing() const { return tracing; }
+
+  /*! Count a dispatch of a sequence by the VM. A sequence reached by enough
+   * backward branches becomes the head of a hot trace. A sequence is only
+   * counted until it is decided whether it is a hot head.
+   *
+   * @param[in] address   The address of the sequence.
+   * @param[in] backward  The sequence is reached by a backward branch.
+   *
+   * @return True if the sequence just became a hot head.
+   */
+  bool countTraceHead(rword address, bool backward);
+
+  /*! Set the memory budget of the cache. When the budget is exceeded, the
+   * coldest regions are flushed with the deferred flush mechanism.
+   *
+   * @param[in] budget  The budget in bytes, 0 for an unbounded cache.
+   */
+  void setMemoryBudget(size_t budget);
+
+  /*! Get the statistics of the cache.
+   *
+   * @return The statistics.
+   */
+  CacheStats getCacheStats() const;
+
+  /*! Unlink all the sequences. They will be linked again the next time their
+   * ExecBlock is programmed if the chaining is still enabled.
+   */
+  void unlinkChains();
+
+  /*! Get the counter of a basic block. The counters of the removed regions are
+   * kept.
+   *
+   * @param[in] bbEnd  The end address of the basic block.
+   *
+   * @return The number of executions of the basic block.
+   */
+  uint64_t getBBCounter(rword bbEnd) const;
+
+  /*! Get the counters of all the basic blocks.
+   *
+   * @return The counters by basic block end address.
+   */
+  std::map<rword, uint64_t> getBBCounters() const;
+
+  /*! Reset all the counters of the basic blocks to zero.
+   */
+  void resetBBCounters();
+
+  /*! Replace the counters of the removed regions. Used to keep the counters
+   * when the manager is recreated.
+   *
+   * @param[in] counters  The counters by basic block end address.
+   */
+  void setBBCounters(std::map<rword, uint64_t> counters) {
+    bbCounters = std::move(counters);
+  }
 };
 
 } // namespace QBDI
@@ -18,6 +18,8 @@
 #ifndef CONTEXT_X86_64_H
 #define CONTEXT_X86_64_H
 
+#include <stddef.h>
+
 #include "QBDI/State.h"
 
 namespace QBDI {
@@ -33,6 +35,38 @@ struct QBDI_ALIGNED(8) HostState {
   rword data;
   rword origin;
   rword executeFlags;
+  rword memTrace;
+  rword xsaveMask;
+  rword vm;
+};
+
+/*! Number of entries of the indirect branch target cache of an ExecBlock. The
+ * epilogue index mask depends on it: it must be a power of two lower than 128.
+ */
+static constexpr size_t IBTC_SIZE = 16;
+
+/*! Target of the unused entries of the indirect branch target cache.
+ */
+static constexpr rword IBTC_EMPTY = static_cast<rword>(-1);
+
+/*! Compute the slot of an address in the indirect branch target cache. Must
+ * match the hash computed by the epilogue.
+ *
+ * @param[in] address  The guest address.
+ *
+ * @return The index of the entry.
+ */
+inline size_t ibtcIndex(rword address) {
+  return ((address >> 4) ^ address) & (IBTC_SIZE - 1);
+}
+
+/*! Indirect branch target cache entry. Associates a guest address with the
+ * selector of the sequence translating it in the same ExecBlock.
+ */
+struct QBDI_ALIGNED(8) IBTCEntry {
+  rword target;
+  rword selector;
+  rword executeFlags;
 };
 
 /*! X86_64 Execution context.
@@ -40,10 +74,12 @@ struct QBDI_ALIGNED(8) HostState {
 struct QBDI_ALIGNED(8) Context {
 
 public:
-  // fprState needs to be first for memory alignement reasons
+  // fprState needs to be first for memory alignement reasons (XSAVE needs a
+  // 64 bytes aligned area)
   FPRState fprState;
   GPRState gprState;
   HostState hostState;
+  IBTCEntry ibtc[IBTC_SIZE];
 };
 
 } // namespace QBDI
@@ -18,6 +18,7 @@
  */
 #include <memory>
 #include <stdint.h>
+#include <string.h>
 #include <vector>
 
 #include "llvm/Support/Memory.h"
@@ -27,7 +28,9 @@
 #include "Engine/LLVMCPU.h"
 #include "ExecBlock/ExecBlock.h"
 #include "ExecBlock/X86_64/Context_X86_64.h"
+#include "Patch/ExecBlockFlags.h"
 #include "Patch/Patch.h"
+#include "Patch/PatchRules.h"
 #include "Patch/RelocatableInst.h"
 #include "Patch/X86_64/PatchRules_X86_64.h"
 #include "Utility/LogSys.h"
@@ -49,6 +52,8 @@ void ExecBlock::selectSeq(uint16_t seqID) {
       reinterpret_cast<rword>(codeBlock.base()) +
       static_cast<rword>(instRegistry[currentInst].offset);
   context->hostState.executeFlags = seqRegistry[currentSeq].executeFlags;
+  context->hostState.xsaveMask =
+      getXSaveMask(seqRegistry[currentSeq].executeFlags);
 }
 
 void ExecBlock::run() {
@@ -61,6 +66,12 @@ void ExecBlock::run() {
       makeRX();
     }
   }
+  // The FPRState may have been changed since the last XSAVE: XRSTOR must load
+  // all the components from the memory instead of the initial state. The rest
+  // of the header may come from setFPRState, XRSTOR faults if it isn't zero.
+  context->fprState.xstate_bv = getXSaveMask(defaultExecuteFlags);
+  context->fprState.xcomp_bv = 0;
+  memset(context->fprState.rsrv4, 0, sizeof(context->fprState.rsrv4));
   qbdi_runCodeBlock(codeBlock.base(), context->hostState.executeFlags);
 }
 
@@ -77,7 +88,7 @@ bool ExecBlock::writePatch(const Patch &p, const LLVMCPU &llvmcpu) {
       QBDI_DEBUG("RelocTag 0x{:x}", inst->getTag());
       tagRegistry.push_back(
           TagInfo{static_cast<uint16_t>(inst->getTag()),
-                  static_cast<uint16_t>(codeStream->current_pos())});
+                  static_cast<uint32_t>(codeStream->current_pos())});
       continue;
     } else if (getEpilogueOffset() > MINIMAL_BLOCK_SIZE) {
       llvmcpu.writeInstruction(inst->reloc(this), codeStream.get());
@@ -90,6 +101,31 @@ bool ExecBlock::writePatch(const Patch &p, const LLVMCPU &llvmcpu) {
   return true;
 }
 
+bool ExecBlock::writeTraceGuard(rword successor, const LLVMCPU &llvmcpu) {
+  rword rollbackOffset = codeStream->current_pos();
+  uint16_t rollbackShadowIdx = shadowIdx;
+
+  uint16_t shadowID = newShadow();
+  setShadow(shadowID, static_cast<rword>(0) - successor);
+  RelocatableInst::UniquePtrVec guard =
+      getTraceGuard(getShadowOffset(shadowID));
+
+  for (const RelocatableInst::UniquePtr &inst : guard) {
+    if (getEpilogueOffset() <= MINIMAL_BLOCK_SIZE) {
+      QBDI_DEBUG("Not enough space left for the trace guard");
+      guard.clear();
+      break;
+    }
+    llvmcpu.writeInstruction(inst->reloc(this), codeStream.get());
+  }
+  if (guard.empty()) {
+    codeStream->seek(rollbackOffset);
+    shadowIdx = rollbackShadowIdx;
+    return false;
+  }
+  return true;
+}
+
 void ExecBlock::initScratchRegisterForPatch(
     std::vector<Patch>::const_iterator seqStart,
     std::vector<Patch>::const_iterator seqEnd) {}
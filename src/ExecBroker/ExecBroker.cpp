@@ -39,6 +39,21 @@ void ExecBroker::changeVMInstanceRef(VMInstanceRef vminstance) {
   transferBlock->changeVMInstanceRef(vminstance);
 }
 
+void ExecBroker::removeStubs(const Range<rword> &r) {
+  for (auto it = stubs.begin(); it != stubs.end();) {
+    if (r.contains(it->first)) {
+      it = stubs.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ExecBroker::setInstrumentedRange(const RangeSet<rword> &r) {
+  stubs.clear();
+  instrumented = r;
+}
+
 void ExecBroker::addInstrumentedRange(const Range<rword> &r) {
   QBDI_DEBUG("Adding instrumented range [0x{:x}, 0x{:x}]", r.start(), r.end());
   instrumented.add(r);
@@ -47,10 +62,14 @@ void ExecBroker::addInstrumentedRange(const Range<rword> &r) {
 void ExecBroker::removeInstrumentedRange(const Range<rword> &r) {
   QBDI_DEBUG("Removing instrumented range [0x{:x}, 0x{:x}]", r.start(),
              r.end());
+  removeStubs(r);
   instrumented.remove(r);
 }
 
-void ExecBroker::removeAllInstrumentedRanges() { instrumented.clear(); }
+void ExecBroker::removeAllInstrumentedRanges() {
+  stubs.clear();
+  instrumented.clear();
+}
 
 bool ExecBroker::addInstrumentedModule(const std::string &name) {
   bool instrumented = false;
@@ -120,8 +139,4 @@ bool ExecBroker::instrumentAllExecutableMaps() {
   return instrumented;
 }
 
-bool ExecBroker::canTransferExecution(GPRState *gprState) const {
-  return getReturnPoint(gprState) ? true : false;
-}
-
 } // namespace QBDI
@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "llvm/Support/Memory.h"
@@ -43,6 +44,7 @@
 
 namespace QBDI {
 class LLVMCPUs;
+class Patch;
 
 class ExecBroker {
 
@@ -53,11 +55,20 @@ private:
 
   using PF = llvm::sys::Memory::ProtectionFlags;
 
+  // Indirect jump stubs (PLT entries) of the instrumented code and the address
+  // of the pointer (GOT entry) they jump to.
+  std::unordered_map<rword, rword> stubs;
+
   // ARCH specific method
   ExecBrokerArchData archData;
 
   void initExecBrokerSequences(const LLVMCPUs &llvmCPUs);
-  rword *getReturnPoint(GPRState *gprState) const;
+
+  /*! Forget the stubs of a range that isn't instrumented anymore.
+   *
+   * @param[in] r  The range of the stubs to remove.
+   */
+  void removeStubs(const Range<rword> &r);
 
 public:
   ExecBroker(std::unique_ptr<ExecBlock> transferBlock, const LLVMCPUs &llvmCPUs,
@@ -67,7 +78,7 @@ public:
 
   bool isInstrumented(rword addr) const { return instrumented.contains(addr); }
 
-  void setInstrumentedRange(const RangeSet<rword> &r) { instrumented = r; }
+  void setInstrumentedRange(const RangeSet<rword> &r);
 
   const RangeSet<rword> &getInstrumentedRange() const { return instrumented; }
 
@@ -82,9 +93,59 @@ public:
 
   bool instrumentAllExecutableMaps();
 
-  bool canTransferExecution(GPRState *gprState) const;
+  /*! Get the return address of a transfer to the non-instrumented code.
+   *
+   * @param[in] gprState  The current GPR state.
+   *
+   * @return The address of the stack slot holding an instrumented return
+   *         address, or nullptr if the execution cannot be transferred.
+   */
+  rword *getReturnPoint(GPRState *gprState) const;
 
-  bool transferExecution(rword addr, GPRState *gprState, FPRState *fprState);
+  /*! Register the basic block if it's an indirect jump stub, like a PLT entry.
+   *
+   * @param[in] basicBlock  A basic block of the instrumented code.
+   */
+  void registerStub(const std::vector<Patch> &basicBlock);
+
+  /*! Get the target of an indirect jump stub.
+   *
+   * @param[in] addr  The address of the stub.
+   *
+   * @return The current target of the stub, or 0 if addr isn't a registered
+   *         stub.
+   */
+  rword getStubTarget(rword addr) const {
+    if (stubs.empty()) {
+      return 0;
+    }
+    auto it = stubs.find(addr);
+    if (it == stubs.end()) {
+      return 0;
+    }
+    return *reinterpret_cast<const rword *>(it->second);
+  }
+
+  /*! Execute natively the code at addr until it returns to the instrumented
+   * code.
+   *
+   * @param[in] addr         The address to execute.
+   * @param[in] gprState     The current GPR state.
+   * @param[in] fprState     The current FPR state.
+   * @param[in] returnPoint  The stack slot of the return address, as returned
+   *                         by getReturnPoint.
+   * @param[in] execBlock    An ExecBlock whose context already holds gprState
+   *                         and fprState, or nullptr. When provided, the
+   *                         transfer is run on this context and the state
+   *                         isn't copied. Otherwise, the state is copied in
+   *                         the context of the transferBlock.
+   *
+   * @return The context holding the state after the return. The state isn't
+   *         copied back to gprState and fprState.
+   */
+  Context *transferExecution(rword addr, GPRState *gprState,
+                             FPRState *fprState, rword *returnPoint,
+                             ExecBlock *execBlock);
 };
 
 } // namespace QBDI
@@ -18,11 +18,15 @@
 #include <memory>
 #include <stdint.h>
 
+#include "X86InstrInfo.h"
+
 #include "QBDI/State.h"
 #include "ExecBlock/Context.h"
 #include "ExecBlock/ExecBlock.h"
 #include "ExecBroker/ExecBroker.h"
 #include "Patch/ExecBlockFlags.h"
+#include "Patch/InstMetadata.h"
+#include "Patch/Patch.h"
 #include "Utility/LogSys.h"
 
 namespace QBDI {
@@ -45,39 +49,83 @@ rword *ExecBroker::getReturnPoint(GPRState *gprState) const {
   return nullptr;
 }
 
-bool ExecBroker::transferExecution(rword addr, GPRState *gprState,
-                                   FPRState *fprState) {
+void ExecBroker::registerStub(const std::vector<Patch> &basicBlock) {
+  // A stub is an indirect jump through a pointer, optionally preceded by an
+  // endbr: jmp [rip + disp] on X86_64, jmp [disp] on X86
+  size_t jmpIdx = 0;
+  if (basicBlock.size() == 2) {
+    unsigned opcode = basicBlock[0].metadata.inst.getOpcode();
+    if (opcode != llvm::X86::ENDBR64 and opcode != llvm::X86::ENDBR32) {
+      return;
+    }
+    jmpIdx = 1;
+  } else if (basicBlock.size() != 1) {
+    return;
+  }
+  const InstMetadata &metadata = basicBlock[jmpIdx].metadata;
+  const llvm::MCInst &inst = metadata.inst;
+  if (inst.getOpcode() != llvm::X86::JMP64m and
+      inst.getOpcode() != llvm::X86::JMP32m) {
+    return;
+  }
+  // memory operand: base, scale, index, displacement, segment
+  if (inst.getNumOperands() != 5 or not inst.getOperand(3).isImm() or
+      inst.getOperand(2).getReg() != 0 or inst.getOperand(4).getReg() != 0) {
+    return;
+  }
+  rword pointer = static_cast<rword>(inst.getOperand(3).getImm());
+  if (inst.getOperand(0).getReg() == llvm::X86::RIP) {
+    pointer += metadata.endAddress();
+  } else if (inst.getOperand(0).getReg() != 0) {
+    return;
+  }
+  QBDI_DEBUG("Register the stub at 0x{:x} jumping through 0x{:x}",
+             basicBlock[0].metadata.address, pointer);
+  stubs[basicBlock[0].metadata.address] = pointer;
+}
+
+Context *ExecBroker::transferExecution(rword addr, GPRState *gprState,
+                                      FPRState *fprState, rword *returnPoint,
+                                      ExecBlock *execBlock) {
   rword hook = 0;
 
+  // Use the context of execBlock if it already holds the state. Its IBTC
+  // cannot match addr as the IBTC are cleared when a range is removed.
+  if (execBlock == nullptr) {
+    execBlock = transferBlock.get();
+  }
+  Context *context = execBlock->getContext();
+
   // Backup / Patch return address
-  hook = transferBlock->getCurrentPC() + transferBlock->getEpilogueOffset();
-  rword *ptr = getReturnPoint(gprState);
-  rword hookedAddress = *ptr;
-  *ptr = hook;
+  hook = execBlock->getCurrentPC() + execBlock->getEpilogueOffset();
+  rword hookedAddress = *returnPoint;
+  *returnPoint = hook;
   QBDI_DEBUG(
       "TransferExecution: Patched {:} hooking return address 0x{:06x} with "
       "0x{:06x}",
-      reinterpret_cast<void *>(ptr), hookedAddress, hook);
+      reinterpret_cast<void *>(returnPoint), hookedAddress, hook);
 
   // Write transfer state
-  transferBlock->getContext()->gprState = *gprState;
-  transferBlock->getContext()->fprState = *fprState;
-  transferBlock->getContext()->hostState.selector = addr;
-  transferBlock->getContext()->hostState.executeFlags = defaultExecuteFlags;
+  if (&context->gprState != gprState) {
+    context->gprState = *gprState;
+  }
+  if (&context->fprState != fprState) {
+    context->fprState = *fprState;
+  }
+  context->hostState.selector = addr;
+  context->hostState.callback = static_cast<rword>(0);
+  context->hostState.executeFlags = defaultExecuteFlags;
+  context->hostState.xsaveMask = getXSaveMask(defaultExecuteFlags);
   // Execute transfer
-  QBDI_DEBUG("Transfering execution to 0x{:x} using transferBlock 0x{:x}", addr,
-             reinterpret_cast<uintptr_t>(&*transferBlock));
-
-  transferBlock->run();
+  QBDI_DEBUG("Transfering execution to 0x{:x} using ExecBlock 0x{:x}", addr,
+             reinterpret_cast<uintptr_t>(execBlock));
 
-  // Read transfer result
-  *gprState = transferBlock->getContext()->gprState;
-  *fprState = transferBlock->getContext()->fprState;
+  execBlock->run();
 
   // Restore original return
-  QBDI_GPR_SET(gprState, REG_PC, hookedAddress);
+  QBDI_GPR_SET(&context->gprState, REG_PC, hookedAddress);
 
-  return true;
+  return context;
 }
 
 } // namespace QBDI
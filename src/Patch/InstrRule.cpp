@@ -40,7 +40,8 @@ namespace QBDI {
 void InstrRule::instrument(Patch &patch,
                            const PatchGenerator::UniquePtrVec &patchGen,
                            bool breakToHost, InstPosition position,
-                           int priority, RelocatableInstTag tag) const {
+                           int priority, RelocatableInstTag tag,
+                           bool inlineCall) const {
 
   if (patchGen.size() == 0 && breakToHost == false) {
     QBDI_DEBUG("Empty patch Generator");
@@ -106,7 +107,11 @@ void InstrRule::instrument(Patch &patch,
     if (restoreLast) {
       prepend(instru, SaveReg(usedRegisters[0], Offset(usedRegisters[0])));
     }
-    append(instru, getBreakToHost(usedRegisters[0], patch, restoreLast));
+    if (inlineCall) {
+      append(instru, getInlineCall(usedRegisters[0], patch, restoreLast));
+    } else {
+      append(instru, getBreakToHost(usedRegisters[0], patch, restoreLast));
+    }
   }
   // Normal case where we append the temporary register restoration code to the
   // instrumentation
@@ -141,11 +146,14 @@ void InstrRule::instrument(Patch &patch,
 InstrRuleBasicCBK::InstrRuleBasicCBK(PatchConditionUniquePtr &&condition,
                                      InstCallback cbk, void *data,
                                      InstPosition position, bool breakToHost,
-                                     int priority, RelocatableInstTag tag)
+                                     int priority, RelocatableInstTag tag,
+                                     bool inlineCall)
     : AutoUnique<InstrRule, InstrRuleBasicCBK>(priority),
       condition(std::forward<PatchConditionUniquePtr>(condition)),
-      patchGen(getCallbackGenerator(cbk, data)), position(position),
-      breakToHost(breakToHost), tag(tag), cbk(cbk), data(data) {}
+      patchGen(inlineCall ? getInlineCallbackGenerator(cbk, data)
+                          : getCallbackGenerator(cbk, data)),
+      position(position), breakToHost(breakToHost), tag(tag),
+      inlineCall(inlineCall), cbk(cbk), data(data) {}
 
 InstrRuleBasicCBK::~InstrRuleBasicCBK() = default;
 
@@ -157,13 +165,22 @@ bool InstrRuleBasicCBK::canBeApplied(const Patch &patch,
 
 bool InstrRuleBasicCBK::changeDataPtr(void *new_data) {
   data = new_data;
-  patchGen = getCallbackGenerator(cbk, data);
+  if (inlineCall) {
+    patchGen = getInlineCallbackGenerator(cbk, data);
+  } else {
+    patchGen = getCallbackGenerator(cbk, data);
+  }
   return true;
 }
 
+bool InstrRuleBasicCBK::canMatchOpcode(unsigned opcode,
+                                       const LLVMCPU &llvmcpu) const {
+  return condition->canMatchOpcode(opcode, llvmcpu);
+}
+
 std::unique_ptr<InstrRule> InstrRuleBasicCBK::clone() const {
   return InstrRuleBasicCBK::unique(condition->clone(), cbk, data, position,
-                                   breakToHost, priority);
+                                   breakToHost, priority, tag, inlineCall);
 };
 
 RangeSet<rword> InstrRuleBasicCBK::affectedRange() const {
@@ -190,6 +207,11 @@ bool InstrRuleDynamic::canBeApplied(const Patch &patch,
                          patch.metadata.instSize, llvmcpu);
 }
 
+bool InstrRuleDynamic::canMatchOpcode(unsigned opcode,
+                                      const LLVMCPU &llvmcpu) const {
+  return condition->canMatchOpcode(opcode, llvmcpu);
+}
+
 std::unique_ptr<InstrRule> InstrRuleDynamic::clone() const {
   return InstrRuleDynamic::unique(condition->clone(), patchGenMethod, position,
                                   breakToHost, priority);
@@ -199,6 +221,35 @@ RangeSet<rword> InstrRuleDynamic::affectedRange() const {
   return condition->affectedRange();
 }
 
+// InstrRuleBBEnd
+// ==============
+
+InstrRuleBBEnd::InstrRuleBBEnd(Range<rword> range,
+                               PatchGeneratorUniquePtrVec &&patchGen,
+                               int priority)
+    : AutoUnique<InstrRule, InstrRuleBBEnd>(priority), range(range),
+      patchGen(std::forward<PatchGeneratorUniquePtrVec>(patchGen)) {}
+
+InstrRuleBBEnd::~InstrRuleBBEnd() = default;
+
+std::unique_ptr<InstrRule> InstrRuleBBEnd::clone() const {
+  return InstrRuleBBEnd::unique(range, cloneVec(patchGen), priority);
+}
+
+bool InstrRuleBBEnd::tryInstrument(Patch &patch,
+                                   const LLVMCPU &llvmcpu) const {
+  // A basic block always ends with the same instruction, whatever the address
+  // where it has been entered
+  if (not patch.metadata.modifyPC or
+      not range.contains(Range<rword>(patch.metadata.address,
+                                      patch.metadata.endAddress()))) {
+    return false;
+  }
+  instrument(patch, patchGen, false, InstPosition::PREINST, priority,
+             RelocTagInvalid);
+  return true;
+}
+
 // InstrRuleUser
 // =============
 
@@ -67,6 +67,16 @@ public:
 
   inline virtual bool changeDataPtr(void *data) { return false; };
 
+  /*! Determine wheter this rule may instrument an instruction with this
+   * opcode. The default implementation is always true.
+   *
+   * @param[in] opcode    The opcode of the instruction.
+   * @param[in] llvmcpu   LLVMCPU object
+   */
+  virtual bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const {
+    return true;
+  }
+
   /*! Determine wheter this rule have to be apply on this Path and instrument if
    * needed.
    *
@@ -84,10 +94,12 @@ public:
    * @param[in] position    Add the patch before or after the instruction
    * @param[in] priority    The priority of this patch
    * @param[in] tag         The tag for this patch
+   * @param[in] inlineCall  The break to host calls the callback from the
+   *                        ExecBlock without leaving it
    */
   void instrument(Patch &patch, const PatchGeneratorUniquePtrVec &patchGen,
                   bool breakToHost, InstPosition position, int priority,
-                  RelocatableInstTag tag) const;
+                  RelocatableInstTag tag, bool inlineCall = false) const;
 };
 
 class InstrRuleBasicCBK : public AutoUnique<InstrRule, InstrRuleBasicCBK> {
@@ -97,6 +109,7 @@ class InstrRuleBasicCBK : public AutoUnique<InstrRule, InstrRuleBasicCBK> {
   InstPosition position;
   bool breakToHost;
   RelocatableInstTag tag;
+  bool inlineCall;
   InstCallback cbk;
   void *data;
 
@@ -116,11 +129,14 @@ public:
    *                         callback for example).
    * @param[in] priority     Priority of the callback
    * @param[in] tag          A tag for the callback
+   * @param[in] inlineCall   Call the callback from the ExecBlock (require
+   *                         breakToHost)
    */
   InstrRuleBasicCBK(PatchConditionUniquePtr &&condition, InstCallback cbk,
                     void *data, InstPosition position, bool breakToHost,
                     int priority = PRIORITY_DEFAULT,
-                    RelocatableInstTag tag = RelocTagInvalid);
+                    RelocatableInstTag tag = RelocTagInvalid,
+                    bool inlineCall = false);
 
   ~InstrRuleBasicCBK() override;
 
@@ -141,12 +157,15 @@ public:
    */
   bool canBeApplied(const Patch &patch, const LLVMCPU &llvmcpu) const;
 
+  bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const override;
+
   bool changeDataPtr(void *data) override;
 
   inline bool tryInstrument(Patch &patch,
                             const LLVMCPU &llvmcpu) const override {
     if (canBeApplied(patch, llvmcpu)) {
-      instrument(patch, patchGen, breakToHost, position, priority, tag);
+      instrument(patch, patchGen, breakToHost, position, priority, tag,
+                 inlineCall);
       return true;
     }
     return false;
@@ -205,6 +224,8 @@ public:
    */
   bool canBeApplied(const Patch &patch, const LLVMCPU &llvmcpu) const;
 
+  bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const override;
+
   inline bool tryInstrument(Patch &patch,
                             const LLVMCPU &llvmcpu) const override {
     if (canBeApplied(patch, llvmcpu)) {
@@ -216,6 +237,36 @@ public:
   }
 };
 
+class InstrRuleBBEnd : public AutoUnique<InstrRule, InstrRuleBBEnd> {
+
+  Range<rword> range;
+  PatchGeneratorUniquePtrVec patchGen;
+
+public:
+  /*! Allocate a new instrumentation rule applied before the last instruction
+   * of the basic blocks. The patch doesn't break to the host.
+   *
+   * @param[in] range     The range where the last instruction of the basic
+   *                      block must be.
+   * @param[in] patchGen  The list of patchGenerator to apply.
+   * @param[in] priority  Priority of the rule
+   */
+  InstrRuleBBEnd(Range<rword> range, PatchGeneratorUniquePtrVec &&patchGen,
+                 int priority = PRIORITY_DEFAULT);
+
+  ~InstrRuleBBEnd() override;
+
+  std::unique_ptr<InstrRule> clone() const override;
+
+  inline RangeSet<rword> affectedRange() const override {
+    RangeSet<rword> r;
+    r.add(range);
+    return r;
+  }
+
+  bool tryInstrument(Patch &patch, const LLVMCPU &llvmcpu) const override;
+};
+
 class InstrRuleUser : public AutoClone<InstrRule, InstrRuleUser> {
 
   InstrRuleCallback cbk;
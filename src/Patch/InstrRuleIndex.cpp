@@ -0,0 +1,104 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+
+#include "llvm/MC/MCInst.h"
+
+#include "QBDI/Range.h"
+#include "Patch/InstMetadata.h"
+#include "Patch/InstrRule.h"
+#include "Patch/InstrRuleIndex.h"
+#include "Patch/Patch.h"
+
+namespace QBDI {
+
+void InstrRuleIndex::invalidate() {
+  valid = false;
+  rules = nullptr;
+  rangeRules.clear();
+  globalRules.clear();
+  opcodeRules.clear();
+}
+
+void InstrRuleIndex::build(const RuleVec &rules) {
+  invalidate();
+  this->rules = &rules;
+
+  uint32_t rangeID = 0;
+  for (uint32_t pos = 0; pos < rules.size(); pos++) {
+    RangeSet<rword> affected = rules[pos].second->affectedRange();
+    const std::vector<Range<rword>> &ranges = affected.getRanges();
+    if (ranges.size() == 1 and ranges[0].start() == 0 and
+        ranges[0].end() == (rword)-1) {
+      globalRules.push_back(pos);
+    } else {
+      for (const Range<rword> &r : ranges) {
+        rangeRules.insert(rangeID++, r, pos);
+      }
+    }
+  }
+  valid = true;
+}
+
+const std::vector<uint32_t> &
+InstrRuleIndex::getCandidates(const Patch &patch, const LLVMCPU &llvmcpu) {
+  unsigned opcode = patch.metadata.inst.getOpcode();
+
+  auto it = opcodeRules.find(opcode);
+  if (it == opcodeRules.end()) {
+    std::vector<uint32_t> matching;
+    for (uint32_t pos : globalRules) {
+      if ((*rules)[pos].second->canMatchOpcode(opcode, llvmcpu)) {
+        matching.push_back(pos);
+      }
+    }
+    it = opcodeRules.emplace(opcode, std::move(matching)).first;
+  }
+
+  if (rangeRules.empty()) {
+    return it->second;
+  }
+
+  candidates.assign(it->second.begin(), it->second.end());
+  size_t nbGlobal = candidates.size();
+
+  rangeRules.forEachOverlap(
+      Range<rword>(patch.metadata.address,
+                   patch.metadata.address + patch.metadata.instSize),
+      [this](uint32_t pos) { candidates.push_back(pos); });
+
+  if (candidates.size() != nbGlobal) {
+    // A rule with several ranges may be found more than once
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+  }
+  return candidates;
+}
+
+bool InstrRuleIndex::mayInstrument(rword address) const {
+  if (not globalRules.empty()) {
+    return true;
+  }
+  bool found = false;
+  rangeRules.forEachOverlap(Range<rword>(address, address + 1),
+                            [&found](uint32_t) { found = true; });
+  return found;
+}
+
+} // namespace QBDI
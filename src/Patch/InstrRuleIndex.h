@@ -0,0 +1,105 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INSTRRULEINDEX_H
+#define INSTRRULEINDEX_H
+
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "QBDI/State.h"
+#include "Utility/IntervalIndex.h"
+
+namespace QBDI {
+
+class InstrRule;
+class LLVMCPU;
+class Patch;
+
+/*! Index of the instrumentation rules of an Engine, used to evaluate only the
+ * rules that may instrument an instruction.
+ *
+ * The rules with a bounded affected range, including the rules on a single
+ * address, are stored by range in an IntervalIndex. The other rules are
+ * filtered by opcode: the list of the rules that may match an opcode is
+ * computed the first time this opcode is instrumented.
+ *
+ * The index keeps the position of the rules in the vector given to build and
+ * must be rebuilt after any change of this vector.
+ */
+class InstrRuleIndex {
+public:
+  using RuleVec = std::vector<std::pair<uint32_t, std::unique_ptr<InstrRule>>>;
+
+private:
+  const RuleVec *rules;
+  bool valid;
+
+  // rules with a bounded affected range
+  IntervalIndex<uint32_t> rangeRules;
+  // rules on the whole address space
+  std::vector<uint32_t> globalRules;
+  // rules of globalRules that may match an opcode
+  std::unordered_map<unsigned, std::vector<uint32_t>> opcodeRules;
+
+  std::vector<uint32_t> candidates;
+
+public:
+  InstrRuleIndex() : rules(nullptr), valid(false) {}
+
+  InstrRuleIndex(const InstrRuleIndex &) = delete;
+  InstrRuleIndex &operator=(const InstrRuleIndex &) = delete;
+
+  inline bool isValid() const { return valid; }
+
+  /*! Mark the index as outdated. It must be rebuilt before the next query.
+   */
+  void invalidate();
+
+  /*! Build the index of a vector of rules.
+   *
+   * @param[in] rules  The rules, in the order they must be applied. The vector
+   *                   must outlive the index.
+   */
+  void build(const RuleVec &rules);
+
+  /*! Get the rules that may instrument a patch.
+   *
+   * @param[in] patch    The patch to instrument.
+   * @param[in] llvmcpu  LLVMCPU object
+   *
+   * @return The position of the rules in the vector, in increasing order. The
+   * reference is valid until the next call.
+   */
+  const std::vector<uint32_t> &getCandidates(const Patch &patch,
+                                             const LLVMCPU &llvmcpu);
+
+  /*! Test if a rule may instrument an address.
+   *
+   * @param[in] address  The address to test.
+   *
+   * @return False if no rule can instrument this address.
+   */
+  bool mayInstrument(rword address) const;
+};
+
+} // namespace QBDI
+
+#endif // INSTRRULEINDEX_H
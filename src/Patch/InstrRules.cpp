@@ -55,4 +55,30 @@ PatchGenerator::UniquePtrVec getCallbackGenerator(InstCallback cbk,
   return callbackGenerator;
 }
 
+/*! Output a list of PatchGenerator which would set up the host state part of
+ * the context for an inline callback.
+ *
+ * @param[in] cbk   The callback function to call.
+ * @param[in] data  The data to pass as an argument to the callback function.
+ *
+ * @return A list of PatchGenerator to set up this callback call.
+ */
+PatchGenerator::UniquePtrVec getInlineCallbackGenerator(InstCallback cbk,
+                                                        void *data) {
+  PatchGenerator::UniquePtrVec callbackGenerator;
+
+  // Write callback address in host state
+  callbackGenerator.push_back(
+      GetConstant::unique(Temp(0), Constant((rword)cbk)));
+  callbackGenerator.push_back(WriteTemp::unique(
+      Temp(0), Offset(offsetof(Context, hostState.callback))));
+  // Write callback data pointer in host state
+  callbackGenerator.push_back(
+      GetConstant::unique(Temp(0), Constant((rword)data)));
+  callbackGenerator.push_back(
+      WriteTemp::unique(Temp(0), Offset(offsetof(Context, hostState.data))));
+
+  return callbackGenerator;
+}
+
 } // namespace QBDI
@@ -19,6 +19,7 @@
 #define INSTRRULES_H
 
 #include <memory>
+#include <stdint.h>
 #include <vector>
 
 #include "Patch/Types.h"
@@ -41,8 +42,39 @@ class RelocatableInst;
 std::vector<std::unique_ptr<PatchGenerator>>
 getCallbackGenerator(InstCallback cbk, void *data);
 
+/*
+ * Setup an inline callback in the host state
+ *
+ * Created patch generator must be followed by getInlineCall.
+ *
+ * @param[in] cbk   Pointer to a user callback
+ * @param[in] data  Opaque pointer to user callback data
+ */
+std::vector<std::unique_ptr<PatchGenerator>>
+getInlineCallbackGenerator(InstCallback cbk, void *data);
+
+/*
+ * Increment the counter of the current instruction
+ *
+ * The counter is a shadow tagged with BB_COUNTER_TAG.
+ */
+std::vector<std::unique_ptr<PatchGenerator>> getBBCounterGenerator();
+
+/*
+ * Set the byte of a coverage map matching the last byte of the current
+ * instruction
+ *
+ * @param[in] map    Pointer to the coverage map
+ * @param[in] start  The address matching the first byte of the map
+ */
+std::vector<std::unique_ptr<PatchGenerator>>
+getCoverageMapGenerator(uint8_t *map, rword start);
+
 std::vector<std::unique_ptr<RelocatableInst>>
 getBreakToHost(Reg temp, const Patch &patch, bool restore);
+
+std::vector<std::unique_ptr<RelocatableInst>>
+getInlineCall(Reg temp, const Patch &patch, bool restore);
 } // namespace QBDI
 
 #endif
@@ -18,6 +18,8 @@
 #ifndef PATCH_MEMORYACCESS_H
 #define PATCH_MEMORYACCESS_H
 
+#include <stddef.h>
+
 #include "Patch/InstrRule.h"
 
 #include "QBDI/Callback.h"
@@ -26,6 +28,18 @@ namespace QBDI {
 
 class ExecBlock;
 
+/*! State of a memory trace buffer. The instrumented code finds it through
+ * HostState::memTrace, writes a MemoryAccess at the cursor and advances it.
+ */
+struct MemTraceState {
+  MemoryAccess *cursor; // must be the first field
+  MemoryAccess *buffer;
+  size_t size;
+  size_t highWaterMark;
+  MemTraceCallback cbk;
+  void *data;
+};
+
 void analyseMemoryAccess(const ExecBlock &currentExecBlock, uint16_t instID,
                          bool afterInst, std::vector<MemoryAccess> &dest);
 
@@ -33,6 +47,10 @@ std::vector<std::unique_ptr<InstrRule>> getInstrRuleMemAccessRead();
 
 std::vector<std::unique_ptr<InstrRule>> getInstrRuleMemAccessWrite();
 
+std::vector<std::unique_ptr<InstrRule>> getInstrRuleMemTraceRead();
+
+std::vector<std::unique_ptr<InstrRule>> getInstrRuleMemTraceWrite();
+
 } // namespace QBDI
 
 #endif
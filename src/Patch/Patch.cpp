@@ -41,8 +41,31 @@ Patch::Patch(const llvm::MCInst &inst, rword address, rword instSize,
   regUsage = getUsedGPR(metadata.inst, llvmcpu);
 }
 
+Patch::Patch(InstMetadata &&metadata, const LLVMCPU *llvmcpu)
+    : metadata(std::move(metadata)), llvmcpu(llvmcpu), finalize(false) {}
+
 Patch::~Patch() = default;
 
+Patch Patch::clone() const {
+  QBDI_REQUIRE(not finalize and userInstCB.empty());
+
+  Patch p(metadata.lightCopy(), llvmcpu);
+  p.insts.reserve(insts.size());
+  for (const auto &inst : insts) {
+    p.insts.push_back(inst->clone());
+  }
+  for (const InstrPatch &el : instsPatchs) {
+    InstrPatch copy{el.position, el.priority, {}};
+    for (const auto &inst : el.insts) {
+      copy.insts.push_back(inst->clone());
+    }
+    p.instsPatchs.push_back(std::move(copy));
+  }
+  p.regUsage = regUsage;
+  p.tempReg = tempReg;
+  return p;
+}
+
 Patch::Patch(Patch &&) = default;
 
 Patch &Patch::operator=(Patch &&) = default;
@@ -47,6 +47,8 @@ class Patch {
 private:
   std::vector<InstrPatch> instsPatchs;
 
+  Patch(InstMetadata &&metadata, const LLVMCPU *llvmcpu);
+
 public:
   InstMetadata metadata;
   std::vector<std::unique_ptr<RelocatableInst>> insts;
@@ -68,6 +70,12 @@ public:
 
   ~Patch();
 
+  /*! Copy a patch that isn't instrumented yet.
+   *
+   * @return The copy of the patch.
+   */
+  Patch clone() const;
+
   void setMerge(bool merge);
   void setModifyPC(bool modifyPC);
 
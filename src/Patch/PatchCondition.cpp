@@ -32,6 +32,13 @@ bool MnemonicIs::test(const llvm::MCInst &inst, rword address, rword instSize,
       mnemonic.c_str(), llvmcpu.getMCII().getName(inst.getOpcode()).data());
 }
 
+bool MnemonicIs::canMatchOpcode(unsigned opcode,
+                                const LLVMCPU &llvmcpu) const {
+  // the mnemonic only depends on the opcode
+  return QBDI::String::startsWith(mnemonic.c_str(),
+                                  llvmcpu.getMCII().getName(opcode).data());
+}
+
 bool OpIs::test(const llvm::MCInst &inst, rword address, rword instSize,
                 const LLVMCPU &llvmcpu) const {
   return inst.getOpcode() == op;
@@ -54,6 +54,17 @@ public:
     return r;
   }
 
+  /*! Return false if the condition is false for any instruction with this
+   * opcode. Used to select the rules to evaluate on an instruction, the
+   * default implementation is always true.
+   *
+   * @param[in] opcode   LLVM instruction opcode ID.
+   * @param[in] llvmcpu  LLVMCPU object
+   */
+  virtual bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const {
+    return true;
+  }
+
   virtual ~PatchCondition() = default;
 };
 
@@ -71,6 +82,8 @@ public:
 
   bool test(const llvm::MCInst &inst, rword address, rword instSize,
             const LLVMCPU &llvmcpu) const override;
+
+  bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const override;
 };
 
 class OpIs : public AutoClone<PatchCondition, OpIs> {
@@ -85,6 +98,10 @@ public:
 
   bool test(const llvm::MCInst &inst, rword address, rword instSize,
             const LLVMCPU &llvmcpu) const override;
+
+  bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const override {
+    return opcode == op;
+  }
 };
 
 class UseReg : public AutoClone<PatchCondition, UseReg> {
@@ -175,6 +192,13 @@ public:
     return r;
   }
 
+  bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const override {
+    return std::all_of(conditions.begin(), conditions.end(),
+                       [&](const PatchCondition::UniquePtr &cond) {
+                         return cond->canMatchOpcode(opcode, llvmcpu);
+                       });
+  }
+
   inline std::unique_ptr<PatchCondition> clone() const override {
     return And::unique(cloneVec(conditions));
   };
@@ -208,6 +232,13 @@ public:
     return r;
   }
 
+  bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const override {
+    return std::any_of(conditions.begin(), conditions.end(),
+                       [&](const PatchCondition::UniquePtr &cond) {
+                         return cond->canMatchOpcode(opcode, llvmcpu);
+                       });
+  }
+
   inline std::unique_ptr<PatchCondition> clone() const override {
     return Or::unique(cloneVec(conditions));
   };
@@ -381,6 +381,28 @@ public:
            Patch *toMerge) const override;
 };
 
+class JmpChain : public AutoClone<PatchGenerator, JmpChain>,
+                 public PureEval<JmpChain> {
+
+  Offset offset;
+
+public:
+  /*! Generate an indirect jump to the address stored in the data block at the
+   * specified offset. Used to link a sequence to its successor.
+   *
+   * @param[in] offset  The offset in the data block of the jump target.
+   */
+  JmpChain(Offset offset) : offset(offset) {}
+
+  /*! Output:
+   *
+   * JMP MEM64 DataBlock[offset]
+   */
+  std::vector<std::unique_ptr<RelocatableInst>>
+  generate(const Patch *patch, TempManager *temp_manager,
+           Patch *toMerge) const override;
+};
+
 } // namespace QBDI
 
 #endif
@@ -43,6 +43,10 @@ bool PatchRule::canBeApplied(const llvm::MCInst &inst, rword address,
   return condition->test(inst, address, instSize, llvmcpu);
 }
 
+bool PatchRule::canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const {
+  return condition->canMatchOpcode(opcode, llvmcpu);
+}
+
 Patch PatchRule::generate(const llvm::MCInst &inst, rword address,
                           rword instSize, const LLVMCPU &llvmcpu,
                           Patch *toMerge) const {
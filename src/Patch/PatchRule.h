@@ -67,6 +67,16 @@ public:
   bool canBeApplied(const llvm::MCInst &inst, rword address, rword instSize,
                     const LLVMCPU &llvmcpu) const;
 
+  /*! Determine wheter this rule may apply to an instruction with this opcode.
+   *
+   * @param[in] opcode    The opcode of the instruction.
+   * @param[in] llvmcpu   LLVMCPU object
+   *
+   * @return False if this patch condition is false for any instruction with
+   * this opcode.
+   */
+  bool canMatchOpcode(unsigned opcode, const LLVMCPU &llvmcpu) const;
+
   /*! Generate this rule output patch by evaluating its generators on the
    * current context. Also handles the temporary register management for this
    * patch.
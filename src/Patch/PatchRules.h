@@ -26,6 +26,7 @@
 
 namespace QBDI {
 
+class InstMetadata;
 class PatchRule;
 class RelocatableInst;
 
@@ -35,8 +36,50 @@ getExecBlockPrologue(Options opts);
 std::vector<std::unique_ptr<RelocatableInst>>
 getExecBlockEpilogue(Options opts);
 
+/*! Get the routine of an ExecBlock calling an inline callback. The routine is
+ * reached from a call site which has set the callback, its data and the
+ * return address in the host state. It saves the guest context, calls the
+ * callback on the host stack and resumes the execution at the return address.
+ *
+ * @param[in] opts  The options of the VM
+ */
+std::vector<std::unique_ptr<RelocatableInst>>
+getExecBlockInlineCall(Options opts);
+
 std::vector<std::unique_ptr<RelocatableInst>> getTerminator(rword address);
 
+/*! Get the only possible successor of an instruction ending a sequence, when it
+ * is known at translation time (direct jump or direct call).
+ *
+ * @param[in]  metadata  The metadata of the last instruction of the sequence
+ * @param[out] target    The address of the successor
+ *
+ * @return True if the successor is known, false otherwise
+ */
+bool getDirectSuccessor(const InstMetadata &metadata, rword &target);
+
+/*! Get the successors of an instruction ending a basic block that are known at
+ * translation time: the targets of the direct jumps and calls, and the next
+ * instruction if the execution may continue there.
+ *
+ * @param[in]  metadata    The metadata of the last instruction of the basic
+ *                         block
+ * @param[out] successors  The addresses of the successors are appended
+ */
+void getStaticSuccessors(const InstMetadata &metadata,
+                         std::vector<rword> &successors);
+
+/*! Get the guard between two basic blocks of a trace. The guard jumps to the
+ * epilogue unless the PC set by the first basic block is the start of the
+ * second one. The flags of the guest are preserved.
+ *
+ * @param[in] shadowOffset  The offset in the data block of a shadow holding the
+ *                          negated address of the second basic block
+ *
+ * @return The guard, or an empty vector if the architecture has no guard
+ */
+std::vector<std::unique_ptr<RelocatableInst>> getTraceGuard(rword shadowOffset);
+
 std::vector<PatchRule> getDefaultPatchRules(Options opts);
 
 } // namespace QBDI
@@ -74,12 +74,16 @@ public:
 class LoadShadow : public AutoClone<RelocatableInst, LoadShadow> {
   unsigned reg;
   uint16_t tag;
+  bool create;
 
 public:
-  LoadShadow(unsigned reg, Shadow tag)
-      : AutoClone<RelocatableInst, LoadShadow>(), reg(reg), tag(tag.getTag()) {}
+  LoadShadow(unsigned reg, Shadow tag, bool create = false)
+      : AutoClone<RelocatableInst, LoadShadow>(), reg(reg), tag(tag.getTag()),
+        create(create) {}
 
-  // Load a value from the last shadow with the given tag
+  // Load a value from a shadow
+  // if create, a shadow initialized to zero is create in the ExecBlock with
+  // the given tag otherwise, the last shadow with this tag is used
   llvm::MCInst reloc(ExecBlock *execBlock) const override;
 };
 
@@ -90,6 +90,9 @@ enum ShadowReservedTag : uint16_t {
   MEMORY_TAG_BEGIN = 0xffe0,
   MEMORY_TAG_END = 0xfff0,
 
+  // Basic block counter Tag
+  BB_COUNTER_TAG = 0xfff0,
+
   // also defined in Callback.h
   Untagged = 0xffff,
 };
@@ -196,6 +199,8 @@ enum RelocatableInstTag {
   RelocTagPatchEnd = 0x21,
   RelocTagPostInstMemAccess = 0x30,
   RelocTagPostInstStdCBK = 0x31,
+  RelocTagMemTraceRecord = 0x40,
+  RelocTagReentry = 0x50,
   RelocTagInvalid = 0xff,
 };
 
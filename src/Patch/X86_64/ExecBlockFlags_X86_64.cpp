@@ -24,10 +24,12 @@
 #include "llvm/MC/MCInstrDesc.h"
 #include "llvm/MC/MCInstrInfo.h"
 
+#include "QBDI/Config.h"
 #include "Engine/LLVMCPU.h"
 #include "Patch/ExecBlockFlags.h"
 #include "Patch/X86_64/ExecBlockFlags_X86_64.h"
 #include "Utility/LogSys.h"
+#include "Utility/System.h"
 
 namespace QBDI {
 namespace {
@@ -37,7 +39,13 @@ struct ExecBlockFlagsArray {
 
   constexpr ExecBlockFlagsArray() : arr() {
     for (unsigned i = 0; i < llvm::X86::NUM_TARGET_REGS; i++) {
-      if (llvm::X86::YMM0 <= i && i <= llvm::X86::YMM15) {
+      if ((llvm::X86::XMM16 <= i && i <= llvm::X86::XMM31) ||
+          (llvm::X86::YMM16 <= i && i <= llvm::X86::YMM31) ||
+          (llvm::X86::ZMM0 <= i && i <= llvm::X86::ZMM31) ||
+          (llvm::X86::K0 <= i && i <= llvm::X86::K7)) {
+        arr[i] = ExecBlockFlags::needAVX512 | ExecBlockFlags::needAVX |
+                 ExecBlockFlags::needFPU;
+      } else if (llvm::X86::YMM0 <= i && i <= llvm::X86::YMM15) {
         arr[i] = ExecBlockFlags::needAVX | ExecBlockFlags::needFPU;
       } else if ((llvm::X86::XMM0 <= i && i <= llvm::X86::XMM15) ||
                  (llvm::X86::ST0 <= i && i <= llvm::X86::ST7) ||
@@ -61,11 +69,50 @@ struct ExecBlockFlagsArray {
   }
 };
 
+struct XSaveMaskArray {
+  uint32_t arr[1 << 4];
+
+  XSaveMaskArray() : arr() {
+    uint32_t hostMask = 0;
+    if (isHostCPUFeaturePresent("xsave")) {
+      hostMask = XSAVE_X87 | XSAVE_SSE;
+      if (isHostCPUFeaturePresent("avx")) {
+        hostMask |= XSAVE_AVX;
+      }
+      if (isHostCPUFeaturePresent("avx512f")) {
+        hostMask |= XSAVE_OPMASK | XSAVE_ZMM_HI256;
+        if constexpr (is_x86_64) {
+          hostMask |= XSAVE_HI16_ZMM;
+        }
+      }
+    }
+    for (uint32_t flags = 0; flags < (1 << 4); flags++) {
+      uint32_t mask = 0;
+      if ((flags & ExecBlockFlags::needFPU) != 0) {
+        mask |= XSAVE_X87 | XSAVE_SSE;
+      }
+      // The VEX instructions clear the upper bits of the ZMM registers
+      if ((flags & ExecBlockFlags::needAVX) != 0) {
+        mask |= XSAVE_AVX | XSAVE_ZMM_HI256;
+      }
+      if ((flags & ExecBlockFlags::needAVX512) != 0) {
+        mask |= XSAVE_OPMASK | XSAVE_ZMM_HI256 | XSAVE_HI16_ZMM;
+      }
+      arr[flags] = mask & hostMask;
+    }
+  }
+};
+
 } // namespace
 
-const uint8_t defaultExecuteFlags = ExecBlockFlags::needAVX |
-                                    ExecBlockFlags::needFPU |
-                                    ExecBlockFlags::needFSGS;
+const uint8_t defaultExecuteFlags =
+    ExecBlockFlags::needAVX | ExecBlockFlags::needFPU |
+    ExecBlockFlags::needFSGS | ExecBlockFlags::needAVX512;
+
+uint32_t getXSaveMask(uint8_t executeFlags) {
+  static const XSaveMaskArray cache;
+  return cache.arr[executeFlags & ((1 << 4) - 1)];
+}
 
 uint8_t getExecBlockFlags(const llvm::MCInst &inst,
                           const QBDI::LLVMCPU &llvmcpu) {
@@ -99,6 +146,17 @@ uint8_t getExecBlockFlags(const llvm::MCInst &inst,
     }
   }
 
+  // The VEX and EVEX vector instructions clear the upper bits of their
+  // destination register
+  uint64_t encoding = desc.TSFlags & llvm::X86II::EncodingMask;
+  if (encoding == llvm::X86II::EVEX) {
+    flags |= ExecBlockFlags::needAVX512 | ExecBlockFlags::needAVX;
+  } else if ((encoding == llvm::X86II::VEX or
+              encoding == llvm::X86II::XOP) and
+             (flags & ExecBlockFlags::needFPU) != 0) {
+    flags |= ExecBlockFlags::needAVX;
+  }
+
   if ((flags & ExecBlockFlags::needAVX) != 0) {
     flags |= ExecBlockFlags::needFPU;
   }
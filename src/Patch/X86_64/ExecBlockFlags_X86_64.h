@@ -26,8 +26,29 @@ typedef enum : uint8_t {
   needAVX = 1 << 0,
   needFPU = 1 << 1,
   needFSGS = 1 << 2,
+  needAVX512 = 1 << 3,
 } ExecBlockFlags;
 
-}
+/*! State components of the XSAVE area.
+ */
+typedef enum : uint32_t {
+  XSAVE_X87 = 1 << 0,
+  XSAVE_SSE = 1 << 1,
+  XSAVE_AVX = 1 << 2,
+  XSAVE_OPMASK = 1 << 5,
+  XSAVE_ZMM_HI256 = 1 << 6,
+  XSAVE_HI16_ZMM = 1 << 7,
+} XSaveComponent;
+
+/*! Get the XSAVE state components to switch for a sequence. Only the
+ * components supported by the host are returned.
+ *
+ * @param[in] executeFlags  The ExecBlockFlags of the sequence.
+ *
+ * @return The mask of XSaveComponent.
+ */
+uint32_t getXSaveMask(uint8_t executeFlags);
+
+} // namespace QBDI
 
 #endif
@@ -24,6 +24,7 @@
 #include "Patch/RelocatableInst.h"
 #include "Patch/Types.h"
 #include "Patch/X86_64/Layer2_X86_64.h"
+#include "Patch/X86_64/PatchGenerator_X86_64.h"
 #include "Patch/X86_64/RelocatableInst_X86_64.h"
 
 #include "QBDI/Config.h"
@@ -64,4 +65,46 @@ RelocatableInst::UniquePtrVec getBreakToHost(Reg temp, const Patch &patch,
   return breakToHost;
 }
 
+/* Generate a series of RelocatableInst which when appended to an
+ * instrumentation code call the inline callback set in the host state. It
+ * receive in argument a temporary reg which will be used for computations then
+ * finally restored. The execution continues after the generated code.
+ */
+RelocatableInst::UniquePtrVec getInlineCall(Reg temp, const Patch &patch,
+                                            bool restore) {
+  RelocatableInst::UniquePtrVec inlineCall;
+
+  QBDI_REQUIRE_ACTION(restore && "X86 don't have a temporary register",
+                      abort());
+
+  // Use the temporary register to compute RIP + offset which is the address
+  // which will follow this patch and where the execution needs to be resumed
+  if constexpr (is_x86)
+    inlineCall.push_back(HostPCRel::unique(mov32ri(temp, 0), 1, 22));
+  else
+    inlineCall.push_back(NoReloc::unique(addr64i(temp, Reg(REG_PC), 19)));
+  // Set the selector to this address, the inline call routine returns to it
+  append(inlineCall,
+         SaveReg(temp, Offset(offsetof(Context, hostState.selector))));
+  // Restore the temporary register
+  append(inlineCall, LoadReg(temp, Offset(temp)));
+  // Jump to the inline call routine of the ExecBlock
+  inlineCall.push_back(InlineCallRel::unique(jmp(0), 0, -1));
+
+  return inlineCall;
+}
+
+// The shadow is a rword, folded in a 64 bits counter when the code is flushed.
+// On X86, it wraps after 2^32 executions between two flushes.
+PatchGenerator::UniquePtrVec getBBCounterGenerator() {
+  return conv_unique<PatchGenerator>(
+      IncrementShadow::unique(Temp(0), Shadow(BB_COUNTER_TAG)));
+}
+
+PatchGenerator::UniquePtrVec getCoverageMapGenerator(uint8_t *map,
+                                                     rword start) {
+  return conv_unique<PatchGenerator>(SetCoverageByte::unique(
+      Temp(0), Constant(reinterpret_cast<rword>(map)), Constant(start)));
+}
+
 } // namespace QBDI
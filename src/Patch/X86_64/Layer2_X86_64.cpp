@@ -63,6 +63,21 @@ llvm::MCInst mov32mr(unsigned int base, rword scale, unsigned int offset,
   return inst;
 }
 
+llvm::MCInst mov8mi(unsigned int base, rword scale, unsigned int offset,
+                    rword displacement, unsigned int seg, uint8_t imm) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::MOV8mi);
+  inst.addOperand(llvm::MCOperand::createReg(base));
+  inst.addOperand(llvm::MCOperand::createImm(scale));
+  inst.addOperand(llvm::MCOperand::createReg(offset));
+  inst.addOperand(llvm::MCOperand::createImm(displacement));
+  inst.addOperand(llvm::MCOperand::createReg(seg));
+  inst.addOperand(llvm::MCOperand::createImm(imm));
+
+  return inst;
+}
+
 llvm::MCInst mov32rm8(unsigned int dst, unsigned int base, rword scale,
                       unsigned int offset, rword displacement,
                       unsigned int seg) {
@@ -204,6 +219,131 @@ llvm::MCInst test64ri32(unsigned int base, uint32_t imm) {
   return inst;
 }
 
+llvm::MCInst test64rr(unsigned int src1, unsigned int src2) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::TEST64rr);
+  inst.addOperand(llvm::MCOperand::createReg(src1));
+  inst.addOperand(llvm::MCOperand::createReg(src2));
+
+  return inst;
+}
+
+llvm::MCInst shr64ri(unsigned int reg, uint8_t imm) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::SHR64ri);
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+  inst.addOperand(llvm::MCOperand::createImm(imm));
+
+  return inst;
+}
+
+llvm::MCInst and32ri8(unsigned int reg, int8_t imm) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::AND32ri8);
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+  inst.addOperand(llvm::MCOperand::createImm(imm));
+
+  return inst;
+}
+
+llvm::MCInst and64ri8(unsigned int reg, int8_t imm) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::AND64ri8);
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+  inst.addOperand(llvm::MCOperand::createImm(imm));
+
+  return inst;
+}
+
+llvm::MCInst xor32rr(unsigned int dst, unsigned int src) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::XOR32rr);
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(src));
+
+  return inst;
+}
+
+llvm::MCInst xor64rr(unsigned int dst, unsigned int src) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::XOR64rr);
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(src));
+
+  return inst;
+}
+
+llvm::MCInst or64rr(unsigned int dst, unsigned int src) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::OR64rr);
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(src));
+
+  return inst;
+}
+
+llvm::MCInst and64rr(unsigned int dst, unsigned int src) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::AND64rr);
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(src));
+
+  return inst;
+}
+
+llvm::MCInst cmovne64rr(unsigned int dst, unsigned int src) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::CMOV64rr);
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(dst));
+  inst.addOperand(llvm::MCOperand::createReg(src));
+  inst.addOperand(llvm::MCOperand::createImm(llvm::X86::CondCode::COND_NE));
+
+  return inst;
+}
+
+llvm::MCInst not64r(unsigned int reg) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::NOT64r);
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+
+  return inst;
+}
+
+llvm::MCInst cmp64rm(unsigned int reg, unsigned int base, rword scale,
+                     unsigned int offset, rword displacement,
+                     unsigned int seg) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::CMP64rm);
+  inst.addOperand(llvm::MCOperand::createReg(reg));
+  inst.addOperand(llvm::MCOperand::createReg(base));
+  inst.addOperand(llvm::MCOperand::createImm(scale));
+  inst.addOperand(llvm::MCOperand::createReg(offset));
+  inst.addOperand(llvm::MCOperand::createImm(displacement));
+  inst.addOperand(llvm::MCOperand::createReg(seg));
+
+  return inst;
+}
+
 llvm::MCInst jmp32m(unsigned int base, rword offset) {
   llvm::MCInst inst;
 
@@ -230,6 +370,32 @@ llvm::MCInst jmp64m(unsigned int base, rword offset) {
   return inst;
 }
 
+llvm::MCInst call32m(unsigned int base, rword offset) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::CALL32m);
+  inst.addOperand(llvm::MCOperand::createReg(base));
+  inst.addOperand(llvm::MCOperand::createImm(1));
+  inst.addOperand(llvm::MCOperand::createReg(0));
+  inst.addOperand(llvm::MCOperand::createImm(offset));
+  inst.addOperand(llvm::MCOperand::createReg(0));
+
+  return inst;
+}
+
+llvm::MCInst call64m(unsigned int base, rword offset) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::CALL64m);
+  inst.addOperand(llvm::MCOperand::createReg(base));
+  inst.addOperand(llvm::MCOperand::createImm(1));
+  inst.addOperand(llvm::MCOperand::createReg(0));
+  inst.addOperand(llvm::MCOperand::createImm(offset));
+  inst.addOperand(llvm::MCOperand::createReg(0));
+
+  return inst;
+}
+
 llvm::MCInst je(int32_t offset) {
   llvm::MCInst inst;
 
@@ -250,6 +416,15 @@ llvm::MCInst jne(int32_t offset) {
   return inst;
 }
 
+llvm::MCInst jrcxz(int8_t offset) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::JRCXZ);
+  inst.addOperand(llvm::MCOperand::createImm(offset));
+
+  return inst;
+}
+
 llvm::MCInst jmp(rword offset) {
   llvm::MCInst inst;
 
@@ -285,6 +460,32 @@ llvm::MCInst fxrstor(unsigned int base, rword offset) {
   return inst;
 }
 
+llvm::MCInst xsave(unsigned int base, rword offset) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::XSAVE);
+  inst.addOperand(llvm::MCOperand::createReg(base));
+  inst.addOperand(llvm::MCOperand::createImm(1));
+  inst.addOperand(llvm::MCOperand::createReg(0));
+  inst.addOperand(llvm::MCOperand::createImm(offset));
+  inst.addOperand(llvm::MCOperand::createReg(0));
+
+  return inst;
+}
+
+llvm::MCInst xrstor(unsigned int base, rword offset) {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::XRSTOR);
+  inst.addOperand(llvm::MCOperand::createReg(base));
+  inst.addOperand(llvm::MCOperand::createImm(1));
+  inst.addOperand(llvm::MCOperand::createReg(0));
+  inst.addOperand(llvm::MCOperand::createImm(offset));
+  inst.addOperand(llvm::MCOperand::createReg(0));
+
+  return inst;
+}
+
 llvm::MCInst vextractf128(unsigned int base, rword offset, unsigned int src,
                           uint8_t regoffset) {
   llvm::MCInst inst;
@@ -436,6 +637,22 @@ llvm::MCInst ret() {
   return inst;
 }
 
+llvm::MCInst cld() {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::CLD);
+
+  return inst;
+}
+
+llvm::MCInst fninit() {
+  llvm::MCInst inst;
+
+  inst.setOpcode(llvm::X86::FNINIT);
+
+  return inst;
+}
+
 llvm::MCInst rdfsbase64(unsigned int reg) {
   llvm::MCInst inst;
 
@@ -574,6 +791,20 @@ llvm::MCInst jmpm(unsigned int base, rword offset) {
     return jmp32m(base, offset);
 }
 
+llvm::MCInst callm(unsigned int base, rword offset) {
+  if constexpr (is_x86_64)
+    return call64m(base, offset);
+  else
+    return call32m(base, offset);
+}
+
+llvm::MCInst andri8(unsigned int reg, int8_t imm) {
+  if constexpr (is_x86_64)
+    return and64ri8(reg, imm);
+  else
+    return and32ri8(reg, imm);
+}
+
 RelocatableInst::UniquePtr Mov(Reg dst, Reg src) {
   return MovReg::unique(dst, src);
 }
@@ -602,6 +833,14 @@ RelocatableInst::UniquePtr JmpM(Offset offset) {
   return DataBlockRelx86(jmpm(0, 0), 0, offset, 6);
 }
 
+RelocatableInst::UniquePtr CallM(Offset offset) {
+  return DataBlockRelx86(callm(0, 0), 0, offset, 6);
+}
+
+RelocatableInst::UniquePtr Lea(Reg reg, Offset offset) {
+  return DataBlockRelx86(lea(reg, 0, 1, 0, 0, 0), 1, offset, 7);
+}
+
 RelocatableInst::UniquePtr Fxsave(Offset offset) {
   return DataBlockRelx86(fxsave(0, 0), 0, offset, 7);
 }
@@ -610,6 +849,14 @@ RelocatableInst::UniquePtr Fxrstor(Offset offset) {
   return DataBlockRelx86(fxrstor(0, 0), 0, offset, 7);
 }
 
+RelocatableInst::UniquePtr Xsave(Offset offset) {
+  return DataBlockRelx86(xsave(0, 0), 0, offset, 7);
+}
+
+RelocatableInst::UniquePtr Xrstor(Offset offset) {
+  return DataBlockRelx86(xrstor(0, 0), 0, offset, 7);
+}
+
 RelocatableInst::UniquePtr Vextractf128(Offset offset, unsigned int src,
                                         Constant regoffset) {
   return DataBlockRelx86(vextractf128(0, 0, src, regoffset), 0, offset, 10);
@@ -636,6 +883,10 @@ RelocatableInst::UniquePtr Popf() { return NoReloc::unique(popf()); }
 
 RelocatableInst::UniquePtr Ret() { return NoReloc::unique(ret()); }
 
+RelocatableInst::UniquePtr Cld() { return NoReloc::unique(cld()); }
+
+RelocatableInst::UniquePtr Fninit() { return NoReloc::unique(fninit()); }
+
 RelocatableInst::UniquePtr Test(Reg reg, unsigned int value) {
   return NoReloc::unique(testri(reg, value));
 }
@@ -39,6 +39,9 @@ llvm::MCInst mov32ri(unsigned int reg, rword imm);
 llvm::MCInst mov32mr(unsigned int base, rword scale, unsigned int offset,
                      rword displacement, unsigned int seg, unsigned int src);
 
+llvm::MCInst mov8mi(unsigned int base, rword scale, unsigned int offset,
+                    rword displacement, unsigned int seg, uint8_t imm);
+
 llvm::MCInst mov32rm8(unsigned int dst, unsigned int base, rword scale,
                       unsigned int offset, rword displacement,
                       unsigned int seg);
@@ -68,20 +71,57 @@ llvm::MCInst test32ri(unsigned int base, uint32_t imm);
 
 llvm::MCInst test64ri32(unsigned int base, uint32_t imm);
 
+llvm::MCInst test64rr(unsigned int src1, unsigned int src2);
+
+llvm::MCInst shr64ri(unsigned int reg, uint8_t imm);
+
+llvm::MCInst and32ri8(unsigned int reg, int8_t imm);
+
+llvm::MCInst and64ri8(unsigned int reg, int8_t imm);
+
+llvm::MCInst xor32rr(unsigned int dst, unsigned int src);
+
+llvm::MCInst xor64rr(unsigned int dst, unsigned int src);
+
+llvm::MCInst or64rr(unsigned int dst, unsigned int src);
+
+llvm::MCInst and64rr(unsigned int dst, unsigned int src);
+
+llvm::MCInst cmovne64rr(unsigned int dst, unsigned int src);
+
+llvm::MCInst not64r(unsigned int reg);
+
+llvm::MCInst cmp64rm(unsigned int reg, unsigned int base, rword scale,
+                     unsigned int offset, rword displacement, unsigned int seg);
+
 llvm::MCInst je(int32_t offset);
 
 llvm::MCInst jne(int32_t offset);
 
+llvm::MCInst jrcxz(int8_t offset);
+
 llvm::MCInst jmp32m(unsigned int base, rword offset);
 
 llvm::MCInst jmp64m(unsigned int base, rword offset);
 
 llvm::MCInst jmp(rword offset);
 
+llvm::MCInst call32m(unsigned int base, rword offset);
+
+llvm::MCInst call64m(unsigned int base, rword offset);
+
+llvm::MCInst cld();
+
+llvm::MCInst fninit();
+
 llvm::MCInst fxsave(unsigned int base, rword offset);
 
 llvm::MCInst fxrstor(unsigned int base, rword offset);
 
+llvm::MCInst xsave(unsigned int base, rword offset);
+
+llvm::MCInst xrstor(unsigned int base, rword offset);
+
 llvm::MCInst vextractf128(unsigned int base, rword offset, unsigned int src,
                           uint8_t regoffset);
 
@@ -157,6 +197,10 @@ llvm::MCInst pushf();
 
 llvm::MCInst jmpm(unsigned int base, rword offset);
 
+llvm::MCInst callm(unsigned int base, rword offset);
+
+llvm::MCInst andri8(unsigned int reg, int8_t imm);
+
 // high level layer 2
 
 std::unique_ptr<RelocatableInst> Mov(Reg dst, Reg src);
@@ -174,10 +218,18 @@ std::unique_ptr<RelocatableInst> Mov(Reg reg, Shadow shadow);
 
 std::unique_ptr<RelocatableInst> JmpM(Offset offset);
 
+std::unique_ptr<RelocatableInst> CallM(Offset offset);
+
+std::unique_ptr<RelocatableInst> Lea(Reg reg, Offset offset);
+
 std::unique_ptr<RelocatableInst> Fxsave(Offset offset);
 
 std::unique_ptr<RelocatableInst> Fxrstor(Offset offset);
 
+std::unique_ptr<RelocatableInst> Xsave(Offset offset);
+
+std::unique_ptr<RelocatableInst> Xrstor(Offset offset);
+
 std::unique_ptr<RelocatableInst> Vextractf128(Offset offset, unsigned int src,
                                               Constant regoffset);
 
@@ -196,6 +248,10 @@ std::unique_ptr<RelocatableInst> Popf();
 
 std::unique_ptr<RelocatableInst> Ret();
 
+std::unique_ptr<RelocatableInst> Cld();
+
+std::unique_ptr<RelocatableInst> Fninit();
+
 std::unique_ptr<RelocatableInst> Test(Reg reg, unsigned int value);
 
 std::unique_ptr<RelocatableInst> Je(int32_t offset);
@@ -65,6 +65,8 @@ enum MemoryTag : uint16_t {
   MEM_READ_0_END_ADDRESS_TAG = MEMORY_TAG_BEGIN + 7,
   MEM_READ_1_END_ADDRESS_TAG = MEMORY_TAG_BEGIN + 8,
   MEM_WRITE_END_ADDRESS_TAG = MEMORY_TAG_BEGIN + 9,
+
+  MEM_TRACE_WRITE_ADDRESS_TAG = MEMORY_TAG_BEGIN + 10,
 };
 
 void analyseMemoryAccessAddrValue(const ExecBlock &curExecBlock,
@@ -388,6 +390,146 @@ generatePostWriteInstrumentPatch(Patch &patch, const LLVMCPU &llvmcpu) {
   }
 }
 
+// Memory trace
+// ============
+
+// Write a record in the memory trace buffer. The address and the value
+// generators must set Temp(0).
+static PatchGenerator::UniquePtrVec
+traceRecord(MemoryAccessType type, PatchGenerator::UniquePtr &&address,
+            PatchGenerator::UniquePtr &&value) {
+  return conv_unique<PatchGenerator>(
+      LoadMemTraceCursor::unique(Temp(2), Temp(1)), std::move(address),
+      WriteMemTrace::unique(Temp(0), Temp(1),
+                            Constant(offsetof(MemoryAccess, accessAddress))),
+      std::move(value),
+      WriteMemTrace::unique(Temp(0), Temp(1),
+                            Constant(offsetof(MemoryAccess, value))),
+      WriteMemTraceInfo::unique(Temp(0), Temp(1), type),
+      AdvanceMemTraceCursor::unique(Temp(2), Temp(1)));
+}
+
+static PatchGenerator::UniquePtrVec
+traceRecord(MemoryAccessType type, PatchGenerator::UniquePtr &&address) {
+  return traceRecord(type, std::move(address),
+                     GetConstant::unique(Temp(0), Constant(0)));
+}
+
+static PatchGenerator::UniquePtrVec
+concat(PatchGenerator::UniquePtrVec &&a, PatchGenerator::UniquePtrVec &&b) {
+  append(a, std::move(b));
+  return std::move(a);
+}
+
+static const PatchGenerator::UniquePtrVec &
+generatePreReadTracePatch(Patch &patch, const LLVMCPU &llvmcpu) {
+
+  // REP prefix: only the begin address is recorded
+  if (hasREPPrefix(patch.metadata.inst)) {
+    if (isDoubleRead(patch.metadata.inst)) {
+      static const PatchGenerator::UniquePtrVec r =
+          concat(traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0), 0)),
+                 traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0), 1)));
+      return r;
+    } else {
+      static const PatchGenerator::UniquePtrVec r =
+          traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0)));
+      return r;
+    }
+  }
+  // instruction with double read
+  else if (isDoubleRead(patch.metadata.inst)) {
+    if (getReadSize(patch.metadata.inst) > sizeof(rword)) {
+      static const PatchGenerator::UniquePtrVec r =
+          concat(traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0), 0)),
+                 traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0), 1)));
+      return r;
+    } else {
+      static const PatchGenerator::UniquePtrVec r =
+          concat(traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0), 0),
+                             GetReadValue::unique(Temp(0), 0)),
+                 traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0), 1),
+                             GetReadValue::unique(Temp(0), 1)));
+      return r;
+    }
+  } else {
+    if (getReadSize(patch.metadata.inst) > sizeof(rword)) {
+      static const PatchGenerator::UniquePtrVec r =
+          traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0)));
+      return r;
+    } else {
+      static const PatchGenerator::UniquePtrVec r =
+          traceRecord(MEMORY_READ, GetReadAddress::unique(Temp(0)),
+                      GetReadValue::unique(Temp(0)));
+      return r;
+    }
+  }
+}
+
+static const PatchGenerator::UniquePtrVec &
+generatePreWriteTracePatch(Patch &patch, const LLVMCPU &llvmcpu) {
+
+  const llvm::MCInstrDesc &desc =
+      llvmcpu.getMCII().get(patch.metadata.inst.getOpcode());
+
+  // REP prefix: only the begin address is recorded
+  if (hasREPPrefix(patch.metadata.inst)) {
+    static const PatchGenerator::UniquePtrVec r =
+        traceRecord(MEMORY_WRITE, GetWriteAddress::unique(Temp(0)));
+    return r;
+  }
+  // Some instruction need to have the address get before the instruction
+  else if (mayChangeWriteAddr(patch.metadata.inst, desc) &&
+           !isStackWrite(patch.metadata.inst)) {
+    static const PatchGenerator::UniquePtrVec r = conv_unique<PatchGenerator>(
+        GetWriteAddress::unique(Temp(0)),
+        WriteTemp::unique(Temp(0), Shadow(MEM_TRACE_WRITE_ADDRESS_TAG)));
+    return r;
+  } else {
+    static const PatchGenerator::UniquePtrVec r;
+    return r;
+  }
+}
+
+static const PatchGenerator::UniquePtrVec &
+generatePostWriteTracePatch(Patch &patch, const LLVMCPU &llvmcpu) {
+
+  const llvm::MCInstrDesc &desc =
+      llvmcpu.getMCII().get(patch.metadata.inst.getOpcode());
+
+  if (hasREPPrefix(patch.metadata.inst)) {
+    static const PatchGenerator::UniquePtrVec r;
+    return r;
+  }
+  // Some instruction need to have the address get before the instruction
+  else if (mayChangeWriteAddr(patch.metadata.inst, desc) &&
+           !isStackWrite(patch.metadata.inst)) {
+    if (getWriteSize(patch.metadata.inst) > sizeof(rword)) {
+      static const PatchGenerator::UniquePtrVec r = traceRecord(
+          MEMORY_WRITE,
+          ReadTemp::unique(Temp(0), Shadow(MEM_TRACE_WRITE_ADDRESS_TAG)));
+      return r;
+    } else {
+      static const PatchGenerator::UniquePtrVec r = traceRecord(
+          MEMORY_WRITE,
+          ReadTemp::unique(Temp(0), Shadow(MEM_TRACE_WRITE_ADDRESS_TAG)),
+          GetWriteValue::unique(Temp(0)));
+      return r;
+    }
+  } else {
+    if (getWriteSize(patch.metadata.inst) > sizeof(rword)) {
+      static const PatchGenerator::UniquePtrVec r =
+          traceRecord(MEMORY_WRITE, GetWriteAddress::unique(Temp(0)));
+      return r;
+    } else {
+      static const PatchGenerator::UniquePtrVec r =
+          traceRecord(MEMORY_WRITE, GetWriteAddress::unique(Temp(0)),
+                      GetWriteValue::unique(Temp(0)));
+      return r;
+    }
+  }
+}
+
 std::vector<std::unique_ptr<InstrRule>> getInstrRuleMemAccessRead() {
   return conv_unique<InstrRule>(
       InstrRuleDynamic::unique(
@@ -408,4 +550,22 @@ std::vector<std::unique_ptr<InstrRule>> getInstrRuleMemAccessWrite() {
           false, PRIORITY_MEMACCESS_LIMIT, RelocTagPostInstMemAccess));
 }
 
+std::vector<std::unique_ptr<InstrRule>> getInstrRuleMemTraceRead() {
+  return conv_unique<InstrRule>(InstrRuleDynamic::unique(
+      DoesReadAccess::unique(), generatePreReadTracePatch, PREINST, false,
+      PRIORITY_MEMACCESS_LIMIT + 1, RelocTagPreInstMemAccess));
+}
+
+std::vector<std::unique_ptr<InstrRule>> getInstrRuleMemTraceWrite() {
+  return conv_unique<InstrRule>(
+      InstrRuleDynamic::unique(DoesWriteAccess::unique(),
+                               generatePreWriteTracePatch, PREINST, false,
+                               PRIORITY_MEMACCESS_LIMIT,
+                               RelocTagPreInstMemAccess),
+      InstrRuleDynamic::unique(DoesWriteAccess::unique(),
+                               generatePostWriteTracePatch, POSTINST, false,
+                               PRIORITY_MEMACCESS_LIMIT,
+                               RelocTagPostInstMemAccess));
+}
+
 } // namespace QBDI
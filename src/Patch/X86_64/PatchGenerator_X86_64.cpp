@@ -17,6 +17,7 @@
  */
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <utility>
 
 #include "MCTargetDesc/X86BaseInfo.h"
@@ -28,7 +29,9 @@
 #include "QBDI/Config.h"
 #include "QBDI/Platform.h"
 #include "Engine/LLVMCPU.h"
+#include "ExecBlock/Context.h"
 #include "Patch/InstInfo.h"
+#include "Patch/MemoryAccess.h"
 #include "Patch/Patch.h"
 #include "Patch/RelocatableInst.h"
 #include "Patch/TempManager.h"
@@ -63,6 +66,16 @@ RelocatableInst::UniquePtrVec JmpEpilogue::generate(const Patch *patch,
   return conv_unique<RelocatableInst>(EpilogueRel::unique(jmp(0), 0, -1));
 }
 
+// JmpChain
+// ========
+
+RelocatableInst::UniquePtrVec JmpChain::generate(const Patch *patch,
+                                                 TempManager *temp_manager,
+                                                 Patch *toMerge) const {
+
+  return conv_unique<RelocatableInst>(JmpM(offset));
+}
+
 // Target Specific PatchGenerator
 
 // GetPCOffset
@@ -568,4 +581,130 @@ RelocatableInst::UniquePtrVec GetWriteValue::generate(const Patch *patch,
       abort());
 }
 
+// LoadMemTraceCursor
+// ==================
+
+RelocatableInst::UniquePtrVec
+LoadMemTraceCursor::generate(const Patch *patch, TempManager *temp_manager,
+                             Patch *toMerge) const {
+  static_assert(offsetof(MemTraceState, cursor) == 0);
+
+  Reg stateReg = temp_manager->getRegForTemp(state);
+  Reg cursorReg = temp_manager->getRegForTemp(cursor);
+
+  return conv_unique<RelocatableInst>(
+      RelocTag::unique(RelocTagMemTraceRecord),
+      LoadDataBlock::unique(stateReg,
+                            Offset(offsetof(Context, hostState.memTrace))),
+      NoReloc::unique(movrm(cursorReg, stateReg, 1, 0, 0, 0)));
+}
+
+// WriteMemTrace
+// =============
+
+RelocatableInst::UniquePtrVec
+WriteMemTrace::generate(const Patch *patch, TempManager *temp_manager,
+                        Patch *toMerge) const {
+
+  return conv_unique<RelocatableInst>(
+      NoReloc::unique(movmr(temp_manager->getRegForTemp(cursor), 1, 0, offset,
+                            0, temp_manager->getRegForTemp(temp))));
+}
+
+// WriteMemTraceInfo
+// =================
+
+RelocatableInst::UniquePtrVec
+WriteMemTraceInfo::generate(const Patch *patch, TempManager *temp_manager,
+                            Patch *toMerge) const {
+  static_assert((sizeof(MemoryAccess) - offsetof(MemoryAccess, size)) %
+                    sizeof(rword) ==
+                0);
+
+  const llvm::MCInst &inst = patch->metadata.inst;
+  Reg tempReg = temp_manager->getRegForTemp(temp);
+  Reg cursorReg = temp_manager->getRegForTemp(cursor);
+
+  // zero initialized to have deterministic padding
+  MemoryAccess access = MemoryAccess();
+  access.instAddress = patch->metadata.address;
+  access.type = type;
+  access.flags = MEMORY_NO_FLAGS;
+  if (type == MEMORY_READ) {
+    access.size = getReadSize(inst);
+  } else {
+    access.size = getWriteSize(inst);
+  }
+  if (isMinSizeRead(inst)) {
+    access.flags |= MEMORY_MINIMUM_SIZE;
+  }
+  if (hasREPPrefix(inst)) {
+    // only the begin address of the access is recorded
+    access.size = 0;
+    access.flags = MEMORY_UNKNOWN_SIZE | MEMORY_UNKNOWN_VALUE;
+  } else if (access.size > sizeof(rword)) {
+    access.flags |= MEMORY_UNKNOWN_VALUE;
+  }
+
+  RelocatableInst::UniquePtrVec res;
+  res.push_back(NoReloc::unique(movri(tempReg, access.instAddress)));
+  res.push_back(NoReloc::unique(movmr(
+      cursorReg, 1, 0, offsetof(MemoryAccess, instAddress), 0, tempReg)));
+  for (size_t off = offsetof(MemoryAccess, size); off < sizeof(MemoryAccess);
+       off += sizeof(rword)) {
+    rword value;
+    memcpy(&value, reinterpret_cast<const uint8_t *>(&access) + off,
+           sizeof(rword));
+    res.push_back(NoReloc::unique(movri(tempReg, value)));
+    res.push_back(NoReloc::unique(movmr(cursorReg, 1, 0, off, 0, tempReg)));
+  }
+  return res;
+}
+
+// AdvanceMemTraceCursor
+// =====================
+
+RelocatableInst::UniquePtrVec
+AdvanceMemTraceCursor::generate(const Patch *patch, TempManager *temp_manager,
+                                Patch *toMerge) const {
+
+  Reg stateReg = temp_manager->getRegForTemp(state);
+  Reg cursorReg = temp_manager->getRegForTemp(cursor);
+
+  return conv_unique<RelocatableInst>(
+      NoReloc::unique(
+          lea(cursorReg, cursorReg, 1, 0, sizeof(MemoryAccess), 0)),
+      NoReloc::unique(movmr(stateReg, 1, 0, 0, 0, cursorReg)));
+}
+
+// IncrementShadow
+// ===============
+
+RelocatableInst::UniquePtrVec
+IncrementShadow::generate(const Patch *patch, TempManager *temp_manager,
+                          Patch *toMerge) const {
+
+  Reg tempReg = temp_manager->getRegForTemp(temp);
+
+  return conv_unique<RelocatableInst>(
+      LoadShadow::unique(tempReg, shadow, true),
+      NoReloc::unique(lea(tempReg, tempReg, 1, 0, 1, 0)),
+      StoreShadow::unique(tempReg, shadow, false));
+}
+
+// SetCoverageByte
+// ===============
+
+RelocatableInst::UniquePtrVec
+SetCoverageByte::generate(const Patch *patch, TempManager *temp_manager,
+                          Patch *toMerge) const {
+
+  Reg tempReg = temp_manager->getRegForTemp(temp);
+  rword index = patch->metadata.endAddress() - 1 - start;
+
+  return conv_unique<RelocatableInst>(
+      LoadImm::unique(tempReg, Constant(map + index)),
+      NoReloc::unique(mov8mi(tempReg, 1, 0, 0, 0, 1)));
+}
+
 } // namespace QBDI
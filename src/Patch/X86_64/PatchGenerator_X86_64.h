@@ -22,6 +22,7 @@
 #include <stddef.h>
 #include <vector>
 
+#include "QBDI/Callback.h"
 #include "QBDI/State.h"
 #include "Patch/PatchGenerator.h"
 #include "Patch/PatchUtils.h"
@@ -239,6 +240,168 @@ public:
            Patch *toMerge) const override;
 };
 
+class LoadMemTraceCursor
+    : public AutoClone<PatchGenerator, LoadMemTraceCursor> {
+
+  Temp state;
+  Temp cursor;
+
+public:
+  /*! Start a new record in the memory trace buffer: load the address of the
+   * MemTraceState and the current cursor of the buffer. The record is tagged
+   * with RelocTagMemTraceRecord.
+   *
+   * @param[in] state   A temporary where the MemTraceState address will be
+   *                    copied.
+   * @param[in] cursor  A temporary where the cursor will be copied.
+   */
+  LoadMemTraceCursor(Temp state, Temp cursor) : state(state), cursor(cursor) {}
+
+  /*! Output:
+   *
+   * MOV REG64 state, MEM64 DataBlock[Offset(hostState.memTrace)]
+   * MOV REG64 cursor, MEM64 [state]
+   */
+  std::vector<std::unique_ptr<RelocatableInst>>
+  generate(const Patch *patch, TempManager *temp_manager,
+           Patch *toMerge) const override;
+};
+
+class WriteMemTrace : public AutoClone<PatchGenerator, WriteMemTrace> {
+
+  Temp temp;
+  Temp cursor;
+  Constant offset;
+
+public:
+  /*! Write a temporary in a field of the current record of the memory trace
+   * buffer.
+   *
+   * @param[in] temp    A temporary which will be written.
+   * @param[in] cursor  A temporary with the cursor of the buffer.
+   * @param[in] offset  The offset of the field in the MemoryAccess.
+   */
+  WriteMemTrace(Temp temp, Temp cursor, Constant offset)
+      : temp(temp), cursor(cursor), offset(offset) {}
+
+  /*! Output:
+   *
+   * MOV MEM64 [cursor + offset], REG64 temp
+   */
+  std::vector<std::unique_ptr<RelocatableInst>>
+  generate(const Patch *patch, TempManager *temp_manager,
+           Patch *toMerge) const override;
+};
+
+class WriteMemTraceInfo : public AutoClone<PatchGenerator, WriteMemTraceInfo> {
+
+  Temp temp;
+  Temp cursor;
+  MemoryAccessType type;
+
+public:
+  /*! Write the static fields of the current record of the memory trace
+   * buffer: the address of the instruction and the size, type and flags of the
+   * access. They are computed when the patch is generated.
+   *
+   * @param[in] temp    A temporary used to write the fields.
+   * @param[in] cursor  A temporary with the cursor of the buffer.
+   * @param[in] type    The type of the access (MEMORY_READ or MEMORY_WRITE).
+   */
+  WriteMemTraceInfo(Temp temp, Temp cursor, MemoryAccessType type)
+      : temp(temp), cursor(cursor), type(type) {}
+
+  /*! Output:
+   *
+   * MOV REG64 temp, IMM64 instAddress
+   * MOV MEM64 [cursor + offsetof(instAddress)], REG64 temp
+   * for each rword of (size, type, flags):
+   *   MOV REG64 temp, IMM64 value
+   *   MOV MEM64 [cursor + offset], REG64 temp
+   */
+  std::vector<std::unique_ptr<RelocatableInst>>
+  generate(const Patch *patch, TempManager *temp_manager,
+           Patch *toMerge) const override;
+};
+
+class AdvanceMemTraceCursor
+    : public AutoClone<PatchGenerator, AdvanceMemTraceCursor> {
+
+  Temp state;
+  Temp cursor;
+
+public:
+  /*! Terminate the current record of the memory trace buffer and store the
+   * cursor of the next one. The flags are not modified.
+   *
+   * @param[in] state   A temporary with the MemTraceState address.
+   * @param[in] cursor  A temporary with the cursor of the buffer.
+   */
+  AdvanceMemTraceCursor(Temp state, Temp cursor)
+      : state(state), cursor(cursor) {}
+
+  /*! Output:
+   *
+   * LEA REG64 cursor, MEM64 [cursor + sizeof(MemoryAccess)]
+   * MOV MEM64 [state], REG64 cursor
+   */
+  std::vector<std::unique_ptr<RelocatableInst>>
+  generate(const Patch *patch, TempManager *temp_manager,
+           Patch *toMerge) const override;
+};
+
+class IncrementShadow : public AutoClone<PatchGenerator, IncrementShadow> {
+
+  Temp temp;
+  Shadow shadow;
+
+public:
+  /*! Increment a counter kept in a new shadow of the data block. The shadow is
+   * initialized to zero when the patch is written. The flags are not modified.
+   *
+   * @param[in] temp    A temporary used to increment the counter.
+   * @param[in] shadow  The tag of the shadow of the counter.
+   */
+  IncrementShadow(Temp temp, Shadow shadow) : temp(temp), shadow(shadow) {}
+
+  /*! Output:
+   *
+   * MOV REG64 temp, MEM64 Shadow
+   * LEA REG64 temp, MEM64 [temp + 1]
+   * MOV MEM64 Shadow, REG64 temp
+   */
+  std::vector<std::unique_ptr<RelocatableInst>>
+  generate(const Patch *patch, TempManager *temp_manager,
+           Patch *toMerge) const override;
+};
+
+class SetCoverageByte : public AutoClone<PatchGenerator, SetCoverageByte> {
+
+  Temp temp;
+  Constant map;
+  Constant start;
+
+public:
+  /*! Set to 1 the byte of a coverage map matching the last byte of the
+   * current instruction. The flags are not modified.
+   *
+   * @param[in] temp   A temporary used to address the map.
+   * @param[in] map    The address of the coverage map.
+   * @param[in] start  The address matching the first byte of the map.
+   */
+  SetCoverageByte(Temp temp, Constant map, Constant start)
+      : temp(temp), map(map), start(start) {}
+
+  /*! Output:
+   *
+   * MOV REG64 temp, IMM64 (map + endAddress - 1 - start)
+   * MOV MEM8 [temp], IMM8 1
+   */
+  std::vector<std::unique_ptr<RelocatableInst>>
+  generate(const Patch *patch, TempManager *temp_manager,
+           Patch *toMerge) const override;
+};
+
 } // namespace QBDI
 
 #endif
@@ -25,6 +25,8 @@
 #include "QBDI/Options.h"
 #include "QBDI/State.h"
 #include "ExecBlock/Context.h"
+#include "Patch/ExecBlockFlags.h"
+#include "Patch/InstMetadata.h"
 #include "Patch/InstTransform.h"
 #include "Patch/PatchCondition.h"
 #include "Patch/PatchGenerator.h"
@@ -37,237 +39,440 @@
 #include "Patch/X86_64/Layer2_X86_64.h"
 #include "Patch/X86_64/PatchGenerator_X86_64.h"
 #include "Patch/X86_64/PatchRules_X86_64.h"
+#include "Patch/X86_64/RelocatableInst_X86_64.h"
 #include "Utility/LogSys.h"
 #include "Utility/System.h"
 
 namespace QBDI {
 
-RelocatableInst::UniquePtrVec getExecBlockPrologue(Options opts) {
-  RelocatableInst::UniquePtrVec prologue;
+namespace {
 
-  // Save host SP
-  append(prologue,
-         SaveReg(Reg(REG_SP), Offset(offsetof(Context, hostState.sp))));
-  // Restore FPR
-  if ((opts & Options::OPT_DISABLE_FPR) == 0) {
+// The XSAVE context switch needs the support of XSAVE by the CPU and the OS
+bool useXSave(Options opts) {
+  if ((opts & Options::OPT_ENABLE_XSAVE) == 0) {
+    return false;
+  }
+  if (getXSaveMask(defaultExecuteFlags) == 0) {
+    QBDI_DEBUG("XSAVE not supported, fallback to FXSAVE");
+    return false;
+  }
+  return true;
+}
+
+// Restore the guest FPR from the context. Reg(0) is used as a scratch.
+void appendRestoreFPR(RelocatableInst::UniquePtrVec &code, Options opts) {
+  if ((opts & Options::OPT_DISABLE_FPR) == 0 and useXSave(opts)) {
+    QBDI_DEBUG("XSAVE enabled in guest context switches");
+    if ((opts & Options::OPT_DISABLE_OPTIONAL_FPR) == 0) {
+      append(code,
+             LoadReg(Reg(0), Offset(offsetof(Context, hostState.xsaveMask))));
+      // the mask is empty when the sequence doesn't need the FPU
+      code.push_back(Test(Reg(0), XSaveComponent::XSAVE_SSE));
+      code.push_back(Je(2 + 7 + 4));
+    } else {
+      code.push_back(NoReloc::unique(
+          mov32ri(llvm::X86::EAX, getXSaveMask(defaultExecuteFlags))));
+    }
+    code.push_back(NoReloc::unique(xor32rr(llvm::X86::EDX, llvm::X86::EDX)));
+    code.push_back(Xrstor(Offset(offsetof(Context, fprState))));
+    // target je empty mask
+  } else if ((opts & Options::OPT_DISABLE_FPR) == 0) {
     if ((opts & Options::OPT_DISABLE_OPTIONAL_FPR) == 0) {
       append(
-          prologue,
+          code,
           LoadReg(Reg(0), Offset(offsetof(Context, hostState.executeFlags))));
-      prologue.push_back(Test(Reg(0), ExecBlockFlags::needFPU));
-      prologue.push_back(Je(7 + 4));
+      code.push_back(Test(Reg(0), ExecBlockFlags::needFPU));
+      code.push_back(Je(7 + 4));
     }
-    prologue.push_back(Fxrstor(Offset(offsetof(Context, fprState))));
+    code.push_back(Fxrstor(Offset(offsetof(Context, fprState))));
     // target je needFPU
     if (isHostCPUFeaturePresent("avx")) {
       QBDI_DEBUG("AVX support enabled in guest context switches");
       // don't restore if not needed
       if ((opts & Options::OPT_DISABLE_OPTIONAL_FPR) == 0) {
-        prologue.push_back(Test(Reg(0), ExecBlockFlags::needAVX));
+        code.push_back(Test(Reg(0), ExecBlockFlags::needAVX));
         if constexpr (is_x86_64)
-          prologue.push_back(Je(16 * 10 + 4));
+          code.push_back(Je(16 * 10 + 4));
         else
-          prologue.push_back(Je(8 * 10 + 4));
+          code.push_back(Je(8 * 10 + 4));
       }
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM0,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm0)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM1,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm1)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM2,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm2)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM3,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm3)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM4,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm4)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM5,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm5)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM6,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm6)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM7,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm7)), 1));
 #if defined(QBDI_ARCH_X86_64)
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM8,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm8)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM9,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm9)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM10,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm10)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM11,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm11)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM12,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm12)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM13,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm13)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM14,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm14)), 1));
-      prologue.push_back(Vinsertf128(
+      code.push_back(Vinsertf128(
           llvm::X86::YMM15,
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm15)), 1));
 #endif // QBDI_ARCH_X86_64
        // target je needAVX
     }
   }
-#if defined(QBDI_ARCH_X86_64)
-  // if enable FS GS
-  if ((opts & Options::OPT_ENABLE_FS_GS) == Options::OPT_ENABLE_FS_GS) {
-    QBDI_REQUIRE_ACTION(isHostCPUFeaturePresent("fsgsbase"), abort());
-
-    append(prologue,
-           LoadReg(Reg(0), Offset(offsetof(Context, hostState.executeFlags))));
-    prologue.push_back(Test(Reg(0), ExecBlockFlags::needFSGS));
-    prologue.push_back(Je(5 * 4 + 7 * 4 + 4));
-
-    append(prologue, LoadReg(Reg(3), Offset(offsetof(Context, gprState.fs))));
-    append(prologue, LoadReg(Reg(4), Offset(offsetof(Context, gprState.gs))));
-    prologue.push_back(Rdfsbase(Reg(1)));
-    prologue.push_back(Rdgsbase(Reg(2)));
-    prologue.push_back(Wrfsbase(Reg(3)));
-    prologue.push_back(Wrgsbase(Reg(4)));
-    append(prologue, SaveReg(Reg(1), Offset(offsetof(Context, hostState.fs))));
-    append(prologue, SaveReg(Reg(2), Offset(offsetof(Context, hostState.gs))));
-  }
-#endif // QBDI_ARCH_X86_64
-  // Restore EFLAGS
-  append(prologue, LoadReg(Reg(0), Offset(offsetof(Context, gprState.eflags))));
-  prologue.push_back(Pushr(Reg(0)));
-  prologue.push_back(Popf());
-  // Restore GPR
-  for (unsigned int i = 0; i < NUM_GPR - 1; i++)
-    append(prologue, LoadReg(Reg(i), Offset(Reg(i))));
-  // Jump selector
-  prologue.push_back(JmpM(Offset(offsetof(Context, hostState.selector))));
-
-  return prologue;
 }
 
-RelocatableInst::UniquePtrVec getExecBlockEpilogue(Options opts) {
-  RelocatableInst::UniquePtrVec epilogue;
-
-  // Save GPR
-  for (unsigned int i = 0; i < NUM_GPR - 1; i++)
-    append(epilogue, SaveReg(Reg(i), Offset(Reg(i))));
-  // Restore host SP
-  append(epilogue,
-         LoadReg(Reg(REG_SP), Offset(offsetof(Context, hostState.sp))));
-  // Save EFLAGS
-  epilogue.push_back(Pushf());
-  epilogue.push_back(Popr(Reg(0)));
-  append(epilogue, SaveReg(Reg(0), Offset(offsetof(Context, gprState.eflags))));
-#if defined(QBDI_ARCH_X86_64)
-  // if enable FS GS
-  if ((opts & Options::OPT_ENABLE_FS_GS) == Options::OPT_ENABLE_FS_GS) {
-    QBDI_REQUIRE_ACTION(isHostCPUFeaturePresent("fsgsbase"), abort());
-
-    append(epilogue,
-           LoadReg(Reg(0), Offset(offsetof(Context, hostState.executeFlags))));
-    epilogue.push_back(Test(Reg(0), ExecBlockFlags::needFSGS));
-    epilogue.push_back(Je(5 * 4 + 7 * 4 + 4));
-
-    append(epilogue, LoadReg(Reg(3), Offset(offsetof(Context, hostState.fs))));
-    append(epilogue, LoadReg(Reg(4), Offset(offsetof(Context, hostState.gs))));
-    epilogue.push_back(Rdfsbase(Reg(1)));
-    epilogue.push_back(Rdgsbase(Reg(2)));
-    epilogue.push_back(Wrfsbase(Reg(3)));
-    epilogue.push_back(Wrgsbase(Reg(4)));
-    append(epilogue, SaveReg(Reg(1), Offset(offsetof(Context, gprState.fs))));
-    append(epilogue, SaveReg(Reg(2), Offset(offsetof(Context, gprState.gs))));
-  }
-#endif // QBDI_ARCH_X86_64
-  // Save FPR
-  if ((opts & Options::OPT_DISABLE_FPR) == 0) {
+// Save the guest FPR in the context. Reg(0) is used as a scratch.
+void appendSaveFPR(RelocatableInst::UniquePtrVec &code, Options opts) {
+  if ((opts & Options::OPT_DISABLE_FPR) == 0 and useXSave(opts)) {
+    if ((opts & Options::OPT_DISABLE_OPTIONAL_FPR) == 0) {
+      append(code,
+             LoadReg(Reg(0), Offset(offsetof(Context, hostState.xsaveMask))));
+      // the mask is empty when the sequence doesn't need the FPU
+      code.push_back(Test(Reg(0), XSaveComponent::XSAVE_SSE));
+      code.push_back(Je(2 + 7 + 4));
+    } else {
+      code.push_back(NoReloc::unique(
+          mov32ri(llvm::X86::EAX, getXSaveMask(defaultExecuteFlags))));
+    }
+    code.push_back(NoReloc::unique(xor32rr(llvm::X86::EDX, llvm::X86::EDX)));
+    code.push_back(Xsave(Offset(offsetof(Context, fprState))));
+    // target je empty mask
+  } else if ((opts & Options::OPT_DISABLE_FPR) == 0) {
     if ((opts & Options::OPT_DISABLE_OPTIONAL_FPR) == 0) {
       append(
-          epilogue,
+          code,
           LoadReg(Reg(0), Offset(offsetof(Context, hostState.executeFlags))));
-      epilogue.push_back(Test(Reg(0), ExecBlockFlags::needFPU));
-      epilogue.push_back(Je(7 + 4));
+      code.push_back(Test(Reg(0), ExecBlockFlags::needFPU));
+      code.push_back(Je(7 + 4));
     }
-    epilogue.push_back(Fxsave(Offset(offsetof(Context, fprState))));
+    code.push_back(Fxsave(Offset(offsetof(Context, fprState))));
     // target je needFPU
     if (isHostCPUFeaturePresent("avx")) {
       QBDI_DEBUG("AVX support enabled in guest context switches");
       // don't save if not needed
       if ((opts & Options::OPT_DISABLE_OPTIONAL_FPR) == 0) {
-        epilogue.push_back(Test(Reg(0), ExecBlockFlags::needAVX));
+        code.push_back(Test(Reg(0), ExecBlockFlags::needAVX));
         if constexpr (is_x86_64)
-          epilogue.push_back(Je(16 * 10 + 4));
+          code.push_back(Je(16 * 10 + 4));
         else
-          epilogue.push_back(Je(8 * 10 + 4));
+          code.push_back(Je(8 * 10 + 4));
       }
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm0)),
           llvm::X86::YMM0, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm1)),
           llvm::X86::YMM1, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm2)),
           llvm::X86::YMM2, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm3)),
           llvm::X86::YMM3, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm4)),
           llvm::X86::YMM4, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm5)),
           llvm::X86::YMM5, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm6)),
           llvm::X86::YMM6, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm7)),
           llvm::X86::YMM7, 1));
 #if defined(QBDI_ARCH_X86_64)
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm8)),
           llvm::X86::YMM8, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm9)),
           llvm::X86::YMM9, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm10)),
           llvm::X86::YMM10, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm11)),
           llvm::X86::YMM11, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm12)),
           llvm::X86::YMM12, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm13)),
           llvm::X86::YMM13, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm14)),
           llvm::X86::YMM14, 1));
-      epilogue.push_back(Vextractf128(
+      code.push_back(Vextractf128(
           Offset(offsetof(Context, fprState) + offsetof(FPRState, ymm15)),
           llvm::X86::YMM15, 1));
 #endif // QBDI_ARCH_X86_64
        // target je needAVX
     }
   }
+}
+
+#if defined(QBDI_ARCH_X86_64)
+// Switch FS and GS to the guest values. Reg(0) to Reg(4) are used as scratch.
+void appendGuestFSGS(RelocatableInst::UniquePtrVec &code, Options opts) {
+  if ((opts & Options::OPT_ENABLE_FS_GS) == Options::OPT_ENABLE_FS_GS) {
+    QBDI_REQUIRE_ACTION(isHostCPUFeaturePresent("fsgsbase"), abort());
+
+    append(code,
+           LoadReg(Reg(0), Offset(offsetof(Context, hostState.executeFlags))));
+    code.push_back(Test(Reg(0), ExecBlockFlags::needFSGS));
+    code.push_back(Je(5 * 4 + 7 * 4 + 4));
+
+    append(code, LoadReg(Reg(3), Offset(offsetof(Context, gprState.fs))));
+    append(code, LoadReg(Reg(4), Offset(offsetof(Context, gprState.gs))));
+    code.push_back(Rdfsbase(Reg(1)));
+    code.push_back(Rdgsbase(Reg(2)));
+    code.push_back(Wrfsbase(Reg(3)));
+    code.push_back(Wrgsbase(Reg(4)));
+    append(code, SaveReg(Reg(1), Offset(offsetof(Context, hostState.fs))));
+    append(code, SaveReg(Reg(2), Offset(offsetof(Context, hostState.gs))));
+  }
+}
+
+// Switch FS and GS to the host values. Reg(0) to Reg(4) are used as scratch.
+void appendHostFSGS(RelocatableInst::UniquePtrVec &code, Options opts) {
+  if ((opts & Options::OPT_ENABLE_FS_GS) == Options::OPT_ENABLE_FS_GS) {
+    QBDI_REQUIRE_ACTION(isHostCPUFeaturePresent("fsgsbase"), abort());
+
+    append(code,
+           LoadReg(Reg(0), Offset(offsetof(Context, hostState.executeFlags))));
+    code.push_back(Test(Reg(0), ExecBlockFlags::needFSGS));
+    code.push_back(Je(5 * 4 + 7 * 4 + 4));
+
+    append(code, LoadReg(Reg(3), Offset(offsetof(Context, hostState.fs))));
+    append(code, LoadReg(Reg(4), Offset(offsetof(Context, hostState.gs))));
+    code.push_back(Rdfsbase(Reg(1)));
+    code.push_back(Rdgsbase(Reg(2)));
+    code.push_back(Wrfsbase(Reg(3)));
+    code.push_back(Wrgsbase(Reg(4)));
+    append(code, SaveReg(Reg(1), Offset(offsetof(Context, gprState.fs))));
+    append(code, SaveReg(Reg(2), Offset(offsetof(Context, gprState.gs))));
+  }
+}
+#endif // QBDI_ARCH_X86_64
+
+} // namespace
+
+RelocatableInst::UniquePtrVec getExecBlockPrologue(Options opts) {
+  RelocatableInst::UniquePtrVec prologue;
+
+  // Save host SP
+  append(prologue,
+         SaveReg(Reg(REG_SP), Offset(offsetof(Context, hostState.sp))));
+  // Restore FPR
+  appendRestoreFPR(prologue, opts);
+#if defined(QBDI_ARCH_X86_64)
+  appendGuestFSGS(prologue, opts);
+#endif // QBDI_ARCH_X86_64
+  // The hits of the indirect branch target cache reenter here
+  prologue.push_back(RelocTag::unique(RelocTagReentry));
+  // Restore EFLAGS
+  append(prologue, LoadReg(Reg(0), Offset(offsetof(Context, gprState.eflags))));
+  prologue.push_back(Pushr(Reg(0)));
+  prologue.push_back(Popf());
+  // Restore GPR
+  for (unsigned int i = 0; i < NUM_GPR - 1; i++)
+    append(prologue, LoadReg(Reg(i), Offset(Reg(i))));
+  // Jump selector
+  prologue.push_back(JmpM(Offset(offsetof(Context, hostState.selector))));
+
+  return prologue;
+}
+
+RelocatableInst::UniquePtrVec getExecBlockEpilogue(Options opts) {
+  RelocatableInst::UniquePtrVec epilogue;
+
+  // Save GPR
+  for (unsigned int i = 0; i < NUM_GPR - 1; i++)
+    append(epilogue, SaveReg(Reg(i), Offset(Reg(i))));
+  // Restore host SP
+  append(epilogue,
+         LoadReg(Reg(REG_SP), Offset(offsetof(Context, hostState.sp))));
+  // Save EFLAGS
+  epilogue.push_back(Pushf());
+  epilogue.push_back(Popr(Reg(0)));
+  append(epilogue, SaveReg(Reg(0), Offset(offsetof(Context, gprState.eflags))));
+#if defined(QBDI_ARCH_X86_64)
+  // Probe the indirect branch target cache before the FPR and FS/GS switch to
+  // the host. The probe hits if the sequence exits without callback request
+  // and the cached sequence doesn't need more context than the current one.
+  // A hit selects the cached sequence and reenters the prologue after its FPR
+  // and FS/GS restore, the guest values are still live. A miss keeps the
+  // selector and returns to host.
+  if ((opts & Options::OPT_ENABLE_BLOCK_CHAINING) ==
+      Options::OPT_ENABLE_BLOCK_CHAINING) {
+    // index = ((target >> 4) ^ target) & (IBTC_SIZE - 1), see ibtcIndex
+    append(epilogue, LoadReg(Reg(0), Offset(Reg(REG_PC))));
+    epilogue.push_back(NoReloc::unique(movrr(Reg(2), Reg(0))));
+    epilogue.push_back(NoReloc::unique(shr64ri(Reg(2), 4)));
+    epilogue.push_back(NoReloc::unique(xor64rr(Reg(2), Reg(0))));
+    epilogue.push_back(NoReloc::unique(and64ri8(Reg(2), IBTC_SIZE - 1)));
+    static_assert(sizeof(IBTCEntry) == 3 * sizeof(rword),
+                  "The index is scaled by 3 * sizeof(rword)");
+    epilogue.push_back(NoReloc::unique(lea(Reg(2), Reg(2), 2, Reg(2), 0, 0)));
+    epilogue.push_back(Lea(Reg(3), Offset(offsetof(Context, ibtc))));
+    // Reg(1) is zero on a hit: same target, no callback request and no
+    // executeFlags missing from the current ones
+    epilogue.push_back(NoReloc::unique(
+        movrm(Reg(1), Reg(3), sizeof(rword), Reg(2),
+              offsetof(IBTCEntry, target), 0)));
+    epilogue.push_back(NoReloc::unique(xor64rr(Reg(1), Reg(0))));
+    append(epilogue,
+           LoadReg(Reg(0), Offset(offsetof(Context, hostState.callback))));
+    epilogue.push_back(NoReloc::unique(or64rr(Reg(1), Reg(0))));
+    append(epilogue,
+           LoadReg(Reg(0), Offset(offsetof(Context, hostState.executeFlags))));
+    epilogue.push_back(NoReloc::unique(not64r(Reg(0))));
+    epilogue.push_back(NoReloc::unique(
+        movrm(Reg(4), Reg(3), sizeof(rword), Reg(2),
+              offsetof(IBTCEntry, executeFlags), 0)));
+    epilogue.push_back(NoReloc::unique(and64rr(Reg(0), Reg(4))));
+    epilogue.push_back(NoReloc::unique(or64rr(Reg(1), Reg(0))));
+    // The selector is only changed on a hit, a callback request resumes at
+    // the current one
+    epilogue.push_back(NoReloc::unique(
+        movrm(Reg(0), Reg(3), sizeof(rword), Reg(2),
+              offsetof(IBTCEntry, selector), 0)));
+    append(epilogue,
+           LoadReg(Reg(4), Offset(offsetof(Context, hostState.selector))));
+    epilogue.push_back(NoReloc::unique(test64rr(Reg(1), Reg(1))));
+    epilogue.push_back(NoReloc::unique(cmovne64rr(Reg(0), Reg(4))));
+    append(epilogue,
+           SaveReg(Reg(0), Offset(offsetof(Context, hostState.selector))));
+    // The immediate of je is relative to its rel32, after the 2 bytes opcode
+    epilogue.push_back(ReentryRel::unique(je(0), 0, -2));
+  }
+  appendHostFSGS(epilogue, opts);
+#endif // QBDI_ARCH_X86_64
+  // Save FPR
+  appendSaveFPR(epilogue, opts);
   // return to host
   epilogue.push_back(Ret());
 
   return epilogue;
 }
 
+RelocatableInst::UniquePtrVec getExecBlockInlineCall(Options opts) {
+  RelocatableInst::UniquePtrVec inlineCall;
+
+  // Save GPR
+  for (unsigned int i = 0; i < NUM_GPR - 1; i++)
+    append(inlineCall, SaveReg(Reg(i), Offset(Reg(i))));
+  // Switch to the host stack, the guest stack (and its red zone) is untouched
+  append(inlineCall,
+         LoadReg(Reg(REG_SP), Offset(offsetof(Context, hostState.sp))));
+  // Save EFLAGS
+  inlineCall.push_back(Pushf());
+  inlineCall.push_back(Popr(Reg(0)));
+  append(inlineCall,
+         SaveReg(Reg(0), Offset(offsetof(Context, gprState.eflags))));
+#if defined(QBDI_ARCH_X86_64)
+  appendHostFSGS(inlineCall, opts);
+#endif // QBDI_ARCH_X86_64
+  // Save FPR, the callee may use any of them
+  appendSaveFPR(inlineCall, opts);
+  if ((opts & Options::OPT_DISABLE_FPR) == 0) {
+    inlineCall.push_back(Fninit());
+  }
+  inlineCall.push_back(Cld());
+  inlineCall.push_back(NoReloc::unique(andri8(Reg(REG_SP), -16)));
+  // Call the callback
+#if defined(QBDI_ARCH_X86_64)
+#if defined(QBDI_PLATFORM_WINDOWS)
+  const Reg argReg[] = {Reg(2), Reg(3), Reg(6), Reg(7)};
+#else
+  const Reg argReg[] = {Reg(5), Reg(4), Reg(3), Reg(2)};
+#endif
+  append(inlineCall,
+         LoadReg(argReg[0], Offset(offsetof(Context, hostState.vm))));
+  inlineCall.push_back(Lea(argReg[1], Offset(offsetof(Context, gprState))));
+  inlineCall.push_back(Lea(argReg[2], Offset(offsetof(Context, fprState))));
+  append(inlineCall,
+         LoadReg(argReg[3], Offset(offsetof(Context, hostState.data))));
+#if defined(QBDI_PLATFORM_WINDOWS)
+  // shadow space of the callee
+  inlineCall.push_back(Add(Reg(REG_SP), Constant(-32)));
+#endif
+#else
+  // the stack stays aligned on 16 bytes with the four arguments
+  append(inlineCall,
+         LoadReg(Reg(0), Offset(offsetof(Context, hostState.data))));
+  inlineCall.push_back(Pushr(Reg(0)));
+  inlineCall.push_back(Lea(Reg(0), Offset(offsetof(Context, fprState))));
+  inlineCall.push_back(Pushr(Reg(0)));
+  inlineCall.push_back(Lea(Reg(0), Offset(offsetof(Context, gprState))));
+  inlineCall.push_back(Pushr(Reg(0)));
+  append(inlineCall, LoadReg(Reg(0), Offset(offsetof(Context, hostState.vm))));
+  inlineCall.push_back(Pushr(Reg(0)));
+#endif // QBDI_ARCH_X86_64
+  inlineCall.push_back(CallM(Offset(offsetof(Context, hostState.callback))));
+  // The callback request is consumed
+  inlineCall.push_back(Mov(Reg(0), Constant(0)));
+  append(inlineCall,
+         SaveReg(Reg(0), Offset(offsetof(Context, hostState.callback))));
+  // XSAVE may have flagged a component in its initial state, XRSTOR would
+  // then ignore a change made by the callback on this component.
+  if ((opts & Options::OPT_DISABLE_FPR) == 0 and useXSave(opts)) {
+    inlineCall.push_back(
+        Mov(Reg(0), Constant(getXSaveMask(defaultExecuteFlags))));
+    append(inlineCall,
+           SaveReg(Reg(0), Offset(offsetof(Context, fprState) +
+                                  offsetof(FPRState, xstate_bv))));
+  }
+  // Restore FPR
+  appendRestoreFPR(inlineCall, opts);
+#if defined(QBDI_ARCH_X86_64)
+  appendGuestFSGS(inlineCall, opts);
+#endif // QBDI_ARCH_X86_64
+  // Restore EFLAGS
+  append(inlineCall,
+         LoadReg(Reg(0), Offset(offsetof(Context, gprState.eflags))));
+  inlineCall.push_back(Pushr(Reg(0)));
+  inlineCall.push_back(Popf());
+  // Restore GPR, the guest stack is restored last
+  for (unsigned int i = 0; i < NUM_GPR - 1; i++)
+    append(inlineCall, LoadReg(Reg(i), Offset(Reg(i))));
+  // Resume after the call site
+  inlineCall.push_back(JmpM(Offset(offsetof(Context, hostState.selector))));
+
+  return inlineCall;
+}
+
 std::vector<PatchRule> getDefaultPatchRules(Options opts) {
   std::vector<PatchRule> rules;
 
@@ -508,4 +713,73 @@ RelocatableInst::UniquePtrVec getTerminator(rword address) {
   return terminator;
 }
 
+RelocatableInst::UniquePtrVec getTraceGuard(rword shadowOffset) {
+  RelocatableInst::UniquePtrVec guard;
+
+#if defined(QBDI_ARCH_X86_64)
+  // RCX := PC - successor, with instructions that don't change the flags
+  append(guard, SaveReg(Reg(2), Offset(Reg(2))));
+  append(guard, SaveReg(Reg(3), Offset(Reg(3))));
+  append(guard, LoadReg(Reg(2), Offset(Reg(REG_PC))));
+  append(guard, LoadReg(Reg(3), Offset(shadowOffset)));
+  guard.push_back(NoReloc::unique(lea(Reg(2), Reg(2), 1, Reg(3), 0, 0)));
+  append(guard, LoadReg(Reg(3), Offset(Reg(3))));
+  // Skip the side exit (mov rcx, [rip + x] and jmp epilogue) if RCX is 0
+  guard.push_back(NoReloc::unique(jrcxz(7 + 5 + 1)));
+  append(guard, LoadReg(Reg(2), Offset(Reg(2))));
+  guard.push_back(EpilogueRel::unique(jmp(0), 0, -1));
+  append(guard, LoadReg(Reg(2), Offset(Reg(2))));
+#endif // QBDI_ARCH_X86_64
+
+  return guard;
+}
+
+bool getDirectSuccessor(const InstMetadata &metadata, rword &target) {
+  switch (metadata.inst.getOpcode()) {
+    // The 16 bits variants truncate the new PC and are left to the VM.
+    case llvm::X86::JMP_1:
+    case llvm::X86::JMP_4:
+    case llvm::X86::CALL64pcrel32:
+    case llvm::X86::CALLpcrel32:
+      target = metadata.endAddress() + metadata.inst.getOperand(0).getImm();
+      return true;
+    default:
+      return false;
+  }
+}
+
+void getStaticSuccessors(const InstMetadata &metadata,
+                         std::vector<rword> &successors) {
+  if (not metadata.modifyPC) {
+    successors.push_back(metadata.endAddress());
+    return;
+  }
+  switch (metadata.inst.getOpcode()) {
+    case llvm::X86::JMP_1:
+    case llvm::X86::JMP_4:
+      successors.push_back(metadata.endAddress() +
+                           metadata.inst.getOperand(0).getImm());
+      break;
+    // The next instruction is reached if the condition is false, or when the
+    // callee returns
+    case llvm::X86::JCC_1:
+    case llvm::X86::JCC_4:
+    case llvm::X86::CALL64pcrel32:
+    case llvm::X86::CALLpcrel32:
+      successors.push_back(metadata.endAddress() +
+                           metadata.inst.getOperand(0).getImm());
+      successors.push_back(metadata.endAddress());
+      break;
+    // The target of an indirect call is unknown, only its return is followed
+    case llvm::X86::CALL32r:
+    case llvm::X86::CALL32m:
+    case llvm::X86::CALL64r:
+    case llvm::X86::CALL64m:
+      successors.push_back(metadata.endAddress());
+      break;
+    default:
+      break;
+  }
+}
+
 } // namespace QBDI
@@ -39,7 +39,13 @@ llvm::MCInst RelocTag::reloc(ExecBlock *exec_block) const {
 // ==========
 
 llvm::MCInst LoadShadow::reloc(ExecBlock *exec_block) const {
-  uint16_t id = exec_block->getLastShadow(tag);
+  uint16_t id;
+  if (create) {
+    id = exec_block->newShadow(tag);
+    exec_block->setShadow(id, 0);
+  } else {
+    id = exec_block->getLastShadow(tag);
+  }
   unsigned int shadowOffset = exec_block->getShadowOffset(id);
 
   if constexpr (is_x86_64) {
@@ -130,6 +136,24 @@ llvm::MCInst EpilogueRel::reloc(ExecBlock *exec_block) const {
   return res;
 }
 
+// ReentryRel
+// ==========
+
+llvm::MCInst ReentryRel::reloc(ExecBlock *exec_block) const {
+  llvm::MCInst res = inst;
+  res.getOperand(opn).setImm(offset + exec_block->getReentryOffset());
+  return res;
+}
+
+// InlineCallRel
+// =============
+
+llvm::MCInst InlineCallRel::reloc(ExecBlock *exec_block) const {
+  llvm::MCInst res = inst;
+  res.getOperand(opn).setImm(offset + exec_block->getInlineCallOffset());
+  return res;
+}
+
 // HostPCRel
 // =========
 
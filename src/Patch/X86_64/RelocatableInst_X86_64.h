@@ -46,6 +46,34 @@ public:
   llvm::MCInst reloc(ExecBlock *exec_block) const override;
 };
 
+class ReentryRel : public AutoClone<RelocatableInst, ReentryRel> {
+  llvm::MCInst inst;
+  unsigned int opn;
+  rword offset;
+
+public:
+  ReentryRel(llvm::MCInst &&inst, unsigned int opn, rword offset)
+      : AutoClone<RelocatableInst, ReentryRel>(),
+        inst(std::forward<llvm::MCInst>(inst)), opn(opn), offset(offset) {}
+
+  // Set an operand to reentryOffset + offset
+  llvm::MCInst reloc(ExecBlock *exec_block) const override;
+};
+
+class InlineCallRel : public AutoClone<RelocatableInst, InlineCallRel> {
+  llvm::MCInst inst;
+  unsigned int opn;
+  rword offset;
+
+public:
+  InlineCallRel(llvm::MCInst &&inst, unsigned int opn, rword offset)
+      : AutoClone<RelocatableInst, InlineCallRel>(),
+        inst(std::forward<llvm::MCInst>(inst)), opn(opn), offset(offset) {}
+
+  // Set an operand to inlineCallOffset + offset
+  llvm::MCInst reloc(ExecBlock *exec_block) const override;
+};
+
 class HostPCRel : public AutoClone<RelocatableInst, HostPCRel> {
   llvm::MCInst inst;
   unsigned int opn;
@@ -0,0 +1,206 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ADDRESSMAP_H
+#define ADDRESSMAP_H
+
+#include <iterator>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+#include "QBDI/State.h"
+
+namespace QBDI {
+
+/*! Hash map indexed by an address, stored in a flat table with open addressing
+ * and linear probing. A lookup usually touches a single cache line and an
+ * insertion only allocates when the table grows.
+ *
+ * The entries cannot be erased one by one, the whole map must be cleared. Any
+ * insertion may invalidate the pointers and references to the values.
+ */
+template <typename T>
+class AddressMap {
+public:
+  using value_type = std::pair<rword, T>;
+  using storage_iterator = typename std::vector<value_type>::const_iterator;
+
+  class const_iterator {
+    friend class AddressMap;
+
+    storage_iterator it;
+    storage_iterator end;
+
+    const_iterator(storage_iterator it, storage_iterator end)
+        : it(it), end(end) {
+      skipEmpty();
+    }
+
+    void skipEmpty() {
+      while (it != end and it->first == EMPTY) {
+        ++it;
+      }
+    }
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = AddressMap::value_type;
+    using difference_type = ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+    reference operator*() const { return *it; }
+    pointer operator->() const { return &*it; }
+
+    const_iterator &operator++() {
+      ++it;
+      skipEmpty();
+      return *this;
+    }
+
+    bool operator==(const const_iterator &o) const { return it == o.it; }
+    bool operator!=(const const_iterator &o) const { return it != o.it; }
+  };
+
+private:
+  // No instruction can start at the last address of the address space
+  static constexpr rword EMPTY = static_cast<rword>(-1);
+  static constexpr size_t MIN_CAPACITY = 16;
+
+  std::vector<value_type> table;
+  size_t entries;
+
+  static size_t hash(rword address) {
+    // Fibonacci hashing, the high bits of the product are folded into the low
+    // bits used as index.
+    if constexpr (sizeof(rword) == 8) {
+      rword h = address * static_cast<rword>(0x9E3779B97F4A7C15ull);
+      return static_cast<size_t>(h ^ (h >> 32));
+    } else {
+      rword h = address * static_cast<rword>(0x9E3779B9u);
+      return static_cast<size_t>(h ^ (h >> 16));
+    }
+  }
+
+  size_t slot(rword address) const {
+    size_t mask = table.size() - 1;
+    size_t i = hash(address) & mask;
+    while (table[i].first != address and table[i].first != EMPTY) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<value_type> old(capacity, value_type{EMPTY, T{}});
+    table.swap(old);
+    for (value_type &v : old) {
+      if (v.first != EMPTY) {
+        table[slot(v.first)] = std::move(v);
+      }
+    }
+  }
+
+public:
+  AddressMap() : entries(0) {}
+
+  AddressMap(AddressMap &&) = default;
+  AddressMap &operator=(AddressMap &&) = default;
+
+  /*! Find the value associated with an address.
+   *
+   * @param[in] address  The address to search.
+   *
+   * @return A pointer to the value, or nullptr if the address isn't in the map.
+   */
+  const T *find(rword address) const {
+    if (entries == 0) {
+      return nullptr;
+    }
+    const value_type &v = table[slot(address)];
+    return (v.first == address) ? &v.second : nullptr;
+  }
+
+  T *find(rword address) {
+    return const_cast<T *>(
+        static_cast<const AddressMap<T> *>(this)->find(address));
+  }
+
+  size_t count(rword address) const { return (find(address) != nullptr); }
+
+  /*! Get the value associated with an address, inserting a default value if
+   * the address isn't in the map.
+   *
+   * @param[in] address  The address of the value, must not be (rword) -1.
+   *
+   * @return A reference to the value.
+   */
+  T &operator[](rword address) {
+    // keep the load factor under 3/4
+    if ((entries + 1) * 4 > table.size() * 3) {
+      rehash(table.empty() ? MIN_CAPACITY : table.size() * 2);
+    }
+    value_type &v = table[slot(address)];
+    if (v.first != address) {
+      v.first = address;
+      entries++;
+    }
+    return v.second;
+  }
+
+  /*! Reserve the space for a number of entries without further growth.
+   *
+   * @param[in] n  The number of entries.
+   */
+  void reserve(size_t n) {
+    size_t capacity = table.empty() ? MIN_CAPACITY : table.size();
+    while (n * 4 > capacity * 3) {
+      capacity *= 2;
+    }
+    if (capacity != table.size()) {
+      rehash(capacity);
+    }
+  }
+
+  size_t size() const { return entries; }
+
+  /*! Get the memory used by the table of the map.
+   *
+   * @return The size of the table in bytes.
+   */
+  size_t memoryUsage() const { return table.capacity() * sizeof(value_type); }
+
+  bool empty() const { return entries == 0; }
+
+  void clear() {
+    table.clear();
+    entries = 0;
+  }
+
+  const_iterator begin() const {
+    return const_iterator(table.cbegin(), table.cend());
+  }
+
+  const_iterator end() const {
+    return const_iterator(table.cend(), table.cend());
+  }
+};
+
+} // namespace QBDI
+
+#endif // ADDRESSMAP_H
@@ -0,0 +1,236 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INTERVALINDEX_H
+#define INTERVALINDEX_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "QBDI/Range.h"
+#include "QBDI/State.h"
+
+namespace QBDI {
+
+/*! Index of possibly overlapping ranges, each one identified by a unique ID.
+ *
+ * The ranges are stored in a treap ordered by start address, where each node
+ * keeps the highest end address of its subtree. Insertion and deletion take
+ * O(log n) and a query takes O(log n + m) for m overlapping ranges, without
+ * heap allocation. The nodes live in a single pool reused after deletion.
+ */
+template <typename T>
+class IntervalIndex {
+private:
+  static constexpr uint32_t NIL = 0xFFFFFFFF;
+
+  struct Node {
+    Range<rword> range;
+    rword maxEnd;
+    uint32_t id;
+    uint32_t priority;
+    uint32_t left;
+    uint32_t right;
+    T value;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> freeNodes;
+  std::unordered_map<uint32_t, uint32_t> idToNode;
+  uint32_t root;
+  uint32_t seed;
+
+  uint32_t nextPriority() {
+    // xorshift32
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  }
+
+  // Order the nodes by (start, id)
+  bool isBefore(uint32_t n, rword start, uint32_t id) const {
+    return nodes[n].range.start() < start or
+           (nodes[n].range.start() == start and nodes[n].id < id);
+  }
+
+  void update(uint32_t n) {
+    Node &node = nodes[n];
+    node.maxEnd = node.range.end();
+    if (node.left != NIL and nodes[node.left].maxEnd > node.maxEnd) {
+      node.maxEnd = nodes[node.left].maxEnd;
+    }
+    if (node.right != NIL and nodes[node.right].maxEnd > node.maxEnd) {
+      node.maxEnd = nodes[node.right].maxEnd;
+    }
+  }
+
+  // Split the subtree t in the nodes before (start, id) and the others
+  std::pair<uint32_t, uint32_t> split(uint32_t t, rword start, uint32_t id) {
+    if (t == NIL) {
+      return {NIL, NIL};
+    }
+    if (isBefore(t, start, id)) {
+      std::pair<uint32_t, uint32_t> r = split(nodes[t].right, start, id);
+      nodes[t].right = r.first;
+      update(t);
+      return {t, r.second};
+    } else {
+      std::pair<uint32_t, uint32_t> r = split(nodes[t].left, start, id);
+      nodes[t].left = r.second;
+      update(t);
+      return {r.first, t};
+    }
+  }
+
+  // Merge two subtrees, all the nodes of l must be before the nodes of r
+  uint32_t merge(uint32_t l, uint32_t r) {
+    if (l == NIL) {
+      return r;
+    }
+    if (r == NIL) {
+      return l;
+    }
+    if (nodes[l].priority > nodes[r].priority) {
+      nodes[l].right = merge(nodes[l].right, r);
+      update(l);
+      return l;
+    } else {
+      nodes[r].left = merge(l, nodes[r].left);
+      update(r);
+      return r;
+    }
+  }
+
+  // Remove the node n from the subtree t
+  uint32_t remove(uint32_t t, uint32_t n) {
+    if (t == n) {
+      return merge(nodes[n].left, nodes[n].right);
+    }
+    if (isBefore(t, nodes[n].range.start(), nodes[n].id)) {
+      nodes[t].right = remove(nodes[t].right, n);
+    } else {
+      nodes[t].left = remove(nodes[t].left, n);
+    }
+    update(t);
+    return t;
+  }
+
+  template <typename F>
+  void query(uint32_t t, const Range<rword> &r, F &f) const {
+    while (t != NIL and nodes[t].maxEnd > r.start()) {
+      const Node &node = nodes[t];
+      query(node.left, r, f);
+      // the nodes on the right start after this one
+      if (node.range.start() >= r.end()) {
+        return;
+      }
+      if (node.range.overlaps(r)) {
+        f(node.value);
+      }
+      t = node.right;
+    }
+  }
+
+public:
+  IntervalIndex() : root(NIL), seed(0x9E3779B9) {}
+
+  /*! Add a range to the index.
+   *
+   * @param[in] id     The unique ID of the range.
+   * @param[in] range  The range to index.
+   * @param[in] value  The value associated with the range.
+   */
+  void insert(uint32_t id, const Range<rword> &range, T value) {
+    uint32_t n;
+    if (freeNodes.empty()) {
+      n = static_cast<uint32_t>(nodes.size());
+      nodes.push_back(
+          Node{range, range.end(), id, 0, NIL, NIL, std::move(value)});
+    } else {
+      n = freeNodes.back();
+      freeNodes.pop_back();
+      nodes[n] = Node{range, range.end(), id, 0, NIL, NIL, std::move(value)};
+    }
+    nodes[n].priority = nextPriority();
+    idToNode[id] = n;
+
+    std::pair<uint32_t, uint32_t> r = split(root, range.start(), id);
+    root = merge(merge(r.first, n), r.second);
+  }
+
+  /*! Remove a range from the index.
+   *
+   * @param[in] id  The ID of the range.
+   *
+   * @return True if the range was found and removed.
+   */
+  bool erase(uint32_t id) {
+    auto it = idToNode.find(id);
+    if (it == idToNode.end()) {
+      return false;
+    }
+    uint32_t n = it->second;
+    idToNode.erase(it);
+
+    root = remove(root, n);
+    freeNodes.push_back(n);
+    return true;
+  }
+
+  /*! Get the value of a range.
+   *
+   * @param[in] id  The ID of the range.
+   *
+   * @return A pointer to the value, or nullptr if the ID isn't in the index.
+   */
+  T *find(uint32_t id) {
+    auto it = idToNode.find(id);
+    if (it == idToNode.end()) {
+      return nullptr;
+    }
+    return &nodes[it->second].value;
+  }
+
+  /*! Call a function on the value of each range overlapping a range, in the
+   * order of their start address. The function must not modify the index.
+   *
+   * @param[in] r  The range to search.
+   * @param[in] f  The function to call with a const reference to each value.
+   */
+  template <typename F>
+  void forEachOverlap(const Range<rword> &r, F &&f) const {
+    query(root, r, f);
+  }
+
+  size_t size() const { return idToNode.size(); }
+
+  bool empty() const { return idToNode.empty(); }
+
+  void clear() {
+    nodes.clear();
+    freeNodes.clear();
+    idToNode.clear();
+    root = NIL;
+  }
+};
+
+} // namespace QBDI
+
+#endif // INTERVALINDEX_H
@@ -25,6 +25,9 @@
 
 #include "llvm/Support/Memory.h"
 
+#include "QBDI/Range.h"
+#include "QBDI/State.h"
+
 namespace QBDI {
 bool isRWXSupported();
 llvm::sys::MemoryBlock
@@ -32,6 +35,60 @@ allocateMappedMemory(size_t NumBytes,
                      const llvm::sys::MemoryBlock *const NearBlock,
                      unsigned PFlags, std::error_code &EC);
 void releaseMappedMemory(llvm::sys::MemoryBlock &block);
+
+/*! Allocate a memory block whose first bytes are mapped a second time at
+ * another address. The first codeBytes of the block are read-execute and the
+ * others are read-write. The writeBlock view of the code is read-write.
+ *
+ * @param[in]  numBytes    Size of the block, a multiple of the page size.
+ * @param[in]  codeBytes   Size of the code part, a multiple of the page size.
+ * @param[out] writeBlock  The read-write view of the code part.
+ * @param[out] ec          The error, if the allocation failed.
+ *
+ * @return The block, or an empty block if the dual mapping isn't supported or
+ * failed.
+ */
+llvm::sys::MemoryBlock
+allocateDualMappedMemory(size_t numBytes, size_t codeBytes,
+                         llvm::sys::MemoryBlock &writeBlock,
+                         std::error_code &ec);
+void releaseDualMappedMemory(llvm::sys::MemoryBlock &block,
+                             llvm::sys::MemoryBlock &writeBlock);
+
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/*! Allocate a read-write memory block aligned on HUGE_PAGE_SIZE. Its whole
+ * huge pages are backed by huge pages when the system allows it. The block is
+ * released with releaseMappedMemory.
+ *
+ * @param[in]  numBytes  Size of the block, a multiple of the page size.
+ * @param[out] ec        The error, if the allocation failed.
+ *
+ * @return The block, or an empty block if the allocation failed.
+ */
+llvm::sys::MemoryBlock allocateHugeMappedMemory(size_t numBytes,
+                                                std::error_code &ec);
+/*! Identify the module loaded at an address by its build-id.
+ *
+ * @param[in]  address  An address in the module.
+ * @param[out] range    The range of the executable segments of the module.
+ * @param[out] bias     The load bias of the module.
+ *
+ * @return The build-id in hexadecimal, or an empty string if no module with a
+ * build-id is loaded at this address.
+ */
+std::string getModuleBuildID(rword address, Range<rword> &range, rword &bias);
+
+/*! Get the entry points of the module loaded at an address: the functions
+ * defined in its dynamic symbol table, and the entry point of its ELF header.
+ *
+ * @param[in]  address  An address in the module.
+ * @param[out] entries  The addresses of the entry points are appended.
+ *
+ * @return False if no ELF module is loaded at this address.
+ */
+bool getModuleEntryPoints(rword address, std::vector<rword> &entries);
+
 const std::string getHostCPUName();
 const std::vector<std::string> getHostCPUFeatures();
 bool isHostCPUFeaturePresent(const char *f);
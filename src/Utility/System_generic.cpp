@@ -16,8 +16,11 @@
  * limitations under the License.
  */
 #include <algorithm>
+#include <errno.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <system_error>
 
@@ -32,6 +35,24 @@
 #include "Utility/LogSys.h"
 #include "Utility/System.h"
 
+#if defined(QBDI_PLATFORM_LINUX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(QBDI_PLATFORM_LINUX) || defined(QBDI_PLATFORM_ANDROID)
+#include <elf.h>
+#include <link.h>
+// bionic only defines ElfW
+#if not defined(ELFW)
+#if defined(__LP64__)
+#define ELFW(type) ELF64_##type
+#else
+#define ELFW(type) ELF32_##type
+#endif
+#endif
+#endif
+
 namespace QBDI {
 
 bool isRWXSupported() { return false; }
@@ -49,6 +70,307 @@ void releaseMappedMemory(llvm::sys::MemoryBlock &block) {
   llvm::sys::Memory::releaseMappedMemory(block);
 }
 
+#if defined(QBDI_PLATFORM_LINUX)
+
+llvm::sys::MemoryBlock
+allocateDualMappedMemory(size_t numBytes, size_t codeBytes,
+                         llvm::sys::MemoryBlock &writeBlock,
+                         std::error_code &ec) {
+  QBDI_REQUIRE_ACTION(codeBytes <= numBytes, abort());
+
+  int fd = memfd_create("qbdi-code", MFD_CLOEXEC);
+  if (fd < 0) {
+    ec = std::error_code(errno, std::generic_category());
+    return llvm::sys::MemoryBlock();
+  }
+  if (ftruncate(fd, codeBytes) != 0) {
+    ec = std::error_code(errno, std::generic_category());
+    close(fd);
+    return llvm::sys::MemoryBlock();
+  }
+
+  // Reserve the whole block, then replace the code part by the RX view of the
+  // file.
+  void *base = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    ec = std::error_code(errno, std::generic_category());
+    close(fd);
+    return llvm::sys::MemoryBlock();
+  }
+  void *rx = mmap(base, codeBytes, PROT_READ | PROT_EXEC,
+                  MAP_SHARED | MAP_FIXED, fd, 0);
+  void *rw = MAP_FAILED;
+  if (rx != MAP_FAILED) {
+    rw = mmap(nullptr, codeBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (rx == MAP_FAILED or rw == MAP_FAILED) {
+    ec = std::error_code(errno, std::generic_category());
+    munmap(base, numBytes);
+    close(fd);
+    return llvm::sys::MemoryBlock();
+  }
+  // the mappings keep the file alive
+  close(fd);
+
+  writeBlock = llvm::sys::MemoryBlock(rw, codeBytes);
+  return llvm::sys::MemoryBlock(base, numBytes);
+}
+
+void releaseDualMappedMemory(llvm::sys::MemoryBlock &block,
+                             llvm::sys::MemoryBlock &writeBlock) {
+  munmap(writeBlock.base(), writeBlock.allocatedSize());
+  munmap(block.base(), block.allocatedSize());
+  writeBlock = llvm::sys::MemoryBlock();
+  block = llvm::sys::MemoryBlock();
+}
+
+llvm::sys::MemoryBlock allocateHugeMappedMemory(size_t numBytes,
+                                                std::error_code &ec) {
+  // The transparent huge pages are only used for an aligned range. Map one
+  // more huge page and unmap the unaligned head and tail.
+  size_t mapSize = numBytes + HUGE_PAGE_SIZE;
+  void *base = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    ec = std::error_code(errno, std::generic_category());
+    return llvm::sys::MemoryBlock();
+  }
+  uintptr_t start = reinterpret_cast<uintptr_t>(base);
+  uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  if (aligned != start) {
+    munmap(base, aligned - start);
+  }
+  if (aligned + numBytes != start + mapSize) {
+    munmap(reinterpret_cast<void *>(aligned + numBytes),
+           start + mapSize - aligned - numBytes);
+  }
+
+#if defined(MADV_HUGEPAGE)
+  // Only an hint, the block stays usable if the huge pages are disabled
+  if (madvise(reinterpret_cast<void *>(aligned), numBytes, MADV_HUGEPAGE) !=
+      0) {
+    QBDI_DEBUG("madvise(MADV_HUGEPAGE) failed: {}", strerror(errno));
+  }
+#endif
+
+  return llvm::sys::MemoryBlock(reinterpret_cast<void *>(aligned), numBytes);
+}
+
+#else // QBDI_PLATFORM_LINUX
+
+llvm::sys::MemoryBlock
+allocateDualMappedMemory(size_t numBytes, size_t codeBytes,
+                         llvm::sys::MemoryBlock &writeBlock,
+                         std::error_code &ec) {
+  ec = std::make_error_code(std::errc::not_supported);
+  return llvm::sys::MemoryBlock();
+}
+
+void releaseDualMappedMemory(llvm::sys::MemoryBlock &block,
+                             llvm::sys::MemoryBlock &writeBlock) {}
+
+llvm::sys::MemoryBlock allocateHugeMappedMemory(size_t numBytes,
+                                                std::error_code &ec) {
+  return allocateMappedMemory(
+      numBytes, nullptr,
+      llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, ec);
+}
+
+#endif // QBDI_PLATFORM_LINUX
+
+#if defined(QBDI_PLATFORM_LINUX) || defined(QBDI_PLATFORM_ANDROID)
+
+namespace {
+
+struct ModuleSearch {
+  rword address;
+  Range<rword> range;
+  rword bias;
+  std::string buildID;
+};
+
+std::string readBuildID(const struct dl_phdr_info *info) {
+  for (unsigned i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+    if (phdr.p_type != PT_NOTE) {
+      continue;
+    }
+    const uint8_t *note =
+        reinterpret_cast<const uint8_t *>(info->dlpi_addr + phdr.p_vaddr);
+    const uint8_t *end = note + phdr.p_memsz;
+    while (note + sizeof(ElfW(Nhdr)) <= end) {
+      const ElfW(Nhdr) *nhdr = reinterpret_cast<const ElfW(Nhdr) *>(note);
+      const uint8_t *name = note + sizeof(ElfW(Nhdr));
+      const uint8_t *desc = name + ((nhdr->n_namesz + 3) & ~3);
+      if (nhdr->n_type == NT_GNU_BUILD_ID and nhdr->n_namesz == 4 and
+          memcmp(name, "GNU", 4) == 0 and desc + nhdr->n_descsz <= end) {
+        static const char hex[] = "0123456789abcdef";
+        std::string buildID;
+        for (unsigned j = 0; j < nhdr->n_descsz; j++) {
+          buildID.push_back(hex[desc[j] >> 4]);
+          buildID.push_back(hex[desc[j] & 0xf]);
+        }
+        return buildID;
+      }
+      note = desc + ((nhdr->n_descsz + 3) & ~3);
+    }
+  }
+  return "";
+}
+
+int searchModule(struct dl_phdr_info *info, size_t size, void *data) {
+  ModuleSearch *search = static_cast<ModuleSearch *>(data);
+  rword start = (rword)-1;
+  rword end = 0;
+  bool found = false;
+  for (unsigned i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+    if (phdr.p_type != PT_LOAD or (phdr.p_flags & PF_X) == 0) {
+      continue;
+    }
+    rword segStart = info->dlpi_addr + phdr.p_vaddr;
+    rword segEnd = segStart + phdr.p_memsz;
+    start = std::min(start, segStart);
+    end = std::max(end, segEnd);
+    if (segStart <= search->address and search->address < segEnd) {
+      found = true;
+    }
+  }
+  if (not found) {
+    return 0;
+  }
+  search->range = Range<rword>(start, end);
+  search->bias = info->dlpi_addr;
+  search->buildID = readBuildID(info);
+  return 1;
+}
+
+} // anonymous namespace
+
+std::string getModuleBuildID(rword address, Range<rword> &range, rword &bias) {
+  ModuleSearch search{address, Range<rword>(0, 0), 0, ""};
+  dl_iterate_phdr(searchModule, &search);
+  range = search.range;
+  bias = search.bias;
+  return search.buildID;
+}
+
+namespace {
+
+struct EntryPointSearch {
+  rword address;
+  std::vector<rword> *entries;
+  bool found;
+};
+
+// Number of symbols of a DT_GNU_HASH table: the last chain of the buckets
+// ends the symbol table.
+size_t countGnuHashSymbols(const uint32_t *table) {
+  uint32_t nbuckets = table[0];
+  uint32_t symoffset = table[1];
+  uint32_t bloomSize = table[2];
+  const uint32_t *buckets = reinterpret_cast<const uint32_t *>(
+      reinterpret_cast<const ElfW(Addr) *>(table + 4) + bloomSize);
+  const uint32_t *chains = buckets + nbuckets;
+  uint32_t last = 0;
+  for (uint32_t i = 0; i < nbuckets; i++) {
+    last = std::max(last, buckets[i]);
+  }
+  if (last < symoffset) {
+    return symoffset;
+  }
+  while ((chains[last - symoffset] & 1) == 0) {
+    last++;
+  }
+  return last + 1;
+}
+
+int searchEntryPoints(struct dl_phdr_info *info, size_t size, void *data) {
+  EntryPointSearch *search = static_cast<EntryPointSearch *>(data);
+  const ElfW(Dyn) *dynamic = nullptr;
+  const ElfW(Ehdr) *header = nullptr;
+  bool found = false;
+  for (unsigned i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+    rword segStart = info->dlpi_addr + phdr.p_vaddr;
+    if (phdr.p_type == PT_DYNAMIC) {
+      dynamic = reinterpret_cast<const ElfW(Dyn) *>(segStart);
+    } else if (phdr.p_type == PT_LOAD) {
+      if (phdr.p_offset == 0) {
+        header = reinterpret_cast<const ElfW(Ehdr) *>(segStart);
+      }
+      if (segStart <= search->address and
+          search->address < segStart + phdr.p_memsz) {
+        found = true;
+      }
+    }
+  }
+  if (not found) {
+    return 0;
+  }
+  search->found = true;
+  if (header != nullptr and header->e_entry != 0) {
+    rword entry = header->e_entry;
+    if (header->e_type == ET_DYN) {
+      entry += info->dlpi_addr;
+    }
+    search->entries->push_back(entry);
+  }
+  if (dynamic == nullptr) {
+    return 1;
+  }
+
+  // The pointers of the dynamic section may not be relocated
+  auto relocate = [info](ElfW(Addr) ptr) -> rword {
+    return ptr < info->dlpi_addr ? info->dlpi_addr + ptr : ptr;
+  };
+  const ElfW(Sym) *symtab = nullptr;
+  size_t nsyms = 0;
+  for (const ElfW(Dyn) *dyn = dynamic; dyn->d_tag != DT_NULL; dyn++) {
+    if (dyn->d_tag == DT_SYMTAB) {
+      symtab = reinterpret_cast<const ElfW(Sym) *>(relocate(dyn->d_un.d_ptr));
+    } else if (dyn->d_tag == DT_HASH) {
+      // the number of chains is the number of symbols
+      nsyms = reinterpret_cast<const uint32_t *>(relocate(dyn->d_un.d_ptr))[1];
+    } else if (dyn->d_tag == DT_GNU_HASH and nsyms == 0) {
+      nsyms = countGnuHashSymbols(
+          reinterpret_cast<const uint32_t *>(relocate(dyn->d_un.d_ptr)));
+    }
+  }
+  if (symtab == nullptr) {
+    return 1;
+  }
+  for (size_t i = 0; i < nsyms; i++) {
+    const ElfW(Sym) &sym = symtab[i];
+    if (ELFW(ST_TYPE)(sym.st_info) == STT_FUNC and sym.st_shndx != SHN_UNDEF and
+        sym.st_value != 0) {
+      search->entries->push_back(info->dlpi_addr + sym.st_value);
+    }
+  }
+  return 1;
+}
+
+} // anonymous namespace
+
+bool getModuleEntryPoints(rword address, std::vector<rword> &entries) {
+  EntryPointSearch search{address, &entries, false};
+  dl_iterate_phdr(searchEntryPoints, &search);
+  return search.found;
+}
+
+#else // QBDI_PLATFORM_LINUX || QBDI_PLATFORM_ANDROID
+
+std::string getModuleBuildID(rword address, Range<rword> &range, rword &bias) {
+  return "";
+}
+
+bool getModuleEntryPoints(rword address, std::vector<rword> &entries) {
+  return false;
+}
+
+#endif // QBDI_PLATFORM_LINUX || QBDI_PLATFORM_ANDROID
+
 const std::string getHostCPUName() {
   const std::string cpuname = llvm::sys::getHostCPUName().str();
   // set default ARM CPU
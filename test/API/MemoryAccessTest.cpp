@@ -18,6 +18,7 @@
 #include <catch2/catch.hpp>
 #include "APITest.h"
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include "inttypes.h"
@@ -658,6 +659,268 @@ TEST_CASE_METHOD(APITest, "MemoryAccessTest-ReadWriteRange") {
   REQUIRE(OFFSET_SUM(buffer_size) == info.i);
 }
 
+static bool sameMemoryAccess(const QBDI::MemoryAccess &a,
+                             const QBDI::MemoryAccess &b) {
+  return a.instAddress == b.instAddress and
+         a.accessAddress == b.accessAddress and a.value == b.value and
+         a.size == b.size and a.type == b.type and a.flags == b.flags;
+}
+
+// Compare the accesses of the copy API with the vector API, with a buffer of
+// one element and a large buffer. Count the mismatches in data.
+static void checkCopyAccess(const std::vector<QBDI::MemoryAccess> &ref,
+                            size_t (*copy)(QBDI::VMInstanceRef,
+                                           QBDI::MemoryAccess *, size_t),
+                            QBDI::VMInstanceRef vm, size_t *mismatch) {
+  QBDI::MemoryAccess buffer[64];
+  QBDI::MemoryAccess small[1];
+
+  if (copy(vm, nullptr, 0) != ref.size()) {
+    (*mismatch)++;
+  }
+  if (copy(vm, small, 1) != ref.size() or
+      (ref.size() > 0 and not sameMemoryAccess(small[0], ref[0]))) {
+    (*mismatch)++;
+  }
+  size_t n = copy(vm, buffer, 64);
+  if (n != ref.size()) {
+    (*mismatch)++;
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (not sameMemoryAccess(buffer[i], ref[i])) {
+      (*mismatch)++;
+    }
+  }
+}
+
+QBDI::VMAction checkCopyInstAccess(QBDI::VMInstanceRef vm,
+                                   QBDI::GPRState *gprState,
+                                   QBDI::FPRState *fprState, void *data) {
+  checkCopyAccess(
+      vm->getInstMemoryAccess(),
+      [](QBDI::VMInstanceRef vm, QBDI::MemoryAccess *buffer, size_t size) {
+        return vm->copyInstMemoryAccess(buffer, size);
+      },
+      vm, static_cast<size_t *>(data));
+  return QBDI::VMAction::CONTINUE;
+}
+
+QBDI::VMAction checkCopyBBAccess(QBDI::VMInstanceRef vm,
+                                 const QBDI::VMState *vmState,
+                                 QBDI::GPRState *gprState,
+                                 QBDI::FPRState *fprState, void *data) {
+  checkCopyAccess(
+      vm->getBBMemoryAccess(),
+      [](QBDI::VMInstanceRef vm, QBDI::MemoryAccess *buffer, size_t size) {
+        return vm->copyBBMemoryAccess(buffer, size);
+      },
+      vm, static_cast<size_t *>(data));
+  return QBDI::VMAction::CONTINUE;
+}
+
+TEST_CASE_METHOD(APITest, "MemoryAccessTest-CopyAccess") {
+  const size_t buffer_size = 10;
+  uint32_t buffer[buffer_size];
+  size_t instMismatch = 0, bbMismatch = 0;
+
+  vm.recordMemoryAccess(QBDI::MEMORY_READ_WRITE);
+  vm.addMemAccessCB(QBDI::MEMORY_READ_WRITE, checkCopyInstAccess,
+                    &instMismatch);
+  vm.addVMEventCB(QBDI::VMEvent::SEQUENCE_EXIT, checkCopyBBAccess,
+                  &bbMismatch);
+
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  bool ran = vm.run((QBDI::rword)arrayWrite32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  ran = vm.run((QBDI::rword)arrayRead32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+
+  CHECK(instMismatch == 0);
+  CHECK(bbMismatch == 0);
+}
+
+QBDI::VMAction countAccess(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
+                          QBDI::FPRState *fprState, void *data) {
+  (*static_cast<size_t *>(data))++;
+  return QBDI::VMAction::CONTINUE;
+}
+
+TEST_CASE_METHOD(APITest, "MemoryAccessTest-ManyRanges") {
+  const size_t buffer_size = 10;
+  uint32_t buffer[buffer_size] = {0};
+  uint32_t unused[1000] = {0};
+  size_t counters[buffer_size] = {0};
+  size_t wholeCounter = 0, unusedCounter = 0;
+  uint32_t ids[buffer_size];
+
+  // one range per element, a range over the whole buffer and many ranges
+  // that are never accessed
+  for (size_t i = 0; i < buffer_size; i++) {
+    ids[i] = vm.addMemRangeCB((QBDI::rword)&buffer[i],
+                              (QBDI::rword)&buffer[i + 1], QBDI::MEMORY_READ,
+                              countAccess, &counters[i]);
+  }
+  vm.addMemRangeCB((QBDI::rword)buffer, (QBDI::rword)(buffer + buffer_size),
+                   QBDI::MEMORY_READ, countAccess, &wholeCounter);
+  for (size_t i = 0; i < 1000; i++) {
+    vm.addMemRangeCB((QBDI::rword)&unused[i], (QBDI::rword)&unused[i + 1],
+                     QBDI::MEMORY_READ_WRITE, countAccess, &unusedCounter);
+  }
+
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  bool ran = vm.run((QBDI::rword)arrayRead32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+  for (size_t i = 0; i < buffer_size; i++) {
+    CHECK(counters[i] == 1);
+  }
+  CHECK(wholeCounter == buffer_size);
+  CHECK(unusedCounter == 0);
+
+  // delete the callbacks of the even elements
+  for (size_t i = 0; i < buffer_size; i += 2) {
+    REQUIRE(vm.deleteInstrumentation(ids[i]));
+    REQUIRE_FALSE(vm.deleteInstrumentation(ids[i]));
+  }
+
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  ran = vm.run((QBDI::rword)arrayRead32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+  for (size_t i = 0; i < buffer_size; i++) {
+    CHECK(counters[i] == ((i % 2 == 0) ? 1 : 2));
+  }
+  CHECK(wholeCounter == 2 * buffer_size);
+  CHECK(unusedCounter == 0);
+}
+
+TEST_CASE_METHOD(APITest, "MemoryAccessTest-RangeOrder") {
+  const size_t buffer_size = 10;
+  uint32_t buffer[buffer_size] = {0};
+  std::vector<int> order;
+
+  // the second range starts first, the callbacks are called in the order of
+  // their registration
+  vm.addMemRangeCB((QBDI::rword)&buffer[5], (QBDI::rword)&buffer[6],
+                   QBDI::MEMORY_READ,
+                   [&order](QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
+                            QBDI::FPRState *fprState) {
+                     order.push_back(1);
+                     return QBDI::VMAction::CONTINUE;
+                   });
+  vm.addMemRangeCB((QBDI::rword)buffer, (QBDI::rword)(buffer + buffer_size),
+                   QBDI::MEMORY_READ,
+                   [&order](QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
+                            QBDI::FPRState *fprState) {
+                     order.push_back(2);
+                     return QBDI::VMAction::CONTINUE;
+                   });
+
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  bool ran = vm.run((QBDI::rword)arrayRead32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+
+  // buffer[5] triggers both callbacks, the others only the second one
+  std::vector<int> expected(buffer_size + 1, 2);
+  expected[5] = 1;
+  CHECK(order == expected);
+}
+
+struct MemTraceTestInfo {
+  std::vector<QBDI::MemoryAccess> accesses;
+  size_t calls;
+  size_t maxSize;
+};
+
+static QBDI::VMAction traceAccess(QBDI::VMInstanceRef vm,
+                                  const QBDI::MemoryAccess *accesses,
+                                  size_t size, void *data) {
+  MemTraceTestInfo *info = static_cast<MemTraceTestInfo *>(data);
+  info->accesses.insert(info->accesses.end(), accesses, accesses + size);
+  info->calls++;
+  info->maxSize = std::max(info->maxSize, size);
+  return QBDI::VMAction::CONTINUE;
+}
+
+static void collectAccess(QBDI::VMInstanceRef vm, QBDI::MemoryAccessType type,
+                          void *data) {
+  std::vector<QBDI::MemoryAccess> *accesses =
+      static_cast<std::vector<QBDI::MemoryAccess> *>(data);
+  for (const QBDI::MemoryAccess &m : vm->getInstMemoryAccess()) {
+    if (m.type == type) {
+      accesses->push_back(m);
+    }
+  }
+}
+
+// reads are traced before the instruction and writes after it
+static QBDI::VMAction collectReadAccess(QBDI::VMInstanceRef vm,
+                                        QBDI::GPRState *gprState,
+                                        QBDI::FPRState *fprState, void *data) {
+  collectAccess(vm, QBDI::MEMORY_READ, data);
+  return QBDI::VMAction::CONTINUE;
+}
+
+static QBDI::VMAction collectWriteAccess(QBDI::VMInstanceRef vm,
+                                         QBDI::GPRState *gprState,
+                                         QBDI::FPRState *fprState, void *data) {
+  collectAccess(vm, QBDI::MEMORY_WRITE, data);
+  return QBDI::VMAction::CONTINUE;
+}
+
+TEST_CASE_METHOD(APITest, "MemoryAccessTest-TraceBuffer") {
+  const size_t buffer_size = 10;
+  uint32_t buffer[buffer_size];
+  QBDI::MemoryAccess trace[16];
+  MemTraceTestInfo info{{}, 0, 0};
+  std::vector<QBDI::MemoryAccess> expected;
+
+  REQUIRE_FALSE(vm.setMemoryTraceBuffer(QBDI::MEMORY_READ_WRITE, trace, 16, 17,
+                                        traceAccess, &info));
+  REQUIRE(vm.setMemoryTraceBuffer(QBDI::MEMORY_READ_WRITE, trace, 16, 8,
+                                  traceAccess, &info));
+
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  bool ran = vm.run((QBDI::rword)arrayWrite32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  ran = vm.run((QBDI::rword)arrayRead32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+
+  CHECK(info.calls > 2);
+  CHECK(info.maxSize <= 16);
+
+  REQUIRE(vm.removeMemoryTraceBuffer());
+  REQUIRE_FALSE(vm.removeMemoryTraceBuffer());
+
+  // compare with the accesses of the shadow based API
+  vm.recordMemoryAccess(QBDI::MEMORY_READ_WRITE);
+  vm.addCodeCB(QBDI::PREINST, collectReadAccess, &expected);
+  vm.addCodeCB(QBDI::POSTINST, collectWriteAccess, &expected);
+
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  ran = vm.run((QBDI::rword)arrayWrite32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+  QBDI::simulateCall(state, FAKE_RET_ADDR,
+                     {(QBDI::rword)buffer, (QBDI::rword)buffer_size});
+  ran = vm.run((QBDI::rword)arrayRead32, (QBDI::rword)FAKE_RET_ADDR);
+  REQUIRE(true == ran);
+
+  REQUIRE(info.accesses.size() == expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    CHECK(sameMemoryAccess(info.accesses[i], expected[i]));
+  }
+}
+
 TEST_CASE_METHOD(APITest, "MemoryAccessTest-MemorySnooping") {
   uint32_t a = 10, b = 42, c = 1337;
   QBDI::rword original = mad(&a, &b, &c);
@@ -154,3 +154,151 @@ TEST_CASE("Range-IntersectionAndOverlaps") {
     testRanges.push_back(newRange);
   }
 }
+
+TEST_CASE("Range-AddEdgeCases") {
+  QBDI::RangeSet<int> rangeSet;
+
+  // empty ranges are ignored
+  rangeSet.add(QBDI::Range<int>(10, 10));
+  CHECK(rangeSet.getRanges().size() == 0);
+
+  rangeSet.add(QBDI::Range<int>(10, 20));
+  rangeSet.add(QBDI::Range<int>(30, 40));
+  rangeSet.add(QBDI::Range<int>(0, 5));
+  REQUIRE(rangeSet.getRanges().size() == 3);
+  CHECK(rangeSet.getRanges()[0] == QBDI::Range<int>(0, 5));
+  CHECK(rangeSet.getRanges()[1] == QBDI::Range<int>(10, 20));
+  CHECK(rangeSet.getRanges()[2] == QBDI::Range<int>(30, 40));
+
+  // adjacent ranges are merged
+  rangeSet.add(QBDI::Range<int>(20, 25));
+  rangeSet.add(QBDI::Range<int>(5, 7));
+  REQUIRE(rangeSet.getRanges().size() == 3);
+  CHECK(rangeSet.getRanges()[0] == QBDI::Range<int>(0, 7));
+  CHECK(rangeSet.getRanges()[1] == QBDI::Range<int>(10, 25));
+
+  // a range bridging two ranges merges them
+  rangeSet.add(QBDI::Range<int>(25, 30));
+  REQUIRE(rangeSet.getRanges().size() == 2);
+  CHECK(rangeSet.getRanges()[1] == QBDI::Range<int>(10, 40));
+
+  // a range covering several ranges replaces them
+  rangeSet.add(QBDI::Range<int>(50, 60));
+  rangeSet.add(QBDI::Range<int>(-5, 55));
+  REQUIRE(rangeSet.getRanges().size() == 1);
+  CHECK(rangeSet.getRanges()[0] == QBDI::Range<int>(-5, 60));
+
+  // an included range changes nothing
+  rangeSet.add(QBDI::Range<int>(0, 60));
+  REQUIRE(rangeSet.getRanges().size() == 1);
+  CHECK(rangeSet.getRanges()[0] == QBDI::Range<int>(-5, 60));
+}
+
+TEST_CASE("Range-RemoveEdgeCases") {
+  QBDI::RangeSet<int> rangeSet;
+  rangeSet.add(QBDI::Range<int>(0, 10));
+  rangeSet.add(QBDI::Range<int>(20, 30));
+  rangeSet.add(QBDI::Range<int>(40, 50));
+
+  // empty and disjoint ranges change nothing
+  rangeSet.remove(QBDI::Range<int>(5, 5));
+  rangeSet.remove(QBDI::Range<int>(10, 20));
+  rangeSet.remove(QBDI::Range<int>(50, 60));
+  REQUIRE(rangeSet.getRanges().size() == 3);
+  CHECK(rangeSet.size() == 30);
+
+  // split a range
+  rangeSet.remove(QBDI::Range<int>(3, 6));
+  REQUIRE(rangeSet.getRanges().size() == 4);
+  CHECK(rangeSet.getRanges()[0] == QBDI::Range<int>(0, 3));
+  CHECK(rangeSet.getRanges()[1] == QBDI::Range<int>(6, 10));
+
+  // truncate the end of a range and the start of the next one
+  rangeSet.remove(QBDI::Range<int>(8, 25));
+  REQUIRE(rangeSet.getRanges().size() == 4);
+  CHECK(rangeSet.getRanges()[1] == QBDI::Range<int>(6, 8));
+  CHECK(rangeSet.getRanges()[2] == QBDI::Range<int>(25, 30));
+
+  // remove an exact range
+  rangeSet.remove(QBDI::Range<int>(25, 30));
+  REQUIRE(rangeSet.getRanges().size() == 3);
+  CHECK(rangeSet.getRanges()[2] == QBDI::Range<int>(40, 50));
+
+  // remove several ranges at once
+  rangeSet.remove(QBDI::Range<int>(-10, 45));
+  REQUIRE(rangeSet.getRanges().size() == 1);
+  CHECK(rangeSet.getRanges()[0] == QBDI::Range<int>(45, 50));
+
+  rangeSet.remove(QBDI::Range<int>(0, 100));
+  CHECK(rangeSet.getRanges().size() == 0);
+}
+
+TEST_CASE("Range-Lookup") {
+  static const int N = 2000;
+  QBDI::RangeSet<int> rangeSet;
+  std::vector<bool> reference(N, false);
+
+  for (int i = 0; i < 200; i++) {
+    int start = rand() % (N - 50);
+    QBDI::Range<int> r(start, start + rand() % 50);
+    bool add = (rand() % 3 != 0);
+    if (add) {
+      rangeSet.add(r);
+    } else {
+      rangeSet.remove(r);
+    }
+    for (int j = r.start(); j < r.end(); j++) {
+      reference[j] = add;
+    }
+  }
+
+  int size = 0;
+  for (int j = 0; j < N; j++) {
+    CHECK(rangeSet.contains(j) == reference[j]);
+    size += reference[j];
+  }
+  CHECK(rangeSet.size() == size);
+
+  // the ranges stay sorted, merged and not empty
+  const std::vector<QBDI::Range<int>> &ranges = rangeSet.getRanges();
+  for (size_t i = 0; i < ranges.size(); i++) {
+    CHECK(ranges[i].start() < ranges[i].end());
+    if (i > 0) {
+      CHECK(ranges[i - 1].end() < ranges[i].start());
+    }
+  }
+
+  for (int i = 0; i < 500; i++) {
+    int start = rand() % (N - 20);
+    QBDI::Range<int> query(start, start + 1 + rand() % 20);
+
+    bool containsAll = true;
+    bool overlapsAny = false;
+    for (int j = query.start(); j < query.end(); j++) {
+      containsAll &= reference[j];
+      overlapsAny |= reference[j];
+    }
+    CHECK(rangeSet.contains(query) == containsAll);
+    CHECK(rangeSet.overlaps(query) == overlapsAny);
+
+    std::vector<QBDI::Range<int>> overlapping;
+    for (const QBDI::Range<int> &r : ranges) {
+      if (r.overlaps(query)) {
+        overlapping.push_back(r);
+      }
+    }
+    CHECK(rangeSet.getOverlappingRanges(query) == overlapping);
+  }
+}
+
+TEST_CASE("Range-OverlapsAfterFirstRange") {
+  QBDI::RangeSet<int> rangeSet;
+  rangeSet.add(QBDI::Range<int>(0, 10));
+  rangeSet.add(QBDI::Range<int>(20, 30));
+
+  CHECK(rangeSet.overlaps(QBDI::Range<int>(25, 35)));
+  CHECK(rangeSet.overlaps(QBDI::Range<int>(5, 25)));
+  CHECK_FALSE(rangeSet.overlaps(QBDI::Range<int>(10, 20)));
+  CHECK_FALSE(rangeSet.overlaps(QBDI::Range<int>(30, 40)));
+  CHECK(rangeSet.getOverlappingRanges(QBDI::Range<int>(5, 25)).size() == 2);
+}
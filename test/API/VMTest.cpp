@@ -16,11 +16,21 @@
  * limitations under the License.
  */
 #include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
 #include <catch2/catch.hpp>
 #include "APITest.h"
 
 #include "inttypes.h"
 
+#if defined(QBDI_PLATFORM_LINUX) || defined(QBDI_PLATFORM_ANDROID)
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
 #include "QBDI/Memory.hpp"
 #include "QBDI/Platform.h"
 #include "Utility/LogSys.h"
@@ -215,6 +225,169 @@ TEST_CASE_METHOD(APITest, "VMTest-InstCallback") {
   SUCCEED();
 }
 
+QBDI::VMAction tracePC(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
+                       QBDI::FPRState *fprState, void *data) {
+  static_cast<std::vector<QBDI::rword> *>(data)->push_back(
+      QBDI_GPR_GET(gprState, QBDI::REG_PC));
+  return QBDI::VMAction::CONTINUE;
+}
+
+// Number of sequences looked up by the VM in its translation cache
+static uint64_t cacheLookups(const QBDI::VM &vm) {
+  QBDI::CacheStats stats = vm.getCacheStats();
+  return stats.hits + stats.misses;
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-InlineCallback") {
+  const QBDI::Options options = vm.getOptions();
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+  std::vector<QBDI::rword> expected;
+  QBDI::rword retval;
+
+  vm.addCodeCB(QBDI::InstPosition::PREINST, tracePC, &expected);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(retval == static_cast<QBDI::rword>(
+                      dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+  CHECK(expected.size() != 0);
+  vm.deleteAllInstrumentations();
+
+  // The inline callbacks are called on the same instructions and with the
+  // same state
+  for (QBDI::Options opts :
+       {options, options | QBDI::Options::OPT_ENABLE_BLOCK_CHAINING}) {
+    std::vector<QBDI::rword> trace;
+    vm.setOptions(opts);
+    vm.setGPRState(&backup);
+    uint32_t id = vm.addCodeCB(QBDI::InstPosition::PREINST, tracePC, &trace,
+                               QBDI::PRIORITY_DEFAULT,
+                               QBDI::CallbackFlags::CALLBACK_INLINE);
+    REQUIRE(id != QBDI::INVALID_EVENTID);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                  {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1)}));
+    CHECK(retval == static_cast<QBDI::rword>(dummyFunBB(
+                        3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+    CHECK(trace == expected);
+#if defined(QBDI_ARCH_X86_64)
+    if (opts != options) {
+      // Once the cache is warm, the 7 indirect calls and their returns are
+      // resolved by the inline target cache between the inline callbacks
+      trace.clear();
+      uint64_t lookups = cacheLookups(vm);
+      vm.setGPRState(&backup);
+      CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                    {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                     reinterpret_cast<QBDI::rword>(dummyFun1),
+                     reinterpret_cast<QBDI::rword>(dummyFun1)}));
+      CHECK(trace == expected);
+      CHECK(cacheLookups(vm) - lookups < 14);
+    }
+#endif // QBDI_ARCH_X86_64
+    vm.deleteAllInstrumentations();
+  }
+  vm.setOptions(options);
+
+  // The inline callbacks can change the GPRState
+  vm.setGPRState(&backup);
+  vm.addCodeCB(
+      QBDI::InstPosition::PREINST,
+      [](QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
+         QBDI::FPRState *fprState) {
+        const QBDI::InstAnalysis *ana = vm->getCachedInstAnalysis(
+            QBDI_GPR_GET(gprState, QBDI::REG_PC));
+        if (ana != nullptr and ana->isReturn) {
+          QBDI_GPR_SET(gprState, QBDI::REG_RETURN, 43);
+        }
+        return QBDI::VMAction::CONTINUE;
+      },
+      QBDI::PRIORITY_DEFAULT, QBDI::CallbackFlags::CALLBACK_INLINE);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFun0)));
+  CHECK(retval == static_cast<QBDI::rword>(43));
+  vm.deleteAllInstrumentations();
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-BBCounter") {
+  const QBDI::rword funAddr = reinterpret_cast<QBDI::rword>(dummyFunBB);
+  QBDI::rword start = 0;
+  QBDI::rword end = 0;
+  for (const QBDI::MemoryMap &m : QBDI::getCurrentProcessMaps()) {
+    if (m.range.contains(funAddr)) {
+      start = m.range.start();
+      end = m.range.end();
+    }
+  }
+  REQUIRE(start < end);
+
+  std::map<QBDI::rword, uint64_t> expected;
+  std::vector<uint8_t> map(end - start, 0);
+  QBDI::rword retval;
+
+  vm.addVMEventCB(QBDI::VMEvent::BASIC_BLOCK_ENTRY,
+                  [&expected](QBDI::VMInstanceRef vm, const QBDI::VMState *st,
+                              QBDI::GPRState *, QBDI::FPRState *) {
+                    expected[st->basicBlockEnd]++;
+                    return QBDI::VMAction::CONTINUE;
+                  });
+  REQUIRE(vm.addBBCounterRange(start, end) != QBDI::INVALID_EVENTID);
+  REQUIRE(vm.addCoverageMapRange(start, end, map.data()) !=
+          QBDI::INVALID_EVENTID);
+
+  CHECK(vm.call(&retval, funAddr,
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(retval == static_cast<QBDI::rword>(
+                      dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+
+  // Each basic block is counted once per execution, whatever its entry
+  std::vector<std::pair<QBDI::rword, uint64_t>> counters = vm.getBBCounters();
+  CHECK(counters == std::vector<std::pair<QBDI::rword, uint64_t>>(
+                        expected.begin(), expected.end()));
+  size_t covered = 0;
+  for (const auto &c : expected) {
+    CHECK(vm.getBBCounter(c.first) == c.second);
+    CHECK(map[c.first - 1 - start] == 1);
+  }
+  for (uint8_t b : map) {
+    covered += b;
+  }
+  CHECK(covered == expected.size());
+
+  // The counters are kept when the cache is cleared
+  vm.clearAllCache();
+  CHECK(vm.getBBCounters() == counters);
+
+  // and when the ExecBlocks are recreated
+  QBDI::Options options = vm.getOptions();
+  vm.setOptions(options | QBDI::Options::OPT_DISABLE_FPR);
+  CHECK(vm.getBBCounters() == counters);
+  vm.setOptions(options);
+  CHECK(vm.getBBCounters() == counters);
+  REQUIRE(vm.setExecBlockSize(0x4000, 0x1000));
+  CHECK(vm.getBBCounters() == counters);
+
+  // the new ExecBlocks add to the kept counters, expected counts both calls
+  CHECK(vm.call(&retval, funAddr,
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  for (const auto &c : expected) {
+    CHECK(vm.getBBCounter(c.first) == c.second);
+  }
+  REQUIRE(vm.setExecBlockSize(0, 0));
+
+  vm.resetBBCounters();
+  for (const auto &c : expected) {
+    CHECK(vm.getBBCounter(c.first) == 0);
+  }
+  vm.deleteAllInstrumentations();
+}
+
 QBDI::VMAction evilMnemCbk(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
                            QBDI::FPRState *fprState, void *data) {
   QBDI::rword *info = (QBDI::rword *)data;
@@ -350,6 +523,70 @@ TEST_CASE_METHOD(APITest, "VMTest-VMEvent_ExecTransfer") {
   vm.deleteAllInstrumentations();
 }
 
+// atoi is called through a PLT stub of the test binary
+QBDI_DISABLE_ASAN QBDI_NOINLINE int dummyFunExternal(int n) {
+  static const char *values[] = {"1", "2", "3"};
+  int sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += atoi(values[i % 3]);
+  }
+  return sum;
+}
+
+static QBDI::VMAction countTransfer(QBDI::VMInstanceRef vm,
+                                   const QBDI::VMState *state,
+                                   QBDI::GPRState *gprState,
+                                   QBDI::FPRState *fprState, void *data) {
+  (*static_cast<int *>(data))++;
+  return QBDI::VMAction::CONTINUE;
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-ExecTransfer_Stub") {
+  int transfers = 0;
+  uint32_t instructions = 0;
+  const int expected = dummyFunExternal(10);
+
+  uint32_t id = vm.addVMEventCB(QBDI::VMEvent::EXEC_TRANSFER_CALL,
+                                countTransfer, &transfers);
+  REQUIRE(id != QBDI::INVALID_EVENTID);
+
+  // The second call uses the cached return points and skips the stubs
+  for (int i = 0; i < 2; i++) {
+    QBDI::rword retval = 0;
+    bool ran = vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunExternal),
+                       {10});
+    REQUIRE(ran);
+    CHECK(retval == (QBDI::rword)expected);
+  }
+  CHECK(transfers >= 20);
+
+  // The stubs are executed when they are instrumented
+  id = vm.addCodeCB(QBDI::PREINST, countInstruction, &instructions);
+  REQUIRE(id != QBDI::INVALID_EVENTID);
+  QBDI::rword retval = 0;
+  bool ran = vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunExternal),
+                     {10});
+  REQUIRE(ran);
+  CHECK(retval == (QBDI::rword)expected);
+  CHECK(instructions > 0);
+  vm.deleteInstrumentation(id);
+
+  // The caches follow the changes of the instrumented ranges
+  vm.removeAllInstrumentedRanges();
+  bool instrumented = vm.addInstrumentedModuleFromAddr(
+      reinterpret_cast<QBDI::rword>(dummyFunExternal));
+  REQUIRE(instrumented);
+  transfers = 0;
+  retval = 0;
+  ran = vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunExternal),
+                {10});
+  REQUIRE(ran);
+  CHECK(retval == (QBDI::rword)expected);
+  CHECK(transfers >= 10);
+
+  vm.deleteAllInstrumentations();
+}
+
 struct CheckBasicBlockData {
   bool waitingEnd;
   QBDI::rword BBStart;
@@ -411,6 +648,586 @@ TEST_CASE_METHOD(APITest, "VMTest-VMEvent_BasicBlock") {
   }
 }
 
+TEST_CASE_METHOD(APITest, "VMTest-BlockChaining") {
+  const QBDI::Options options = vm.getOptions();
+  vm.setOptions(options | QBDI::Options::OPT_ENABLE_BLOCK_CHAINING);
+
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+
+  for (QBDI::rword i = 0; i < 8; i++) {
+    vm.setGPRState(&backup);
+    QBDI::rword retval;
+    bool ran = vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                       {i, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                        reinterpret_cast<QBDI::rword>(dummyFun1),
+                        reinterpret_cast<QBDI::rword>(dummyFun1)});
+    CHECK(ran);
+    CHECK(retval == static_cast<QBDI::rword>(
+                        dummyFunBB(i, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+  }
+
+  // The instrumentation added on linked sequences must be reached
+  uint32_t count1 = 0;
+  uint32_t count2 = 0;
+  vm.addCodeCB(QBDI::InstPosition::POSTINST, countInstruction, &count1);
+  vm.setGPRState(&backup);
+  QBDI::rword retval;
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(count1 != 0);
+
+  vm.setOptions(options);
+  vm.deleteAllInstrumentations();
+  vm.addCodeCB(QBDI::InstPosition::POSTINST, countInstruction, &count2);
+  vm.setGPRState(&backup);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(count1 == count2);
+  vm.deleteAllInstrumentations();
+
+  // A BasicBlock VMEvent disables the chaining
+  vm.setOptions(options | QBDI::Options::OPT_ENABLE_BLOCK_CHAINING);
+  CheckBasicBlockData data{false, 0, 0, 0};
+  vm.addVMEventCB(QBDI::BASIC_BLOCK_ENTRY | QBDI::BASIC_BLOCK_EXIT,
+                  checkBasicBlock, &data);
+  vm.setGPRState(&backup);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK_FALSE(data.waitingEnd);
+  CHECK(data.count != 0);
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-DualMapping") {
+  const QBDI::Options options = vm.getOptions();
+  vm.setOptions(options | QBDI::Options::OPT_ENABLE_DUAL_MAPPING);
+
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+
+  // each run writes new basic blocks in the ExecBlocks already executed
+  uint32_t count = 0;
+  for (QBDI::rword i = 0; i < 8; i++) {
+    if (i == 4) {
+      vm.addCodeCB(QBDI::InstPosition::POSTINST, countInstruction, &count);
+    }
+    vm.setGPRState(&backup);
+    QBDI::rword retval;
+    bool ran = vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                       {i, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                        reinterpret_cast<QBDI::rword>(dummyFun1),
+                        reinterpret_cast<QBDI::rword>(dummyFun1)});
+    CHECK(ran);
+    CHECK(retval == static_cast<QBDI::rword>(
+                        dummyFunBB(i, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+  }
+  CHECK(count != 0);
+#if defined(QBDI_PLATFORM_LINUX)
+  QBDI::CacheStats stats = vm.getCacheStats();
+  CHECK(stats.execBlocks != 0);
+  CHECK(stats.dualMapped == stats.execBlocks);
+#endif
+
+  vm.deleteAllInstrumentations();
+  vm.setOptions(options);
+
+  // the ExecBlocks are recreated without the second mapping
+  vm.setGPRState(&backup);
+  QBDI::rword retval;
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(vm.getCacheStats().execBlocks != 0);
+  CHECK(vm.getCacheStats().dualMapped == 0);
+}
+
+QBDI_DISABLE_ASAN QBDI_NOINLINE QBDI::rword dummyFunLoop(QBDI::rword n) {
+  QBDI::rword acc = 0;
+  for (QBDI::rword i = 0; i < n; i++) {
+    if (i % 3 == 0) {
+      acc += dummyFun1(static_cast<int>(i)) * 7;
+    } else {
+      acc ^= i;
+    }
+  }
+  return acc;
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-HotTraces") {
+  const QBDI::Options options = vm.getOptions();
+
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+
+  std::vector<QBDI::rword> expected;
+  QBDI::rword retval;
+  vm.addCodeCB(QBDI::InstPosition::PREINST, tracePC, &expected);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunLoop), {200}));
+  CHECK(retval == dummyFunLoop(200));
+  CHECK(expected.size() != 0);
+  vm.deleteAllInstrumentations();
+
+  // The instructions of the traces are instrumented as their basic blocks
+  for (QBDI::Options opts :
+       {options | QBDI::Options::OPT_ENABLE_HOT_TRACES,
+        options | QBDI::Options::OPT_ENABLE_HOT_TRACES |
+            QBDI::Options::OPT_ENABLE_BLOCK_CHAINING}) {
+    std::vector<QBDI::rword> trace;
+    vm.setOptions(opts);
+    vm.setGPRState(&backup);
+    vm.addCodeCB(QBDI::InstPosition::PREINST, tracePC, &trace);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunLoop), {200}));
+    CHECK(retval == dummyFunLoop(200));
+    CHECK(trace == expected);
+#if defined(QBDI_ARCH_X86_64)
+    CHECK(vm.getCacheStats().traces != 0);
+#endif
+    vm.deleteAllInstrumentations();
+
+    // The traces written without instrumentation give the same results
+    for (QBDI::rword n : {0, 1, 50, 300}) {
+      vm.setGPRState(&backup);
+      CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunLoop), {n}));
+      CHECK(retval == dummyFunLoop(n));
+    }
+    vm.clearAllCache();
+  }
+  vm.setOptions(options);
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-HotTracesEvents") {
+  const QBDI::Options options = vm.getOptions();
+
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+
+  QBDI::rword retval;
+  size_t expected = 0;
+  vm.addVMEventCB(QBDI::VMEvent::BASIC_BLOCK_ENTRY,
+                  [&expected](QBDI::VMInstanceRef, const QBDI::VMState *,
+                              QBDI::GPRState *, QBDI::FPRState *) {
+                    expected++;
+                    return QBDI::VMAction::CONTINUE;
+                  });
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunLoop), {200}));
+  CHECK(expected != 0);
+  vm.deleteAllInstrumentations();
+  vm.clearAllCache();
+
+  for (QBDI::Options opts :
+       {options | QBDI::Options::OPT_ENABLE_HOT_TRACES,
+        options | QBDI::Options::OPT_ENABLE_HOT_TRACES |
+            QBDI::Options::OPT_ENABLE_BLOCK_CHAINING}) {
+    vm.setOptions(opts);
+    vm.setGPRState(&backup);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunLoop), {200}));
+#if defined(QBDI_ARCH_X86_64)
+    uint64_t traces = vm.getCacheStats().traces;
+    CHECK(traces != 0);
+#endif
+
+    // The traces are dropped: each basic block is signaled again
+    size_t count = 0;
+    vm.addVMEventCB(QBDI::VMEvent::BASIC_BLOCK_ENTRY,
+                    [&count](QBDI::VMInstanceRef, const QBDI::VMState *,
+                             QBDI::GPRState *, QBDI::FPRState *) {
+                      count++;
+                      return QBDI::VMAction::CONTINUE;
+                    });
+    vm.setGPRState(&backup);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunLoop), {200}));
+    CHECK(retval == dummyFunLoop(200));
+    CHECK(count == expected);
+#if defined(QBDI_ARCH_X86_64)
+    CHECK(vm.getCacheStats().traces == traces);
+#endif
+    vm.deleteAllInstrumentations();
+    vm.clearAllCache();
+  }
+  vm.setOptions(options);
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-Pretranslation") {
+  const QBDI::Options options = vm.getOptions();
+
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+
+  std::vector<QBDI::rword> expected;
+  QBDI::rword retval;
+  vm.addCodeCB(QBDI::InstPosition::PREINST, tracePC, &expected);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(expected.size() != 0);
+  vm.deleteAllInstrumentations();
+
+  vm.setOptions(options | QBDI::Options::OPT_ENABLE_PRETRANSLATION);
+  for (int run = 0; run < 2; run++) {
+    // The InstrRule callbacks are called by the thread running the VM
+    std::vector<QBDI::rword> trace;
+    const std::thread::id vmThread = std::this_thread::get_id();
+    bool sameThread = true;
+    vm.addInstrRule(
+        [&](QBDI::VMInstanceRef, const QBDI::InstAnalysis *)
+            -> std::vector<QBDI::InstrRuleDataCBK> {
+          sameThread = sameThread and std::this_thread::get_id() == vmThread;
+          // let the translator thread decode the successors
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          return {};
+        },
+        QBDI::ANALYSIS_INSTRUCTION);
+    uint64_t pretranslated = vm.getCacheStats().pretranslated;
+    vm.addCodeCB(QBDI::InstPosition::PREINST, tracePC, &trace);
+    vm.setGPRState(&backup);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                  {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1)}));
+    CHECK(retval == static_cast<QBDI::rword>(dummyFunBB(
+                        3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+    CHECK(trace == expected);
+    CHECK(sameThread);
+    // some basic blocks were taken from the translator thread
+    CHECK(vm.getCacheStats().pretranslated > pretranslated);
+    // The staged basic blocks are discarded with the cache
+    vm.deleteAllInstrumentations();
+    vm.clearAllCache();
+  }
+  vm.setOptions(options);
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-ExecBlockSize") {
+  // not a multiple of the page size
+  CHECK_FALSE(vm.setExecBlockSize(100, 0));
+  CHECK_FALSE(vm.setExecBlockSize(0, 1 << 30));
+
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+
+  uint32_t count = 0;
+  vm.addCodeCB(QBDI::InstPosition::POSTINST, countInstruction, &count);
+
+  uint32_t expectedCount = 0;
+  for (size_t codeSize : {0, 0x4000, 0x10000, 0x200000}) {
+    REQUIRE(vm.setExecBlockSize(codeSize, codeSize / 4));
+    count = 0;
+    vm.setGPRState(&backup);
+    QBDI::rword retval;
+    bool ran = vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                       {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                        reinterpret_cast<QBDI::rword>(dummyFun1),
+                        reinterpret_cast<QBDI::rword>(dummyFun1)});
+    CHECK(ran);
+    CHECK(retval == static_cast<QBDI::rword>(
+                        dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+    // the same instructions are executed whatever the size of the ExecBlocks
+    if (expectedCount == 0) {
+      expectedCount = count;
+    }
+    CHECK(count == expectedCount);
+  }
+  CHECK(expectedCount != 0);
+
+  vm.deleteAllInstrumentations();
+  REQUIRE(vm.setExecBlockSize(0, 0));
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-CacheBudget") {
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+  QBDI::rword retval;
+
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+
+  QBDI::CacheStats stats = vm.getCacheStats();
+  CHECK(stats.memoryBudget == 0);
+  CHECK(stats.memoryUsage != 0);
+  CHECK(stats.regions != 0);
+  CHECK(stats.execBlocks != 0);
+  CHECK(stats.misses != 0);
+  CHECK(stats.evictions == 0);
+
+  // the regions are kept once after a hit, all of them are evicted by the
+  // second turn of the clock
+  vm.setCacheBudget(1);
+  stats = vm.getCacheStats();
+  CHECK(stats.memoryBudget == 1);
+  CHECK(stats.memoryUsage == 0);
+  CHECK(stats.regions == 0);
+  CHECK(stats.evictions == 1);
+  CHECK(stats.evictedRegions != 0);
+  CHECK(stats.evictedExecBlocks != 0);
+  CHECK(stats.evictedBytes != 0);
+
+  // the code is translated again, each new basic block evicts the others
+  for (QBDI::rword i = 0; i < 4; i++) {
+    vm.setGPRState(&backup);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                  {i, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1)}));
+    CHECK(retval == static_cast<QBDI::rword>(
+                        dummyFunBB(i, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+  }
+  CHECK(vm.getCacheStats().regions <= 2);
+
+  vm.setCacheBudget(0);
+  CHECK(vm.getCacheStats().memoryBudget == 0);
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-CallWarmCache") {
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+  QBDI::rword retval;
+
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  uint64_t misses = vm.getCacheStats().misses;
+  CHECK(misses != 0);
+
+  // the stop address doesn't change, the next calls don't translate again
+  for (int i = 0; i < 4; i++) {
+    vm.setGPRState(&backup);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                  {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1)}));
+    CHECK(retval == static_cast<QBDI::rword>(
+                        dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+  }
+  CHECK(vm.getCacheStats().misses == misses);
+}
+
+TEST_CASE_METHOD(APITest, "VMTest-PrecacheRange") {
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+  QBDI::rword retval;
+
+  QBDI::rword start = reinterpret_cast<QBDI::rword>(dummyFunBB);
+  QBDI::rword end = 0;
+  for (const QBDI::MemoryMap &m : QBDI::getCurrentProcessMaps()) {
+    if (m.range.contains(start)) {
+      end = m.range.end();
+    }
+  }
+  REQUIRE(end != 0);
+
+  CHECK_FALSE(vm.precacheRange(start, start));
+  CHECK_FALSE(vm.precacheModule(""));
+
+  std::vector<QBDI::rword> expected;
+  vm.addCodeCB(QBDI::InstPosition::PREINST, tracePC, &expected);
+  uint64_t misses = vm.getCacheStats().misses;
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  uint64_t coldMisses = vm.getCacheStats().misses - misses;
+  CHECK(coldMisses != 0);
+  vm.clearAllCache();
+
+  // The basic blocks are instrumented when they are precached
+  QBDI::PrecacheReport report;
+  CHECK(vm.precacheRange(start, end, &report, 2));
+  CHECK(report.entryPoints != 0);
+  CHECK(report.basicBlocks != 0);
+  CHECK(report.newBasicBlocks != 0);
+  CHECK(report.newBasicBlocks <= report.basicBlocks);
+  CHECK(report.coveredBytes != 0);
+  CHECK(report.coveredBytes <= report.rangeBytes);
+  CHECK(report.rangeBytes <= end - start);
+  CHECK(report.threads == 2);
+
+  std::vector<QBDI::rword> trace;
+  vm.deleteAllInstrumentations();
+  vm.addCodeCB(QBDI::InstPosition::PREINST, tracePC, &trace);
+  vm.clearAllCache();
+  CHECK(vm.precacheRange(start, end, &report, 2));
+  misses = vm.getCacheStats().misses;
+  vm.setGPRState(&backup);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(retval == static_cast<QBDI::rword>(
+                      dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+  CHECK(trace == expected);
+  CHECK(vm.getCacheStats().misses - misses < coldMisses);
+
+  // The cached basic blocks aren't written again
+  CHECK(vm.precacheRange(start, end, &report, 1));
+  CHECK(report.newBasicBlocks == 0);
+  CHECK(report.threads == 1);
+}
+
+#if defined(QBDI_PLATFORM_LINUX) || defined(QBDI_PLATFORM_ANDROID)
+TEST_CASE_METHOD(APITest, "VMTest-PersistentCache") {
+  char directory[] = "/tmp/qbdi-cache-XXXXXX";
+  REQUIRE(mkdtemp(directory) != nullptr);
+
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+  std::vector<std::string> disassembly[2];
+  uint64_t hits[2];
+  QBDI::rword retval;
+
+  // The second run decodes the instructions from the files of the first one
+  for (int i = 0; i < 2; i++) {
+    REQUIRE(vm.setPersistentCache(directory));
+    uint32_t id = vm.addCodeCB(
+        QBDI::PREINST,
+        [&disassembly, i](QBDI::VMInstanceRef vm, QBDI::GPRState *,
+                          QBDI::FPRState *) {
+          disassembly[i].emplace_back(
+              vm->getInstAnalysis(QBDI::ANALYSIS_DISASSEMBLY)->disassembly);
+          return QBDI::VMAction::CONTINUE;
+        });
+    vm.setGPRState(&backup);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                  {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1)}));
+    CHECK(retval == static_cast<QBDI::rword>(
+                        dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+    vm.deleteInstrumentation(id);
+    hits[i] = vm.getCacheStats().persistentHits;
+    CHECK(vm.savePersistentCache());
+    vm.setPersistentCache("");
+    vm.clearAllCache();
+  }
+  CHECK(disassembly[0].size() != 0);
+  CHECK(disassembly[0] == disassembly[1]);
+  // the first run decodes everything, the second one reads the files
+  CHECK(hits[0] == 0);
+  CHECK(hits[1] > 0);
+  CHECK(vm.getCacheStats().persistentHits == hits[1]);
+  CHECK_FALSE(vm.savePersistentCache());
+
+  // A file with a record of size 0 is ignored. The size of the first record
+  // follows the file header (24 bytes) and the offset, opcode and flags of the
+  // record (16 bytes).
+  DIR *files = opendir(directory);
+  REQUIRE(files != nullptr);
+  while (struct dirent *entry = readdir(files)) {
+    if (entry->d_name[0] != '.') {
+      std::string path = std::string(directory) + "/" + entry->d_name;
+      FILE *file = fopen(path.c_str(), "r+b");
+      REQUIRE(file != nullptr);
+      CHECK(fseek(file, 40, SEEK_SET) == 0);
+      CHECK(fputc(0, file) == 0);
+      fclose(file);
+    }
+  }
+  closedir(files);
+  REQUIRE(vm.setPersistentCache(directory));
+  vm.setGPRState(&backup);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(retval == static_cast<QBDI::rword>(
+                      dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+  CHECK(vm.getCacheStats().persistentHits == hits[1]);
+  vm.setPersistentCache("");
+  vm.clearAllCache();
+
+  // remove the cache files
+  int nbFiles = 0;
+  DIR *dir = opendir(directory);
+  REQUIRE(dir != nullptr);
+  while (struct dirent *entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      std::string path = std::string(directory) + "/" + entry->d_name;
+      CHECK(unlink(path.c_str()) == 0);
+      nbFiles++;
+    }
+  }
+  closedir(dir);
+  rmdir(directory);
+  CHECK(nbFiles != 0);
+}
+#endif
+
+TEST_CASE_METHOD(APITest, "VMTest-IndirectBranchCache") {
+  const QBDI::Options options = vm.getOptions();
+  vm.setOptions(options | QBDI::Options::OPT_ENABLE_BLOCK_CHAINING);
+
+  // backup GPRState to have the same state before each run
+  QBDI::GPRState backup = *(vm.getGPRState());
+  QBDI::rword retval;
+
+  // fill the cache with the targets of the indirect calls and the returns
+  for (int i = 0; i < 4; i++) {
+    vm.setGPRState(&backup);
+    CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                  {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1),
+                   reinterpret_cast<QBDI::rword>(dummyFun1)}));
+    CHECK(retval == static_cast<QBDI::rword>(
+                        dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+  }
+#if defined(QBDI_ARCH_X86_64)
+  // Without the inline target cache, each of the 7 indirect calls and of
+  // their returns needs a lookup of the VM
+  uint64_t lookups = cacheLookups(vm);
+  vm.setGPRState(&backup);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(cacheLookups(vm) - lookups < 14);
+#endif // QBDI_ARCH_X86_64
+
+  // A new instrumentation on a cached target must be reached
+  uint32_t count = 0;
+  uint32_t instr = vm.addCodeAddrCB(reinterpret_cast<QBDI::rword>(dummyFun1),
+                                    QBDI::InstPosition::PREINST,
+                                    countInstruction, &count);
+  vm.setGPRState(&backup);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(count == 5);
+
+  // Once removed, the cached target must not reach it anymore
+  vm.deleteInstrumentation(instr);
+  vm.setGPRState(&backup);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(count == 5);
+  CHECK(retval == static_cast<QBDI::rword>(
+                      dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+
+  // A target leaving the instrumented ranges must be reached by the VM
+  vm.removeAllInstrumentedRanges();
+  vm.addInstrumentedRange(reinterpret_cast<QBDI::rword>(dummyFunBB),
+                          reinterpret_cast<QBDI::rword>(dummyFunBB) + 1);
+  vm.setGPRState(&backup);
+  CHECK(vm.call(&retval, reinterpret_cast<QBDI::rword>(dummyFunBB),
+                {3, 5, 13, reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1),
+                 reinterpret_cast<QBDI::rword>(dummyFun1)}));
+  CHECK(retval == static_cast<QBDI::rword>(
+                      dummyFunBB(3, 5, 13, dummyFun1, dummyFun1, dummyFun1)));
+}
+
 TEST_CASE_METHOD(APITest, "VMTest-CacheInvalidation") {
   uint32_t count1 = 0;
   uint32_t count2 = 0;
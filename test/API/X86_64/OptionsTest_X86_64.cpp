@@ -21,10 +21,12 @@
 #include <algorithm>
 #include <sstream>
 #include <string>
+#include <string.h>
 #include "inttypes.h"
 
 #include "QBDI/Memory.hpp"
 #include "QBDI/Platform.h"
+#include "Utility/System.h"
 
 TEST_CASE_METHOD(OptionsTest, "OptionsTest_X86_64-ATTSyntax") {
 
@@ -103,3 +105,91 @@ TEST_CASE_METHOD(OptionsTest, "OptionsTest_X86_64-setOption") {
 
   QBDI::alignedFree(fakestack);
 }
+
+static QBDI::VMAction setYmm1(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
+                              QBDI::FPRState *fprState, void *data) {
+  memset(fprState->ymm1, 0xF0, sizeof(fprState->ymm1));
+  return QBDI::VMAction::CONTINUE;
+}
+
+TEST_CASE_METHOD(OptionsTest, "OptionsTest_X86_64-XSAVE") {
+  if (not QBDI::isHostCPUFeaturePresent("avx")) {
+    return;
+  }
+
+  InMemoryObject xorObj("vxorps %ymm1, %ymm0, %ymm0\nret\n");
+  QBDI::rword addr = (QBDI::rword)xorObj.getCode().data();
+
+  uint8_t *fakestack;
+  QBDI::GPRState *state = vm.getGPRState();
+  bool ret = QBDI::allocateVirtualStack(state, 4096, &fakestack);
+  REQUIRE(ret == true);
+  vm.addInstrumentedRange(addr, addr + (QBDI::rword)xorObj.getCode().size());
+
+  for (QBDI::Options opt :
+       {QBDI::Options::NO_OPT, QBDI::Options::OPT_ENABLE_XSAVE,
+        QBDI::Options::OPT_ENABLE_XSAVE |
+            QBDI::Options::OPT_DISABLE_OPTIONAL_FPR}) {
+    vm.setOptions(opt);
+
+    QBDI::FPRState *fstate = vm.getFPRState();
+    memset(fstate->xmm0, 0x11, sizeof(fstate->xmm0));
+    memset(fstate->ymm0, 0x0F, sizeof(fstate->ymm0));
+    memset(fstate->xmm1, 0x22, sizeof(fstate->xmm1));
+    memset(fstate->ymm1, 0, sizeof(fstate->ymm1));
+
+    // The callback changes the upper half of YMM1 before the instruction
+    uint32_t id = vm.addCodeAddrCB(addr, QBDI::PREINST, setYmm1, nullptr);
+    REQUIRE(id != QBDI::INVALID_EVENTID);
+
+    QBDI::rword retval;
+    REQUIRE(vm.call(&retval, addr, {}));
+    vm.deleteInstrumentation(id);
+
+    fstate = vm.getFPRState();
+    for (size_t i = 0; i < sizeof(fstate->xmm0); i++) {
+      CHECK(static_cast<uint8_t>(fstate->xmm0[i]) == 0x33);
+      CHECK(static_cast<uint8_t>(fstate->ymm0[i]) == 0xFF);
+    }
+  }
+
+  QBDI::alignedFree(fakestack);
+}
+
+TEST_CASE_METHOD(OptionsTest, "OptionsTest_X86_64-XSAVE-AVX512") {
+  if (not QBDI::isHostCPUFeaturePresent("avx512f") or
+      not QBDI::isHostCPUFeaturePresent("xsave")) {
+    return;
+  }
+
+  InMemoryObject xorObj("vpxorq %zmm1, %zmm0, %zmm0\n"
+                        "vpxorq %zmm17, %zmm16, %zmm16\n"
+                        "ret\n");
+  QBDI::rword addr = (QBDI::rword)xorObj.getCode().data();
+
+  uint8_t *fakestack;
+  QBDI::GPRState *state = vm.getGPRState();
+  bool ret = QBDI::allocateVirtualStack(state, 4096, &fakestack);
+  REQUIRE(ret == true);
+  vm.addInstrumentedRange(addr, addr + (QBDI::rword)xorObj.getCode().size());
+  vm.setOptions(QBDI::Options::OPT_ENABLE_XSAVE);
+
+  QBDI::FPRState *fstate = vm.getFPRState();
+  memset(fstate->zmm0, 0x0F, sizeof(fstate->zmm0));
+  memset(fstate->zmm1, 0xF0, sizeof(fstate->zmm1));
+  memset(fstate->zmm16, 0x55, sizeof(fstate->zmm16));
+  memset(fstate->zmm17, 0xAA, sizeof(fstate->zmm17));
+
+  QBDI::rword retval;
+  REQUIRE(vm.call(&retval, addr, {}));
+
+  fstate = vm.getFPRState();
+  for (size_t i = 0; i < sizeof(fstate->zmm0); i++) {
+    CHECK(static_cast<uint8_t>(fstate->zmm0[i]) == 0xFF);
+  }
+  for (size_t i = 0; i < sizeof(fstate->zmm16); i++) {
+    CHECK(static_cast<uint8_t>(fstate->zmm16[i]) == 0xFF);
+  }
+
+  QBDI::alignedFree(fakestack);
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <map>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#include "ExecBlock/ExecBlockManager.h"
+#include "Utility/AddressMap.h"
+
+// Addresses of consecutive instructions of 1 to 15 bytes
+static std::vector<QBDI::rword> instAddresses(size_t n) {
+  std::vector<QBDI::rword> addresses;
+  QBDI::rword address = 0x400000;
+  addresses.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    address += (rand() % 15) + 1;
+    addresses.push_back(address);
+  }
+  return addresses;
+}
+
+template <typename Cache>
+static void benchCache(const std::string &name, size_t n) {
+  const std::vector<QBDI::rword> addresses = instAddresses(n);
+
+  BENCHMARK_ADVANCED(name + " insert " + std::to_string(n))
+  (Catch::Benchmark::Chronometer meter) {
+    std::vector<Cache> caches(meter.runs());
+    meter.measure([&](int i) {
+      uint16_t id = 0;
+      for (QBDI::rword address : addresses) {
+        caches[i][address] = QBDI::InstLoc{0, id++};
+      }
+      return caches[i].size();
+    });
+  };
+
+  Cache cache;
+  uint16_t id = 0;
+  for (QBDI::rword address : addresses) {
+    cache[address] = QBDI::InstLoc{0, id++};
+  }
+
+  BENCHMARK(name + " lookup " + std::to_string(n)) {
+    size_t found = 0;
+    for (QBDI::rword address : addresses) {
+      // half of the lookups miss
+      found += cache.count(address);
+      found += cache.count(address + 0x10000000);
+    }
+    return found;
+  };
+}
+
+TEST_CASE("Benchmark_AddressMap") {
+  for (size_t n : {10000, 100000, 1000000}) {
+    benchCache<std::map<QBDI::rword, QBDI::InstLoc>>("std::map", n);
+    benchCache<QBDI::AddressMap<QBDI::InstLoc>>("AddressMap", n);
+  }
+}
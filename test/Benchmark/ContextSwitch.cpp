@@ -0,0 +1,129 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "QBDI.h"
+#include "Utility/System.h"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#if defined(QBDI_ARCH_X86_64) || defined(QBDI_ARCH_X86)
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define QBDI_TARGET_AVX
+#else
+#define QBDI_TARGET_AVX __attribute__((target("avx")))
+#endif
+
+// Each instruction of the targets is followed by a context switch to the
+// callback, the targets differ by the FPU state they need.
+QBDI_NOINLINE QBDI::rword contextSwitchGPR(QBDI::rword n) {
+  QBDI::rword v = 1;
+  for (QBDI::rword i = 0; i < n; i++) {
+    v = v * 5 + i;
+  }
+  return v;
+}
+
+QBDI_NOINLINE QBDI::rword contextSwitchSSE(QBDI::rword n) {
+  __m128d v = _mm_set1_pd(1.0);
+  const __m128d step = _mm_set1_pd(0.5);
+  for (QBDI::rword i = 0; i < n; i++) {
+    v = _mm_add_pd(_mm_mul_pd(v, step), step);
+  }
+  return static_cast<QBDI::rword>(_mm_cvtsd_f64(v) * 1000);
+}
+
+QBDI_TARGET_AVX QBDI_NOINLINE QBDI::rword contextSwitchAVX(QBDI::rword n) {
+  __m256d v = _mm256_set1_pd(1.0);
+  const __m256d step = _mm256_set1_pd(0.5);
+  for (QBDI::rword i = 0; i < n; i++) {
+    v = _mm256_add_pd(_mm256_mul_pd(v, step), step);
+  }
+  return static_cast<QBDI::rword>(
+      _mm_cvtsd_f64(_mm256_extractf128_pd(v, 1)) * 1000);
+}
+
+static QBDI::VMAction contextSwitchCB(QBDI::VMInstanceRef vm,
+                                      QBDI::GPRState *gprState,
+                                      QBDI::FPRState *fprState, void *data) {
+  return QBDI::VMAction::CONTINUE;
+}
+
+static void benchContextSwitch(const char *name,
+                               QBDI::rword (*target)(QBDI::rword),
+                               const char *optName, QBDI::Options opts) {
+  std::string benchName =
+      std::string("Context switch ") + name + " with " + optName;
+
+  BENCHMARK_ADVANCED(benchName.c_str())
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, opts};
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(target));
+    vm.addCodeCB(QBDI::PREINST, contextSwitchCB, nullptr);
+
+    // fill the cache
+    QBDI::rword warmup = 0;
+    vm.call(&warmup, reinterpret_cast<QBDI::rword>(target),
+            {static_cast<QBDI::rword>(100)});
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(target),
+              {static_cast<QBDI::rword>(100)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+}
+
+TEST_CASE("Benchmark_ContextSwitch") {
+  std::vector<std::pair<const char *, QBDI::rword (*)(QBDI::rword)>> targets =
+      {{"GPR", contextSwitchGPR}, {"SSE", contextSwitchSSE}};
+  if (QBDI::isHostCPUFeaturePresent("avx")) {
+    targets.emplace_back("AVX", contextSwitchAVX);
+  }
+
+  const std::pair<const char *, QBDI::Options> options[] = {
+      {"FXSAVE", QBDI::Options::NO_OPT},
+      {"FXSAVE (all FPR)", QBDI::Options::OPT_DISABLE_OPTIONAL_FPR},
+      {"XSAVE", QBDI::Options::OPT_ENABLE_XSAVE},
+      {"XSAVE (all FPR)", QBDI::Options::OPT_ENABLE_XSAVE |
+                              QBDI::Options::OPT_DISABLE_OPTIONAL_FPR},
+  };
+
+  for (const auto &target : targets) {
+    for (const auto &opt : options) {
+      benchContextSwitch(target.first, target.second, opt.first, opt.second);
+    }
+  }
+}
+
+#endif // QBDI_ARCH_X86_64 || QBDI_ARCH_X86
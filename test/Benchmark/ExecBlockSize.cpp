@@ -0,0 +1,130 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stddef.h>
+#include <string>
+
+#include "QBDI.h"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+// Many basic blocks calling each other, to spread the code over several
+// ExecBlocks with the default size
+#define STEP(N, OP)                                                            \
+  QBDI_NOINLINE static QBDI::rword step##N(QBDI::rword v, QBDI::rword i) {     \
+    if ((v ^ i) & 1) {                                                         \
+      return OP;                                                               \
+    }                                                                          \
+    return v + N;                                                              \
+  }
+
+STEP(0, v * 3 + 1)
+STEP(1, (v >> 1) ^ i)
+STEP(2, v + (i << 2))
+STEP(3, v - (v >> 3))
+STEP(4, (v | i) * 5)
+STEP(5, (v & 0xffff) + i)
+STEP(6, v ^ (v << 7))
+STEP(7, v + 7)
+
+#undef STEP
+
+QBDI_NOINLINE QBDI::rword execBlockSizeTarget(QBDI::rword n) {
+  QBDI::rword v = n;
+  for (QBDI::rword i = 0; i < n; i++) {
+    switch ((v + i) % 8) {
+      case 0:
+        v = step0(v, i);
+        break;
+      case 1:
+        v = step1(v, i);
+        break;
+      case 2:
+        v = step2(v, i);
+        break;
+      case 3:
+        v = step3(v, i);
+        break;
+      case 4:
+        v = step4(v, i);
+        break;
+      case 5:
+        v = step5(v, i);
+        break;
+      case 6:
+        v = step6(v, i);
+        break;
+      default:
+        v = step7(v, i) ^ step0(v, i);
+        break;
+    }
+  }
+  return v;
+}
+
+static std::string sizeName(size_t size) {
+  // 0 is the default size of one page
+  return (size == 0) ? "1 page" : std::to_string(size / 1024) + "KB";
+}
+
+static void benchExecBlockSize(size_t codeSize, size_t dataSize,
+                               bool uncached) {
+  std::string name = "ExecBlock code " + sizeName(codeSize) + " data " +
+                     sizeName(dataSize) + " " +
+                     (uncached ? "translation" : "execution");
+
+  BENCHMARK_ADVANCED(name.c_str())
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, QBDI::Options::OPT_ENABLE_BLOCK_CHAINING};
+    uint8_t *fakestack = nullptr;
+
+    REQUIRE(vm.setExecBlockSize(codeSize, dataSize));
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(execBlockSizeTarget));
+
+    // fill the cache
+    QBDI::rword warmup = 0;
+    vm.call(&warmup, reinterpret_cast<QBDI::rword>(execBlockSizeTarget),
+            {static_cast<QBDI::rword>(256)});
+
+    meter.measure([&] {
+      if (uncached) {
+        vm.clearAllCache();
+      }
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(execBlockSizeTarget),
+              {static_cast<QBDI::rword>(256)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+}
+
+TEST_CASE("Benchmark_ExecBlockSize") {
+  for (size_t codeSize : {0, 16 * 1024, 64 * 1024, 256 * 1024, 2048 * 1024}) {
+    size_t dataSize = codeSize / 4;
+    benchExecBlockSize(codeSize, dataSize, true);
+    benchExecBlockSize(codeSize, dataSize, false);
+  }
+}
@@ -0,0 +1,91 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+
+#include <QBDI.h>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+// The function pointer prevents the compiler from inlining strlen: each
+// iteration calls the libc, which is executed through the ExecBroker.
+static size_t (*volatile externalStrlen)(const char *) = strlen;
+
+QBDI_NOINLINE QBDI::rword execBrokerLoop(QBDI::rword n) {
+  static const char str[] = "QBDI ExecBroker benchmark";
+  QBDI::rword v = 0;
+  for (QBDI::rword i = 0; i < n; i++) {
+    v += externalStrlen(str + (i % 8));
+  }
+  return v;
+}
+
+static QBDI::VMAction transferCB(QBDI::VMInstanceRef vm,
+                                 const QBDI::VMState *vmState,
+                                 QBDI::GPRState *gprState,
+                                 QBDI::FPRState *fprState, void *data) {
+  (*static_cast<uint64_t *>(data))++;
+  return QBDI::VMAction::CONTINUE;
+}
+
+static void benchExecBroker(const char *name, QBDI::Options opts,
+                            bool transferCallback) {
+  BENCHMARK_ADVANCED(name)
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, opts};
+    uint8_t *fakestack = nullptr;
+    uint64_t transfers = 0;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(execBrokerLoop));
+    if (transferCallback) {
+      vm.addVMEventCB(QBDI::EXEC_TRANSFER_CALL | QBDI::EXEC_TRANSFER_RETURN,
+                      transferCB, &transfers);
+    }
+
+    // fill the cache
+    QBDI::rword warmup = 0;
+    vm.call(&warmup, reinterpret_cast<QBDI::rword>(execBrokerLoop),
+            {static_cast<QBDI::rword>(100)});
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(execBrokerLoop),
+              {static_cast<QBDI::rword>(1000)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+}
+
+TEST_CASE("Benchmark_ExecBroker") {
+
+  BENCHMARK("Loop calling strlen") { return execBrokerLoop(1000); };
+
+  benchExecBroker("Loop calling strlen with QBDI", QBDI::Options::NO_OPT,
+                  false);
+  benchExecBroker("Loop calling strlen with QBDI and block chaining",
+                  QBDI::Options::OPT_ENABLE_BLOCK_CHAINING, false);
+  benchExecBroker("Loop calling strlen with QBDI and EXEC_TRANSFER events",
+                  QBDI::Options::NO_OPT, true);
+}
@@ -16,6 +16,8 @@
  * limitations under the License.
  */
 
+#include <vector>
+
 #include <QBDI.h>
 
 #define CATCH_CONFIG_ENABLE_BENCHMARKING
@@ -49,6 +51,30 @@ static QBDI::VMAction instEmptyCB(QBDI::VMInstanceRef vm,
   return QBDI::VMAction::CONTINUE;
 }
 
+static QBDI::VMAction instCountCB(QBDI::VMInstanceRef vm,
+                                  QBDI::GPRState *gprState,
+                                  QBDI::FPRState *fprState, void *data) {
+  (*static_cast<uint64_t *>(data))++;
+  return QBDI::VMAction::CONTINUE;
+}
+
+static QBDI::VMAction eventCountCB(QBDI::VMInstanceRef vm,
+                                   const QBDI::VMState *vmState,
+                                   QBDI::GPRState *gprState,
+                                   QBDI::FPRState *fprState, void *data) {
+  (*static_cast<uint64_t *>(data))++;
+  return QBDI::VMAction::CONTINUE;
+}
+
+static QBDI::Range<QBDI::rword> getMapRange(QBDI::rword address) {
+  for (const QBDI::MemoryMap &m : QBDI::getCurrentProcessMaps()) {
+    if (m.range.contains(address)) {
+      return m.range;
+    }
+  }
+  return {0, 0};
+}
+
 static QBDI::VMAction instCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
                              QBDI::FPRState *fprState, void *data) {
   unsigned *v = static_cast<unsigned *>(data);
@@ -118,6 +144,184 @@ TEST_CASE("Benchmark_Fibonacci") {
     QBDI::alignedFree(fakestack);
   };
 
+  BENCHMARK_ADVANCED("Fibonacci(20) with QBDI and block chaining")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, QBDI::Options::OPT_ENABLE_BLOCK_CHAINING};
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(Fibonacci));
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(Fibonacci),
+              {static_cast<QBDI::rword>(20)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED("Fibonacci(20) with QBDI with InstCallback")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(Fibonacci));
+
+    // add callback
+    uint64_t count = 0;
+    vm.addCodeCB(QBDI::PREINST, instCountCB, &count);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(Fibonacci),
+              {static_cast<QBDI::rword>(20)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED("Fibonacci(20) with QBDI with inline InstCallback")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(Fibonacci));
+
+    // add callback
+    uint64_t count = 0;
+    vm.addCodeCB(QBDI::PREINST, instCountCB, &count, QBDI::PRIORITY_DEFAULT,
+                 QBDI::CALLBACK_INLINE);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(Fibonacci),
+              {static_cast<QBDI::rword>(20)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED(
+      "Fibonacci(20) with QBDI and block chaining with inline InstCallback")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, QBDI::Options::OPT_ENABLE_BLOCK_CHAINING};
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(Fibonacci));
+
+    // add callback
+    uint64_t count = 0;
+    vm.addCodeCB(QBDI::PREINST, instCountCB, &count, QBDI::PRIORITY_DEFAULT,
+                 QBDI::CALLBACK_INLINE);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(Fibonacci),
+              {static_cast<QBDI::rword>(20)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED("Fibonacci(20) with QBDI with BASIC_BLOCK_ENTRY")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(Fibonacci));
+
+    // add vm event
+    uint64_t count = 0;
+    vm.addVMEventCB(QBDI::BASIC_BLOCK_ENTRY, eventCountCB, &count);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(Fibonacci),
+              {static_cast<QBDI::rword>(20)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED("Fibonacci(20) with QBDI with BB counters")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(Fibonacci));
+
+    // add counters
+    QBDI::Range<QBDI::rword> range =
+        getMapRange(reinterpret_cast<QBDI::rword>(Fibonacci));
+    vm.addBBCounterRange(range.start(), range.end());
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(Fibonacci),
+              {static_cast<QBDI::rword>(20)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED(
+      "Fibonacci(20) with QBDI and block chaining with coverage map")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, QBDI::Options::OPT_ENABLE_BLOCK_CHAINING};
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(Fibonacci));
+
+    // add coverage map
+    QBDI::Range<QBDI::rword> range =
+        getMapRange(reinterpret_cast<QBDI::rword>(Fibonacci));
+    std::vector<uint8_t> map(range.size(), 0);
+    vm.addCoverageMapRange(range.start(), range.end(), map.data());
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(Fibonacci),
+              {static_cast<QBDI::rword>(20)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
   BENCHMARK_ADVANCED("Fibonacci(20) with QBDI uncached")
   (Catch::Benchmark::Chronometer meter) {
     // init QBDI
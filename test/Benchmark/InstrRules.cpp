@@ -0,0 +1,153 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "QBDI.h"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+// Many small basic blocks, to measure the translation rather than the execution
+QBDI_NOINLINE QBDI::rword translateTarget(QBDI::rword n) {
+  QBDI::rword v = n;
+  for (QBDI::rword i = 0; i < n; i++) {
+    switch ((v ^ i) % 8) {
+      case 0:
+        v = v * 3 + 1;
+        break;
+      case 1:
+        v = (v >> 1) ^ i;
+        break;
+      case 2:
+        v = v + (i << 2);
+        break;
+      case 3:
+        v = v - (v >> 3);
+        break;
+      case 4:
+        v = (v | i) * 5;
+        break;
+      case 5:
+        v = (v & 0xffff) + i;
+        break;
+      case 6:
+        v = v ^ (v << 7);
+        break;
+      default:
+        v = v + 7;
+        break;
+    }
+  }
+  return v;
+}
+
+// Never executed, the rules on these addresses never apply
+static uint8_t unusedCode[0x10000];
+
+// Mnemonics not used by translateTarget
+static const char *unusedMnemonics[] = {"CPUID", "RDTSC", "XGETBV", "PAUSE",
+                                        "UD2", "HLT", "INT3", "SYSCALL"};
+
+static QBDI::VMAction emptyCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
+                              QBDI::FPRState *fprState, void *data) {
+  return QBDI::VMAction::CONTINUE;
+}
+
+static void benchRules(size_t nbRules) {
+  BENCHMARK_ADVANCED("translate with " + std::to_string(nbRules) +
+                     " InstrRules")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(translateTarget));
+
+    // the same number of address, range and mnemonic rules
+    QBDI::rword base = reinterpret_cast<QBDI::rword>(unusedCode);
+    for (size_t i = 0; i < nbRules; i++) {
+      QBDI::rword addr = base + (i * 16) % sizeof(unusedCode);
+      switch (i % 3) {
+        case 0:
+          vm.addCodeAddrCB(addr, QBDI::PREINST, emptyCB, nullptr);
+          break;
+        case 1:
+          vm.addCodeRangeCB(addr, addr + 8, QBDI::POSTINST, emptyCB, nullptr);
+          break;
+        default:
+          vm.addMnemonicCB(unusedMnemonics[(i / 3) % 8], QBDI::PREINST,
+                           emptyCB, nullptr);
+          break;
+      }
+    }
+
+    meter.measure([&] {
+      vm.clearAllCache();
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(translateTarget),
+              {static_cast<QBDI::rword>(64)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+}
+
+TEST_CASE("Benchmark_InstrRules") {
+  for (size_t n : {1, 10, 100, 1000}) {
+    benchRules(n);
+  }
+}
+
+TEST_CASE("Benchmark_InstrRules_Toggle") {
+  BENCHMARK_ADVANCED("toggle a code callback 1000 times")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(translateTarget));
+
+    // warm the cache
+    QBDI::rword ret_value = 0;
+    vm.call(&ret_value, reinterpret_cast<QBDI::rword>(translateTarget),
+            {static_cast<QBDI::rword>(64)});
+
+    meter.measure([&] {
+      for (int i = 0; i < 1000; i++) {
+        uint32_t id = vm.addCodeCB(QBDI::PREINST, emptyCB, nullptr);
+        vm.call(&ret_value, reinterpret_cast<QBDI::rword>(translateTarget),
+                {static_cast<QBDI::rword>(64)});
+        vm.deleteInstrumentation(id);
+      }
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string>
+#include <utility>
+
+#include "QBDI.h"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+// A loop of several basic blocks, with a branch taken one time out of four
+QBDI_NOINLINE QBDI::rword loopTarget(QBDI::rword n) {
+  QBDI::rword acc = 1;
+  for (QBDI::rword i = 0; i < n; i++) {
+    if ((i & 3) == 0) {
+      acc = acc * 31 + i;
+    } else {
+      acc ^= (acc >> 7) + i;
+    }
+  }
+  return acc;
+}
+
+static void benchLoops(const char *optName, QBDI::Options opts) {
+  std::string benchName = std::string("100000 iterations with ") + optName;
+
+  BENCHMARK_ADVANCED(benchName.c_str())
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, opts};
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(reinterpret_cast<QBDI::rword>(loopTarget));
+
+    // fill the cache and write the traces
+    QBDI::rword ret_value = 0;
+    vm.call(&ret_value, reinterpret_cast<QBDI::rword>(loopTarget), {1000});
+
+    meter.measure([&] {
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(loopTarget), {100000});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+}
+
+TEST_CASE("Benchmark_Loops") {
+  const std::pair<const char *, QBDI::Options> options[] = {
+      {"default options", QBDI::Options::NO_OPT},
+      {"hot traces", QBDI::Options::OPT_ENABLE_HOT_TRACES},
+      {"block chaining", QBDI::Options::OPT_ENABLE_BLOCK_CHAINING},
+      {"block chaining and hot traces",
+       QBDI::Options::OPT_ENABLE_BLOCK_CHAINING |
+           QBDI::Options::OPT_ENABLE_HOT_TRACES},
+  };
+
+  for (const auto &opt : options) {
+    benchLoops(opt.first, opt.second);
+  }
+}
@@ -0,0 +1,107 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "QBDI.h"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+// One small object per registered range, as a heap tracer would do
+struct Object {
+  uint64_t value[4];
+};
+
+QBDI_NOINLINE uint64_t touchObjects(Object *objects, size_t n) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    sum += objects[i].value[0];
+    objects[i].value[1] = sum;
+  }
+  return sum;
+}
+
+static QBDI::VMAction countCB(QBDI::VMInstanceRef vm, QBDI::GPRState *gprState,
+                              QBDI::FPRState *fprState, void *data) {
+  (*static_cast<size_t *>(data))++;
+  return QBDI::VMAction::CONTINUE;
+}
+
+static void benchRanges(size_t nbRanges) {
+  // touch 1000 objects, whatever the number of registered ranges
+  const size_t nbTouched = 1000;
+
+  BENCHMARK_ADVANCED("touch 1000 objects with " + std::to_string(nbRanges) +
+                     " MemRangeCB")
+  (Catch::Benchmark::Chronometer meter) {
+    std::vector<Object> objects(nbRanges);
+    size_t counter = 0;
+
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(touchObjects));
+    for (Object &o : objects) {
+      vm.addMemRangeCB(reinterpret_cast<QBDI::rword>(&o),
+                       reinterpret_cast<QBDI::rword>(&o + 1),
+                       QBDI::MEMORY_READ_WRITE, countCB, &counter);
+    }
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(touchObjects),
+              {reinterpret_cast<QBDI::rword>(objects.data()), nbTouched});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+}
+
+TEST_CASE("Benchmark_MemRangeCB") {
+  for (size_t n : {1000, 10000, 100000}) {
+    benchRanges(n);
+  }
+
+  BENCHMARK_ADVANCED("add and delete 100000 MemRangeCB")
+  (Catch::Benchmark::Chronometer meter) {
+    std::vector<Object> objects(100000);
+    QBDI::VM vm;
+    std::vector<uint32_t> ids;
+    ids.reserve(objects.size());
+
+    meter.measure([&] {
+      for (Object &o : objects) {
+        ids.push_back(vm.addMemRangeCB(reinterpret_cast<QBDI::rword>(&o),
+                                       reinterpret_cast<QBDI::rword>(&o + 1),
+                                       QBDI::MEMORY_WRITE, countCB, nullptr));
+      }
+      for (uint32_t id : ids) {
+        vm.deleteInstrumentation(id);
+      }
+      ids.clear();
+    });
+  };
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include <QBDI.h>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+#if defined(QBDI_PLATFORM_LINUX) || defined(QBDI_PLATFORM_ANDROID)
+
+#include <dirent.h>
+#include <unistd.h>
+
+// Run some code of the standard library to translate many basic blocks
+QBDI_NOINLINE QBDI::rword startupWorkload(QBDI::rword n) {
+  std::vector<uint32_t> values;
+  std::map<uint32_t, uint32_t> counts;
+  uint32_t v = 1;
+  for (QBDI::rword i = 0; i < n; i++) {
+    v = v * 1103515245 + 12345;
+    values.push_back(v >> 16);
+    counts[(v >> 16) & 0xff]++;
+  }
+  std::sort(values.begin(), values.end());
+  return values[n / 2] + counts.size();
+}
+
+static QBDI::rword runStartup(const std::string &directory) {
+  // init QBDI
+  QBDI::VM vm;
+  uint8_t *fakestack = nullptr;
+  if (not directory.empty()) {
+    vm.setPersistentCache(directory);
+  }
+
+  // alloc stack
+  QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+  // instrument QBDI
+  vm.addInstrumentedModuleFromAddr(
+      reinterpret_cast<QBDI::rword>(startupWorkload));
+
+  QBDI::rword ret_value = 0;
+  vm.call(&ret_value, reinterpret_cast<QBDI::rword>(startupWorkload),
+          {static_cast<QBDI::rword>(1000)});
+  QBDI::alignedFree(fakestack);
+  return ret_value;
+}
+
+TEST_CASE("Benchmark_PersistentCache") {
+  char directory[] = "/tmp/qbdi-bench-cache-XXXXXX";
+  REQUIRE(mkdtemp(directory) != nullptr);
+
+  // fill the persistent cache
+  runStartup(directory);
+
+  BENCHMARK("Startup with a cold cache") { return runStartup(""); };
+
+  BENCHMARK("Startup with a warm persistent cache") {
+    return runStartup(directory);
+  };
+
+  // remove the cache files
+  DIR *dir = opendir(directory);
+  if (dir != nullptr) {
+    while (struct dirent *entry = readdir(dir)) {
+      if (entry->d_name[0] != '.') {
+        unlink((std::string(directory) + "/" + entry->d_name).c_str());
+      }
+    }
+    closedir(dir);
+  }
+  rmdir(directory);
+}
+
+#endif // QBDI_PLATFORM_LINUX || QBDI_PLATFORM_ANDROID
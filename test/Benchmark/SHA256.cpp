@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 #include <stdint.h>
+#include <vector>
 
 #include "sha256.h"
 #include "QBDI.h"
@@ -73,6 +74,34 @@ static QBDI::VMAction instMemoryCB(QBDI::VMInstanceRef vm,
   return QBDI::VMAction::CONTINUE;
 }
 
+static QBDI::VMAction eventMemoryCopyCB(QBDI::VMInstanceRef vm,
+                                        const QBDI::VMState *vmState,
+                                        QBDI::GPRState *gprState,
+                                        QBDI::FPRState *fprState, void *data) {
+  QBDI::MemoryAccess accesses[64];
+  unsigned *v = static_cast<unsigned *>(data);
+  *v += vm->copyBBMemoryAccess(accesses, 64);
+  return QBDI::VMAction::CONTINUE;
+}
+
+static QBDI::VMAction instMemoryCopyCB(QBDI::VMInstanceRef vm,
+                                       QBDI::GPRState *gprState,
+                                       QBDI::FPRState *fprState, void *data) {
+  QBDI::MemoryAccess accesses[8];
+  unsigned *v = static_cast<unsigned *>(data);
+  *v += vm->copyInstMemoryAccess(accesses, 8);
+
+  return QBDI::VMAction::CONTINUE;
+}
+
+static QBDI::VMAction memTraceCB(QBDI::VMInstanceRef vm,
+                                 const QBDI::MemoryAccess *accesses,
+                                 size_t size, void *data) {
+  unsigned *v = static_cast<unsigned *>(data);
+  *v += size;
+  return QBDI::VMAction::CONTINUE;
+}
+
 TEST_CASE("Benchmark_sha256") {
 
   BENCHMARK("sha256(len: 16 Bytes)") { return compute_sha(16); };
@@ -123,6 +152,28 @@ TEST_CASE("Benchmark_sha256") {
     QBDI::alignedFree(fakestack);
   };
 
+  BENCHMARK_ADVANCED("sha256(len: 4KBytes) with QBDI and block chaining")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, QBDI::Options::OPT_ENABLE_BLOCK_CHAINING};
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(compute_sha));
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(compute_sha),
+              {sizeof(buffer)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
   BENCHMARK_ADVANCED("sha256(len: 4KBytes) with QBDI uncached")
   (Catch::Benchmark::Chronometer meter) {
     // init QBDI
@@ -315,4 +366,153 @@ TEST_CASE("Benchmark_sha256") {
     });
     QBDI::alignedFree(fakestack);
   };
+
+  BENCHMARK_ADVANCED(
+      "sha256(len: 4KBytes) with QBDI with MemoryAccess and "
+      "getBBMemoryAccess")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(compute_sha));
+
+    vm.recordMemoryAccess(QBDI::MEMORY_READ_WRITE);
+
+    // add callback
+    unsigned v = 0;
+    vm.addVMEventCB(QBDI::SEQUENCE_EXIT, eventMemoryCB, &v);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(compute_sha),
+              {sizeof(buffer)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED(
+      "sha256(len: 4KBytes) with QBDI with MemoryAccess and "
+      "copyBBMemoryAccess")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(compute_sha));
+
+    vm.recordMemoryAccess(QBDI::MEMORY_READ_WRITE);
+
+    // add callback
+    unsigned v = 0;
+    vm.addVMEventCB(QBDI::SEQUENCE_EXIT, eventMemoryCopyCB, &v);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(compute_sha),
+              {sizeof(buffer)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED(
+      "sha256(len: 4KBytes) with QBDI with MemoryAccess and "
+      "getInstMemoryAccess")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(compute_sha));
+
+    vm.recordMemoryAccess(QBDI::MEMORY_READ_WRITE);
+
+    // add callback
+    unsigned v = 0;
+    vm.addMemAccessCB(QBDI::MEMORY_READ_WRITE, instMemoryCB, &v);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(compute_sha),
+              {sizeof(buffer)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED(
+      "sha256(len: 4KBytes) with QBDI with MemoryAccess and "
+      "copyInstMemoryAccess")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(compute_sha));
+
+    vm.recordMemoryAccess(QBDI::MEMORY_READ_WRITE);
+
+    // add callback
+    unsigned v = 0;
+    vm.addMemAccessCB(QBDI::MEMORY_READ_WRITE, instMemoryCopyCB, &v);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(compute_sha),
+              {sizeof(buffer)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+
+  BENCHMARK_ADVANCED(
+      "sha256(len: 4KBytes) with QBDI with setMemoryTraceBuffer")
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm;
+    uint8_t *fakestack = nullptr;
+    std::vector<QBDI::MemoryAccess> trace(4096);
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(compute_sha));
+
+    // add trace buffer
+    unsigned v = 0;
+    vm.setMemoryTraceBuffer(QBDI::MEMORY_READ_WRITE, trace.data(), trace.size(),
+                            trace.size() / 2, memTraceCB, &v);
+
+    meter.measure([&] {
+      QBDI::rword ret_value = 0;
+      vm.call(&ret_value, reinterpret_cast<QBDI::rword>(compute_sha),
+              {sizeof(buffer)});
+      return ret_value;
+    });
+    QBDI::alignedFree(fakestack);
+  };
 }
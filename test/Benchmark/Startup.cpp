@@ -0,0 +1,118 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include <QBDI.h>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+// size of the range translated ahead of the first call
+static const QBDI::rword PRECACHE_SIZE = 0x10000;
+
+// Run many small functions to translate many basic blocks at the first call
+QBDI_NOINLINE QBDI::rword precacheWorkload(QBDI::rword n) {
+  std::vector<uint32_t> values;
+  std::map<uint32_t, uint32_t> counts;
+  std::string text;
+  uint32_t v = 7;
+  for (QBDI::rword i = 0; i < n; i++) {
+    v = v * 1103515245 + 12345;
+    values.push_back(v >> 16);
+    counts[(v >> 16) & 0xff]++;
+    text += static_cast<char>('a' + (v >> 16) % 26);
+  }
+  std::sort(values.begin(), values.end());
+  std::reverse(text.begin(), text.end());
+  return values[n / 2] + counts.size() + text.find('q');
+}
+
+struct StartupVM {
+  QBDI::VM vm;
+  uint8_t *fakestack = nullptr;
+
+  StartupVM() {
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(precacheWorkload));
+  }
+
+  ~StartupVM() { QBDI::alignedFree(fakestack); }
+
+  void precache(unsigned threads) {
+    QBDI::rword start = reinterpret_cast<QBDI::rword>(precacheWorkload);
+    QBDI::rword end = start + PRECACHE_SIZE;
+    for (const QBDI::MemoryMap &m : QBDI::getCurrentProcessMaps()) {
+      if (m.range.contains(start)) {
+        end = std::min(end, m.range.end());
+      }
+    }
+    vm.precacheRange(start, end, nullptr, threads);
+  }
+
+  QBDI::rword run() {
+    QBDI::rword ret_value = 0;
+    vm.call(&ret_value, reinterpret_cast<QBDI::rword>(precacheWorkload),
+            {static_cast<QBDI::rword>(1000)});
+    return ret_value;
+  }
+};
+
+TEST_CASE("Benchmark_Startup") {
+  BENCHMARK_ADVANCED("First call without precache")
+  (Catch::Benchmark::Chronometer meter) {
+    std::vector<std::unique_ptr<StartupVM>> vms;
+    for (int i = 0; i < meter.runs(); i++) {
+      vms.push_back(std::make_unique<StartupVM>());
+    }
+    meter.measure([&](int i) { return vms[i]->run(); });
+  };
+
+  BENCHMARK_ADVANCED("First call after precacheRange")
+  (Catch::Benchmark::Chronometer meter) {
+    std::vector<std::unique_ptr<StartupVM>> vms;
+    for (int i = 0; i < meter.runs(); i++) {
+      vms.push_back(std::make_unique<StartupVM>());
+      vms.back()->precache(0);
+    }
+    meter.measure([&](int i) { return vms[i]->run(); });
+  };
+
+  for (unsigned threads : {1u, 0u}) {
+    std::string name = "precacheRange with " +
+                       (threads == 0 ? std::string("all the CPUs")
+                                     : std::to_string(threads) + " thread");
+    BENCHMARK_ADVANCED(name.c_str())
+    (Catch::Benchmark::Chronometer meter) {
+      std::vector<std::unique_ptr<StartupVM>> vms;
+      for (int i = 0; i < meter.runs(); i++) {
+        vms.push_back(std::make_unique<StartupVM>());
+      }
+      meter.measure([&](int i) { vms[i]->precache(threads); });
+    };
+  }
+}
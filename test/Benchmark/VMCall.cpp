@@ -0,0 +1,73 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string>
+#include <utility>
+
+#include "QBDI.h"
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+QBDI_NOINLINE QBDI::rword smallCallTarget(QBDI::rword a, QBDI::rword b) {
+  return (a ^ b) + (a >> 3);
+}
+
+static void benchVMCall(const char *optName, QBDI::Options opts) {
+  std::string benchName = std::string("1000 calls with ") + optName;
+
+  BENCHMARK_ADVANCED(benchName.c_str())
+  (Catch::Benchmark::Chronometer meter) {
+    // init QBDI
+    QBDI::VM vm{"", {}, opts};
+    uint8_t *fakestack = nullptr;
+
+    // alloc stack
+    QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 20, &fakestack);
+
+    // instrument QBDI
+    vm.addInstrumentedModuleFromAddr(
+        reinterpret_cast<QBDI::rword>(smallCallTarget));
+
+    // fill the cache
+    QBDI::rword ret_value = 0;
+    vm.call(&ret_value, reinterpret_cast<QBDI::rword>(smallCallTarget),
+            {1, 2});
+
+    meter.measure([&] {
+      QBDI::rword sum = 0;
+      for (QBDI::rword i = 0; i < 1000; i++) {
+        vm.call(&ret_value, reinterpret_cast<QBDI::rword>(smallCallTarget),
+                {i, sum});
+        sum += ret_value;
+      }
+      return sum;
+    });
+    QBDI::alignedFree(fakestack);
+  };
+}
+
+TEST_CASE("Benchmark_VMCall") {
+  const std::pair<const char *, QBDI::Options> options[] = {
+      {"default options", QBDI::Options::NO_OPT},
+      {"block chaining", QBDI::Options::OPT_ENABLE_BLOCK_CHAINING},
+  };
+
+  for (const auto &opt : options) {
+    benchVMCall(opt.first, opt.second);
+  }
+}
@@ -0,0 +1,121 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <memory>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "QBDI.h"
+
+#if defined(QBDI_PLATFORM_LINUX) || defined(QBDI_PLATFORM_ANDROID)
+#include <unistd.h>
+#endif
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+
+QBDI_NOINLINE QBDI::rword vmCreationTarget(QBDI::rword n) {
+  QBDI::rword v = 1;
+  for (QBDI::rword i = 0; i < n; i++) {
+    v = v * 3 + i;
+  }
+  return v;
+}
+
+// Resident set size of the process in bytes, 0 if unknown
+static size_t getRSS() {
+#if defined(QBDI_PLATFORM_LINUX) || defined(QBDI_PLATFORM_ANDROID)
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == nullptr) {
+    return 0;
+  }
+  unsigned long size = 0, resident = 0;
+  int res = fscanf(f, "%lu %lu", &size, &resident);
+  fclose(f);
+  if (res != 2) {
+    return 0;
+  }
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+static QBDI::rword runVM(QBDI::VM &vm, uint8_t **fakestack) {
+  QBDI::allocateVirtualStack(vm.getGPRState(), 1 << 16, fakestack);
+  vm.addInstrumentedModuleFromAddr(
+      reinterpret_cast<QBDI::rword>(vmCreationTarget));
+
+  QBDI::rword ret_value = 0;
+  vm.call(&ret_value, reinterpret_cast<QBDI::rword>(vmCreationTarget),
+          {static_cast<QBDI::rword>(16)});
+  return ret_value;
+}
+
+TEST_CASE("Benchmark_VMCreation") {
+  // The first VM of the process initializes LLVM
+  { QBDI::VM warmup; }
+
+  BENCHMARK("VM construction") {
+    QBDI::VM vm;
+    return vm.getGPRState();
+  };
+
+  BENCHMARK_ADVANCED("VM construction and first call")
+  (Catch::Benchmark::Chronometer meter) {
+    meter.measure([&] {
+      QBDI::VM vm;
+      uint8_t *fakestack = nullptr;
+      QBDI::rword ret_value = runVM(vm, &fakestack);
+      QBDI::alignedFree(fakestack);
+      return ret_value;
+    });
+  };
+
+  BENCHMARK("VM copy") {
+    QBDI::VM vm;
+    QBDI::VM copy(vm);
+    return copy.getGPRState();
+  };
+}
+
+TEST_CASE("Benchmark_VMCreation-RSS") {
+  const size_t nbVM = 64;
+  std::vector<std::unique_ptr<QBDI::VM>> vms;
+  std::vector<uint8_t *> stacks(nbVM, nullptr);
+
+  { QBDI::VM warmup; }
+  size_t before = getRSS();
+
+  for (size_t i = 0; i < nbVM; i++) {
+    vms.push_back(std::make_unique<QBDI::VM>());
+    runVM(*vms.back(), &stacks[i]);
+  }
+
+  size_t after = getRSS();
+  if (before != 0 and after > before) {
+    WARN("RSS per VM: " + std::to_string((after - before) / nbVM / 1024) +
+         "KB (" + std::to_string(nbVM) + " VMs)");
+  }
+
+  vms.clear();
+  for (uint8_t *stack : stacks) {
+    QBDI::alignedFree(stack);
+  }
+}
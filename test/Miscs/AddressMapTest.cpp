@@ -0,0 +1,103 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <map>
+#include <stdlib.h>
+
+#include <catch2/catch.hpp>
+
+#include "Utility/AddressMap.h"
+
+TEST_CASE("AddressMapTest-Empty") {
+  QBDI::AddressMap<int> map;
+
+  CHECK(map.empty());
+  CHECK(map.size() == 0);
+  CHECK(map.find(0x1000) == nullptr);
+  CHECK(map.count(0) == 0);
+  CHECK(map.begin() == map.end());
+}
+
+TEST_CASE("AddressMapTest-InsertFind") {
+  QBDI::AddressMap<int> map;
+
+  map[0x1000] = 1;
+  map[0x1004] = 2;
+  map[0] = 3;
+
+  CHECK(map.size() == 3);
+  REQUIRE(map.find(0x1000) != nullptr);
+  CHECK(*map.find(0x1000) == 1);
+  REQUIRE(map.find(0x1004) != nullptr);
+  CHECK(*map.find(0x1004) == 2);
+  REQUIRE(map.find(0) != nullptr);
+  CHECK(*map.find(0) == 3);
+  CHECK(map.find(0x1002) == nullptr);
+  CHECK(map.count(0x1004) == 1);
+  CHECK(map.count(0x1008) == 0);
+
+  // overwrite an existing entry
+  map[0x1004] = 4;
+  CHECK(map.size() == 3);
+  CHECK(*map.find(0x1004) == 4);
+
+  // default inserted value
+  CHECK(map[0x2000] == 0);
+  CHECK(map.size() == 4);
+
+  map.clear();
+  CHECK(map.empty());
+  CHECK(map.find(0x1000) == nullptr);
+  map[0x1000] = 5;
+  CHECK(*map.find(0x1000) == 5);
+}
+
+TEST_CASE("AddressMapTest-CompareMap") {
+  QBDI::AddressMap<QBDI::rword> map;
+  std::map<QBDI::rword, QBDI::rword> ref;
+
+  QBDI::rword address = 0x400000;
+  for (int i = 0; i < 50000; i++) {
+    address += (rand() % 15) + 1;
+    QBDI::rword value = rand();
+    map[address] = value;
+    ref[address] = value;
+    // revisit some previous addresses
+    if (i % 7 == 0) {
+      QBDI::rword previous = address - (rand() % 64);
+      map[previous] = i;
+      ref[previous] = i;
+    }
+  }
+  map.reserve(200000);
+
+  REQUIRE(map.size() == ref.size());
+  for (const auto &it : ref) {
+    const QBDI::rword *v = map.find(it.first);
+    REQUIRE(v != nullptr);
+    CHECK(*v == it.second);
+  }
+  size_t iterated = 0;
+  for (const auto &it : map) {
+    REQUIRE(ref.count(it.first) == 1);
+    CHECK(ref[it.first] == it.second);
+    iterated++;
+  }
+  CHECK(iterated == ref.size());
+  CHECK(map.find(0x3FFFFF) == nullptr);
+  CHECK(map.find(address + 1) == nullptr);
+}
@@ -0,0 +1,117 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <map>
+#include <stdlib.h>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "Utility/IntervalIndex.h"
+
+static std::vector<uint32_t>
+overlapping(const QBDI::IntervalIndex<uint32_t> &index, QBDI::rword start,
+            QBDI::rword end) {
+  std::vector<uint32_t> res;
+  index.forEachOverlap({start, end}, [&](uint32_t v) { res.push_back(v); });
+  return res;
+}
+
+TEST_CASE("IntervalIndexTest-Empty") {
+  QBDI::IntervalIndex<uint32_t> index;
+
+  CHECK(index.empty());
+  CHECK(index.size() == 0);
+  CHECK(index.find(0) == nullptr);
+  CHECK_FALSE(index.erase(0));
+  CHECK(overlapping(index, 0, 0x1000).empty());
+}
+
+TEST_CASE("IntervalIndexTest-InsertErase") {
+  QBDI::IntervalIndex<uint32_t> index;
+
+  index.insert(1, {0x1000, 0x2000}, 1);
+  index.insert(2, {0x1800, 0x1900}, 2);
+  index.insert(3, {0x3000, 0x4000}, 3);
+  // same range as 1
+  index.insert(4, {0x1000, 0x2000}, 4);
+
+  CHECK(index.size() == 4);
+  REQUIRE(index.find(2) != nullptr);
+  CHECK(*index.find(2) == 2);
+  CHECK(index.find(5) == nullptr);
+
+  CHECK(overlapping(index, 0x1000, 0x1001) == std::vector<uint32_t>{1, 4});
+  CHECK(overlapping(index, 0x1850, 0x1851) == std::vector<uint32_t>{1, 4, 2});
+  CHECK(overlapping(index, 0x1fff, 0x3001) == std::vector<uint32_t>{1, 4, 3});
+  CHECK(overlapping(index, 0x2000, 0x3000).empty());
+  CHECK(overlapping(index, 0x4000, 0x5000).empty());
+
+  CHECK(index.erase(1));
+  CHECK_FALSE(index.erase(1));
+  CHECK(index.size() == 3);
+  CHECK(overlapping(index, 0x1850, 0x1851) == std::vector<uint32_t>{4, 2});
+
+  // reuse a free node
+  index.insert(5, {0x10, 0x20}, 5);
+  CHECK(overlapping(index, 0, 0x1001) == std::vector<uint32_t>{5, 4});
+
+  index.clear();
+  CHECK(index.empty());
+  CHECK(index.find(2) == nullptr);
+  CHECK(overlapping(index, 0, 0x5000).empty());
+}
+
+TEST_CASE("IntervalIndexTest-CompareBruteForce") {
+  QBDI::IntervalIndex<uint32_t> index;
+  std::map<uint32_t, QBDI::Range<QBDI::rword>> ref;
+
+  for (uint32_t id = 0; id < 5000; id++) {
+    QBDI::rword start = 0x10000 + (rand() % 0x10000);
+    QBDI::rword size =
+        (id % 10 == 0) ? (rand() % 0x1000) + 1 : (rand() % 32) + 1;
+    index.insert(id, {start, start + size}, id);
+    ref.emplace(id, QBDI::Range<QBDI::rword>{start, start + size});
+    // delete some previous ranges
+    if (id % 3 == 0) {
+      uint32_t victim = rand() % (id + 1);
+      CHECK(index.erase(victim) == (ref.erase(victim) == 1));
+    }
+  }
+  REQUIRE(index.size() == ref.size());
+
+  for (int i = 0; i < 2000; i++) {
+    QBDI::rword start = 0xF000 + (rand() % 0x12000);
+    QBDI::rword end = start + (rand() % 64) + 1;
+    QBDI::Range<QBDI::rword> r{start, end};
+
+    std::vector<uint32_t> expected;
+    for (const auto &it : ref) {
+      if (it.second.overlaps(r)) {
+        expected.push_back(it.first);
+      }
+    }
+    std::vector<uint32_t> found = overlapping(index, start, end);
+    // the values are returned by start address
+    for (size_t j = 1; j < found.size(); j++) {
+      CHECK(ref.at(found[j - 1]).start() <= ref.at(found[j]).start());
+    }
+    std::sort(found.begin(), found.end());
+    REQUIRE(found == expected);
+  }
+}
@@ -0,0 +1,173 @@
+/*
+ * This file is part of QBDI.
+ *
+ * Copyright 2017 - 2022 Quarkslab
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "llvm/MC/MCInst.h"
+
+#include "QBDI/Callback.h"
+#include "Patch/InstrRule.h"
+#include "Patch/InstrRuleIndex.h"
+#include "Patch/Patch.h"
+#include "Patch/PatchCondition.h"
+#include "Patch/PatchUtils.h"
+#include "TestSetup/LLVMTestEnv.h"
+
+// The opcodes are only compared by the conditions, the instructions have no
+// operand
+static const unsigned OP_A = 10;
+static const unsigned OP_B = 11;
+static const unsigned OP_C = 12;
+
+static QBDI::VMAction emptyCB(QBDI::VMInstanceRef, QBDI::GPRState *,
+                              QBDI::FPRState *, void *) {
+  return QBDI::VMAction::CONTINUE;
+}
+
+static void addRule(QBDI::InstrRuleIndex::RuleVec &rules, uint32_t id,
+                    QBDI::PatchCondition::UniquePtr &&condition) {
+  rules.emplace_back(id, QBDI::InstrRuleBasicCBK::unique(
+                             std::move(condition), emptyCB, nullptr,
+                             QBDI::PREINST, true));
+}
+
+static QBDI::Patch getPatch(QBDI::rword address, unsigned opcode,
+                            const QBDI::LLVMCPU &llvmcpu) {
+  llvm::MCInst inst;
+  inst.setOpcode(opcode);
+  return QBDI::Patch(inst, address, 4, llvmcpu);
+}
+
+// Positions of the rules that apply to a patch, among the given positions
+static std::vector<uint32_t>
+applied(const QBDI::InstrRuleIndex::RuleVec &rules,
+        const std::vector<uint32_t> &positions, const QBDI::Patch &patch,
+        const QBDI::LLVMCPU &llvmcpu) {
+  std::vector<uint32_t> res;
+  for (uint32_t pos : positions) {
+    // all the rules of the tests are InstrRuleBasicCBK
+    const auto *rule =
+        static_cast<const QBDI::InstrRuleBasicCBK *>(rules[pos].second.get());
+    if (rule->canBeApplied(patch, llvmcpu)) {
+      res.push_back(pos);
+    }
+  }
+  return res;
+}
+
+// Compare the index with a linear scan of all the rules
+static void checkIndex(QBDI::InstrRuleIndex &index,
+                       const QBDI::InstrRuleIndex::RuleVec &rules,
+                       const QBDI::LLVMCPU &llvmcpu) {
+  std::vector<uint32_t> all;
+  for (uint32_t pos = 0; pos < rules.size(); pos++) {
+    all.push_back(pos);
+  }
+  for (QBDI::rword address :
+       {0x0, 0x1000, 0x17fe, 0x1800, 0x1804, 0x1ffe, 0x3000, 0x5000}) {
+    for (unsigned opcode : {OP_A, OP_B, OP_C}) {
+      QBDI::Patch patch = getPatch(address, opcode, llvmcpu);
+      std::vector<uint32_t> candidates = index.getCandidates(patch, llvmcpu);
+      INFO("address 0x" << std::hex << address << " opcode " << std::dec
+                        << opcode);
+
+      // in the order of the rules, without duplicate
+      for (size_t i = 1; i < candidates.size(); i++) {
+        CHECK(candidates[i - 1] < candidates[i]);
+      }
+      CHECK(applied(rules, candidates, patch, llvmcpu) ==
+            applied(rules, all, patch, llvmcpu));
+    }
+  }
+}
+
+TEST_CASE_METHOD(LLVMTestEnv, "InstrRuleIndexTest-LinearScan") {
+  const QBDI::LLVMCPU &llvmcpu = getCPU(QBDI::CPUMode::DEFAULT);
+  QBDI::InstrRuleIndex::RuleVec rules;
+  QBDI::InstrRuleIndex index;
+
+  // global rules
+  addRule(rules, 0, QBDI::True::unique());
+  addRule(rules, 1, QBDI::OpIs::unique(OP_A));
+  // range rules
+  addRule(rules, 2, QBDI::InstructionInRange::unique(0x1000, 0x2000));
+  addRule(rules, 3, QBDI::AddressIs::unique(0x1804));
+  // opcode rule, matching two opcodes
+  addRule(rules, 4,
+          QBDI::Or::unique(QBDI::conv_unique<QBDI::PatchCondition>(
+              QBDI::OpIs::unique(OP_A), QBDI::OpIs::unique(OP_B))));
+  // range rule with two ranges overlapped by the same instruction
+  addRule(rules, 5,
+          QBDI::Or::unique(QBDI::conv_unique<QBDI::PatchCondition>(
+              QBDI::InstructionInRange::unique(0x17fc, 0x1802),
+              QBDI::InstructionInRange::unique(0x1803, 0x1900))));
+  // range and opcode rule
+  addRule(rules, 6,
+          QBDI::And::unique(QBDI::conv_unique<QBDI::PatchCondition>(
+              QBDI::InstructionInRange::unique(0x1000, 0x2000),
+              QBDI::OpIs::unique(OP_C))));
+  addRule(rules, 7, QBDI::OpIs::unique(OP_B));
+
+  CHECK_FALSE(index.isValid());
+  index.build(rules);
+  REQUIRE(index.isValid());
+  checkIndex(index, rules, llvmcpu);
+
+  // only the global rules that may match the opcode
+  CHECK(index.getCandidates(getPatch(0x5000, OP_A, llvmcpu), llvmcpu) ==
+        std::vector<uint32_t>{0, 1, 4});
+  CHECK(index.getCandidates(getPatch(0x5000, OP_C, llvmcpu), llvmcpu) ==
+        std::vector<uint32_t>{0});
+  // the range rules overlapping the instruction, found once
+  CHECK(index.getCandidates(getPatch(0x1800, OP_C, llvmcpu), llvmcpu) ==
+        std::vector<uint32_t>{0, 2, 5, 6});
+  CHECK(index.mayInstrument(0x5000));
+
+  // A rule inserted by priority moves the following rules. The opcode lists
+  // computed before must not be used anymore.
+  index.invalidate();
+  CHECK_FALSE(index.isValid());
+  rules.erase(rules.begin());
+  addRule(rules, 8, QBDI::AddressIs::unique(0x3000));
+  std::rotate(rules.begin(), rules.end() - 1, rules.end());
+  index.build(rules);
+  REQUIRE(index.isValid());
+  checkIndex(index, rules, llvmcpu);
+  CHECK(index.getCandidates(getPatch(0x5000, OP_A, llvmcpu), llvmcpu) ==
+        std::vector<uint32_t>{1, 4});
+
+  // without global rule, only the ranges may be instrumented
+  index.invalidate();
+  rules.erase(
+      std::remove_if(rules.begin(), rules.end(),
+                     [](const auto &r) {
+                       return r.second->affectedRange().contains(
+                           QBDI::Range<QBDI::rword>(0, (QBDI::rword)-1));
+                     }),
+      rules.end());
+  index.build(rules);
+  checkIndex(index, rules, llvmcpu);
+  CHECK(index.mayInstrument(0x1000));
+  CHECK(index.mayInstrument(0x3000));
+  CHECK_FALSE(index.mayInstrument(0x2000));
+  CHECK_FALSE(index.mayInstrument(0x5000));
+}
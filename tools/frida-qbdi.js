@@ -747,6 +747,29 @@ var Options = Object.freeze({
      * execblock doesn't used FPR.
      */
     OPT_DISABLE_OPTIONAL_FPR : 1<<1,
+    /**
+     * Allow the sequences ending with a direct jump to jump to their successor
+     * in the same ExecBlock without going back to the VM. Only effective while
+     * no SEQUENCE or BASIC_BLOCK_ENTRY/EXIT VMEvent callback is registered.
+     */
+    OPT_ENABLE_BLOCK_CHAINING : 1<<2,
+    /**
+     * Map the code of the ExecBlocks twice, RX for the execution and RW for
+     * the JIT, so that the page permissions never change. Only available on
+     * Linux.
+     */
+    OPT_ENABLE_DUAL_MAPPING : 1<<3,
+    /**
+     * Translate the hot loops as traces of basic blocks in one sequence. Only
+     * effective on X86_64 while no SEQUENCE or BASIC_BLOCK_ENTRY/EXIT VMEvent
+     * callback is registered.
+     */
+    OPT_ENABLE_HOT_TRACES : 1<<4,
+    /**
+     * Decode and patch the successors of the new basic blocks on a translator
+     * thread.
+     */
+    OPT_ENABLE_PRETRANSLATION : 1<<5,
     /**
      * Used the AT&T syntax for instruction disassembly (for X86 and X86_64)
      */
@@ -756,7 +779,13 @@ var Options = Object.freeze({
      * This option uses the instructions (RD|WR)(FS|GS)BASE that must be 
      * supported by the operating system.
      */
-    OPT_ENABLE_FS_GS : 1<<25
+    OPT_ENABLE_FS_GS : 1<<25,
+    /**
+     * Use XSAVE and XRSTOR for the FPU context switches, with only the state
+     * components needed by the sequence. Saves and restores the AVX-512
+     * registers when the CPU supports them.
+     */
+    OPT_ENABLE_XSAVE : 1<<26
 });
 
 class InstrRuleDataCBK {
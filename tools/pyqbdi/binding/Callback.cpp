@@ -118,6 +118,60 @@ void init_binding_Callback(py::module_ &m) {
                     "The current sequence end address which can also be the "
                     "execution transfer destination.");
 
+  py::class_<CacheStats>(m, "CacheStats")
+      .def_readonly("memoryUsage", &CacheStats::memoryUsage,
+                    "Memory used by the translated code, its metadata and the "
+                    "decoded basic blocks (in bytes).")
+      .def_readonly("memoryBudget", &CacheStats::memoryBudget,
+                    "Memory budget of the cache (in bytes), 0 if the cache is "
+                    "unbounded.")
+      .def_readonly("regions", &CacheStats::regions,
+                    "Number of regions in the cache.")
+      .def_readonly("execBlocks", &CacheStats::execBlocks,
+                    "Number of ExecBlocks in the cache.")
+      .def_readonly("dualMapped", &CacheStats::dualMapped,
+                    "ExecBlocks of the cache whose code is written through a "
+                    "second mapping.")
+      .def_readonly("hits", &CacheStats::hits, "Sequences found in the cache.")
+      .def_readonly("misses", &CacheStats::misses,
+                    "Sequences missing from the cache.")
+      .def_readonly("evictions", &CacheStats::evictions,
+                    "Number of times the budget was exceeded.")
+      .def_readonly("evictedRegions", &CacheStats::evictedRegions,
+                    "Number of regions evicted.")
+      .def_readonly("evictedExecBlocks", &CacheStats::evictedExecBlocks,
+                    "Number of ExecBlocks evicted.")
+      .def_readonly("evictedBytes", &CacheStats::evictedBytes,
+                    "Memory released by the evictions (in bytes).")
+      .def_readonly("traces", &CacheStats::traces,
+                    "Number of hot traces written.")
+      .def_readonly("pretranslated", &CacheStats::pretranslated,
+                    "Basic blocks decoded ahead by the translator thread and "
+                    "used.")
+      .def_readonly("persistentHits", &CacheStats::persistentHits,
+                    "Instructions read from the files of the persistent "
+                    "cache.");
+
+  py::class_<PrecacheReport>(m, "PrecacheReport")
+      .def_readonly("entryPoints", &PrecacheReport::entryPoints,
+                    "Addresses where the discovery started.")
+      .def_readonly("basicBlocks", &PrecacheReport::basicBlocks,
+                    "Basic blocks found by the discovery.")
+      .def_readonly("newBasicBlocks", &PrecacheReport::newBasicBlocks,
+                    "Basic blocks written in the cache.")
+      .def_readonly("coveredBytes", &PrecacheReport::coveredBytes,
+                    "Bytes of the range in the basic blocks found.")
+      .def_readonly("rangeBytes", &PrecacheReport::rangeBytes,
+                    "Bytes of the instrumented part of the range.")
+      .def_readonly("threads", &PrecacheReport::threads,
+                    "Threads used by the discovery.")
+      .def_readonly("discoveryTime", &PrecacheReport::discoveryTime,
+                    "Time of the discovery, the decoding and the patching (in "
+                    "microseconds).")
+      .def_readonly("writeTime", &PrecacheReport::writeTime,
+                    "Time of the instrumentation and the writing in the cache "
+                    "(in microseconds).");
+
   enum_int_flag_<MemoryAccessFlags>(m, "MemoryAccessFlags",
                                     "Memory access flags", py::arithmetic())
       .value("MEMORY_NO_FLAGS", MemoryAccessFlags::MEMORY_NO_FLAGS,
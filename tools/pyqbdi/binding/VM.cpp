@@ -148,6 +148,9 @@ void init_binding_VM(py::module_ &m) {
            "options"_a = NO_OPT)
       .def_property("options", &VM::getOptions, &VM::setOptions,
                     "Options of the VM")
+      .def("setExecBlockSize", &VM::setExecBlockSize,
+           "Set the size of the code and data blocks of the ExecBlocks.",
+           "codeSize"_a, "dataSize"_a)
       .def("getGPRState", &VM::getGPRState,
            py::return_value_policy::reference_internal,
            "Obtain the current general purpose register state.")
@@ -403,11 +406,36 @@ void init_binding_VM(py::module_ &m) {
            py::return_value_policy::copy)
       .def("precacheBasicBlock", &VM::precacheBasicBlock,
            "Pre-cache a known basic block", "pc"_a)
+      .def(
+          "precacheRange",
+          [](VM &vm, rword start, rword end, unsigned threads) {
+            PrecacheReport report = {};
+            bool ret = vm.precacheRange(start, end, &report, threads);
+            return std::make_tuple(ret, report);
+          },
+          "Pre-cache the basic blocks of a range, found by recursive descent "
+          "from the start of the range and the entry points of its module.",
+          "start"_a, "end"_a, "threads"_a = 0)
+      .def(
+          "precacheModule",
+          [](VM &vm, const std::string &name, unsigned threads) {
+            PrecacheReport report = {};
+            bool ret = vm.precacheModule(name, &report, threads);
+            return std::make_tuple(ret, report);
+          },
+          "Pre-cache the basic blocks of the executable ranges of a module.",
+          "name"_a, "threads"_a = 0)
       .def("clearCache", &VM::clearCache,
            "Clear a specific address range from the translation cache.",
            "start"_a, "end"_a)
       .def("clearAllCache", &VM::clearAllCache,
-           "Clear the entire translation cache.");
+           "Clear the entire translation cache.")
+      .def("setCacheBudget", &VM::setCacheBudget,
+           "Set the memory budget of the translation cache (0 for an "
+           "unbounded cache).",
+           "budget"_a)
+      .def("getCacheStats", &VM::getCacheStats,
+           "Get the statistics of the translation cache.");
 }
 
 } // namespace pyQBDI
@@ -247,6 +247,118 @@ void init_binding_State(py::module_ &m) {
             std::string(v).copy(t.ymm7, sizeof(t.ymm7), 0);
           },
           "YMM7[255:128]")
+      .def_property(
+          "k0",
+          [](const FPRState &t) { return py::bytes(t.k0, sizeof(t.k0)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k0, sizeof(t.k0), 0);
+          },
+          "K0")
+      .def_property(
+          "k1",
+          [](const FPRState &t) { return py::bytes(t.k1, sizeof(t.k1)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k1, sizeof(t.k1), 0);
+          },
+          "K1")
+      .def_property(
+          "k2",
+          [](const FPRState &t) { return py::bytes(t.k2, sizeof(t.k2)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k2, sizeof(t.k2), 0);
+          },
+          "K2")
+      .def_property(
+          "k3",
+          [](const FPRState &t) { return py::bytes(t.k3, sizeof(t.k3)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k3, sizeof(t.k3), 0);
+          },
+          "K3")
+      .def_property(
+          "k4",
+          [](const FPRState &t) { return py::bytes(t.k4, sizeof(t.k4)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k4, sizeof(t.k4), 0);
+          },
+          "K4")
+      .def_property(
+          "k5",
+          [](const FPRState &t) { return py::bytes(t.k5, sizeof(t.k5)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k5, sizeof(t.k5), 0);
+          },
+          "K5")
+      .def_property(
+          "k6",
+          [](const FPRState &t) { return py::bytes(t.k6, sizeof(t.k6)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k6, sizeof(t.k6), 0);
+          },
+          "K6")
+      .def_property(
+          "k7",
+          [](const FPRState &t) { return py::bytes(t.k7, sizeof(t.k7)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k7, sizeof(t.k7), 0);
+          },
+          "K7")
+      .def_property(
+          "zmm0",
+          [](const FPRState &t) { return py::bytes(t.zmm0, sizeof(t.zmm0)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm0, sizeof(t.zmm0), 0);
+          },
+          "ZMM0[511:256]")
+      .def_property(
+          "zmm1",
+          [](const FPRState &t) { return py::bytes(t.zmm1, sizeof(t.zmm1)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm1, sizeof(t.zmm1), 0);
+          },
+          "ZMM1[511:256]")
+      .def_property(
+          "zmm2",
+          [](const FPRState &t) { return py::bytes(t.zmm2, sizeof(t.zmm2)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm2, sizeof(t.zmm2), 0);
+          },
+          "ZMM2[511:256]")
+      .def_property(
+          "zmm3",
+          [](const FPRState &t) { return py::bytes(t.zmm3, sizeof(t.zmm3)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm3, sizeof(t.zmm3), 0);
+          },
+          "ZMM3[511:256]")
+      .def_property(
+          "zmm4",
+          [](const FPRState &t) { return py::bytes(t.zmm4, sizeof(t.zmm4)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm4, sizeof(t.zmm4), 0);
+          },
+          "ZMM4[511:256]")
+      .def_property(
+          "zmm5",
+          [](const FPRState &t) { return py::bytes(t.zmm5, sizeof(t.zmm5)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm5, sizeof(t.zmm5), 0);
+          },
+          "ZMM5[511:256]")
+      .def_property(
+          "zmm6",
+          [](const FPRState &t) { return py::bytes(t.zmm6, sizeof(t.zmm6)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm6, sizeof(t.zmm6), 0);
+          },
+          "ZMM6[511:256]")
+      .def_property(
+          "zmm7",
+          [](const FPRState &t) { return py::bytes(t.zmm7, sizeof(t.zmm7)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm7, sizeof(t.zmm7), 0);
+          },
+          "ZMM7[511:256]")
       .def("__str__", [](const FPRState &obj) {
         std::ostringstream oss;
         oss << std::hex << std::setfill('0')
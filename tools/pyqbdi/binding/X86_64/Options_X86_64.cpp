@@ -32,12 +32,32 @@ void init_binding_Options(py::module_ &m) {
       .value("OPT_DISABLE_OPTIONAL_FPR", Options::OPT_DISABLE_OPTIONAL_FPR,
              "Disable context switch optimisation when the target execblock "
              "doesn't used FPR")
+      .value("OPT_ENABLE_BLOCK_CHAINING", Options::OPT_ENABLE_BLOCK_CHAINING,
+             "Allow the sequences ending with a direct jump to jump to their "
+             "successor in the same ExecBlock without going back to the VM. "
+             "Only effective while no SEQUENCE or BASIC_BLOCK_ENTRY/EXIT "
+             "VMEvent callback is registered")
+      .value("OPT_ENABLE_DUAL_MAPPING", Options::OPT_ENABLE_DUAL_MAPPING,
+             "Map the code of the ExecBlocks twice, RX for the execution and "
+             "RW for the JIT, so that the page permissions never change. Only "
+             "available on Linux")
+      .value("OPT_ENABLE_HOT_TRACES", Options::OPT_ENABLE_HOT_TRACES,
+             "Translate the hot loops as traces of basic blocks in one "
+             "sequence. Only effective on X86_64 while no SEQUENCE or "
+             "BASIC_BLOCK_ENTRY/EXIT VMEvent callback is registered")
+      .value("OPT_ENABLE_PRETRANSLATION", Options::OPT_ENABLE_PRETRANSLATION,
+             "Decode and patch the successors of the new basic blocks ahead "
+             "on a translator thread")
       .value("OPT_ATT_SYNTAX", Options::OPT_ATT_SYNTAX,
              "Used the AT&T syntax for instruction disassembly")
       .value("OPT_ENABLE_FS_GS", Options::OPT_ENABLE_FS_GS,
              "Enable Backup/Restore of FS/GS segment. This option uses the "
              "instructions (RD|WR)(FS|GS)BASE that must be supported by the "
              "operating system.")
+      .value("OPT_ENABLE_XSAVE", Options::OPT_ENABLE_XSAVE,
+             "Use XSAVE and XRSTOR for the FPU context switches, with only "
+             "the state components needed by the sequence. Saves and "
+             "restores the AVX-512 registers when the CPU supports them")
       .export_values()
       .def_invert()
       .def_repr_str();
@@ -359,6 +359,286 @@ void init_binding_State(py::module_ &m) {
             std::string(v).copy(t.ymm15, sizeof(t.ymm15), 0);
           },
           "YMM15[255:128]")
+      .def_property(
+          "k0",
+          [](const FPRState &t) { return py::bytes(t.k0, sizeof(t.k0)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k0, sizeof(t.k0), 0);
+          },
+          "K0")
+      .def_property(
+          "k1",
+          [](const FPRState &t) { return py::bytes(t.k1, sizeof(t.k1)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k1, sizeof(t.k1), 0);
+          },
+          "K1")
+      .def_property(
+          "k2",
+          [](const FPRState &t) { return py::bytes(t.k2, sizeof(t.k2)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k2, sizeof(t.k2), 0);
+          },
+          "K2")
+      .def_property(
+          "k3",
+          [](const FPRState &t) { return py::bytes(t.k3, sizeof(t.k3)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k3, sizeof(t.k3), 0);
+          },
+          "K3")
+      .def_property(
+          "k4",
+          [](const FPRState &t) { return py::bytes(t.k4, sizeof(t.k4)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k4, sizeof(t.k4), 0);
+          },
+          "K4")
+      .def_property(
+          "k5",
+          [](const FPRState &t) { return py::bytes(t.k5, sizeof(t.k5)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k5, sizeof(t.k5), 0);
+          },
+          "K5")
+      .def_property(
+          "k6",
+          [](const FPRState &t) { return py::bytes(t.k6, sizeof(t.k6)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k6, sizeof(t.k6), 0);
+          },
+          "K6")
+      .def_property(
+          "k7",
+          [](const FPRState &t) { return py::bytes(t.k7, sizeof(t.k7)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.k7, sizeof(t.k7), 0);
+          },
+          "K7")
+      .def_property(
+          "zmm0",
+          [](const FPRState &t) { return py::bytes(t.zmm0, sizeof(t.zmm0)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm0, sizeof(t.zmm0), 0);
+          },
+          "ZMM0[511:256]")
+      .def_property(
+          "zmm1",
+          [](const FPRState &t) { return py::bytes(t.zmm1, sizeof(t.zmm1)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm1, sizeof(t.zmm1), 0);
+          },
+          "ZMM1[511:256]")
+      .def_property(
+          "zmm2",
+          [](const FPRState &t) { return py::bytes(t.zmm2, sizeof(t.zmm2)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm2, sizeof(t.zmm2), 0);
+          },
+          "ZMM2[511:256]")
+      .def_property(
+          "zmm3",
+          [](const FPRState &t) { return py::bytes(t.zmm3, sizeof(t.zmm3)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm3, sizeof(t.zmm3), 0);
+          },
+          "ZMM3[511:256]")
+      .def_property(
+          "zmm4",
+          [](const FPRState &t) { return py::bytes(t.zmm4, sizeof(t.zmm4)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm4, sizeof(t.zmm4), 0);
+          },
+          "ZMM4[511:256]")
+      .def_property(
+          "zmm5",
+          [](const FPRState &t) { return py::bytes(t.zmm5, sizeof(t.zmm5)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm5, sizeof(t.zmm5), 0);
+          },
+          "ZMM5[511:256]")
+      .def_property(
+          "zmm6",
+          [](const FPRState &t) { return py::bytes(t.zmm6, sizeof(t.zmm6)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm6, sizeof(t.zmm6), 0);
+          },
+          "ZMM6[511:256]")
+      .def_property(
+          "zmm7",
+          [](const FPRState &t) { return py::bytes(t.zmm7, sizeof(t.zmm7)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm7, sizeof(t.zmm7), 0);
+          },
+          "ZMM7[511:256]")
+      .def_property(
+          "zmm8",
+          [](const FPRState &t) { return py::bytes(t.zmm8, sizeof(t.zmm8)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm8, sizeof(t.zmm8), 0);
+          },
+          "ZMM8[511:256]")
+      .def_property(
+          "zmm9",
+          [](const FPRState &t) { return py::bytes(t.zmm9, sizeof(t.zmm9)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm9, sizeof(t.zmm9), 0);
+          },
+          "ZMM9[511:256]")
+      .def_property(
+          "zmm10",
+          [](const FPRState &t) { return py::bytes(t.zmm10, sizeof(t.zmm10)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm10, sizeof(t.zmm10), 0);
+          },
+          "ZMM10[511:256]")
+      .def_property(
+          "zmm11",
+          [](const FPRState &t) { return py::bytes(t.zmm11, sizeof(t.zmm11)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm11, sizeof(t.zmm11), 0);
+          },
+          "ZMM11[511:256]")
+      .def_property(
+          "zmm12",
+          [](const FPRState &t) { return py::bytes(t.zmm12, sizeof(t.zmm12)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm12, sizeof(t.zmm12), 0);
+          },
+          "ZMM12[511:256]")
+      .def_property(
+          "zmm13",
+          [](const FPRState &t) { return py::bytes(t.zmm13, sizeof(t.zmm13)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm13, sizeof(t.zmm13), 0);
+          },
+          "ZMM13[511:256]")
+      .def_property(
+          "zmm14",
+          [](const FPRState &t) { return py::bytes(t.zmm14, sizeof(t.zmm14)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm14, sizeof(t.zmm14), 0);
+          },
+          "ZMM14[511:256]")
+      .def_property(
+          "zmm15",
+          [](const FPRState &t) { return py::bytes(t.zmm15, sizeof(t.zmm15)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm15, sizeof(t.zmm15), 0);
+          },
+          "ZMM15[511:256]")
+      .def_property(
+          "zmm16",
+          [](const FPRState &t) { return py::bytes(t.zmm16, sizeof(t.zmm16)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm16, sizeof(t.zmm16), 0);
+          },
+          "ZMM16")
+      .def_property(
+          "zmm17",
+          [](const FPRState &t) { return py::bytes(t.zmm17, sizeof(t.zmm17)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm17, sizeof(t.zmm17), 0);
+          },
+          "ZMM17")
+      .def_property(
+          "zmm18",
+          [](const FPRState &t) { return py::bytes(t.zmm18, sizeof(t.zmm18)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm18, sizeof(t.zmm18), 0);
+          },
+          "ZMM18")
+      .def_property(
+          "zmm19",
+          [](const FPRState &t) { return py::bytes(t.zmm19, sizeof(t.zmm19)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm19, sizeof(t.zmm19), 0);
+          },
+          "ZMM19")
+      .def_property(
+          "zmm20",
+          [](const FPRState &t) { return py::bytes(t.zmm20, sizeof(t.zmm20)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm20, sizeof(t.zmm20), 0);
+          },
+          "ZMM20")
+      .def_property(
+          "zmm21",
+          [](const FPRState &t) { return py::bytes(t.zmm21, sizeof(t.zmm21)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm21, sizeof(t.zmm21), 0);
+          },
+          "ZMM21")
+      .def_property(
+          "zmm22",
+          [](const FPRState &t) { return py::bytes(t.zmm22, sizeof(t.zmm22)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm22, sizeof(t.zmm22), 0);
+          },
+          "ZMM22")
+      .def_property(
+          "zmm23",
+          [](const FPRState &t) { return py::bytes(t.zmm23, sizeof(t.zmm23)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm23, sizeof(t.zmm23), 0);
+          },
+          "ZMM23")
+      .def_property(
+          "zmm24",
+          [](const FPRState &t) { return py::bytes(t.zmm24, sizeof(t.zmm24)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm24, sizeof(t.zmm24), 0);
+          },
+          "ZMM24")
+      .def_property(
+          "zmm25",
+          [](const FPRState &t) { return py::bytes(t.zmm25, sizeof(t.zmm25)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm25, sizeof(t.zmm25), 0);
+          },
+          "ZMM25")
+      .def_property(
+          "zmm26",
+          [](const FPRState &t) { return py::bytes(t.zmm26, sizeof(t.zmm26)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm26, sizeof(t.zmm26), 0);
+          },
+          "ZMM26")
+      .def_property(
+          "zmm27",
+          [](const FPRState &t) { return py::bytes(t.zmm27, sizeof(t.zmm27)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm27, sizeof(t.zmm27), 0);
+          },
+          "ZMM27")
+      .def_property(
+          "zmm28",
+          [](const FPRState &t) { return py::bytes(t.zmm28, sizeof(t.zmm28)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm28, sizeof(t.zmm28), 0);
+          },
+          "ZMM28")
+      .def_property(
+          "zmm29",
+          [](const FPRState &t) { return py::bytes(t.zmm29, sizeof(t.zmm29)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm29, sizeof(t.zmm29), 0);
+          },
+          "ZMM29")
+      .def_property(
+          "zmm30",
+          [](const FPRState &t) { return py::bytes(t.zmm30, sizeof(t.zmm30)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm30, sizeof(t.zmm30), 0);
+          },
+          "ZMM30")
+      .def_property(
+          "zmm31",
+          [](const FPRState &t) { return py::bytes(t.zmm31, sizeof(t.zmm31)); },
+          [](FPRState &t, py::bytes v) {
+            std::string(v).copy(t.zmm31, sizeof(t.zmm31), 0);
+          },
+          "ZMM31")
       .def("__str__", [](const FPRState &obj) {
         std::ostringstream oss;
         oss << std::hex << std::setfill('0')